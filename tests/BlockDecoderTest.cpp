@@ -0,0 +1,394 @@
+#include "BlockDecoder.h"
+#include "TestCheck.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace unigles;
+
+// Hand-built blocks of every decodable family come out as the pixels their format
+// specifications give: BC1 in both color modes, with and without its transparent
+// color; BC2 and BC3 alpha over always four color BC1; BC4 and BC5 in both value modes;
+// BC7 with one subset, two subsets and a rotated alpha; ETC1 individual and
+// differential blocks; the ETC2 T, H and planar modes and punch-through alpha; and EAC
+// alpha and eleven bit channels. Whole images clip their edge blocks, and signed or
+// float formats are refused.
+
+// Pixel x, y of a decoded 4x4 block or a decoded image width pixels across.
+static bool PixelIs(const uint8_t* rgba, unsigned width, unsigned x, unsigned y, int r, int g, int b, int a) {
+	const uint8_t* pixel = rgba + (y * width + x) * 4;
+	if (pixel[0] == r && pixel[1] == g && pixel[2] == b && pixel[3] == a) {
+		return true;
+	}
+	std::fprintf(stderr, "  pixel %u,%u is %d %d %d %d, expected %d %d %d %d\n", x, y, pixel[0], pixel[1], pixel[2], pixel[3], r, g, b, a);
+	return false;
+}
+
+static std::vector<uint8_t> Decode(CompressedFormat format, const std::vector<uint8_t>& data, unsigned width = 4, unsigned height = 4) {
+	std::vector<uint8_t> rgba(size_t(width) * height * 4, 0xCD);
+	CHECK(DecodeBlocks(format, data.data(), data.size(), width, height, rgba.data()));
+	return rgba;
+}
+
+// Writes bits from the lowest up, the way BC7 lays out its fields.
+class BitWriter {
+public:
+	BitWriter() : mBlock(16), mPosition(0) {}
+
+	void Write(unsigned value, unsigned count) {
+		for (unsigned i = 0; i < count; i++, mPosition++) {
+			if ((value >> i) & 1) {
+				mBlock[mPosition >> 3] |= uint8_t(1 << (mPosition & 7));
+			}
+		}
+	}
+
+	const std::vector<uint8_t>& GetBlock() const { return mBlock; }
+	unsigned GetPosition() const { return mPosition; }
+
+private:
+	std::vector<uint8_t> mBlock;
+	unsigned mPosition;
+};
+
+// BC4 endpoints with a 3 bit index per pixel in row order.
+static std::vector<uint8_t> Bc4Block(uint8_t first, uint8_t second, const unsigned* indices) {
+	std::vector<uint8_t> block({ first, second, 0, 0, 0, 0, 0, 0 });
+	uint64_t bits = 0;
+	for (unsigned i = 0; i < 16; i++) {
+		bits |= uint64_t(indices[i]) << (3 * i);
+	}
+	for (unsigned i = 0; i < 6; i++) {
+		block[2 + i] = uint8_t(bits >> (8 * i));
+	}
+	return block;
+}
+
+// An EAC block, stored big endian with the pixels in column order.
+static std::vector<uint8_t> EacBlock(unsigned base, unsigned multiplier, unsigned table, const unsigned* indices) {
+	uint64_t bits = uint64_t(base) << 56 | uint64_t(multiplier) << 52 | uint64_t(table) << 48;
+	for (unsigned i = 0; i < 16; i++) {
+		bits |= uint64_t(indices[i]) << (45 - 3 * i);
+	}
+	std::vector<uint8_t> block(8);
+	for (unsigned i = 0; i < 8; i++) {
+		block[i] = uint8_t(bits >> (56 - 8 * i));
+	}
+	return block;
+}
+
+static void TestFormats() {
+	CHECK(FormatFromGl(0x9274) == CompressedFormat::Etc2Rgb && FormatFromGl(0x8E8C) == CompressedFormat::Bc7);
+	CHECK(FormatFromGl(0x1908) == CompressedFormat::Unknown);
+	CHECK(FormatFromVulkan(147) == CompressedFormat::Etc2Rgb && FormatFromVulkan(131) == CompressedFormat::Bc1Rgb);
+	// ETC1 has no Vulkan format of its own.
+	CHECK(FormatFromVulkan(0) == CompressedFormat::Unknown);
+	CHECK(GetFormatInfo(CompressedFormat::Bc7Srgb).srgb && GetFormatInfo(CompressedFormat::Bc7Srgb).blockBytes == 16);
+	CHECK(CompressedImageSize(CompressedFormat::Bc1Rgb, 1, 1) == 8);
+	CHECK(CompressedImageSize(CompressedFormat::Bc7, 5, 9) == 2 * 3 * 16);
+
+	// Signed and float data has no RGBA8 form.
+	std::vector<uint8_t> data(16);
+	std::vector<uint8_t> rgba(64);
+	for (CompressedFormat format : { CompressedFormat::Unknown, CompressedFormat::Bc4Signed, CompressedFormat::Bc5Signed,
+		CompressedFormat::Bc6hUfloat, CompressedFormat::Bc6hSfloat, CompressedFormat::EacR11Signed, CompressedFormat::EacRg11Signed }) {
+		CHECK(!GetFormatInfo(format).decodable && !DecodeBlocks(format, data.data(), data.size(), 4, 4, rgba.data()));
+	}
+	CHECK(!DecodeBlocks(CompressedFormat::Bc7, data.data(), 15, 4, 4, rgba.data()));
+}
+
+static void TestBc1() {
+	// Red over blue picks four colors, each row of indices running 0 to 3.
+	std::vector<uint8_t> block({ 0x00, 0xF8, 0x1F, 0x00, 0xE4, 0xE4, 0xE4, 0xE4 });
+	const int fourColors[4][3] = { { 255, 0, 0 }, { 0, 0, 255 }, { 170, 0, 85 }, { 85, 0, 170 } };
+	for (CompressedFormat format : { CompressedFormat::Bc1Rgb, CompressedFormat::Bc1Rgba, CompressedFormat::Bc1Srgb }) {
+		std::vector<uint8_t> rgba = Decode(format, block);
+		for (unsigned i = 0; i < 16; i++) {
+			const int* color = fourColors[i & 3];
+			CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, color[0], color[1], color[2], 255));
+		}
+	}
+
+	// Black under a dark grey has three colors and black, transparent only with alpha.
+	block = std::vector<uint8_t>({ 0x00, 0x00, 0x82, 0x10, 0xE4, 0xE4, 0xE4, 0xE4 });
+	for (CompressedFormat format : { CompressedFormat::Bc1Rgb, CompressedFormat::Bc1Rgba }) {
+		std::vector<uint8_t> rgba = Decode(format, block);
+		for (unsigned y = 0; y < 4; y++) {
+			CHECK(PixelIs(rgba.data(), 4, 0, y, 0, 0, 0, 255));
+			CHECK(PixelIs(rgba.data(), 4, 1, y, 16, 16, 16, 255));
+			CHECK(PixelIs(rgba.data(), 4, 2, y, 8, 8, 8, 255));
+			CHECK(PixelIs(rgba.data(), 4, 3, y, 0, 0, 0, format == CompressedFormat::Bc1Rgba ? 0 : 255));
+		}
+	}
+}
+
+static void TestBc2Bc3() {
+	// Blue under red would be three colors in BC1; here it is always four.
+	const uint8_t color[8] = { 0x1F, 0x00, 0x00, 0xF8, 0xE4, 0xE4, 0xE4, 0xE4 };
+	const int colors[4][3] = { { 0, 0, 255 }, { 255, 0, 0 }, { 85, 0, 170 }, { 170, 0, 85 } };
+
+	// Explicit alpha: pixel i is i * 17.
+	std::vector<uint8_t> block;
+	for (unsigned i = 0; i < 8; i++) {
+		block.push_back(uint8_t(2 * i | (2 * i + 1) << 4));
+	}
+	block.insert(block.end(), color, color + 8);
+	std::vector<uint8_t> rgba = Decode(CompressedFormat::Bc2, block);
+	for (unsigned i = 0; i < 16; i++) {
+		const int* expected = colors[i & 3];
+		CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, expected[0], expected[1], expected[2], int(i * 17)));
+	}
+
+	// Interpolated alpha with six steps between 210 and 0.
+	unsigned indices[16];
+	for (unsigned i = 0; i < 16; i++) {
+		indices[i] = i & 7;
+	}
+	const int alphas[8] = { 210, 0, 180, 150, 120, 90, 60, 30 };
+	block = Bc4Block(210, 0, indices);
+	block.insert(block.end(), color, color + 8);
+	rgba = Decode(CompressedFormat::Bc3, block);
+	for (unsigned i = 0; i < 16; i++) {
+		const int* expected = colors[i & 3];
+		CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, expected[0], expected[1], expected[2], alphas[i & 7]));
+	}
+}
+
+static void TestBc4Bc5() {
+	unsigned indices[16];
+	for (unsigned i = 0; i < 16; i++) {
+		indices[i] = i & 7;
+	}
+	// Ascending endpoints give four steps, then 0 and 255.
+	const int sixValues[8] = { 0, 200, 40, 80, 120, 160, 0, 255 };
+	const int eightValues[8] = { 210, 0, 180, 150, 120, 90, 60, 30 };
+	std::vector<uint8_t> red = Bc4Block(0, 200, indices);
+	std::vector<uint8_t> rgba = Decode(CompressedFormat::Bc4, red);
+	for (unsigned i = 0; i < 16; i++) {
+		CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, sixValues[i & 7], 0, 0, 255));
+	}
+	std::vector<uint8_t> block = red;
+	std::vector<uint8_t> green = Bc4Block(210, 0, indices);
+	block.insert(block.end(), green.begin(), green.end());
+	rgba = Decode(CompressedFormat::Bc5, block);
+	for (unsigned i = 0; i < 16; i++) {
+		CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, sixValues[i & 7], eightValues[i & 7], 0, 255));
+	}
+}
+
+static void TestBc7() {
+	// Mode 6: black to white, alpha too, across all sixteen 4 bit weights.
+	BitWriter mode6;
+	mode6.Write(1 << 6, 7);
+	for (unsigned channel = 0; channel < 4; channel++) {
+		mode6.Write(0, 7);
+		mode6.Write(127, 7);
+	}
+	mode6.Write(0, 1);
+	mode6.Write(1, 1);
+	mode6.Write(0, 3);
+	for (unsigned i = 1; i < 16; i++) {
+		mode6.Write(i, 4);
+	}
+	CHECK(mode6.GetPosition() == 128);
+	const int ramp[16] = { 0, 16, 36, 52, 68, 84, 104, 120, 135, 151, 171, 187, 203, 219, 239, 255 };
+	std::vector<uint8_t> rgba = Decode(CompressedFormat::Bc7, mode6.GetBlock());
+	for (unsigned i = 0; i < 16; i++) {
+		CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, ramp[i], ramp[i], ramp[i], ramp[i]));
+	}
+
+	// Mode 1, partition 13: red on the top two rows, blue on the bottom two.
+	BitWriter mode1;
+	mode1.Write(1 << 1, 2);
+	mode1.Write(13, 6);
+	const unsigned endpoints[3][4] = { { 63, 63, 0, 0 }, { 0, 0, 0, 0 }, { 0, 0, 63, 63 } };
+	for (unsigned channel = 0; channel < 3; channel++) {
+		for (unsigned endpoint = 0; endpoint < 4; endpoint++) {
+			mode1.Write(endpoints[channel][endpoint], 6);
+		}
+	}
+	mode1.Write(0, 2);
+	// The first pixel and the second subset's anchor, the last one, have 2 bit indices.
+	mode1.Write(0, 46);
+	CHECK(mode1.GetPosition() == 128);
+	rgba = Decode(CompressedFormat::Bc7, mode1.GetBlock());
+	for (unsigned i = 0; i < 16; i++) {
+		if (i < 8) {
+			CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, 253, 0, 0, 255));
+		} else {
+			CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, 0, 0, 253, 255));
+		}
+	}
+
+	// Mode 5 with rotation 1: black, with the alpha ramp swapped into red.
+	BitWriter mode5;
+	mode5.Write(1 << 5, 6);
+	mode5.Write(1, 2);
+	for (unsigned channel = 0; channel < 3; channel++) {
+		mode5.Write(0, 7);
+		mode5.Write(127, 7);
+	}
+	mode5.Write(0, 8);
+	mode5.Write(255, 8);
+	mode5.Write(0, 31);
+	mode5.Write(1, 1);
+	for (unsigned i = 1; i < 16; i++) {
+		mode5.Write(3, 2);
+	}
+	CHECK(mode5.GetPosition() == 128);
+	rgba = Decode(CompressedFormat::Bc7Srgb, mode5.GetBlock());
+	CHECK(PixelIs(rgba.data(), 4, 0, 0, 84, 0, 0, 0));
+	for (unsigned i = 1; i < 16; i++) {
+		CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, 255, 0, 0, 0));
+	}
+
+	// No mode bit set is reserved, and decodes to transparent black.
+	rgba = Decode(CompressedFormat::Bc7, std::vector<uint8_t>(16, 0));
+	for (unsigned i = 0; i < 16; i++) {
+		CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, 0, 0, 0, 0));
+	}
+}
+
+static void TestEtc() {
+	// Individual mode: grey 136 on the left with table 0, 68 on the right with table 7;
+	// each row uses the next index.
+	std::vector<uint8_t> individual({ 0x84, 0x84, 0x84, 0x1C, 0xCC, 0xCC, 0xAA, 0xAA });
+	const int left[4] = { 138, 144, 134, 128 };
+	const int right[4] = { 115, 251, 21, 0 };
+	for (CompressedFormat format : { CompressedFormat::Etc1Rgb, CompressedFormat::Etc2Rgb }) {
+		std::vector<uint8_t> rgba = Decode(format, individual);
+		for (unsigned y = 0; y < 4; y++) {
+			for (unsigned x = 0; x < 4; x++) {
+				int value = x < 2 ? left[y] : right[y];
+				CHECK(PixelIs(rgba.data(), 4, x, y, value, value, value, 255));
+			}
+		}
+	}
+
+	// Differential mode, flipped: 132 on the top half and 148 on the bottom, each plus 2.
+	std::vector<uint8_t> flipped({ 0x82, 0x82, 0x82, 0x03, 0x00, 0x00, 0x00, 0x00 });
+	std::vector<uint8_t> rgba = Decode(CompressedFormat::Etc1Rgb, flipped);
+	for (unsigned i = 0; i < 16; i++) {
+		int value = i < 8 ? 134 : 150;
+		CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, value, value, value, 255));
+	}
+
+	// T mode: green for the first row, then grey 136 plus, at and minus a distance of 11.
+	rgba = Decode(CompressedFormat::Etc2Rgb, std::vector<uint8_t>({ 0x04, 0xF0, 0x88, 0x86, 0xCC, 0xCC, 0xAA, 0xAA }));
+	for (unsigned x = 0; x < 4; x++) {
+		CHECK(PixelIs(rgba.data(), 4, x, 0, 0, 255, 0, 255));
+		CHECK(PixelIs(rgba.data(), 4, x, 1, 147, 147, 147, 255));
+		CHECK(PixelIs(rgba.data(), 4, x, 2, 136, 136, 136, 255));
+		CHECK(PixelIs(rgba.data(), 4, x, 3, 125, 125, 125, 255));
+	}
+
+	// H mode: black and grey 136, each plus and minus 23.
+	rgba = Decode(CompressedFormat::Etc2Rgb, std::vector<uint8_t>({ 0x00, 0x04, 0x44, 0x46, 0xCC, 0xCC, 0xAA, 0xAA }));
+	const int h[4] = { 23, 0, 159, 113 };
+	for (unsigned i = 0; i < 16; i++) {
+		int value = h[i >> 2];
+		CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, value, value, value, 255));
+	}
+
+	// Planar mode: red rises to the right, green downwards.
+	rgba = Decode(CompressedFormat::Etc2Srgb, std::vector<uint8_t>({ 0x00, 0x00, 0x04, 0x7F, 0x00, 0x00, 0x1F, 0xC0 }));
+	const int gradient[4] = { 0, 64, 128, 191 };
+	for (unsigned i = 0; i < 16; i++) {
+		CHECK(PixelIs(rgba.data(), 4, i & 3, i >> 2, gradient[i & 3], gradient[i >> 2], 0, 255));
+	}
+
+	// Punch-through without the opaque bit: index 0 is the base color, index 2 a hole.
+	rgba = Decode(CompressedFormat::Etc2RgbA1, std::vector<uint8_t>({ 0x82, 0x82, 0x82, 0x00, 0xCC, 0xCC, 0xAA, 0xAA }));
+	const int punchLeft[4] = { 132, 140, 0, 124 };
+	const int punchRight[4] = { 148, 156, 0, 140 };
+	for (unsigned y = 0; y < 4; y++) {
+		for (unsigned x = 0; x < 4; x++) {
+			int value = x < 2 ? punchLeft[y] : punchRight[y];
+			CHECK(PixelIs(rgba.data(), 4, x, y, value, value, value, y == 2 ? 0 : 255));
+		}
+	}
+	// With it, the same block is an ordinary differential one.
+	rgba = Decode(CompressedFormat::Etc2RgbA1, std::vector<uint8_t>({ 0x82, 0x82, 0x82, 0x02, 0xCC, 0xCC, 0xAA, 0xAA }));
+	CHECK(PixelIs(rgba.data(), 4, 0, 0, 134, 134, 134, 255) && PixelIs(rgba.data(), 4, 3, 2, 146, 146, 146, 255));
+}
+
+static void TestEac() {
+	// Table 13 steps -1, -2, -3, -10, 0, 1, 2 and 9, pixel i taking index i & 7 in
+	// column order.
+	const int modifiers[8] = { -1, -2, -3, -10, 0, 1, 2, 9 };
+	unsigned indices[16];
+	for (unsigned i = 0; i < 16; i++) {
+		indices[i] = i & 7;
+	}
+
+	// ETC2 RGBA: EAC alpha around 128 over an opaque differential color block.
+	std::vector<uint8_t> block = EacBlock(128, 1, 13, indices);
+	const uint8_t color[8] = { 0x82, 0x82, 0x82, 0x03, 0x00, 0x00, 0x00, 0x00 };
+	block.insert(block.end(), color, color + 8);
+	std::vector<uint8_t> rgba = Decode(CompressedFormat::Etc2Rgba, block);
+	for (unsigned x = 0; x < 4; x++) {
+		for (unsigned y = 0; y < 4; y++) {
+			int value = y < 2 ? 134 : 150;
+			CHECK(PixelIs(rgba.data(), 4, x, y, value, value, value, 128 + modifiers[(x * 4 + y) & 7]));
+		}
+	}
+
+	// Eleven bit red and green, scaled by 15 and 0 near the top of the range; the
+	// 0 to 2047 values map to 0 to 255, rounded.
+	std::vector<uint8_t> red = EacBlock(255, 15, 13, indices);
+	std::vector<uint8_t> green = EacBlock(128, 0, 13, indices);
+	block = red;
+	block.insert(block.end(), green.begin(), green.end());
+	rgba = Decode(CompressedFormat::EacRg11, block);
+	for (unsigned x = 0; x < 4; x++) {
+		for (unsigned y = 0; y < 4; y++) {
+			int modifier = modifiers[(x * 4 + y) & 7];
+			double wideRed = (std::min)(2047, 255 * 8 + 4 + modifier * 15 * 8);
+			double wideGreen = 128 * 8 + 4 + modifier;
+			const uint8_t* pixel = &rgba[(y * 4 + x) * 4];
+			CHECK(std::fabs(pixel[0] - wideRed * 255.0 / 2047.0) <= 0.5 + 1.0e-9);
+			CHECK(std::fabs(pixel[1] - wideGreen * 255.0 / 2047.0) <= 0.5 + 1.0e-9);
+			CHECK(pixel[2] == 0 && pixel[3] == 255);
+		}
+	}
+	// A single channel leaves green at zero.
+	std::vector<uint8_t> single = Decode(CompressedFormat::EacR11, red);
+	for (unsigned i = 0; i < 16; i++) {
+		CHECK(single[i * 4] == rgba[i * 4] && single[i * 4 + 1] == 0 && single[i * 4 + 2] == 0 && single[i * 4 + 3] == 255);
+	}
+}
+
+static void TestImageEdges() {
+	// A 6x5 BC1 image: four solid blocks, clipped at the right and bottom.
+	const uint16_t colors[4] = { 0xF800, 0x07E0, 0x001F, 0xFFFF };
+	const int rgb[4][3] = { { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 255, 255 } };
+	std::vector<uint8_t> data;
+	for (uint16_t color : colors) {
+		const uint8_t block[8] = { uint8_t(color), uint8_t(color >> 8), uint8_t(color), uint8_t(color >> 8), 0, 0, 0, 0 };
+		data.insert(data.end(), block, block + 8);
+	}
+	std::vector<uint8_t> rgba = Decode(CompressedFormat::Bc1Rgb, data, 6, 5);
+	unsigned wrong = 0;
+	for (unsigned y = 0; y < 5; y++) {
+		for (unsigned x = 0; x < 6; x++) {
+			const int* expected = rgb[(y / 4) * 2 + x / 4];
+			const uint8_t* pixel = &rgba[(y * 6 + x) * 4];
+			wrong += pixel[0] != expected[0] || pixel[1] != expected[1] || pixel[2] != expected[2] || pixel[3] != 255;
+		}
+	}
+	CHECK(wrong == 0);
+	CHECK(!DecodeBlocks(CompressedFormat::Bc1Rgb, data.data(), data.size() - 1, 6, 5, rgba.data()));
+}
+
+int main() {
+	TestFormats();
+	TestBc1();
+	TestBc2Bc3();
+	TestBc4Bc5();
+	TestBc7();
+	TestEtc();
+	TestEac();
+	TestImageEdges();
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,254 @@
+#include "DamageTracker.h"
+#include "TestCheck.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+using namespace unigles;
+
+// A layer that moves damages where it was and where it is, one that changes in place
+// damages its bounds, an unchanged one nothing, and one left out of a frame where it
+// was. Damage is clipped to the surface, overlapping rectangles merge, and past the
+// limit the pairs that waste least are joined; past the full fraction, or after a
+// resize or Invalidate, the frame is whole. EGL rectangles count from the bottom, and
+// a back buffer of age n is repainted with the damage of the n - 1 frames it missed,
+// or whole when its age is zero or beyond the history. The stats average what was
+// presented and drawn.
+
+static const int Width = 100;
+static const int Height = 80;
+
+static DamageRect Rect(int x, int y, int width, int height) {
+	return MakeDamageRect(x, y, width, height);
+}
+
+static bool Is(const DamageRect& rect, int x, int y, int width, int height) {
+	return rect.x == x && rect.y == y && rect.width == width && rect.height == height;
+}
+
+static bool DamageIs(const DamageTracker& tracker, const std::vector<DamageRect>& expected) {
+	const std::vector<DamageRect>& damage = tracker.GetDamage();
+	bool same = damage.size() == expected.size();
+	for (size_t i = 0; same && i < damage.size(); i++) {
+		same = Is(damage[i], expected[i].x, expected[i].y, expected[i].width, expected[i].height);
+	}
+	return same;
+}
+
+// Presents the resolved frame: partial unless it is full, drawing the repaint bounds of
+// a back buffer of the given age.
+static void Present(DamageTracker& tracker, unsigned bufferAge, double milliseconds) {
+	tracker.EndFrame(milliseconds, !tracker.IsFull(), tracker.GetRepaintBounds(bufferAge));
+}
+
+static void TestRects() {
+	CHECK(Rect(0, 0, 0, 5).Empty() && Rect(0, 0, 5, -1).Empty() && Rect(0, 0, 0, 5).Area() == 0);
+	CHECK(Rect(1, 2, 3, 4).Area() == 12 && Rect(1, 2, 3, 4) == Rect(1, 2, 3, 4) && Rect(1, 2, 3, 4) != Rect(1, 2, 4, 4));
+	// Every empty rectangle is the same nothing.
+	CHECK(Rect(5, 5, 0, 3) == DamageRect());
+	CHECK(Is(UnionRects(Rect(0, 0, 10, 10), Rect(20, 5, 5, 10)), 0, 0, 25, 15));
+	CHECK(Is(UnionRects(DamageRect(), Rect(3, 4, 5, 6)), 3, 4, 5, 6));
+	CHECK(Is(IntersectRects(Rect(0, 0, 10, 10), Rect(5, -5, 10, 10)), 5, 0, 5, 5));
+	// Touching edges share no pixels.
+	CHECK(IntersectRects(Rect(0, 0, 10, 10), Rect(10, 0, 10, 10)).Empty());
+
+	// A box in front of an identity view-projection, with a pixel of slack around it.
+	float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	Aabb box;
+	box.min[0] = -0.5f;
+	box.min[1] = -0.5f;
+	box.min[2] = 0.0f;
+	box.max[0] = 0.5f;
+	box.max[1] = 0.5f;
+	box.max[2] = 0.5f;
+	CHECK(Is(ProjectBounds(box, identity, Width, Height), 24, 19, 52, 42));
+	// Behind the eye it could be anywhere.
+	float behind[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, -1 };
+	CHECK(Is(ProjectBounds(box, behind, Width, Height), 0, 0, Width, Height));
+	CHECK(std::string(PresentMethodName(PresentMethod::SwapWithDamage)) == "swap with damage");
+}
+
+static void TestLayers() {
+	DamageTracker tracker;
+	// The first frame has nothing in its back buffer.
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(10, 10, 20, 20));
+	tracker.Resolve();
+	CHECK(tracker.IsFull() && DamageIs(tracker, { Rect(0, 0, Width, Height) }));
+	CHECK(tracker.GetEglRects() == std::vector<int32_t>({ 0, 0, Width, Height }));
+	CHECK(Is(tracker.GetRepaintBounds(1), 0, 0, Width, Height));
+	Present(tracker, 0, 8.0);
+
+	// Nothing changed, nothing to present or draw.
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(10, 10, 20, 20), false);
+	tracker.Resolve();
+	CHECK(!tracker.IsFull() && tracker.GetDamage().empty() && tracker.GetEglRects().empty());
+	CHECK(tracker.GetRepaintBounds(1).Empty());
+	Present(tracker, 1, 1.0);
+
+	// Moved right: its old and new bounds, which only touch.
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(30, 10, 20, 20), false);
+	tracker.Resolve();
+	CHECK(!tracker.IsFull() && DamageIs(tracker, { Rect(10, 10, 20, 20), Rect(30, 10, 20, 20) }));
+	CHECK(tracker.GetEglRects() == std::vector<int32_t>({ 10, 50, 20, 20, 30, 50, 20, 20 }));
+	// By buffer age: this frame, plus the empty one before, plus the full first frame.
+	CHECK(Is(tracker.GetRepaintBounds(1), 10, 10, 40, 20));
+	CHECK(Is(tracker.GetRepaintBounds(2), 10, 10, 40, 20));
+	CHECK(Is(tracker.GetRepaintBounds(3), 0, 0, Width, Height));
+	CHECK(Is(tracker.GetRepaintBounds(0), 0, 0, Width, Height));
+	Present(tracker, 2, 2.0);
+
+	// A new layer in the corner; a buffer two frames old also missed the move.
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(30, 10, 20, 20), false);
+	tracker.SetLayer(1, Rect(70, 60, 10, 10));
+	tracker.Resolve();
+	CHECK(DamageIs(tracker, { Rect(70, 60, 10, 10) }));
+	CHECK(tracker.GetEglRects() == std::vector<int32_t>({ 70, 10, 10, 10 }));
+	CHECK(Is(tracker.GetRepaintBounds(1), 70, 60, 10, 10));
+	CHECK(Is(tracker.GetRepaintBounds(2), 10, 10, 70, 60));
+	CHECK(Is(tracker.GetRepaintBounds(3), 10, 10, 70, 60));
+	CHECK(Is(tracker.GetRepaintBounds(4), 0, 0, Width, Height));
+	// Older than the history holds.
+	CHECK(Is(tracker.GetRepaintBounds(5), 0, 0, Width, Height));
+	CHECK(Is(tracker.GetRepaintBounds(100), 0, 0, Width, Height));
+	Present(tracker, 1, 2.0);
+
+	// The corner layer left out damages where it was; layer 0 redrawn in place damages
+	// its bounds once.
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(30, 10, 20, 20), true);
+	tracker.Resolve();
+	CHECK(DamageIs(tracker, { Rect(30, 10, 20, 20), Rect(70, 60, 10, 10) }));
+	Present(tracker, 1, 2.0);
+
+	// Partly off the surface, clipped to it.
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(-10, 70, 30, 30));
+	tracker.Resolve();
+	CHECK(DamageIs(tracker, { Rect(30, 10, 20, 20), Rect(0, 70, 20, 10) }));
+	CHECK(tracker.GetEglRects() == std::vector<int32_t>({ 30, 50, 20, 20, 0, 0, 20, 10 }));
+	Present(tracker, 1, 2.0);
+
+	// Covering most of the surface is presented whole.
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(0, 0, 90, 70));
+	tracker.Resolve();
+	CHECK(tracker.IsFull() && DamageIs(tracker, { Rect(0, 0, Width, Height) }));
+	Present(tracker, 1, 8.0);
+}
+
+static void TestMerging() {
+	DamageTracker tracker(2);
+	const DamageRect layers[4] = { Rect(0, 0, 10, 10), Rect(12, 0, 10, 10), Rect(60, 60, 10, 10), Rect(72, 60, 10, 10) };
+	for (int frame = 0; frame < 2; frame++) {
+		tracker.BeginFrame(Width, Height);
+		for (unsigned layer = 0; layer < 4; layer++) {
+			tracker.SetLayer(layer, layers[layer]);
+		}
+		tracker.Resolve();
+		Present(tracker, 1, 1.0);
+	}
+	// Each neighbor pair joins across its 2 pixel gap, not the far corners.
+	CHECK(!tracker.IsFull() && DamageIs(tracker, { Rect(0, 0, 22, 10), Rect(60, 60, 22, 10) }));
+
+	// Overlapping layers merge whatever the limit.
+	DamageTracker overlapping(4);
+	overlapping.BeginFrame(Width, Height);
+	overlapping.Resolve();
+	Present(overlapping, 1, 1.0);
+	overlapping.BeginFrame(Width, Height);
+	overlapping.SetLayer(0, Rect(10, 10, 20, 20));
+	overlapping.SetLayer(1, Rect(20, 20, 20, 20));
+	overlapping.SetLayer(2, Rect(60, 10, 5, 5));
+	overlapping.Resolve();
+	CHECK(DamageIs(overlapping, { Rect(10, 10, 30, 30), Rect(60, 10, 5, 5) }));
+
+	// A limit of zero counts as one, the bounding rectangle.
+	DamageTracker single(0);
+	single.BeginFrame(Width, Height);
+	single.Resolve();
+	Present(single, 1, 1.0);
+	single.BeginFrame(Width, Height);
+	single.SetLayer(0, Rect(0, 0, 5, 5));
+	single.SetLayer(1, Rect(20, 30, 5, 5));
+	single.Resolve();
+	CHECK(DamageIs(single, { Rect(0, 0, 25, 35) }));
+}
+
+static void TestInvalidateAndResize() {
+	DamageTracker tracker;
+	for (int frame = 0; frame < 2; frame++) {
+		tracker.BeginFrame(Width, Height);
+		tracker.SetLayer(0, Rect(10, 10, 20, 20), false);
+		tracker.Resolve();
+		Present(tracker, 1, 1.0);
+	}
+	CHECK(!tracker.IsFull() && tracker.GetDamage().empty());
+
+	// A lost device: one whole frame, then back to nothing.
+	tracker.Invalidate();
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(10, 10, 20, 20), false);
+	tracker.Resolve();
+	CHECK(tracker.IsFull() && Is(tracker.GetRepaintBounds(1), 0, 0, Width, Height));
+	Present(tracker, 1, 1.0);
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(10, 10, 20, 20), false);
+	tracker.Resolve();
+	CHECK(!tracker.IsFull() && tracker.GetDamage().empty());
+	// A buffer from before the invalidation missed the whole frame.
+	CHECK(Is(tracker.GetRepaintBounds(2), 0, 0, Width, Height));
+	Present(tracker, 1, 1.0);
+
+	// A resize is whole at the new size, with EGL rectangles from its bottom.
+	tracker.BeginFrame(120, 60);
+	tracker.SetLayer(0, Rect(10, 10, 20, 20), false);
+	tracker.Resolve();
+	CHECK(tracker.IsFull() && DamageIs(tracker, { Rect(0, 0, 120, 60) }));
+	CHECK(tracker.GetEglRects() == std::vector<int32_t>({ 0, 0, 120, 60 }));
+	Present(tracker, 1, 1.0);
+	tracker.BeginFrame(120, 60);
+	tracker.SetLayer(0, Rect(100, 50, 20, 20));
+	tracker.Resolve();
+	CHECK(!tracker.IsFull() && DamageIs(tracker, { Rect(10, 10, 20, 20), Rect(100, 50, 20, 10) }));
+	CHECK(tracker.GetEglRects() == std::vector<int32_t>({ 10, 30, 20, 20, 100, 0, 20, 10 }));
+	// The same size again changes nothing.
+	tracker.BeginFrame(120, 60);
+	tracker.Resolve();
+	CHECK(!tracker.IsFull());
+}
+
+static void TestStats() {
+	DamageTracker tracker;
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(0, 0, 20, 20));
+	tracker.Resolve();
+	Present(tracker, 0, 6.0);
+	CHECK(tracker.GetStats().savedMilliseconds == 0.0);
+	// A quarter of the surface, presented and drawn.
+	tracker.BeginFrame(Width, Height);
+	tracker.SetLayer(0, Rect(0, 0, 50, 40));
+	tracker.Resolve();
+	Present(tracker, 1, 2.0);
+	const DamageStats& stats = tracker.GetStats();
+	CHECK(stats.frames == 2 && stats.partialFrames == 1);
+	CHECK(stats.fullPresentMilliseconds == 6.0 && stats.partialPresentMilliseconds == 2.0);
+	CHECK(stats.savedMilliseconds == 4.0);
+	CHECK(std::fabs(stats.presentedFraction - (1.0 + 0.25) / 2) < 1.0e-9);
+	CHECK(std::fabs(stats.repaintedFraction - (1.0 + 0.25) / 2) < 1.0e-9);
+	tracker.ResetStats();
+	CHECK(tracker.GetStats().frames == 0 && tracker.GetStats().presentedFraction == 0.0);
+}
+
+int main() {
+	TestRects();
+	TestLayers();
+	TestMerging();
+	TestInvalidateAndResize();
+	TestStats();
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "TestCheck.h"
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+// A GLES2 context on a pbuffer for the tests of the GL code, and the program helpers they
+// share. ctest runs them on Mesa's surfaceless platform; without an EGL display they exit
+// with SkipExitCode.
+namespace unigles {
+	namespace test {
+		struct EglTestContext {
+			EGLDisplay display = EGL_NO_DISPLAY;
+			EGLConfig config = nullptr;
+			EGLSurface surface = EGL_NO_SURFACE;
+			EGLContext context = EGL_NO_CONTEXT;
+		};
+
+		// Creates the context and makes it current on a width x height RGBA8 pbuffer.
+		inline bool CreateEglTestContext(unsigned width, unsigned height, EglTestContext& egl) {
+			egl.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+			if (egl.display == EGL_NO_DISPLAY || !eglInitialize(egl.display, nullptr, nullptr)) {
+				return false;
+			}
+			const EGLint configAttributes[] = {
+				EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+				EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8, EGL_NONE
+			};
+			EGLint configCount = 0;
+			if (!eglChooseConfig(egl.display, configAttributes, &egl.config, 1, &configCount) || configCount == 0) {
+				return false;
+			}
+			const EGLint surfaceAttributes[] = { EGL_WIDTH, EGLint(width), EGL_HEIGHT, EGLint(height), EGL_NONE };
+			egl.surface = eglCreatePbufferSurface(egl.display, egl.config, surfaceAttributes);
+			const EGLint contextAttributes[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+			eglBindAPI(EGL_OPENGL_ES_API);
+			egl.context = eglCreateContext(egl.display, egl.config, EGL_NO_CONTEXT, contextAttributes);
+			return egl.surface != EGL_NO_SURFACE && egl.context != EGL_NO_CONTEXT &&
+				eglMakeCurrent(egl.display, egl.surface, egl.surface, egl.context);
+		}
+
+		// Links a program with its first attribute bound to location 0; a failure to link
+		// is a failed check.
+		inline GLuint CreateTestProgram(const char* vertexShader, const char* fragmentShader, const char* attribute) {
+			GLuint program = glCreateProgram();
+			const char* sources[] = { vertexShader, fragmentShader };
+			const GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+			for (int i = 0; i < 2; i++) {
+				GLuint shader = glCreateShader(types[i]);
+				glShaderSource(shader, 1, &sources[i], nullptr);
+				glCompileShader(shader);
+				glAttachShader(program, shader);
+				glDeleteShader(shader);
+			}
+			glBindAttribLocation(program, 0, attribute);
+			glLinkProgram(program);
+			GLint linked = GL_FALSE;
+			glGetProgramiv(program, GL_LINK_STATUS, &linked);
+			CHECK(linked == GL_TRUE);
+			return program;
+		}
+	}
+}
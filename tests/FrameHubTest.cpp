@@ -0,0 +1,227 @@
+#include "FrameHub.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace unigles;
+
+// One producer publishes twenty thousand frames to five subscribers on their own
+// threads, at different rates, depths and speeds, two of them through a converted
+// format and one through a conversion that always fails. Every frame a subscriber
+// takes must still hold what was written for its sequence, so no buffer is recycled
+// while a handle is out; every frame must be accounted for; and every buffer must be
+// back in its pool at the end.
+
+struct TestFrame {
+	uint64_t sequence = 0;
+	std::vector<uint32_t> data;
+};
+
+static const int64_t TicksPerSecond = 10000000;
+static const unsigned FrameCount = 20000;
+static const unsigned SourceBuffers = 12;
+
+static uint32_t Expected(uint64_t sequence, size_t index, bool half) {
+	return half ? uint32_t((sequence * 7 + 2 * index) / 2) : uint32_t(sequence * 7 + index);
+}
+
+static void TestRateGate() {
+	// 30 fps with two milliseconds of jitter taken at 10 fps, and 60 fps at 24.
+	FrameRateGate tenth(10.0, TicksPerSecond);
+	unsigned admitted = 0;
+	for (int i = 0; i < 300; i++) {
+		admitted += tenth.Admit(int64_t(i * 333333.3) + (i % 3 == 0 ? 20000 : -20000)) ? 1 : 0;
+	}
+	CHECK(admitted == 100);
+	FrameRateGate film(24.0, TicksPerSecond);
+	admitted = 0;
+	for (int i = 0; i < 600; i++) {
+		admitted += film.Admit(int64_t(i * 166666.7)) ? 1 : 0;
+	}
+	CHECK(admitted == 240);
+}
+
+struct Consumer {
+	const char* name;
+	const char* format;
+	double framesPerSecond;
+	unsigned depth;
+	unsigned sleepMicroseconds;
+};
+
+static void TestStress() {
+	FrameHub<TestFrame> hub(SourceBuffers, TicksPerSecond);
+	std::atomic<uint64_t> conversions(0);
+	hub.AddFormat("half", [&](const TestFrame& source, TestFrame& target) {
+		conversions++;
+		target.sequence = source.sequence;
+		target.data.resize(source.data.size() / 2);
+		for (size_t i = 0; i < target.data.size(); i++) {
+			target.data[i] = source.data[2 * i] / 2;
+		}
+		return true;
+	}, 8);
+	hub.AddFormat("broken", [](const TestFrame&, TestFrame&) { return false; }, 2);
+
+	const Consumer consumers[] = {
+		{ "preview", "", 0.0, 1, 0 },
+		{ "recorder", "", 30.0, 4, 50 },
+		{ "detector", "half", 10.0, 1, 300 },
+		{ "analytics", "half", 5.0, 1, 2000 },
+		{ "broken", "broken", 2.0, 1, 0 },
+	};
+	const unsigned consumerCount = sizeof(consumers) / sizeof(consumers[0]);
+	std::vector<FrameHub<TestFrame>::SubscriberId> ids;
+	for (const Consumer& consumer : consumers) {
+		FrameSubscription subscription;
+		subscription.name = consumer.name;
+		subscription.format = consumer.format;
+		subscription.framesPerSecond = consumer.framesPerSecond;
+		subscription.depth = consumer.depth;
+		ids.push_back(hub.Subscribe(subscription));
+	}
+	bool threw = false;
+	try {
+		FrameSubscription unknown;
+		unknown.format = "unknown";
+		hub.Subscribe(unknown);
+	} catch (const std::invalid_argument&) {
+		threw = true;
+	}
+	CHECK(threw);
+
+	std::atomic<bool> done(false);
+	std::atomic<int64_t> clock(0);
+	std::atomic<unsigned> corrupted(0);
+	std::vector<uint64_t> taken(consumerCount, 0);
+	std::vector<std::thread> threads;
+	for (unsigned k = 0; k < consumerCount; k++) {
+		threads.emplace_back([&, k]() {
+			bool half = consumers[k].format[0] != 0;
+			// Holds on to a couple of frames, like a consumer still working on them.
+			std::vector<FrameHandle<TestFrame>> held;
+			while (true) {
+				FrameHandle<TestFrame> frame;
+				if (!hub.TryPop(ids[k], frame, clock.load())) {
+					if (done) {
+						break;
+					}
+					std::this_thread::yield();
+					continue;
+				}
+				taken[k]++;
+				bool intact = frame->sequence == frame.GetSequence() && !frame->data.empty();
+				for (size_t i = 0; i < frame->data.size() && intact; i++) {
+					intact = frame->data[i] == Expected(frame->sequence, i, half);
+				}
+				corrupted += intact ? 0 : 1;
+				held.push_back(frame);
+				if (held.size() > 2) {
+					held.erase(held.begin());
+				}
+				if (consumers[k].sleepMicroseconds != 0) {
+					std::this_thread::sleep_for(std::chrono::microseconds(consumers[k].sleepMicroseconds));
+				}
+			}
+		});
+	}
+
+	uint64_t sourceDrops = 0;
+	for (unsigned i = 0; i < FrameCount; i++) {
+		int64_t timestamp = int64_t(i) * 333333;
+		clock = timestamp;
+		FrameHandle<TestFrame> frame = hub.Acquire();
+		if (!frame) {
+			sourceDrops++;
+			std::this_thread::sleep_for(std::chrono::microseconds(20));
+			continue;
+		}
+		TestFrame* payload = frame.GetMutable();
+		CHECK(payload != nullptr);
+		payload->sequence = hub.GetPublishedCount() + 1;
+		payload->data.resize(256);
+		for (size_t j = 0; j < payload->data.size(); j++) {
+			payload->data[j] = Expected(payload->sequence, j, false);
+		}
+		hub.Publish(std::move(frame), timestamp);
+		if (i % 64 == 0) {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+	done = true;
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	uint64_t published = hub.GetPublishedCount();
+	CHECK(published + sourceDrops == FrameCount);
+	CHECK(corrupted == 0);
+	std::vector<SubscriberStats> stats = hub.GetSubscriberStats();
+	CHECK(stats.size() == consumerCount);
+	uint64_t halfOffered = 0;
+	for (unsigned k = 0; k < consumerCount && k < stats.size(); k++) {
+		const SubscriberStats& subscriber = stats[k];
+		// Each queue was drained, so every due frame was taken, replaced or missed.
+		CHECK(subscriber.offered + subscriber.skipped == published);
+		CHECK(subscriber.offered == subscriber.delivery.delivered + subscriber.delivery.Dropped() + subscriber.missed);
+		CHECK(subscriber.delivery.delivered == taken[k]);
+		CHECK(subscriber.delivery.depth == 0);
+		if (std::string(consumers[k].format) == "half") {
+			halfOffered += subscriber.offered;
+		}
+	}
+	// The every-frame subscriber sees them all; the gated ones near their rate.
+	CHECK(stats[0].offered == published);
+	CHECK(stats[2].offered >= published / 3 - 2 && stats[2].offered <= published / 3 + 2);
+	CHECK(stats[4].delivery.delivered == 0 && stats[4].missed == stats[4].offered);
+	// A frame due for both subscribers of a format is converted once.
+	std::vector<FrameFormatStats> formats = hub.GetFormatStats();
+	CHECK(formats.size() == 2);
+	CHECK(formats[0].conversions == conversions && formats[0].conversions <= halfOffered);
+	CHECK(formats[0].conversions >= stats[2].offered);
+	CHECK(formats[1].conversions == 0 && formats[1].failures == stats[4].offered);
+
+	// Queued frames are released on unsubscribing; then every buffer is free again.
+	CHECK(hub.GetSourcePoolStats().allocated <= SourceBuffers);
+	for (FrameHub<TestFrame>::SubscriberId id : ids) {
+		hub.Unsubscribe(id);
+	}
+	FramePoolStats source = hub.GetSourcePoolStats();
+	CHECK(source.free == source.allocated);
+	for (const FrameFormatStats& format : hub.GetFormatStats()) {
+		CHECK(format.pool.free == format.pool.allocated && format.pool.allocated <= 8);
+	}
+}
+
+static void TestHandleOutlivesPool() {
+	FrameHandle<TestFrame> kept;
+	{
+		FramePool<TestFrame> pool(2);
+		kept = pool.Acquire();
+		FrameHandle<TestFrame> copy = kept;
+		CHECK(kept.GetUseCount() == 2);
+		CHECK(kept.GetMutable() == nullptr);
+		FrameHandle<TestFrame> second = pool.Acquire();
+		CHECK(bool(second));
+		CHECK(!pool.Acquire());
+		CHECK(pool.GetStats().exhausted == 1);
+	}
+	CHECK(kept.GetUseCount() == 1);
+	CHECK(kept.GetMutable() != nullptr);
+	// Returns the buffer to a pool only the handle keeps alive.
+	kept.Reset();
+	CHECK(!kept);
+}
+
+int main() {
+	TestRateGate();
+	TestStress();
+	TestHandleOutlivesPool();
+	return unigles::test::TestResult();
+}
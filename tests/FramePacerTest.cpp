@@ -0,0 +1,196 @@
+#include "FramePacer.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace unigles;
+
+// A 30 fps camera drives a 60 Hz display through the pacer at every depth. A steady
+// stream shows every frame once, with latency growing by a frame interval per level of
+// depth and never past depth intervals and a vsync, whatever the offset between the
+// camera and local clocks. Arrival jitter within the depth is absorbed without judder,
+// as are bursts of three frames at depth 2, while shallower buffers skip. A pause in the
+// source is one underrun, however many vsyncs it lasts, and a step back in the
+// timestamps restarts the clock mapping.
+
+static const int64_t Interval = 333333;	// 100 ns ticks
+static const int64_t Vsync = 166667;
+static const int64_t Transport = 50000;
+static const double VsyncMilliseconds = Vsync / 10000.0;
+
+struct Trace {
+	std::vector<int64_t> timestamps;	// Camera clock
+	std::vector<int64_t> arrivals;		// Local clock
+};
+
+// Frames at a steady interval from the camera clock's base, each arriving Transport
+// plus jitter[i] after it was taken.
+static Trace MakeTrace(unsigned frames, int64_t base, const std::vector<int64_t>& jitter = std::vector<int64_t>()) {
+	Trace trace;
+	for (unsigned i = 0; i < frames; i++) {
+		trace.timestamps.push_back(base + i * Interval);
+		trace.arrivals.push_back(i * Interval + Transport + (i < jitter.size() ? jitter[i] : 0));
+	}
+	return trace;
+}
+
+static std::vector<int64_t> UniformJitter(unsigned frames, int64_t range, unsigned seed) {
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int64_t> distribution(0, range);
+	std::vector<int64_t> jitter(frames);
+	for (int64_t& value : jitter) {
+		value = distribution(random);
+	}
+	return jitter;
+}
+
+// Pushes every frame that arrived before a vsync, then asks for the vsync's frame, until
+// the last frame is gone; vsyncs past the end of the stream would count as a stall.
+// Presented ids must only ever increase.
+static PacingStats Play(const Trace& trace, unsigned depth) {
+	PacerSettings settings;
+	settings.depth = depth;
+	FramePacer pacer(settings);
+	size_t next = 0;
+	uint64_t lastId = 0;
+	bool ordered = true;
+	for (int64_t display = 1000; next < trace.arrivals.size() || pacer.GetQueuedCount() > 0; display += Vsync) {
+		while (next < trace.arrivals.size() && trace.arrivals[next] <= display) {
+			pacer.Push(next + 1, trace.timestamps[next], trace.arrivals[next]);
+			next++;
+		}
+		PacerDecision decision = pacer.Select(display);
+		if (decision.present) {
+			ordered &= decision.id > lastId;
+			lastId = decision.id;
+		}
+	}
+	CHECK(ordered);
+	return pacer.GetStats();
+}
+
+static double LatencyBound(unsigned depth) {
+	return depth * Interval / 10000.0 + VsyncMilliseconds + 0.001;
+}
+
+static void TestSteady() {
+	double previousMean = -1.0;
+	for (unsigned depth = 0; depth <= FramePacer::MaxDepth; depth++) {
+		for (int64_t base : { int64_t(0), int64_t(123456789012), int64_t(-5000000) }) {
+			PacingStats stats = Play(MakeTrace(90, base), depth);
+			CHECK(stats.pushed == 90 && stats.presented == 90);
+			CHECK(stats.skipped == 0 && stats.overflowed == 0 && stats.underruns == 0 && stats.resets == 0);
+			CHECK(stats.latency.GetMax() <= LatencyBound(depth));
+			CHECK(stats.judder.GetMax() <= VsyncMilliseconds + 0.001 && stats.judder.GetMean() < 1.0);
+			if (base == 0) {
+				// Each level of depth is one more frame interval of latency.
+				if (previousMean >= 0.0) {
+					double step = stats.latency.GetMean() - previousMean;
+					CHECK(step > 0.9 * Interval / 10000.0 && step < 1.1 * Interval / 10000.0);
+				}
+				previousMean = stats.latency.GetMean();
+			}
+		}
+	}
+	// The clock offset changes nothing.
+	PacingStats zero = Play(MakeTrace(90, 0), 1);
+	PacingStats offset = Play(MakeTrace(90, 987654321), 1);
+	CHECK(zero.latency.GetMean() == offset.latency.GetMean() && zero.judder.GetMean() == offset.judder.GetMean());
+}
+
+static void TestJitter() {
+	// Up to 20 ms late, well within one 33 ms interval of depth.
+	std::vector<int64_t> jitter = UniformJitter(90, 200000, 37);
+	PacingStats shallow = Play(MakeTrace(90, 42, jitter), 0);
+	for (unsigned depth = 1; depth <= FramePacer::MaxDepth; depth++) {
+		PacingStats stats = Play(MakeTrace(90, 42, jitter), depth);
+		CHECK(stats.presented == 90 && stats.skipped == 0 && stats.underruns == 0);
+		CHECK(stats.judder.GetMax() <= VsyncMilliseconds + 0.001);
+		CHECK(stats.judder.GetMean() < shallow.judder.GetMean());
+		CHECK(stats.latency.GetMax() <= LatencyBound(depth) + 20.0);
+	}
+	// Without depth the jitter shows.
+	CHECK(shallow.judder.GetMax() > VsyncMilliseconds);
+	CHECK(shallow.latency.GetMax() <= LatencyBound(0) + 20.0);
+	std::printf("20 ms jitter: judder %.2f ms at depth 0, latency %.2f ms\n", shallow.judder.GetMean(), shallow.latency.GetMean());
+}
+
+static void TestBursts() {
+	// Frames arrive three at a time, when the third is taken.
+	Trace trace = MakeTrace(90, 7);
+	for (size_t i = 0; i < trace.arrivals.size(); i++) {
+		trace.arrivals[i] = int64_t(i / 3 * 3 + 2) * Interval + Transport;
+	}
+	PacingStats deep = Play(trace, 2);
+	CHECK(deep.presented == 90 && deep.skipped == 0 && deep.overflowed == 0 && deep.underruns == 0);
+	CHECK(deep.judder.GetMax() <= VsyncMilliseconds + 0.001);
+	CHECK(deep.latency.GetMax() <= LatencyBound(2));
+	for (unsigned depth = 0; depth < 2; depth++) {
+		PacingStats stats = Play(trace, depth);
+		CHECK(stats.presented < 90 && stats.skipped + stats.overflowed == 90 - stats.presented);
+		CHECK(stats.latency.GetMax() <= LatencyBound(depth) + 2 * Interval / 10000.0);
+	}
+}
+
+static void TestGap() {
+	// The source pauses for a fifth of a second: six frames never come.
+	Trace steady = MakeTrace(90, 0);
+	Trace trace;
+	for (size_t i = 0; i < steady.timestamps.size(); i++) {
+		if (i < 30 || i >= 36) {
+			trace.timestamps.push_back(steady.timestamps[i]);
+			trace.arrivals.push_back(steady.arrivals[i]);
+		}
+	}
+	for (unsigned depth = 0; depth <= FramePacer::MaxDepth; depth++) {
+		PacingStats stats = Play(trace, depth);
+		CHECK(stats.presented == 84 && stats.skipped == 0 && stats.resets == 0);
+		CHECK(stats.underruns == 1);
+		// Frames either side of the pause keep their spacing.
+		CHECK(stats.judder.GetMax() <= VsyncMilliseconds + 0.001);
+	}
+
+	// Three separate pauses are three underruns.
+	Trace gaps;
+	for (size_t i = 0; i < steady.timestamps.size(); i++) {
+		if (i % 25 < 20) {
+			gaps.timestamps.push_back(steady.timestamps[i]);
+			gaps.arrivals.push_back(steady.arrivals[i]);
+		}
+	}
+	CHECK(Play(gaps, 1).underruns == 3);
+}
+
+static void TestRestart() {
+	// A new stream whose timestamps start over.
+	Trace trace = MakeTrace(40, 5000000000);
+	Trace second = MakeTrace(40, 0);
+	for (size_t i = 0; i < second.timestamps.size(); i++) {
+		trace.timestamps.push_back(second.timestamps[i]);
+		trace.arrivals.push_back(second.arrivals[i] + 40 * Interval);
+	}
+	PacingStats stats = Play(trace, 1);
+	CHECK(stats.resets == 1 && stats.pushed == 80);
+	CHECK(stats.presented + stats.skipped + stats.overflowed + 2 >= 80 && stats.presented >= 76);
+	CHECK(stats.underruns == 0);
+
+	FramePacer pacer;
+	pacer.SetDepth(5);
+	CHECK(pacer.GetDepth() == FramePacer::MaxDepth);
+	pacer.Push(1, 0, Transport);
+	pacer.Push(2, Interval, Interval + Transport);
+	CHECK(pacer.GetFrameInterval() == Interval && pacer.GetQueuedCount() == 2);
+	pacer.Reset();
+	CHECK(pacer.GetQueuedCount() == 0 && pacer.GetFrameInterval() == 0 && !pacer.Select(10 * Interval).present);
+}
+
+int main() {
+	TestSteady();
+	TestJitter();
+	TestBursts();
+	TestGap();
+	TestRestart();
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,144 @@
+#include "GaussianPyramid.h"
+#include "TaskPool.h"
+#include "TestCheck.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace unigles;
+
+// The blocked, vectorized, threaded build is bit exact with the straight 5x5 reference
+// for odd sizes, tiny images and padded strides; a block writes exactly its rectangle;
+// and the filter keeps flat and linear images as they are. The benchmark prints what a
+// 1080p pyramid costs each way.
+
+static bool SameLevels(const GaussianPyramid& a, const GaussianPyramid& b) {
+	bool same = a.GetLevelCount() == b.GetLevelCount();
+	for (unsigned level = 0; same && level < a.GetLevelCount(); level++) {
+		same = a.GetLevel(level).width == b.GetLevel(level).width && a.GetLevel(level).height == b.GetLevel(level).height &&
+			a.GetLevel(level).pixels == b.GetLevel(level).pixels;
+	}
+	return same;
+}
+
+static void TestMatchesScalar() {
+	std::mt19937 random(47);
+	TaskPool pool(3);
+	for (unsigned width : { 1u, 2u, 3u, 5u, 17u, 18u, 33u, 255u, 513u, 1921u }) {
+		for (unsigned height : { 1u, 2u, 3u, 7u, 64u, 131u }) {
+			size_t stride = width + 13;
+			std::vector<uint8_t> image(stride * height);
+			for (uint8_t& value : image) {
+				value = uint8_t(random());
+			}
+			GaussianPyramid vectorized(GaussianPyramid::MaxLevels);
+			GaussianPyramid scalar(GaussianPyramid::MaxLevels);
+			vectorized.Build(image.data(), stride, width, height, &pool);
+			scalar.BuildScalar(image.data(), stride, width, height);
+			if (!CHECK(SameLevels(vectorized, scalar))) {
+				std::fprintf(stderr, "  at %ux%u\n", width, height);
+			}
+		}
+	}
+}
+
+static void TestBlock() {
+	std::mt19937 random(5);
+	std::vector<uint8_t> image(100 * 80);
+	for (uint8_t& value : image) {
+		value = uint8_t(random());
+	}
+	std::vector<uint8_t> whole(50 * 40);
+	std::vector<uint8_t> block(50 * 40, 0xab);
+	PyramidDownScalar(image.data(), 100, 100, 80, whole.data(), 50);
+	PyramidDownBlock(image.data(), 100, 100, 80, block.data(), 50, 7, 5, 31, 22);
+	unsigned wrong = 0;
+	for (unsigned y = 0; y < 40; y++) {
+		for (unsigned x = 0; x < 50; x++) {
+			bool inside = x >= 7 && x < 31 && y >= 5 && y < 22;
+			wrong += block[y * 50 + x] == (inside ? whole[y * 50 + x] : 0xab) ? 0 : 1;
+		}
+	}
+	CHECK(wrong == 0);
+}
+
+static void TestShapes() {
+	// A flat image stays flat on every level, which are halved rounding up.
+	std::vector<uint8_t> flat(640 * 480, 77);
+	GaussianPyramid pyramid(6);
+	pyramid.Build(flat.data(), 640, 640, 480);
+	CHECK(pyramid.GetLevelCount() == 6);
+	CHECK(pyramid.GetLevel(5).width == 20 && pyramid.GetLevel(5).height == 15);
+	size_t bytes = 0;
+	unsigned changed = 0;
+	for (unsigned level = 0; level < pyramid.GetLevelCount(); level++) {
+		for (uint8_t value : pyramid.GetLevel(level).pixels) {
+			changed += value == 77 ? 0 : 1;
+		}
+		bytes += pyramid.GetLevel(level).pixels.size();
+	}
+	CHECK(changed == 0);
+	CHECK(pyramid.GetBytes() == bytes);
+
+	// The kernel is symmetric, so away from the edges a ramp halves into a ramp twice as
+	// steep, sampled at the even pixels.
+	std::vector<uint8_t> ramp(64 * 8);
+	for (unsigned y = 0; y < 8; y++) {
+		for (unsigned x = 0; x < 64; x++) {
+			ramp[y * 64 + x] = uint8_t(2 * x);
+		}
+	}
+	std::vector<uint8_t> half(32 * 4);
+	PyramidDownScalar(ramp.data(), 64, 64, 8, half.data(), 32);
+	unsigned off = 0;
+	for (unsigned y = 0; y < 4; y++) {
+		for (unsigned x = 1; x < 31; x++) {
+			off += half[y * 32 + x] == 4 * x ? 0 : 1;
+		}
+	}
+	CHECK(off == 0);
+
+	// Nothing is left to halve below a single pixel.
+	uint8_t one = 5;
+	GaussianPyramid tiny(GaussianPyramid::MaxLevels);
+	tiny.Build(&one, 1, 1, 1);
+	CHECK(tiny.GetLevelCount() == 1 && tiny.GetLevel(0).pixels[0] == 5);
+}
+
+static void Benchmark() {
+	const unsigned width = 1920;
+	const unsigned height = 1080;
+	std::mt19937 random(1);
+	std::vector<uint8_t> image(width * height);
+	for (uint8_t& value : image) {
+		value = uint8_t(random());
+	}
+	GaussianPyramid pyramid(4);
+	TaskPool single(1);
+	auto measure = [&](const char* name, int mode) {
+		const int runs = 10;
+		auto start = std::chrono::steady_clock::now();
+		for (int run = 0; run < runs; run++) {
+			if (mode == 0) {
+				pyramid.BuildScalar(image.data(), width, width, height);
+			} else {
+				pyramid.Build(image.data(), width, width, height, mode == 1 ? &single : nullptr);
+			}
+		}
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+		std::printf("%-16s %7.3f ms per 1080p pyramid of 4 levels\n", name, milliseconds);
+	};
+	measure("scalar", 0);
+	measure("one thread", 1);
+	measure("default pool", 2);
+}
+
+int main() {
+	TestMatchesScalar();
+	TestBlock();
+	TestShapes();
+	Benchmark();
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,220 @@
+#include "GlGpuProfiler.h"
+#include "EglTestContext.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+using namespace unigles;
+
+// Against a fake timer query driver: every pass's elapsed time reaches the log at the
+// first BeginFrame after its results are available, CPU times are logged as the passes
+// end, queries are reused frame after frame and deleted with the profiler, a frame
+// still pending when its slot comes round again is discarded, and a disjoint read
+// discards every frame in flight. On the pbuffer the profiler logs CPU times whether or
+// not the driver has EXT_disjoint_timer_query, and GPU times where it does.
+
+static const unsigned Size = 16;
+
+// The fake driver: a query's result is the elapsed time set when it began.
+static std::map<GLuint, GLuint64> gElapsed;
+static GLuint gNextQuery = 1;
+static unsigned gGenerated = 0;
+static unsigned gDeleted = 0;
+static GLuint64 gNextElapsed = 0;
+static bool gAvailable = true;
+static bool gDisjoint = false;
+
+static void GL_APIENTRY FakeGenQueries(GLsizei n, GLuint* ids) {
+	for (GLsizei i = 0; i < n; i++) {
+		ids[i] = gNextQuery++;
+		gGenerated++;
+	}
+}
+
+static void GL_APIENTRY FakeDeleteQueries(GLsizei n, const GLuint* ids) {
+	for (GLsizei i = 0; i < n; i++) {
+		gElapsed.erase(ids[i]);
+		gDeleted++;
+	}
+}
+
+static void GL_APIENTRY FakeBeginQuery(GLenum, GLuint id) {
+	gElapsed[id] = gNextElapsed;
+}
+
+static void GL_APIENTRY FakeEndQuery(GLenum) {}
+
+static void GL_APIENTRY FakeGetQueryObjectuiv(GLuint, GLenum, GLuint* value) {
+	*value = gAvailable ? GL_TRUE : GL_FALSE;
+}
+
+static void GL_APIENTRY FakeGetQueryObjectui64v(GLuint id, GLenum, GLuint64* value) {
+	*value = gElapsed[id];
+}
+
+// Reading the flag clears it, as in the extension.
+static void GL_APIENTRY FakeGetIntegerv(GLenum, GLint* value) {
+	*value = gDisjoint ? 1 : 0;
+	gDisjoint = false;
+}
+
+static GlTimerQueries FakeQueries() {
+	GlTimerQueries queries;
+	queries.genQueries = FakeGenQueries;
+	queries.deleteQueries = FakeDeleteQueries;
+	queries.beginQuery = FakeBeginQuery;
+	queries.endQuery = FakeEndQuery;
+	queries.getQueryObjectuiv = FakeGetQueryObjectuiv;
+	queries.getQueryObjectui64v = FakeGetQueryObjectui64v;
+	queries.getIntegerv = FakeGetIntegerv;
+	return queries;
+}
+
+static void ResetFake() {
+	gElapsed.clear();
+	gGenerated = 0;
+	gDeleted = 0;
+	gAvailable = true;
+	gDisjoint = false;
+}
+
+static PassTiming Find(const GpuProfileLog& log, const std::string& name) {
+	for (const PassTiming& pass : log.GetPasses()) {
+		if (pass.name == name) {
+			return pass;
+		}
+	}
+	return PassTiming{ name, 0, 0, 0, 0, 0, 0, 0, 0 };
+}
+
+// Two passes of 2 and 3 ms.
+static void RunFrame(GlGpuProfiler& profiler) {
+	profiler.BeginFrame();
+	gNextElapsed = 2000000;
+	{
+		GlGpuPassScope scope(profiler, "scene");
+	}
+	gNextElapsed = 3000000;
+	profiler.BeginPass("overlay");
+	profiler.EndPass();
+	profiler.EndFrame();
+}
+
+static void TestCollection() {
+	ResetFake();
+	{
+		GpuProfileLog log;
+		GlGpuProfiler profiler(log, FakeQueries());
+		CHECK(profiler.IsSupported());
+		RunFrame(profiler);
+		// CPU times right away, GPU times at the next frame.
+		CHECK(Find(log, "scene").cpuSamples == 1 && Find(log, "scene").gpuSamples == 0);
+		profiler.BeginFrame();
+		profiler.EndFrame();
+		CHECK(Find(log, "scene").gpuSamples == 1 && Find(log, "scene").gpuLast == 2.0);
+		CHECK(Find(log, "overlay").gpuSamples == 1 && Find(log, "overlay").gpuLast == 3.0);
+
+		for (unsigned i = 0; i < 3 * GlGpuProfiler::Latency; i++) {
+			RunFrame(profiler);
+		}
+		profiler.BeginFrame();
+		PassTiming scene = Find(log, "scene");
+		CHECK(scene.cpuSamples == 1 + 3 * GlGpuProfiler::Latency && scene.gpuSamples == scene.cpuSamples);
+		CHECK(scene.gpuMean == 2.0 && scene.gpuMax == 2.0);
+		CHECK(log.GetDiscardedFrames() == 0);
+		// One query per pass and slot, whatever the number of frames.
+		CHECK(gGenerated == 2 * GlGpuProfiler::Latency);
+
+		// An end without a beginning is ignored.
+		profiler.EndPass();
+		CHECK(Find(log, "scene").cpuSamples == scene.cpuSamples && log.GetPasses().size() == 2);
+	}
+	CHECK(gDeleted == gGenerated && gElapsed.empty());
+}
+
+static void TestDiscarded() {
+	ResetFake();
+	GpuProfileLog log;
+	GlGpuProfiler profiler(log, FakeQueries());
+	// Nothing comes back for a whole round of slots: the oldest frame gives way.
+	gAvailable = false;
+	for (unsigned i = 0; i < GlGpuProfiler::Latency; i++) {
+		RunFrame(profiler);
+	}
+	CHECK(log.GetDiscardedFrames() == 0);
+	RunFrame(profiler);
+	CHECK(log.GetDiscardedFrames() == 1 && Find(log, "scene").gpuSamples == 0);
+	// The rest are still collected once they are back.
+	gAvailable = true;
+	profiler.BeginFrame();
+	CHECK(Find(log, "scene").gpuSamples == GlGpuProfiler::Latency);
+	profiler.EndFrame();
+
+	// A disjoint read throws away everything in flight.
+	gAvailable = false;
+	RunFrame(profiler);
+	RunFrame(profiler);
+	gAvailable = true;
+	gDisjoint = true;
+	profiler.BeginFrame();
+	profiler.EndFrame();
+	CHECK(log.GetDiscardedFrames() == 3 && Find(log, "scene").gpuSamples == GlGpuProfiler::Latency);
+	RunFrame(profiler);
+	profiler.BeginFrame();
+	CHECK(Find(log, "scene").gpuSamples == GlGpuProfiler::Latency + 1);
+}
+
+static void TestUnsupported() {
+	ResetFake();
+	GpuProfileLog log;
+	GlTimerQueries partial = FakeQueries();
+	partial.getQueryObjectui64v = nullptr;
+	GlGpuProfiler profiler(log, partial);
+	CHECK(!profiler.IsSupported());
+	for (unsigned i = 0; i < 2 * GlGpuProfiler::Latency; i++) {
+		RunFrame(profiler);
+	}
+	CHECK(Find(log, "scene").cpuSamples == 2 * GlGpuProfiler::Latency && Find(log, "scene").gpuSamples == 0);
+	CHECK(log.GetDiscardedFrames() == 0 && gGenerated == 0);
+}
+
+static void TestDriver() {
+	test::EglTestContext egl;
+	if (!test::CreateEglTestContext(Size, Size, egl)) {
+		std::fprintf(stderr, "no EGL display with GLES2 pbuffers, driver run skipped\n");
+		return;
+	}
+	GpuProfileLog log;
+	GlGpuProfiler profiler(log);
+	const unsigned frames = 3 * GlGpuProfiler::Latency;
+	for (unsigned i = 0; i < frames; i++) {
+		profiler.BeginFrame();
+		{
+			GlGpuPassScope scope(profiler, "clear");
+			glClearColor(0.25f, 0.5f, 0.75f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+		profiler.EndFrame();
+		// Results are only ever collected, never waited for; finishing makes them due.
+		glFinish();
+	}
+	profiler.BeginFrame();
+	PassTiming clear = Find(log, "clear");
+	CHECK(clear.cpuSamples == frames && clear.cpuMean >= 0.0);
+	if (profiler.IsSupported()) {
+		CHECK(clear.gpuSamples + log.GetDiscardedFrames() == frames && clear.gpuSamples > 0);
+	} else {
+		CHECK(clear.gpuSamples == 0 && log.GetDiscardedFrames() == 0);
+	}
+	CHECK(glGetError() == GL_NO_ERROR);
+}
+
+int main() {
+	TestCollection();
+	TestDiscarded();
+	TestUnsupported();
+	TestDriver();
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,130 @@
+#include "GpuResourceRegistry.h"
+#include "TestCheck.h"
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace unigles;
+
+// Device loss against a mock device: resources remember the device generation they
+// were created on, creating on a removed device throws like a failed HRESULT does, and
+// releasing never touches the device.
+
+struct MockDevice {
+	unsigned generation = 1;
+	bool removed = false;
+	unsigned failCreates = 0;		// Creates that fail even though the device is fine
+
+	unsigned Create() {
+		if (removed) {
+			throw std::runtime_error("device removed");
+		}
+		if (failCreates > 0) {
+			failCreates--;
+			throw std::runtime_error("out of memory");
+		}
+		return generation;
+	}
+};
+
+struct MockResource {
+	std::string name;
+	unsigned generation = 0;	// Zero while released
+};
+
+int main() {
+	GpuResourceRegistry registry;
+	MockDevice device;
+	std::vector<std::string> calls;
+	MockResource shader{ "shader" };
+	MockResource target{ "target" };
+	MockResource lazy{ "lazy" };
+	MockResource renderer{ "renderer" };
+
+	auto registerResource = [&](GpuDomain domain, MockResource& resource, bool eager) {
+		std::function<void()> create;
+		if (eager) {
+			create = [&]() {
+				resource.generation = device.Create();
+				calls.push_back("create " + resource.name);
+			};
+		}
+		return registry.Register(domain, resource.name, create, [&]() {
+			resource.generation = 0;
+			calls.push_back("release " + resource.name);
+		});
+	};
+	registerResource(GpuDomain::D3D, shader, true);
+	registerResource(GpuDomain::D3D, target, true);
+	GpuResourceRegistry::Handle lazyHandle = registerResource(GpuDomain::D3D, lazy, false);
+	registerResource(GpuDomain::Gl, renderer, true);
+	registry.SetLossProbe(GpuDomain::D3D, [&]() { return device.removed; });
+	CHECK((registry.GetNames(GpuDomain::D3D) == std::vector<std::string>{ "shader", "target", "lazy" }));
+
+	// First creation, in registration order; lazy resources are left to their owner.
+	CHECK(registry.Recreate(GpuDomain::D3D));
+	CHECK(registry.Recreate(GpuDomain::Gl));
+	CHECK((calls == std::vector<std::string>{ "create shader", "create target", "create renderer" }));
+	lazy.generation = device.Create();
+	CHECK(!registry.CheckLost(GpuDomain::D3D));
+	CHECK(!registry.CheckLost(GpuDomain::Gl));	// No probe
+
+	// The device goes away: the domain is released in reverse order, the other one stays.
+	calls.clear();
+	device.removed = true;
+	CHECK(registry.CheckLost(GpuDomain::D3D));
+	CHECK(registry.IsLost(GpuDomain::D3D) && !registry.IsLost(GpuDomain::Gl));
+	CHECK((calls == std::vector<std::string>{ "release lazy", "release target", "release shader" }));
+	CHECK(shader.generation == 0 && target.generation == 0 && lazy.generation == 0 && renderer.generation == 1);
+	// Further checks neither count another loss nor release again.
+	calls.clear();
+	CHECK(registry.CheckLost(GpuDomain::D3D));
+	CHECK(calls.empty());
+
+	// Rebuilding before the device is back fails and keeps the domain lost.
+	CHECK(!registry.Recreate(GpuDomain::D3D));
+	CHECK(registry.IsLost(GpuDomain::D3D));
+
+	// A new device, but a creation fails once: the next attempt rebuilds everything.
+	device.removed = false;
+	device.generation = 2;
+	device.failCreates = 1;
+	calls.clear();
+	CHECK(!registry.Recreate(GpuDomain::D3D));
+	CHECK(registry.IsLost(GpuDomain::D3D));
+	CHECK(registry.Recreate(GpuDomain::D3D));
+	CHECK(!registry.IsLost(GpuDomain::D3D));
+	CHECK(shader.generation == 2 && target.generation == 2);
+	CHECK((calls == std::vector<std::string>{ "create shader", "create target" }));
+
+	// Unregistered resources are neither released nor listed any more.
+	registry.Unregister(lazyHandle);
+	CHECK((registry.GetNames(GpuDomain::D3D) == std::vector<std::string>{ "shader", "target" }));
+
+	GpuRecoveryStats stats = registry.GetStats(GpuDomain::D3D);
+	CHECK(stats.losses == 1 && stats.recoveries == 1 && stats.failedRebuilds == 2);
+	CHECK(stats.lastMilliseconds >= 0.0 && stats.worstMilliseconds == stats.lastMilliseconds);
+
+	// Injected faults take the same path without a probe, and only once.
+	calls.clear();
+	registry.InjectLoss(GpuDomain::Gl);
+	CHECK(registry.CheckLost(GpuDomain::Gl));
+	CHECK(renderer.generation == 0 && shader.generation == 2);
+	CHECK(registry.Recreate(GpuDomain::Gl));
+	CHECK(!registry.CheckLost(GpuDomain::Gl));
+	CHECK(renderer.generation == 2);
+	CHECK((calls == std::vector<std::string>{ "release renderer", "create renderer" }));
+
+	// Release callbacks may use the registry; they run outside its lock.
+	registry.Register(GpuDomain::Gl, "reentrant", nullptr, [&]() {
+		CHECK(registry.IsLost(GpuDomain::Gl));
+		calls.push_back("reentrant saw " + std::to_string(registry.GetNames(GpuDomain::Gl).size()));
+	});
+	calls.clear();
+	registry.ReportLost(GpuDomain::Gl);
+	CHECK((calls == std::vector<std::string>{ "reentrant saw 2", "release renderer" }));
+	CHECK(registry.GetStats(GpuDomain::Gl).losses == 2);
+	return unigles::test::TestResult();
+}
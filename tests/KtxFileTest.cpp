@@ -0,0 +1,299 @@
+#include "KtxFile.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace unigles;
+
+// Files written here the way the KTX 1.1 and 2.0 specifications lay them out parse to
+// levels pointing at their data: KTX1 in either byte order, with key/value data and
+// padded levels, and KTX2 with its levels stored smallest first. Every header or index
+// that runs past the end, a level whose size does not match its dimensions, more levels
+// than the size allows, supercompression, cube maps, arrays, 3D and uncompressed data
+// are each refused with their own error and no levels. A mapped file parses like
+// memory.
+
+static const uint32_t GlBc1Rgb = 0x83F0;
+static const uint32_t GlRgba8 = 0x8058;
+static const uint32_t VkEtc2Rgb = 147;
+
+static void PutUint32(std::vector<uint8_t>& file, size_t offset, uint32_t value, bool bigEndian = false) {
+	for (unsigned i = 0; i < 4; i++) {
+		file[offset + i] = uint8_t(value >> (bigEndian ? 24 - 8 * i : 8 * i));
+	}
+}
+
+static void PutUint64(std::vector<uint8_t>& file, size_t offset, uint64_t value) {
+	for (unsigned i = 0; i < 8; i++) {
+		file[offset + i] = uint8_t(value >> (8 * i));
+	}
+}
+
+// Level l of a texture, filled with bytes that tell the levels apart.
+static std::vector<uint8_t> LevelData(CompressedFormat format, unsigned width, unsigned height, unsigned level) {
+	std::vector<uint8_t> data(CompressedImageSize(format, (std::max)(width >> level, 1u), (std::max)(height >> level, 1u)));
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = uint8_t(level * 64 + i);
+	}
+	return data;
+}
+
+struct Ktx1Fields {
+	uint32_t glType = 0;
+	uint32_t glFormat = 0;
+	uint32_t glInternalFormat = GlBc1Rgb;
+	uint32_t width = 8;
+	uint32_t height = 8;
+	uint32_t depth = 0;
+	uint32_t layers = 0;
+	uint32_t faces = 1;
+	uint32_t levels = 4;
+	uint32_t keyValueBytes = 16;
+};
+
+// A KTX 1.1 file; each level is its size followed by its data, padded to four bytes.
+static std::vector<uint8_t> MakeKtx1(const Ktx1Fields& fields, bool bigEndian) {
+	static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+	std::vector<uint8_t> file(64 + fields.keyValueBytes);
+	memcpy(file.data(), identifier, sizeof(identifier));
+	const uint32_t header[13] = { 0x04030201, fields.glType, 1, fields.glFormat, fields.glInternalFormat, 0, fields.width,
+		fields.height, fields.depth, fields.layers, fields.faces, fields.levels, fields.keyValueBytes };
+	for (unsigned i = 0; i < 13; i++) {
+		PutUint32(file, 12 + 4 * i, header[i], bigEndian);
+	}
+	CompressedFormat format = FormatFromGl(fields.glInternalFormat);
+	for (unsigned level = 0; level < (std::max)(fields.levels, 1u); level++) {
+		std::vector<uint8_t> data = LevelData(format, fields.width, fields.height, level);
+		size_t offset = file.size();
+		file.resize(offset + 4);
+		PutUint32(file, offset, uint32_t(data.size()), bigEndian);
+		file.insert(file.end(), data.begin(), data.end());
+		file.resize((file.size() + 3) & ~size_t(3));
+	}
+	return file;
+}
+
+struct Ktx2Fields {
+	uint32_t vkFormat = VkEtc2Rgb;
+	uint32_t width = 8;
+	uint32_t height = 4;
+	uint32_t depth = 0;
+	uint32_t layers = 0;
+	uint32_t faces = 1;
+	uint32_t levels = 3;
+	uint32_t supercompression = 0;
+};
+
+// A KTX 2.0 file without data format descriptor or key/value data; the level index
+// lists level 0 first while the data runs from the smallest level up.
+static std::vector<uint8_t> MakeKtx2(const Ktx2Fields& fields) {
+	static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	unsigned levels = (std::max)(fields.levels, 1u);
+	std::vector<uint8_t> file(80 + 24 * levels);
+	memcpy(file.data(), identifier, sizeof(identifier));
+	const uint32_t header[9] = { fields.vkFormat, 1, fields.width, fields.height, fields.depth, fields.layers, fields.faces,
+		fields.levels, fields.supercompression };
+	for (unsigned i = 0; i < 9; i++) {
+		PutUint32(file, 12 + 4 * i, header[i]);
+	}
+	CompressedFormat format = FormatFromVulkan(fields.vkFormat);
+	for (unsigned level = levels; level-- > 0;) {
+		std::vector<uint8_t> data = LevelData(format, fields.width, fields.height, level);
+		size_t entry = 80 + 24 * level;
+		PutUint64(file, entry, file.size());
+		PutUint64(file, entry + 8, data.size());
+		PutUint64(file, entry + 16, data.size());
+		file.insert(file.end(), data.begin(), data.end());
+	}
+	return file;
+}
+
+// The texture's levels are where, and what, the writer put.
+static bool LevelsMatch(const KtxTexture& texture, const std::vector<uint8_t>& file, CompressedFormat format, unsigned width, unsigned height, unsigned levels) {
+	bool match = texture.GetLevels().size() == levels && texture.GetFormat() == format &&
+		texture.GetWidth() == width && texture.GetHeight() == height;
+	size_t total = 0;
+	for (unsigned level = 0; match && level < levels; level++) {
+		const KtxLevel& entry = texture.GetLevels()[level];
+		std::vector<uint8_t> data = LevelData(format, width, height, level);
+		match = entry.width == (std::max)(width >> level, 1u) && entry.height == (std::max)(height >> level, 1u) &&
+			entry.size == data.size() && entry.data >= file.data() && entry.data + entry.size <= file.data() + file.size() &&
+			memcmp(entry.data, data.data(), data.size()) == 0;
+		total += data.size();
+	}
+	return match && texture.GetDataSize() == total;
+}
+
+static bool Refuses(const std::vector<uint8_t>& file, const char* error) {
+	KtxTexture texture;
+	bool refused = !texture.Parse(file.data(), file.size()) && texture.GetLevels().empty() && texture.GetDataSize() == 0;
+	if (texture.GetError() != error) {
+		std::fprintf(stderr, "  error \"%s\", expected \"%s\"\n", texture.GetError().c_str(), error);
+		refused = false;
+	}
+	return refused;
+}
+
+static void TestVersion1() {
+	Ktx1Fields fields;
+	for (bool bigEndian : { false, true }) {
+		std::vector<uint8_t> file = MakeKtx1(fields, bigEndian);
+		KtxTexture texture;
+		CHECK(texture.Parse(file.data(), file.size()) && texture.GetError().empty());
+		CHECK(texture.GetVersion() == 1);
+		CHECK(LevelsMatch(texture, file, CompressedFormat::Bc1Rgb, 8, 8, 4));
+	}
+
+	// Zero levels means one; an odd size and no key/value data.
+	fields.width = 5;
+	fields.height = 3;
+	fields.levels = 0;
+	fields.keyValueBytes = 0;
+	std::vector<uint8_t> file = MakeKtx1(fields, false);
+	KtxTexture texture;
+	CHECK(texture.Parse(file.data(), file.size()) && LevelsMatch(texture, file, CompressedFormat::Bc1Rgb, 5, 3, 1));
+
+	// A parse that fails forgets the texture before it.
+	std::vector<uint8_t> garbage(64, 0);
+	CHECK(!texture.Parse(garbage.data(), garbage.size()) && texture.GetLevels().empty() && texture.GetVersion() == 0);
+	CHECK(texture.GetFormat() == CompressedFormat::Unknown && texture.GetError() == "not a KTX file");
+}
+
+static void TestVersion2() {
+	Ktx2Fields fields;
+	std::vector<uint8_t> file = MakeKtx2(fields);
+	KtxTexture texture;
+	CHECK(texture.Parse(file.data(), file.size()) && texture.GetVersion() == 2);
+	CHECK(LevelsMatch(texture, file, CompressedFormat::Etc2Rgb, 8, 4, 3));
+	// The smallest level comes first in the file.
+	CHECK(texture.GetLevels().size() == 3 && texture.GetLevels()[2].data < texture.GetLevels()[0].data);
+
+	fields.vkFormat = 145;
+	fields.width = 16;
+	fields.height = 16;
+	fields.levels = 5;
+	file = MakeKtx2(fields);
+	CHECK(texture.Parse(file.data(), file.size()) && LevelsMatch(texture, file, CompressedFormat::Bc7, 16, 16, 5));
+}
+
+static void TestMalformedVersion1() {
+	Ktx1Fields fields;
+	std::vector<uint8_t> valid = MakeKtx1(fields, false);
+	CHECK(Refuses(std::vector<uint8_t>(valid.begin(), valid.begin() + 11), "too short for a KTX file"));
+	CHECK(Refuses(std::vector<uint8_t>(valid.begin(), valid.begin() + 63), "truncated KTX header"));
+
+	std::vector<uint8_t> file = valid;
+	PutUint32(file, 12, 0x12345678);
+	CHECK(Refuses(file, "bad KTX endianness marker"));
+	file = valid;
+	file[5] = '2';
+	CHECK(Refuses(file, "not a KTX file"));
+
+	// Key/value data running past the end, then a file ending right after it.
+	file = valid;
+	PutUint32(file, 60, uint32_t(valid.size()));
+	CHECK(Refuses(file, "truncated key/value data"));
+	CHECK(Refuses(std::vector<uint8_t>(valid.begin(), valid.begin() + 64 + 16 + 2), "truncated mip level size"));
+	// Level 0 cut short, then level 3's size missing.
+	CHECK(Refuses(std::vector<uint8_t>(valid.begin(), valid.begin() + 64 + 16 + 4 + 31), "truncated mip level"));
+	CHECK(Refuses(std::vector<uint8_t>(valid.begin(), valid.end() - 12), "truncated mip level size"));
+
+	file = valid;
+	PutUint32(file, 64 + 16, 33);
+	CHECK(Refuses(file, "mip level size does not match its dimensions"));
+	// The second level's size, as stored big endian.
+	file = MakeKtx1(fields, true);
+	PutUint32(file, 64 + 16 + 4 + 32, 16, true);
+	CHECK(Refuses(file, "mip level size does not match its dimensions"));
+
+	Ktx1Fields changed = fields;
+	changed.levels = 5;
+	CHECK(Refuses(MakeKtx1(changed, false), "more mip levels than the size allows"));
+	changed = fields;
+	changed.faces = 6;
+	CHECK(Refuses(MakeKtx1(changed, false), "only 2D textures are supported"));
+	changed = fields;
+	changed.layers = 2;
+	CHECK(Refuses(MakeKtx1(changed, false), "only 2D textures are supported"));
+	changed = fields;
+	changed.depth = 4;
+	CHECK(Refuses(MakeKtx1(changed, false), "only 2D textures are supported"));
+	changed = fields;
+	changed.height = 0;
+	CHECK(Refuses(MakeKtx1(changed, false), "empty or one dimensional texture"));
+	// Uncompressed data, and a compressed format with a type.
+	file = valid;
+	PutUint32(file, 28, GlRgba8);
+	CHECK(Refuses(file, "not a supported compressed format"));
+	file = valid;
+	PutUint32(file, 16, 0x1401);
+	CHECK(Refuses(file, "not a supported compressed format"));
+}
+
+static void TestMalformedVersion2() {
+	Ktx2Fields fields;
+	std::vector<uint8_t> valid = MakeKtx2(fields);
+	CHECK(Refuses(std::vector<uint8_t>(valid.begin(), valid.begin() + 79), "truncated KTX2 header"));
+	CHECK(Refuses(std::vector<uint8_t>(valid.begin(), valid.begin() + 80 + 3 * 24 - 1), "truncated level index"));
+	// Level 0 is stored last, so losing the final byte cuts it short.
+	CHECK(Refuses(std::vector<uint8_t>(valid.begin(), valid.end() - 1), "truncated mip level"));
+
+	std::vector<uint8_t> file = valid;
+	PutUint64(file, 80 + 8, 8);
+	CHECK(Refuses(file, "mip level size does not match its dimensions"));
+	file = valid;
+	PutUint64(file, 80, uint64_t(1) << 62);
+	CHECK(Refuses(file, "truncated mip level"));
+
+	Ktx2Fields changed = fields;
+	changed.supercompression = 2;
+	CHECK(Refuses(MakeKtx2(changed), "supercompressed KTX2 files are not supported"));
+	changed = fields;
+	changed.levels = 5;
+	CHECK(Refuses(MakeKtx2(changed), "more mip levels than the size allows"));
+	changed = fields;
+	changed.faces = 6;
+	CHECK(Refuses(MakeKtx2(changed), "only 2D textures are supported"));
+	changed = fields;
+	changed.layers = 4;
+	CHECK(Refuses(MakeKtx2(changed), "only 2D textures are supported"));
+	// RGBA8, which has no blocks.
+	changed = fields;
+	changed.vkFormat = 37;
+	CHECK(Refuses(MakeKtx2(changed), "not a supported compressed format"));
+}
+
+static void TestMappedFile() {
+	std::vector<uint8_t> file = MakeKtx1(Ktx1Fields(), false);
+	const std::string path = "KtxFileTest.ktx";
+	FILE* stream = std::fopen(path.c_str(), "wb");
+	CHECK(stream != nullptr && std::fwrite(file.data(), 1, file.size(), stream) == file.size());
+	if (stream != nullptr) {
+		std::fclose(stream);
+	}
+
+	MappedFile mapped;
+	CHECK(!mapped.IsOpen() && mapped.GetSize() == 0);
+	CHECK(mapped.Open(path) && mapped.GetSize() == file.size());
+	CHECK(memcmp(mapped.GetData(), file.data(), file.size()) == 0);
+	KtxTexture texture;
+	CHECK(texture.Parse(mapped.GetData(), mapped.GetSize()) && texture.GetLevels().size() == 4);
+	CHECK(!texture.GetLevels().empty() && texture.GetLevels()[0].data == mapped.GetData() + 64 + 16 + 4);
+	mapped.Close();
+	CHECK(!mapped.IsOpen() && mapped.GetData() == nullptr);
+	std::remove(path.c_str());
+	CHECK(!mapped.Open(path) && !mapped.IsOpen());
+}
+
+int main() {
+	TestVersion1();
+	TestVersion2();
+	TestMalformedVersion1();
+	TestMalformedVersion2();
+	TestMappedFile();
+	return unigles::test::TestResult();
+}
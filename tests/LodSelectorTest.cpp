@@ -0,0 +1,144 @@
+#include "LodSelector.h"
+#include "TestCheck.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace unigles;
+
+// A mesh level is taken once its projected error fits the budget, less the hysteresis
+// when it is coarser than the current one; a texture variant once its extent covers the
+// footprint, with the same margin. An object moving back and forth across a threshold
+// switches once, not every frame, while without hysteresis it would flicker. The stats
+// add up what each frame drew against what the full levels would have.
+
+static std::vector<MeshLod> Chain() {
+	// At 1000 pixels per unit the coarser levels fit from 12.5 and 62.5 units away.
+	return std::vector<MeshLod>({ MeshLod{ 0.0f, 1000 }, MeshLod{ 0.01f, 500 }, MeshLod{ 0.05f, 100 } });
+}
+
+static void TestProjection() {
+	float projection[16] = {};
+	projection[5] = 2.0f;
+	CHECK(LodSelector::PixelsPerUnit(projection, 600) == 600.0f);
+	LodSelector selector;
+	selector.BeginFrame(1000.0f);
+	CHECK(std::fabs(selector.ScreenError(0.01f, 10.0f) - 1.0f) < 1.0e-6f);
+	// Too close to divide by stays finite.
+	CHECK(std::isfinite(selector.ScreenError(0.01f, 0.0f)));
+}
+
+static void TestMeshThresholds() {
+	LodSelector selector;
+	std::vector<MeshLod> levels = Chain();
+	selector.BeginFrame(1000.0f);
+	// Going coarser needs 0.8 pixels.
+	CHECK(selector.SelectMesh(levels, 12.0f, 0) == 0);
+	CHECK(selector.SelectMesh(levels, 13.0f, 0) == 1);
+	CHECK(selector.SelectMesh(levels, 60.0f, 0) == 1);
+	CHECK(selector.SelectMesh(levels, 63.0f, 0) == 2);
+	CHECK(selector.SelectMesh(levels, 63.0f, 1) == 2);
+	// Staying, or going finer, is judged against the full pixel.
+	CHECK(selector.SelectMesh(levels, 11.0f, 1) == 1);
+	CHECK(selector.SelectMesh(levels, 9.9f, 1) == 0);
+	CHECK(selector.SelectMesh(levels, 51.0f, 2) == 2);
+	CHECK(selector.SelectMesh(levels, 49.0f, 2) == 1);
+	CHECK(selector.SelectMesh(std::vector<MeshLod>(), 100.0f, 0) == 0);
+
+	// Nine selections above, three of them keeping the current level.
+	const LodStats& stats = selector.GetStats();
+	CHECK(stats.trianglesFull == 9 * 1000);
+	CHECK(stats.trianglesDrawn == 1000 + 500 + 500 + 100 + 100 + 500 + 1000 + 100 + 500);
+	CHECK(stats.switches == 6);
+	CHECK(stats.TriangleSavings() > 0.0 && stats.TriangleSavings() < 1.0);
+	selector.BeginFrame(1000.0f);
+	CHECK(selector.GetStats().trianglesFull == 0 && selector.GetStats().switches == 0 && selector.GetStats().TriangleSavings() == 0.0);
+}
+
+static void TestTextureThresholds() {
+	LodSelector selector;
+	selector.BeginFrame(1000.0f);
+	// 1024x512 with variants of 512, 256 and 128 texels across.
+	CHECK(selector.SelectTexture(1024, 512, 4, 1100.0f, 0) == 0);
+	CHECK(selector.SelectTexture(1024, 512, 4, 400.0f, 0) == 1);
+	CHECK(selector.SelectTexture(1024, 512, 4, 100.0f, 0) == 3);
+	CHECK(selector.SelectTexture(1024, 512, 4, 120.0f, 0) == 2);
+	CHECK(selector.SelectTexture(1024, 512, 4, 120.0f, 3) == 3);
+	CHECK(selector.SelectTexture(1024, 512, 4, 130.0f, 3) == 2);
+	CHECK(selector.SelectTexture(1024, 512, 1, 10.0f, 0) == 0);
+	const LodStats& stats = selector.GetStats();
+	CHECK(stats.texelsFull == 7 * 1024 * 512);
+	CHECK(stats.texelsSampled == 2 * 1024 * 512 + 512 * 256 + 128 * 64 + 2 * 256 * 128 + 128 * 64);
+	CHECK(stats.switches == 4);
+
+	// Sharper settings want more texels per pixel.
+	LodSettings settings;
+	settings.texelsPerPixel = 2.0f;
+	LodSelector sharp(settings);
+	sharp.BeginFrame(1000.0f);
+	CHECK(sharp.SelectTexture(1024, 512, 4, 100.0f, 0) == 2);
+}
+
+// Counts level changes of an object swinging between two distances for a hundred frames.
+static unsigned MeshSwitches(float hysteresis, float closer, float farther) {
+	LodSettings settings;
+	settings.hysteresis = hysteresis;
+	LodSelector selector(settings);
+	std::vector<MeshLod> levels = Chain();
+	unsigned level = 0;
+	unsigned switches = 0;
+	for (unsigned frame = 0; frame < 100; frame++) {
+		selector.BeginFrame(1000.0f);
+		level = selector.SelectMesh(levels, frame % 2 ? closer : farther, level);
+		switches += selector.GetStats().switches;
+	}
+	return switches;
+}
+
+static unsigned TextureSwitches(float hysteresis) {
+	LodSettings settings;
+	settings.hysteresis = hysteresis;
+	LodSelector selector(settings);
+	unsigned level = 0;
+	unsigned switches = 0;
+	for (unsigned frame = 0; frame < 100; frame++) {
+		selector.BeginFrame(1000.0f);
+		level = selector.SelectTexture(1024, 512, 4, frame % 2 ? 250.0f : 262.0f, level);
+		switches += selector.GetStats().switches;
+	}
+	return switches;
+}
+
+static void TestHysteresis() {
+	// Around the 10 units where the full pixel runs out, and the 12.5 where 0.8 does.
+	CHECK(MeshSwitches(0.2f, 9.7f, 10.3f) == 0);
+	CHECK(MeshSwitches(0.0f, 9.7f, 10.3f) > 90);
+	CHECK(MeshSwitches(0.2f, 12.3f, 12.7f) == 1);
+	CHECK(TextureSwitches(0.2f) == 1);
+	CHECK(TextureSwitches(0.0f) > 90);
+
+	// Approaching from afar the coarse level holds until the full pixel is used up.
+	LodSelector selector;
+	std::vector<MeshLod> levels = Chain();
+	unsigned level = 2;
+	unsigned switches = 0;
+	for (float distance = 100.0f; distance > 5.0f; distance -= 0.5f) {
+		selector.BeginFrame(1000.0f);
+		unsigned next = selector.SelectMesh(levels, distance, level);
+		CHECK(next <= level);
+		if (next == 1 && level == 2) {
+			CHECK(distance < 50.0f);
+		}
+		level = next;
+		switches += selector.GetStats().switches;
+	}
+	CHECK(level == 0 && switches == 2);
+}
+
+int main() {
+	TestProjection();
+	TestMeshThresholds();
+	TestTextureThresholds();
+	TestHysteresis();
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,106 @@
+#include "LumaChangeDetector.h"
+#include "TestCheck.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace unigles;
+
+// Skipping starts after quietFrames calm frames, a change dirties only the tiles it
+// touches, and a drift too slow to notice frame to frame still adds up to a change.
+
+static const unsigned Width = 100;
+static const unsigned Height = 70;
+static const size_t Stride = 104;
+
+static void TestStaticScene() {
+	ChangeDetectorSettings settings;
+	settings.tileSize = 16;
+	settings.quietFrames = 3;
+	LumaChangeDetector detector(settings);
+	std::vector<uint8_t> image(Stride * Height, 50);
+
+	// The first frame is processed, and so are quiet ones until there were three.
+	for (unsigned frame = 0; frame < 3; frame++) {
+		CHECK(detector.Process(image.data(), Width, Height, Stride));
+	}
+	for (unsigned frame = 0; frame < 5; frame++) {
+		CHECK(!detector.Process(image.data(), Width, Height, Stride));
+	}
+	CHECK(detector.GetTilesX() == 7 && detector.GetTilesY() == 5);
+	CHECK(detector.GetStats().frames == 8 && detector.GetStats().skipped == 5);
+
+	// A bright block over x 40..59, y 20..29 covers tile columns 2 and 3 of row 1.
+	for (unsigned y = 20; y < 30; y++) {
+		for (unsigned x = 40; x < 60; x++) {
+			image[y * Stride + x] = 200;
+		}
+	}
+	CHECK(detector.Process(image.data(), Width, Height, Stride));
+	const std::vector<uint8_t>& mask = detector.GetDirtyMask();
+	for (unsigned ty = 0; ty < detector.GetTilesY(); ty++) {
+		for (unsigned tx = 0; tx < detector.GetTilesX(); tx++) {
+			bool expected = ty == 1 && (tx == 2 || tx == 3);
+			CHECK((mask[ty * detector.GetTilesX() + tx] != 0) == expected);
+		}
+	}
+
+	// Noise below the threshold settles back into skipping.
+	for (unsigned frame = 0; frame < 2; frame++) {
+		image[frame] ^= 1;
+		CHECK(detector.Process(image.data(), Width, Height, Stride));
+	}
+	CHECK(!detector.Process(image.data(), Width, Height, Stride));
+
+	detector.Reset();
+	CHECK(detector.Process(image.data(), Width, Height, Stride));
+	CHECK(detector.GetStats().frames == 1 && detector.GetStats().skipped == 0);
+}
+
+static void TestSlowDrift() {
+	ChangeDetectorSettings settings;
+	settings.quietFrames = 1;
+	settings.threshold = 6;
+	LumaChangeDetector detector(settings);
+	std::vector<uint8_t> image(Stride * Height, 100);
+	CHECK(detector.Process(image.data(), Width, Height, Stride));
+	CHECK(!detector.Process(image.data(), Width, Height, Stride));
+
+	// One level per frame never crosses the threshold against the previous frame, but
+	// the reference stays where it was while frames are skipped.
+	unsigned processedAt = 0;
+	for (unsigned frame = 1; frame <= 10 && processedAt == 0; frame++) {
+		for (uint8_t& value : image) {
+			value++;
+		}
+		if (detector.Process(image.data(), Width, Height, Stride)) {
+			processedAt = frame;
+		}
+	}
+	CHECK(processedAt == settings.threshold + 1);
+}
+
+static void TestRowSad() {
+	std::vector<uint8_t> a(77);
+	std::vector<uint8_t> b(77);
+	std::srand(7);
+	for (size_t i = 0; i < a.size(); i++) {
+		a[i] = uint8_t(std::rand());
+		b[i] = uint8_t(std::rand());
+	}
+	// Every length covers a different split between the vector loop and the tail.
+	for (unsigned count = 0; count <= a.size(); count++) {
+		uint32_t expected = 0;
+		for (unsigned i = 0; i < count; i++) {
+			expected += uint32_t(std::abs(int(a[i]) - int(b[i])));
+		}
+		CHECK(LumaChangeDetector::RowSad(a.data(), b.data(), count) == expected);
+	}
+}
+
+int main() {
+	TestStaticScene();
+	TestSlowDrift();
+	TestRowSad();
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,109 @@
+#include "LumaStatistics.h"
+#include "TaskPool.h"
+#include "TestCheck.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace unigles;
+
+// The vectorized, threaded kernel is bit exact with the scalar one for odd sizes,
+// padded strides and every tile layout, and the worker hands back what the kernel
+// computes for the newest plane it picked up.
+
+static bool SameStatistics(const LumaStatistics& a, const LumaStatistics& b) {
+	bool same = std::memcmp(a.histogram, b.histogram, sizeof(a.histogram)) == 0 && a.count == b.count && a.mean == b.mean &&
+		a.min == b.min && a.max == b.max && a.tileSize == b.tileSize && a.tilesX == b.tilesX && a.tilesY == b.tilesY &&
+		a.tiles.size() == b.tiles.size();
+	for (size_t i = 0; same && i < a.tiles.size(); i++) {
+		same = a.tiles[i].sum == b.tiles[i].sum && a.tiles[i].count == b.tiles[i].count && a.tiles[i].min == b.tiles[i].min &&
+			a.tiles[i].max == b.tiles[i].max;
+	}
+	return same;
+}
+
+static std::vector<uint8_t> RandomPlane(size_t stride, unsigned height) {
+	std::vector<uint8_t> plane(stride * height);
+	for (uint8_t& value : plane) {
+		// Mostly mid tones, with a share of highlights so min and max move per tile.
+		value = uint8_t(std::rand() % 200 + (std::rand() % 3 ? 0 : 55));
+	}
+	return plane;
+}
+
+static void TestMatchesScalar() {
+	std::srand(3);
+	TaskPool pool(3);
+	const unsigned sizes[][2] = { { 1, 1 }, { 15, 9 }, { 17, 33 }, { 640, 480 }, { 1283, 719 } };
+	for (const auto& size : sizes) {
+		size_t stride = size[0] + 13;
+		std::vector<uint8_t> plane = RandomPlane(stride, size[1]);
+		for (unsigned tileSize : { 0u, 16u, 50u, 64u }) {
+			LumaStatisticsSettings settings;
+			settings.tileSize = tileSize;
+			LumaStatistics vectorized;
+			LumaStatistics scalar;
+			ComputeLumaStatistics(plane.data(), size[0], size[1], stride, settings, vectorized, &pool);
+			ComputeLumaStatisticsScalar(plane.data(), size[0], size[1], stride, settings, scalar);
+			CHECK(SameStatistics(vectorized, scalar));
+			CHECK(vectorized.count == uint64_t(size[0]) * size[1]);
+		}
+	}
+}
+
+static void TestPercentile() {
+	// Values 0..99, one pixel each.
+	std::vector<uint8_t> plane(100);
+	for (unsigned i = 0; i < plane.size(); i++) {
+		plane[i] = uint8_t(i);
+	}
+	LumaStatistics statistics;
+	ComputeLumaStatistics(plane.data(), 10, 10, 10, LumaStatisticsSettings(), statistics);
+	CHECK(statistics.min == 0 && statistics.max == 99);
+	CHECK(statistics.mean == 49.5);
+	CHECK(statistics.Percentile(0.0) == 0);
+	CHECK(statistics.Percentile(0.5) == 49);
+	CHECK(statistics.Percentile(1.0) == 99);
+}
+
+static void TestWorker() {
+	const unsigned width = 320;
+	const unsigned height = 240;
+	LumaStatisticsSettings settings;
+	settings.tileSize = 32;
+	LumaStatisticsWorker worker(settings);
+	LumaStatistics result;
+	CHECK(!worker.GetLatest(result));
+	CHECK(worker.IsIdle());
+
+	std::shared_ptr<std::vector<uint8_t>> last;
+	for (uint64_t frame = 1; frame <= 20; frame++) {
+		last = std::make_shared<std::vector<uint8_t>>(RandomPlane(width, height));
+		worker.Submit(last, width, height, width, frame);
+	}
+	// Planes submitted while one was queued replaced it; the last one is always computed.
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while ((!worker.GetLatest(result) || result.frame != 20) && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(result.frame == 20);
+	CHECK(worker.IsIdle());
+	CHECK(worker.GetReplacedCount() < 20);
+	LumaStatistics expected;
+	ComputeLumaStatisticsScalar(last->data(), width, height, width, settings, expected);
+	expected.frame = 20;
+	CHECK(SameStatistics(result, expected));
+	// The worker lets go of a plane once it is done with it.
+	CHECK(last.use_count() == 1);
+}
+
+int main() {
+	TestMatchesScalar();
+	TestPercentile();
+	TestWorker();
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,203 @@
+#include "PipelineEdge.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace unigles;
+
+// Each drop reason is produced on purpose on one thread, then a producer and a consumer
+// run at mismatched speeds under every policy: the consumer sees items in the order they
+// were pushed, every pushed item is delivered, dropped or still queued, and pressure is
+// signalled as often as it is counted.
+
+typedef std::unique_ptr<int> Item;
+
+static int64_t Now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool Balanced(const EdgeStats& stats) {
+	return stats.pushed == stats.delivered + stats.Dropped() + stats.depth;
+}
+
+static void TestLatestWins() {
+	EdgeSettings settings;
+	settings.capacity = 2;
+	PipelineEdge<Item> edge("LatestWins", settings);
+	for (int i = 0; i < 5; i++) {
+		CHECK(edge.Push(Item(new int(i)), i));
+	}
+	// The three oldest were replaced; the consumer gets the two newest in order.
+	Item item;
+	CHECK(edge.TryPop(item, 5) && *item == 3);
+	CHECK(edge.TryPop(item, 5) && *item == 4);
+	CHECK(!edge.TryPop(item, 5));
+	EdgeStats stats = edge.GetStats();
+	CHECK(stats.drops[unsigned(DropReason::ConsumerSlow)] == 3);
+	CHECK(stats.Dropped() == 3 && stats.delivered == 2 && Balanced(stats));
+}
+
+static void TestBoundedQueue() {
+	EdgeSettings settings;
+	settings.policy = EdgePolicy::BoundedQueue;
+	settings.capacity = 2;
+	PipelineEdge<Item> edge("BoundedQueue", settings);
+	CHECK(edge.Push(Item(new int(0)), 0));
+	CHECK(edge.Push(Item(new int(1)), 1));
+	CHECK(!edge.Push(Item(new int(2)), 2));
+	Item item;
+	CHECK(edge.TryPop(item, 2) && *item == 0);
+	EdgeStats stats = edge.GetStats();
+	CHECK(stats.drops[unsigned(DropReason::ProducerBusy)] == 1);
+	CHECK(stats.depth == 1 && Balanced(stats));
+}
+
+static void TestBlockProducer() {
+	EdgeSettings settings;
+	settings.policy = EdgePolicy::BlockProducer;
+	settings.capacity = 1;
+	settings.blockTimeoutMilliseconds = 20;
+	PipelineEdge<Item> edge("BlockProducer", settings);
+	CHECK(edge.Push(Item(new int(0)), 0));
+	// Nobody takes the first item, so the second one times out.
+	CHECK(!edge.Push(Item(new int(1)), 1));
+	EdgeStats stats = edge.GetStats();
+	CHECK(stats.drops[unsigned(DropReason::ProducerBusy)] == 1);
+	CHECK(stats.blockedMilliseconds >= 15.0);
+	// A consumer making room lets a blocked producer through.
+	std::thread consumer([&]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		Item item;
+		CHECK(edge.TryPop(item, 2) && *item == 0);
+	});
+	CHECK(edge.Push(Item(new int(2)), 2));
+	consumer.join();
+	CHECK(edge.GetStats().depth == 1 && Balanced(edge.GetStats()));
+}
+
+static void TestStale() {
+	EdgeSettings settings;
+	settings.policy = EdgePolicy::BoundedQueue;
+	settings.capacity = 4;
+	settings.maxAge = 10;
+	PipelineEdge<Item> edge("Stale", settings);
+	CHECK(edge.Push(Item(new int(0)), 100));
+	// Older than what is already queued.
+	CHECK(!edge.Push(Item(new int(1)), 90));
+	CHECK(edge.Push(Item(new int(2)), 105));
+	// The first item waited too long; the second is still fresh.
+	Item item;
+	CHECK(edge.TryPop(item, 112) && *item == 2);
+	EdgeStats stats = edge.GetStats();
+	CHECK(stats.drops[unsigned(DropReason::StaleTimestamp)] == 2);
+	CHECK(stats.delivered == 1 && Balanced(stats));
+	// Clearing forgets the newest timestamp, as for a restarted pipeline.
+	edge.Clear();
+	CHECK(edge.Push(Item(new int(3)), 50));
+}
+
+static void TestPressure() {
+	EdgeSettings settings;
+	settings.policy = EdgePolicy::BoundedQueue;
+	settings.capacity = 8;
+	settings.highWater = 4;
+	PipelineEdge<Item> edge("Pressure", settings);
+	std::vector<bool> signals;
+	edge.SetPressureCallback([&](bool pressure) {
+		// Called outside the lock, so the edge can be queried.
+		CHECK(edge.IsUnderPressure() == pressure);
+		signals.push_back(pressure);
+	});
+	for (int i = 0; i < 6; i++) {
+		edge.Push(Item(new int(i)), i);
+	}
+	CHECK(edge.IsUnderPressure());
+	Item item;
+	for (int i = 0; i < 3; i++) {
+		edge.TryPop(item, 6);
+	}
+	// Still above half the high water level.
+	CHECK(edge.IsUnderPressure());
+	edge.TryPop(item, 6);
+	CHECK(!edge.IsUnderPressure());
+	CHECK((signals == std::vector<bool>{ true, false }));
+	EdgeStats stats = edge.GetStats();
+	CHECK(stats.pressureEvents == 1 && stats.highWaterMark == 6);
+}
+
+static void TestConcurrent(EdgePolicy policy, unsigned capacity, int produceMicroseconds, int consumeMicroseconds, int64_t maxAge) {
+	EdgeSettings settings;
+	settings.policy = policy;
+	settings.capacity = capacity;
+	settings.maxAge = maxAge;
+	settings.blockTimeoutMilliseconds = 5;
+	PipelineEdge<Item> edge(ToString(policy), settings);
+	std::atomic<uint64_t> pressureOn(0);
+	std::atomic<uint64_t> pressureOff(0);
+	edge.SetPressureCallback([&](bool pressure) {
+		(pressure ? pressureOn : pressureOff)++;
+	});
+	std::atomic<bool> done(false);
+	uint64_t consumed = 0;
+	bool ordered = true;
+	std::thread consumer([&]() {
+		int last = -1;
+		Item item;
+		while (!done || edge.GetStats().depth != 0) {
+			if (!edge.TryPop(item, Now())) {
+				std::this_thread::yield();
+				continue;
+			}
+			consumed++;
+			ordered = ordered && *item > last;
+			last = *item;
+			std::this_thread::sleep_for(std::chrono::microseconds(consumeMicroseconds));
+		}
+	});
+	const int count = 500;
+	for (int i = 0; i < count; i++) {
+		edge.Push(Item(new int(i)), Now());
+		std::this_thread::sleep_for(std::chrono::microseconds(produceMicroseconds));
+	}
+	done = true;
+	consumer.join();
+
+	EdgeStats stats = edge.GetStats();
+	CHECK(ordered);
+	CHECK(stats.pushed == uint64_t(count));
+	CHECK(stats.delivered == consumed && consumed > 0);
+	CHECK(stats.depth == 0 && Balanced(stats));
+	CHECK(stats.highWaterMark <= capacity);
+	CHECK(pressureOn == stats.pressureEvents);
+	CHECK(pressureOff + 1 >= pressureOn && pressureOff <= pressureOn);
+	if (policy != EdgePolicy::LatestWins) {
+		CHECK(stats.drops[unsigned(DropReason::ConsumerSlow)] == 0);
+	}
+	if (policy == EdgePolicy::LatestWins) {
+		CHECK(stats.drops[unsigned(DropReason::ProducerBusy)] == 0);
+	}
+	if (maxAge == 0) {
+		// Timestamps only go forward, so nothing is stale without an age limit.
+		CHECK(stats.drops[unsigned(DropReason::StaleTimestamp)] == 0);
+	}
+}
+
+int main() {
+	TestLatestWins();
+	TestBoundedQueue();
+	TestBlockProducer();
+	TestStale();
+	TestPressure();
+	for (EdgePolicy policy : { EdgePolicy::LatestWins, EdgePolicy::BoundedQueue, EdgePolicy::BlockProducer }) {
+		// A slow consumer, a fast one, and a slow one with an age limit.
+		TestConcurrent(policy, 4, 100, 300, 0);
+		TestConcurrent(policy, 4, 300, 100, 0);
+		TestConcurrent(policy, 8, 100, 300, 2000);
+	}
+	return unigles::test::TestResult();
+}
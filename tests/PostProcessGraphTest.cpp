@@ -0,0 +1,270 @@
+#include "PostProcessGraph.h"
+#include "PostProcessInterpreter.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace unigles;
+
+// Per-pixel passes ride along with the draw before them, and every neighbourhood pass
+// opens a draw of its own. Each stage reads the target the stage before it wrote, never
+// the one it writes, and a chain of any length gets by with two pooled targets. A fused
+// plan gives what its passes give run one draw at a time, up to the 8-bit rounding of
+// the skipped intermediates. The text format builds the same graphs, rejects malformed
+// lines with their number, and the shipped Assets/PostProcessing.txt parses.
+//
+//     PostProcessGraphTest <PostProcessing.txt>
+
+static std::shared_ptr<const std::vector<float>> IdentityLut(unsigned size) {
+	auto table = std::make_shared<std::vector<float>>();
+	for (unsigned b = 0; b < size; b++) {
+		for (unsigned g = 0; g < size; g++) {
+			for (unsigned r = 0; r < size; r++) {
+				table->push_back(r / float(size - 1));
+				table->push_back(g / float(size - 1));
+				table->push_back(b / float(size - 1));
+			}
+		}
+	}
+	return table;
+}
+
+static ColorCorrection Grade() {
+	ColorCorrection correction;
+	correction.exposure = 0.25f;
+	correction.contrast = 1.1f;
+	correction.saturation = 1.2f;
+	correction.gain[2] = 0.9f;
+	correction.lift[0] = 0.02f;
+	return correction;
+}
+
+// Gradients with a little noise, all in the midtones: a fused draw does not clip what
+// its passes hand each other, so the comparison only holds where no target would.
+static PostImage MidtoneImage(unsigned width, unsigned height, unsigned seed) {
+	std::mt19937 random(seed);
+	PostImage image;
+	image.Resize(width, height);
+	for (unsigned y = 0; y < height; y++) {
+		for (unsigned x = 0; x < width; x++) {
+			float* c = image.At(x, y);
+			c[0] = float(64 + 96 * x / width + random() % 5) / 255.0f;
+			c[1] = float(64 + 96 * y / height + random() % 5) / 255.0f;
+			c[2] = float(112 + random() % 5) / 255.0f;
+		}
+	}
+	return image;
+}
+
+static float MaxDifference(const PostImage& a, const PostImage& b) {
+	float difference = 0.0f;
+	for (size_t i = 0; i < a.rgb.size(); i++) {
+		difference = std::max(difference, std::fabs(a.rgb[i] - b.rgb[i]));
+	}
+	return difference;
+}
+
+// Every stage reads what the one before it wrote, from a slot other than its own.
+static bool ValidLifetimes(const PostProcessPlan& plan) {
+	bool valid = !plan.stages.empty() && plan.stages.front().input == PostStage::External &&
+		plan.stages.back().output == PostStage::External;
+	for (size_t s = 0; valid && s < plan.stages.size(); s++) {
+		const PostStage& stage = plan.stages[s];
+		valid = (s == 0 || stage.input == plan.stages[s - 1].output) &&
+			(s + 1 == plan.stages.size() || (stage.output >= 0 && unsigned(stage.output) < plan.poolSize)) &&
+			(stage.input == PostStage::External || stage.input != stage.output);
+	}
+	return valid;
+}
+
+static void TestFusion() {
+	PostProcessGraph graph;
+	graph.AddColorCorrection("grade", Grade())
+		.AddLut("look", 5, IdentityLut(5))
+		.AddSharpen("detail", 0.5f)
+		.AddColorCorrection("trim", ColorCorrection())
+		.AddBlur("soften", 1.5f);
+	CHECK(graph.GetPasses().size() == 6);
+
+	// The conversion takes the leading colour passes; the sharpen the one after it.
+	PostProcessPlan plan = graph.Compile(PostSource::Nv12);
+	CHECK(plan.stages.size() == 4);
+	CHECK(plan.stages[0].head < 0 && plan.stages[0].fused == std::vector<unsigned>({ 0, 1 }));
+	CHECK(plan.stages[1].head == 2 && plan.stages[1].fused == std::vector<unsigned>({ 3 }));
+	CHECK(plan.stages[2].head == 4 && plan.stages[2].fused.empty());
+	CHECK(plan.stages[3].head == 5 && plan.stages[3].fused.empty());
+	CHECK(plan.stages[0].name == "convert+grade+look");
+	CHECK(plan.stages[1].name == "detail+trim");
+	CHECK(plan.stages[3].name == "soften.v");
+	CHECK(plan.costs.size() == 6);
+	CHECK(plan.lutRegister == std::vector<int>({ -1, 2, -1, -1, -1, -1 }));
+	CHECK(plan.fusedBytesPerPixel < plan.unfusedBytesPerPixel);
+	for (const PostStage& stage : plan.stages) {
+		CHECK(stage.shader.find("PS(") != std::string::npos);
+	}
+
+	// From RGB a leading neighbourhood pass reads the source itself.
+	PostProcessGraph sharpenFirst;
+	sharpenFirst.AddSharpen("detail", 0.5f).AddColorCorrection("grade", Grade());
+	PostProcessPlan rgb = sharpenFirst.Compile(PostSource::Rgb);
+	CHECK(rgb.stages.size() == 1 && rgb.stages[0].head == 0 && rgb.stages[0].fused == std::vector<unsigned>({ 1 }));
+	CHECK(rgb.poolSize == 0);
+	PostProcessPlan nv12 = sharpenFirst.Compile(PostSource::Nv12);
+	CHECK(nv12.stages.size() == 2 && nv12.stages[0].head < 0 && nv12.stages[1].head == 0);
+
+	// Nothing to compile, nothing to run.
+	CHECK(PostProcessGraph().Compile(PostSource::Nv12).Empty());
+}
+
+static void TestLifetimes() {
+	for (unsigned blurs = 0; blurs <= 6; blurs++) {
+		PostProcessGraph graph;
+		graph.AddColorCorrection("grade", Grade());
+		for (unsigned i = 0; i < blurs; i++) {
+			graph.AddBlur("blur" + std::to_string(i), 1.0f + i).AddColorCorrection("trim" + std::to_string(i), ColorCorrection());
+		}
+		PostProcessPlan plan = graph.Compile(PostSource::Nv12);
+		size_t stages = 1 + 2 * blurs;
+		CHECK(plan.stages.size() == stages);
+		CHECK(ValidLifetimes(plan));
+		CHECK(plan.poolSize == (std::min)(stages - 1, size_t(2)));
+	}
+}
+
+static void TestFusedMatchesUnfused() {
+	PostProcessGraph graph;
+	graph.AddSharpen("detail", 0.6f)
+		.AddColorCorrection("grade", Grade())
+		.AddLut("look", 9, IdentityLut(9))
+		.AddBlur("soften", 1.2f)
+		.AddColorCorrection("trim", ColorCorrection());
+	PostImage input = MidtoneImage(37, 29, 3);
+
+	PostProcessInterpreter fused(graph.Compile(PostSource::Rgb));
+	PostImage fusedOutput;
+	fused.Execute(input, fusedOutput);
+	CHECK(fused.GetTimings().size() == fused.GetPlan().stages.size());
+
+	// The same passes one draw each, the way an unfused renderer would run them.
+	PostImage image = input;
+	for (const PostPass& pass : graph.GetPasses()) {
+		PostProcessGraph single;
+		single.AddColorCorrection("copy", ColorCorrection());
+		PostProcessPlan plan = single.Compile(PostSource::Rgb);
+		plan.passes[0] = pass;
+		std::copy(pass.params, pass.params + PostPass::ParamCount, plan.constants.begin() + PostProcessPlan::ParamsOffset);
+		if (!pass.IsPerPixel()) {
+			plan.stages[0].head = 0;
+			plan.stages[0].fused.clear();
+		} else if (pass.type == PostPassType::Lut3D) {
+			plan.lutRegister[0] = 2;
+		}
+		PostProcessInterpreter interpreter(plan);
+		PostImage output;
+		interpreter.Execute(image, output);
+		image = output;
+	}
+	CHECK(image.width == fusedOutput.width && image.height == fusedOutput.height);
+	float difference = MaxDifference(image, fusedOutput);
+	if (!CHECK(difference <= 2.0f / 255.0f)) {
+		std::fprintf(stderr, "  fused and unfused differ by %.1f levels\n", difference * 255.0f);
+	}
+
+	// An identity LUT leaves the image alone, up to the final rounding.
+	PostProcessGraph lut;
+	lut.AddLut("identity", 17, IdentityLut(17));
+	PostProcessInterpreter identity(lut.Compile(PostSource::Rgb));
+	PostImage same;
+	identity.Execute(input, same);
+	CHECK(MaxDifference(input, same) <= 0.5f / 255.0f);
+}
+
+static void TestParse() {
+	PostProcessGraph graph;
+	std::string error;
+	CHECK(ParsePostProcessGraph(
+		"# comment\n"
+		"\n"
+		"color grade 0.25 1.1 1.2 1 1 0.9 0.02 0 0\t# trailing comment\n"
+		"sharpen\tdetail 0.5\n"
+		"color trim 0 1 1\n"
+		"blur soften 1.5\n", graph, &error));
+	PostProcessGraph expected;
+	expected.AddColorCorrection("grade", Grade())
+		.AddSharpen("detail", 0.5f)
+		.AddColorCorrection("trim", ColorCorrection())
+		.AddBlur("soften", 1.5f);
+	bool same = graph.GetPasses().size() == expected.GetPasses().size();
+	for (size_t i = 0; same && i < expected.GetPasses().size(); i++) {
+		const PostPass& a = graph.GetPasses()[i];
+		const PostPass& b = expected.GetPasses()[i];
+		same = a.name == b.name && a.type == b.type && std::equal(a.params, a.params + PostPass::ParamCount, b.params);
+	}
+	CHECK(same);
+
+	// Gain alone, without the lift.
+	PostProcessGraph gainOnly;
+	CHECK(ParsePostProcessGraph("color warm 0 1 1 1.1 1 0.9\n", gainOnly));
+	CHECK(gainOnly.GetPasses().size() == 1 && gainOnly.GetPasses()[0].params[4] == 0.0f);
+
+	const char* malformed[] = {
+		"blur soften\n",
+		"sharpen detail 0.5 0.5\n",
+		"color grade 0 1\n",
+		"color grade 0 1 1 1.1 1\n",
+		"color grade 0 1 1 1 1 1 0 0\n",
+		"lut look 17\n",
+		"sharpen detail x\n",
+	};
+	for (const char* text : malformed) {
+		PostProcessGraph rejected;
+		error.clear();
+		if (!CHECK(!ParsePostProcessGraph(std::string("sharpen ok 0.5\n") + text, rejected, &error))) {
+			std::fprintf(stderr, "  accepted %s", text);
+		}
+		CHECK(error.compare(0, 7, "line 2:") == 0);
+	}
+}
+
+static void TestShippedGraph(const char* path) {
+	std::ifstream file(path, std::ios::binary);
+	std::ostringstream text;
+	text << file.rdbuf();
+	PostProcessGraph graph;
+	std::string error;
+	if (!CHECK(file && ParsePostProcessGraph(text.str(), graph, &error))) {
+		std::fprintf(stderr, "%s: %s\n", path, error.c_str());
+	}
+	// Its example, uncommented, is a valid graph too.
+	std::string example;
+	std::istringstream lines(text.str());
+	std::string line;
+	while (std::getline(lines, line)) {
+		if (line.compare(0, 6, "#color") == 0 || line.compare(0, 8, "#sharpen") == 0) {
+			example += line.substr(1) + "\n";
+		}
+	}
+	PostProcessGraph uncommented;
+	CHECK(!example.empty() && ParsePostProcessGraph(example, uncommented) && uncommented.GetPasses().size() == 2);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: PostProcessGraphTest <PostProcessing.txt>\n");
+		return 2;
+	}
+	TestFusion();
+	TestLifetimes();
+	TestFusedMatchesUnfused();
+	TestParse();
+	TestShippedGraph(argv[1]);
+	return unigles::test::TestResult();
+}
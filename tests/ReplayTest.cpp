@@ -0,0 +1,254 @@
+#include "FeatureTracker.h"
+#include "GaussianPyramid.h"
+#include "LensRemap.h"
+#include "LumaChangeDetector.h"
+#include "PerfRecorder.h"
+#include "ReplayClip.h"
+#include "TemporalDenoiser.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace unigles;
+
+// Replays a recorded clip through the app's CPU frame path, the way ReadSoftwareBitmap
+// runs it: change detection, lens correction, denoising, the Gaussian pyramid and
+// feature tracking. The frames at a few checkpoints are compared with golden images,
+// the stage times and counters with data/ReplayBudgets.txt, and the vectorized run
+// with the scalar one.
+//
+//     ReplayTest <data directory> <PerfBudgets.txt> [--update]
+//
+// --update rewrites the golden images after an intended change of the output.
+//
+// data/replay_128x96.nv12 is twelve frames of a textured scene that pans with a bright
+// square moving over it for six frames, then holds still with two levels of noise.
+
+static const char* ClipName = "replay_128x96.nv12";
+static const unsigned ClipWidth = 128;
+static const unsigned ClipHeight = 96;
+static const unsigned Checkpoints[] = { 2, 5, 11 };
+static const unsigned PyramidLevels = 3;
+static const unsigned GoldenTolerance = 1;
+static const double MinPsnr = 45.0;
+
+struct ReplayImage {
+	std::string name;
+	GoldenImage image;
+};
+
+struct ReplayRun {
+	std::vector<ReplayImage> images;
+	std::vector<std::vector<FeaturePoint>> features;	// Per published frame
+	unsigned published = 0;
+};
+
+static GoldenImage ToImage(const uint8_t* pixels, unsigned width, unsigned height) {
+	GoldenImage image;
+	image.width = width;
+	image.height = height;
+	image.channels = 1;
+	image.pixels.assign(pixels, pixels + size_t(width) * height);
+	return image;
+}
+
+static LensModel ReplayLens() {
+	LensModel lens;
+	lens.width = ClipWidth;
+	lens.height = ClipHeight;
+	lens.fx = 110.0;
+	lens.fy = 110.0;
+	lens.cx = 63.5;
+	lens.cy = 47.5;
+	lens.k1 = -0.12;
+	lens.k2 = 0.02;
+	lens.zoom = 0.95;
+	return lens;
+}
+
+static ReplayRun Replay(const Nv12Clip& clip, bool vectorized, PerfRecorder& recorder) {
+	ReplayRun run;
+	LumaChangeDetector detector;
+	LensCorrector lens(ReplayLens());
+	TemporalDenoiser denoiser;
+	GaussianPyramid pyramids[2] = { GaussianPyramid(PyramidLevels), GaussianPyramid(PyramidLevels) };
+	unsigned pyramidWrite = 0;
+	FeatureTracker tracker;
+	Nv12Frame source;
+	Nv12Frame target;
+	for (unsigned index = 0; index < clip.GetFrameCount(); index++) {
+		CHECK(clip.ReadFrame(index, source));
+		bool publish;
+		{
+			PerfScope perf(recorder, "Detection");
+			publish = detector.Process(source.luma.data(), source.width, source.height, source.width);
+		}
+		recorder.AddCount("Detection", "processed", publish ? 1 : 0);
+		if (publish) {
+			run.published++;
+			{
+				PerfScope perf(recorder, "Lens");
+				if (vectorized) {
+					lens.Process(source, target);
+				} else {
+					lens.ProcessScalar(source, target);
+				}
+			}
+			{
+				PerfScope perf(recorder, "Denoise");
+				if (vectorized) {
+					denoiser.Process(target);
+				} else {
+					denoiser.ProcessScalar(target);
+				}
+			}
+			GaussianPyramid& pyramid = pyramids[pyramidWrite];
+			{
+				PerfScope perf(recorder, "Pyramid");
+				if (vectorized) {
+					pyramid.Build(target.luma.data(), target.width, target.width, target.height);
+				} else {
+					pyramid.BuildScalar(target.luma.data(), target.width, target.width, target.height);
+				}
+			}
+			{
+				PerfScope perf(recorder, "Features");
+				if (vectorized) {
+					tracker.Process(pyramids[1 - pyramidWrite], pyramid, target.features);
+				} else {
+					tracker.ProcessScalar(pyramids[1 - pyramidWrite], pyramid, target.features);
+				}
+			}
+			pyramidWrite = 1 - pyramidWrite;
+			const FeatureStats& stats = tracker.GetStats();
+			recorder.AddCount("Features", "tracked", stats.tracked);
+			recorder.AddCount("Features", "lost", stats.lost);
+			recorder.AddCount("Features", "detected", stats.detected);
+			run.features.push_back(target.features);
+		}
+		recorder.EndFrame();
+
+		for (unsigned checkpoint : Checkpoints) {
+			if (checkpoint != index) {
+				continue;
+			}
+			// The frame the subscribers would show, which is the last one published.
+			std::string prefix = "replay_" + std::to_string(index) + "_";
+			run.images.push_back({ prefix + "luma.pgm", ToImage(target.luma.data(), target.width, target.height) });
+			run.images.push_back({ prefix + "chroma.pgm", ToImage(target.chroma.data(), target.ChromaWidth() * 2, target.ChromaHeight()) });
+			const PyramidLevel& level = pyramids[1 - pyramidWrite].GetLevel(PyramidLevels - 1);
+			run.images.push_back({ prefix + "pyramid.pgm", ToImage(level.pixels.data(), level.width, level.height) });
+		}
+	}
+	return run;
+}
+
+static bool ReadText(const std::string& path, std::string& text) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	text = contents.str();
+	return true;
+}
+
+static bool SameFeatures(const std::vector<FeaturePoint>& a, const std::vector<FeaturePoint>& b) {
+	if (a.size() != b.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].error != b[i].error || a[i].id != b[i].id || a[i].age != b[i].age) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::fprintf(stderr, "usage: ReplayTest <data directory> <PerfBudgets.txt> [--update]\n");
+		return 2;
+	}
+	std::string data = std::string(argv[1]) + "/";
+	bool update = argc > 3 && std::strcmp(argv[3], "--update") == 0;
+
+	Nv12Clip clip;
+	if (!CHECK(clip.Open(data + ClipName, ClipWidth, ClipHeight))) {
+		return unigles::test::TestResult();
+	}
+	CHECK(clip.GetFrameCount() == 12);
+
+	PerfRecorder recorder;
+	ReplayRun run = Replay(clip, true, recorder);
+	PerfRecorder scalarRecorder;
+	ReplayRun scalar = Replay(clip, false, scalarRecorder);
+
+	// The static tail is skipped once the detector has seen enough quiet frames.
+	CHECK(run.published > 6 && run.published < clip.GetFrameCount());
+	CHECK(!run.features.empty() && run.features.back().size() > 20);
+
+	// Every kernel on the path is bit exact with its scalar version.
+	CHECK(scalar.published == run.published);
+	CHECK(scalar.images.size() == run.images.size());
+	for (size_t i = 0; i < run.images.size() && i < scalar.images.size(); i++) {
+		if (!CHECK(run.images[i].image.pixels == scalar.images[i].image.pixels)) {
+			std::fprintf(stderr, "%s differs from the scalar replay\n", run.images[i].name.c_str());
+		}
+	}
+	for (size_t i = 0; i < run.features.size() && i < scalar.features.size(); i++) {
+		if (!CHECK(SameFeatures(run.features[i], scalar.features[i]))) {
+			std::fprintf(stderr, "features of published frame %zu differ from the scalar replay\n", i);
+		}
+	}
+
+	for (const ReplayImage& output : run.images) {
+		std::string path = data + output.name;
+		if (update) {
+			CHECK(output.image.Write(path));
+			continue;
+		}
+		GoldenImage golden;
+		if (!CHECK(golden.Read(path))) {
+			std::fprintf(stderr, "no golden image %s; run with --update to create it\n", path.c_str());
+			continue;
+		}
+		ImageDifference difference = CompareImages(output.image, golden, GoldenTolerance);
+		std::printf("%s: PSNR %.1f dB, %llu of %llu values off by up to %u\n", output.name.c_str(), difference.psnr,
+			(unsigned long long)difference.differing, (unsigned long long)difference.values, difference.maxDifference);
+		CHECK(difference.sameShape);
+		CHECK(difference.Matches(0.001));
+		CHECK(difference.psnr >= MinPsnr);
+	}
+
+	// The budgets the app checks its render loop against must at least parse.
+	std::string text;
+	std::string error;
+	std::vector<PerfBudget> budgets;
+	CHECK(ReadText(argv[2], text));
+	if (!CHECK(ParsePerfBudgets(text, budgets, &error) && !budgets.empty())) {
+		std::fprintf(stderr, "%s: %s\n", argv[2], error.c_str());
+	}
+
+	budgets.clear();
+	CHECK(ReadText(data + "ReplayBudgets.txt", text));
+	if (!CHECK(ParsePerfBudgets(text, budgets, &error) && !budgets.empty())) {
+		std::fprintf(stderr, "ReplayBudgets.txt: %s\n", error.c_str());
+	}
+	std::vector<PerfBudgetResult> results = CheckPerfBudgets(recorder, budgets);
+	for (const PerfBudgetResult& result : results) {
+		std::printf("%s %s: %.3f of %.3f\n", result.budget.stage.c_str(), result.budget.metric.c_str(), result.measured, result.threshold);
+		if (!CHECK(result.passed)) {
+			std::fprintf(stderr, "%s %s over budget\n", result.budget.stage.c_str(), result.budget.metric.c_str());
+		}
+	}
+	std::ofstream report("replay_report.json");
+	WritePerfReport(report, recorder, results);
+	return unigles::test::TestResult();
+}
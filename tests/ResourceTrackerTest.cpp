@@ -0,0 +1,134 @@
+#include "ResourceTracker.h"
+#include "TestCheck.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace unigles;
+
+// Allocations are tagged by heap and subsystem, in the order subsystems first allocate;
+// live and peak bytes follow tracking, resizing, moving and releasing per heap and per
+// subsystem; only detailed tracking keeps records, with their names and formats; and a
+// check lists what is still live while counting every leaked resource only once, however
+// many checks find it.
+
+static void TestImageBytes() {
+	CHECK(ImageBytes(640, 480, 4) == 640 * 480 * 4);
+	// 4x2, 2x1, 1x1 and nothing below.
+	CHECK(ImageBytes(4, 2, 1, 8) == 8 + 2 + 1);
+	CHECK(ImageBytes(5, 3, 2, 2) == 5 * 3 * 2 + 2 * 1 * 2);
+}
+
+static void TestAccounting() {
+	ResourceTracker tracker;
+	CHECK(tracker.GetLevel() == TrackingLevel::Counters);
+	TrackedResource texture = tracker.Track(ResourceHeap::Gl, "Renderer", "RGBA8", 1000);
+	TrackedResource buffer = tracker.Track(ResourceHeap::Gl, "Renderer", "vertices", 200);
+	TrackedResource staging = tracker.Track(ResourceHeap::D3D, "Bridge", "NV12", 3000);
+	TrackedResource frames = tracker.Track(ResourceHeap::Host, "Frames", "NV12", 50);
+	CHECK(texture.IsTracked() && texture.GetBytes() == 1000);
+	CHECK(tracker.GetLiveBytes(ResourceHeap::Gl) == 1200);
+	CHECK(tracker.GetLiveBytes(ResourceHeap::D3D) == 3000);
+	CHECK(tracker.GetLiveBytes(ResourceHeap::Host) == 50);
+
+	std::vector<ResourceUsage> usage = tracker.GetUsage();
+	CHECK(usage.size() == 3);
+	CHECK(usage[0].subsystem == "Renderer" && usage[0].heap == ResourceHeap::Gl && usage[0].live == 2 && usage[0].liveBytes == 1200);
+	CHECK(usage[1].subsystem == "Bridge" && usage[1].heap == ResourceHeap::D3D);
+	CHECK(usage[2].subsystem == "Frames" && usage[2].heap == ResourceHeap::Host);
+	// Counters only: no records.
+	CHECK(tracker.GetLiveRecords().empty());
+
+	// Growing raises the peak, shrinking and releasing leave it.
+	buffer.Resize(800);
+	CHECK(tracker.GetLiveBytes(ResourceHeap::Gl) == 1800 && tracker.GetPeakBytes(ResourceHeap::Gl) == 1800);
+	buffer.Resize(100);
+	texture.Reset();
+	CHECK(!texture.IsTracked() && texture.GetBytes() == 0);
+	texture.Reset();
+	CHECK(tracker.GetLiveBytes(ResourceHeap::Gl) == 100 && tracker.GetPeakBytes(ResourceHeap::Gl) == 1800);
+	usage = tracker.GetUsage();
+	CHECK(usage[0].live == 1 && usage[0].allocations == 2 && usage[0].releases == 1 && usage[0].peakBytes == 1800);
+
+	// Moving hands the record over; replacing releases the old one.
+	TrackedResource moved(std::move(staging));
+	CHECK(!staging.IsTracked() && moved.IsTracked());
+	CHECK(tracker.GetLiveBytes(ResourceHeap::D3D) == 3000);
+	moved = tracker.Track(ResourceHeap::D3D, "Bridge", "NV12", 500);
+	CHECK(tracker.GetLiveBytes(ResourceHeap::D3D) == 500 && tracker.GetPeakBytes(ResourceHeap::D3D) == 3500);
+	CHECK(tracker.GetUsage()[1].live == 1);
+
+	// Per heap: the other heaps are untouched by all of this.
+	CHECK(tracker.GetLiveBytes(ResourceHeap::Host) == 50 && tracker.GetPeakBytes(ResourceHeap::Host) == 50);
+	// Untracked resources do nothing.
+	TrackedResource empty;
+	empty.Resize(10);
+	empty.Reset();
+	CHECK(tracker.GetLiveBytes(ResourceHeap::Gl) == 100);
+}
+
+static void TestDetailed() {
+	ResourceTracker tracker(TrackingLevel::Detailed);
+	TrackedResource first = tracker.Track(ResourceHeap::D3D, "Bridge", "BGRA8", 64, "shared");
+	TrackedResource second = tracker.Track(ResourceHeap::D3D, "Thumbnail", "R8", 16);
+	second.Resize(32);
+	std::vector<ResourceRecord> records = tracker.GetLiveRecords();
+	CHECK(records.size() == 2);
+	CHECK(records[0].subsystem == "Bridge" && records[0].name == "shared" && records[0].format == "BGRA8" && records[0].bytes == 64);
+	CHECK(records[1].subsystem == "Thumbnail" && records[1].name.empty() && records[1].bytes == 32);
+	CHECK(records[0].id < records[1].id && records[0].ageMilliseconds >= records[1].ageMilliseconds);
+	first.Reset();
+	records = tracker.GetLiveRecords();
+	CHECK(records.size() == 1 && records[0].subsystem == "Thumbnail");
+}
+
+static void TestLeaks(TrackingLevel level) {
+	ResourceTracker tracker(level);
+	TrackedResource kept = tracker.Track(ResourceHeap::Gl, "Renderer", "RGBA8", 400, "atlas");
+	TrackedResource released = tracker.Track(ResourceHeap::Gl, "Overlay", "A8", 100);
+	TrackedResource other = tracker.Track(ResourceHeap::D3D, "Bridge", "BGRA8", 900);
+	released.Reset();
+
+	ResourceLeaks leaks = tracker.CheckReleased(ResourceHeap::Gl);
+	CHECK(!leaks.Empty() && leaks.heap == ResourceHeap::Gl);
+	CHECK(leaks.resources == 1 && leaks.bytes == 400);
+	CHECK(leaks.subsystems.size() == 1 && leaks.subsystems[0].subsystem == "Renderer");
+	CHECK(leaks.records.size() == (level == TrackingLevel::Detailed ? 1u : 0u));
+	CHECK(leaks.Describe().find("Renderer") != std::string::npos);
+	CHECK(tracker.GetLeakCount() == 1);
+
+	// A leak found again is still one leak; a new one adds to it.
+	leaks = tracker.CheckReleased(ResourceHeap::Gl);
+	CHECK(leaks.resources == 1);
+	CHECK(tracker.GetLeakCount() == 1);
+	TrackedResource later = tracker.Track(ResourceHeap::Gl, "Renderer", "RGBA8", 10);
+	CHECK(tracker.CheckReleased(ResourceHeap::Gl).resources == 2);
+	CHECK(tracker.GetLeakCount() == 2);
+
+	// Releasing a counted leak does not make a later one look counted.
+	kept.Reset();
+	TrackedResource replacement = tracker.Track(ResourceHeap::Gl, "Renderer", "RGBA8", 20);
+	CHECK(tracker.CheckReleased(ResourceHeap::Gl).resources == 2);
+	CHECK(tracker.GetLeakCount() == 3);
+
+	// Another heap is checked on its own.
+	CHECK(tracker.CheckReleased(ResourceHeap::D3D).resources == 1);
+	CHECK(tracker.GetLeakCount() == 4);
+	later.Reset();
+	replacement.Reset();
+	other.Reset();
+	CHECK(tracker.CheckReleased(ResourceHeap::Gl).Empty());
+	CHECK(tracker.CheckReleased(ResourceHeap::D3D).Empty());
+	CHECK(tracker.CheckReleased(ResourceHeap::Host).Empty());
+	CHECK(tracker.GetLeakCount() == 4);
+}
+
+int main() {
+	TestImageBytes();
+	TestAccounting();
+	TestDetailed();
+	TestLeaks(TrackingLevel::Counters);
+	TestLeaks(TrackingLevel::Detailed);
+	return unigles::test::TestResult();
+}
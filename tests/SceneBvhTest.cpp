@@ -0,0 +1,169 @@
+#include "MathHelper.h"
+#include "SceneBvh.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace unigles;
+
+// Culling through the tree finds exactly the objects a test of every box finds, through
+// inserts, small moves, teleports and removals, and the tree stays balanced. The
+// benchmark does the same with a million objects seen through the app's camera and
+// reports how much of the scene the cull had to look at.
+//
+//     SceneBvhTest [objects]
+
+struct SceneObject {
+	Aabb bounds;
+	SceneBvh::Proxy proxy = SceneBvh::NullProxy;
+};
+
+static double Milliseconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Frustum CameraFrustum() {
+	MathHelper::Matrix4 viewProjection = MathHelper::MultiplyMatrices(MathHelper::SimpleProjectionMatrix(16.0f / 9.0f),
+		MathHelper::SimpleViewMatrix());
+	return Frustum::FromViewProjection(&viewProjection.m[0][0]);
+}
+
+// User data of every live object whose fat box touches the frustum, ascending.
+static std::vector<uint32_t> BruteForceCull(const SceneBvh& bvh, const std::vector<SceneObject>& objects, const Frustum& frustum) {
+	std::vector<uint32_t> visible;
+	for (size_t i = 0; i < objects.size(); i++) {
+		if (objects[i].proxy != SceneBvh::NullProxy && frustum.Test(bvh.GetFatBounds(objects[i].proxy)) != Frustum::Outside) {
+			visible.push_back(uint32_t(i));
+		}
+	}
+	return visible;
+}
+
+static std::vector<uint32_t> TreeCull(SceneBvh& bvh, const Frustum& frustum) {
+	std::vector<uint32_t> visible;
+	bvh.Cull(frustum, visible);
+	std::sort(visible.begin(), visible.end());
+	return visible;
+}
+
+static void Populate(SceneBvh& bvh, std::vector<SceneObject>& objects, unsigned count, float world, std::mt19937& random) {
+	std::uniform_real_distribution<float> position(-world, world);
+	std::uniform_real_distribution<float> extent(0.1f, 1.0f);
+	objects.resize(count);
+	for (unsigned i = 0; i < count; i++) {
+		objects[i].bounds = Aabb::FromCenterExtents(position(random), position(random) * 0.1f, position(random),
+			extent(random), extent(random), extent(random));
+		objects[i].proxy = bvh.Insert(objects[i].bounds, i);
+	}
+}
+
+static void Translate(Aabb& box, float dx, float dy, float dz) {
+	const float delta[3] = { dx, dy, dz };
+	for (int axis = 0; axis < 3; axis++) {
+		box.min[axis] += delta[axis];
+		box.max[axis] += delta[axis];
+	}
+}
+
+static void TestMatchesBruteForce() {
+	const unsigned count = 20000;
+	const float world = 60.0f;
+	std::mt19937 random(34);
+	SceneBvh bvh(0.1f);
+	std::vector<SceneObject> objects;
+	Populate(bvh, objects, count, world, random);
+	Frustum frustum = CameraFrustum();
+	CHECK(bvh.GetCount() == count);
+	// Within a few levels of a perfectly balanced tree.
+	CHECK(bvh.GetHeight() <= 2 * int(std::ceil(std::log2(double(count)))));
+	std::vector<uint32_t> visible = TreeCull(bvh, frustum);
+	CHECK(!visible.empty() && visible.size() < count);
+	CHECK(visible == BruteForceCull(bvh, objects, frustum));
+
+	std::uniform_real_distribution<float> step(-0.3f, 0.3f);
+	std::uniform_real_distribution<float> position(-world, world);
+	for (unsigned round = 0; round < 5; round++) {
+		// Jitter a tenth of the objects, teleport a hundredth and replace a few.
+		for (unsigned i = round; i < count; i += 10) {
+			Translate(objects[i].bounds, step(random), step(random), step(random));
+			bvh.Move(objects[i].proxy, objects[i].bounds);
+		}
+		for (unsigned i = round + 5; i < count; i += 100) {
+			objects[i].bounds = Aabb::FromCenterExtents(position(random), 0.0f, position(random), 0.5f, 0.5f, 0.5f);
+			bvh.Move(objects[i].proxy, objects[i].bounds);
+		}
+		for (unsigned i = round + 7; i < count; i += 500) {
+			bvh.Remove(objects[i].proxy);
+			objects[i].proxy = bvh.Insert(objects[i].bounds, i);
+		}
+		CHECK(TreeCull(bvh, frustum) == BruteForceCull(bvh, objects, frustum));
+	}
+	CHECK(bvh.GetRefitCount() > 0 && bvh.GetReinsertCount() > 0);
+	unsigned escaped = 0;
+	for (const SceneObject& object : objects) {
+		escaped += bvh.GetFatBounds(object.proxy).Contains(object.bounds) ? 0 : 1;
+	}
+	CHECK(escaped == 0);
+
+	// Removing every other object keeps the rest intact.
+	for (unsigned i = 0; i < count; i += 2) {
+		bvh.Remove(objects[i].proxy);
+		objects[i].proxy = SceneBvh::NullProxy;
+	}
+	CHECK(bvh.GetCount() == count / 2);
+	CHECK(TreeCull(bvh, frustum) == BruteForceCull(bvh, objects, frustum));
+	CHECK(bvh.GetHeight() <= 2 * int(std::ceil(std::log2(double(count / 2)))));
+}
+
+static void Benchmark(unsigned count) {
+	std::mt19937 random(1);
+	SceneBvh bvh(0.1f);
+	std::vector<SceneObject> objects;
+	auto start = std::chrono::steady_clock::now();
+	Populate(bvh, objects, count, 200.0f, random);
+	double insertMilliseconds = Milliseconds(start);
+	Frustum frustum = CameraFrustum();
+
+	std::vector<uint32_t> visible;
+	double cullMilliseconds = 1.0e9;
+	for (int run = 0; run < 10; run++) {
+		bvh.Cull(frustum, visible);
+		cullMilliseconds = (std::min)(cullMilliseconds, bvh.GetCullStats().milliseconds);
+	}
+	const CullStats& stats = bvh.GetCullStats();
+	start = std::chrono::steady_clock::now();
+	std::vector<uint32_t> expected = BruteForceCull(bvh, objects, frustum);
+	double bruteMilliseconds = Milliseconds(start);
+	std::sort(visible.begin(), visible.end());
+	CHECK(visible == expected);
+	// The camera sees about a sixth of the scene, and whole subtrees inside the frustum
+	// are taken without testing, so the tree tests far fewer boxes than there are objects.
+	CHECK(stats.visible > count / 10 && stats.visible < count / 4);
+	CHECK(stats.nodesTested < count / 4);
+
+	std::uniform_real_distribution<float> step(-0.3f, 0.3f);
+	start = std::chrono::steady_clock::now();
+	for (unsigned i = 0; i < count; i += 10) {
+		Translate(objects[i].bounds, step(random), step(random), step(random));
+		bvh.Move(objects[i].proxy, objects[i].bounds);
+	}
+	double moveMilliseconds = Milliseconds(start);
+
+	std::printf("%u objects: insert %.0f ms, height %d\n", count, insertMilliseconds, bvh.GetHeight());
+	std::printf("cull %.3f ms for %u visible, %u nodes tested; testing every box %.3f ms\n", cullMilliseconds, stats.visible,
+		stats.nodesTested, bruteMilliseconds);
+	std::printf("moving a tenth %.1f ms, %llu refits, %llu reinserts\n", moveMilliseconds,
+		(unsigned long long)bvh.GetRefitCount(), (unsigned long long)bvh.GetReinsertCount());
+}
+
+int main(int argc, char** argv) {
+	TestMatchesBruteForce();
+	Benchmark(argc > 1 ? unsigned(std::atoi(argv[1])) : 1000000);
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,128 @@
+#include "ShaderPermutations.h"
+#include "TestCheck.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace unigles;
+
+// Features take the next bit of the key in the order they are added, and a key is
+// valid only with its features' needs and without their exclusions. A variant's
+// defines follow the key's bits, and Generate puts them right after a leading #version
+// line, past any comments and blank lines before it, or at the very start without one.
+// The cache compiles each valid key once, caches failures too, and releases what it
+// built.
+
+static void TestKeys() {
+	ShaderPermutations permutations;
+	CHECK(permutations.GetValidKeys() == std::vector<PermutationKey>({ 0 }));
+	PermutationKey texture = permutations.AddFeature("CAMERA_TEXTURE");
+	PermutationKey planes = permutations.AddFeature("NV12_PLANES", texture);
+	PermutationKey fog = permutations.AddFeature("FOG");
+	PermutationKey lut = permutations.AddFeature("LUT", 0, fog);
+	CHECK(texture == 1 && planes == 2 && fog == 4 && lut == 8 && permutations.GetFeatureCount() == 4);
+
+	CHECK(permutations.IsValid(0) && permutations.IsValid(texture | planes) && permutations.IsValid(texture | fog));
+	CHECK(!permutations.IsValid(planes) && !permutations.IsValid(fog | lut));
+	// Bits past the last feature.
+	CHECK(!permutations.IsValid(16) && !permutations.IsValid(texture | 0x80000000u));
+	// Three texture choices, times no fog, fog, or the LUT.
+	std::vector<PermutationKey> keys = permutations.GetValidKeys();
+	CHECK(keys == std::vector<PermutationKey>({ 0, 1, 3, 4, 5, 7, 8, 9, 11 }));
+
+	CHECK(permutations.Describe(0) == "base" && permutations.GetDefines(0).empty());
+	CHECK(permutations.Describe(texture | planes | lut) == "CAMERA_TEXTURE+NV12_PLANES+LUT");
+	std::vector<std::pair<std::string, std::string>> defines = permutations.GetDefines(texture | fog);
+	CHECK(defines.size() == 2 && defines[0].first == "CAMERA_TEXTURE" && defines[1].first == "FOG");
+	CHECK(defines[0].second == "1" && defines[1].second == "1");
+
+	ShaderPermutations full;
+	for (unsigned i = 0; i < ShaderPermutations::MaxFeatures; i++) {
+		full.AddFeature("F" + std::to_string(i));
+	}
+	bool threw = false;
+	try {
+		full.AddFeature("ONE_TOO_MANY");
+	} catch (const std::length_error&) {
+		threw = true;
+	}
+	CHECK(threw && full.GetFeatureCount() == ShaderPermutations::MaxFeatures);
+	CHECK(full.IsValid(0xFFFF) && !full.IsValid(0x10000));
+}
+
+static void TestGenerate() {
+	ShaderPermutations permutations;
+	PermutationKey texture = permutations.AddFeature("CAMERA_TEXTURE");
+	PermutationKey fog = permutations.AddFeature("FOG");
+	const std::string defines = "#define CAMERA_TEXTURE 1\n#define FOG 1\n";
+
+	// Without #version the defines lead.
+	const std::string body = "precision mediump float;\nvoid main() {}\n";
+	CHECK(permutations.Generate(texture | fog, body) == defines + body);
+	CHECK(permutations.Generate(fog, body) == "#define FOG 1\n" + body);
+	CHECK(permutations.Generate(0, body) == body);
+	CHECK(permutations.Generate(texture, "") == "#define CAMERA_TEXTURE 1\n");
+
+	// With it they follow it, after whatever came first.
+	CHECK(permutations.Generate(texture | fog, "#version 100\n" + body) == "#version 100\n" + defines + body);
+	CHECK(permutations.Generate(texture | fog, "\n  \t#version 100\r\n" + body) == "\n  \t#version 100\r\n" + defines + body);
+	const std::string comments = "// Camera shader\n/* Two\n   lines */ \n";
+	CHECK(permutations.Generate(texture | fog, comments + "#version 100\n" + body) == comments + "#version 100\n" + defines + body);
+	CHECK(permutations.Generate(fog, "#version 300 es") == "#version 300 es\n#define FOG 1\n");
+	CHECK(permutations.Generate(0, "#version 100\n" + body) == "#version 100\n" + body);
+
+	// A #version further down is not leading; nor is one inside a comment.
+	const std::string late = body + "#version 100\n";
+	CHECK(permutations.Generate(fog, late) == "#define FOG 1\n" + late);
+	const std::string commented = "// #version 100\nvoid main() {}\n";
+	CHECK(permutations.Generate(fog, commented) == "#define FOG 1\n" + commented);
+	const std::string unterminated = "/* #version 100\n";
+	CHECK(permutations.Generate(fog, unterminated) == "#define FOG 1\n" + unterminated);
+}
+
+static void TestCache() {
+	ShaderPermutations permutations;
+	PermutationKey texture = permutations.AddFeature("CAMERA_TEXTURE");
+	PermutationKey planes = permutations.AddFeature("NV12_PLANES", texture);
+	std::vector<PermutationKey> compiled;
+	std::vector<uint32_t> released;
+	{
+		// The planes variant fails to compile.
+		ShaderVariantCache cache(permutations, [&](PermutationKey key, const ShaderPermutations& features) {
+			compiled.push_back(key);
+			CHECK(features.GetFeatureCount() == 2);
+			return key == (texture | planes) ? 0u : 100 + key;
+		}, [&](uint32_t handle) {
+			released.push_back(handle);
+		});
+		CHECK(cache.Get(texture) == 101 && cache.Get(texture) == 101 && cache.Get(0) == 100);
+		CHECK(cache.Get(planes) == 0);
+		CHECK(cache.Get(texture | planes) == 0 && cache.Get(texture | planes) == 0);
+		CHECK(compiled == std::vector<PermutationKey>({ texture, 0, texture | planes }));
+		const ShaderVariantStats& stats = cache.GetStats();
+		CHECK(stats.lookups == 6 && stats.misses == 3 && stats.compiled == 3 && stats.failed == 1);
+		CHECK(stats.compileMilliseconds >= stats.maxCompileMilliseconds && stats.maxCompileMilliseconds >= 0.0);
+		CHECK(cache.GetVariantCount() == 3);
+
+		cache.Clear();
+		CHECK(cache.GetVariantCount() == 0 && released.size() == 2);
+		// Ahead of time, every valid key once; invalid ones are passed over.
+		cache.Precompile(permutations.GetValidKeys());
+		cache.Precompile(std::vector<PermutationKey>({ planes, texture }));
+		CHECK(compiled.size() == 6 && cache.GetVariantCount() == 3 && cache.GetStats().misses == 3);
+		CHECK(cache.Get(0) == 100 && cache.GetStats().misses == 3);
+	}
+	// The destructor releases the successful variants, not the failure.
+	CHECK(released.size() == 4);
+	for (uint32_t handle : released) {
+		CHECK(handle != 0);
+	}
+}
+
+int main() {
+	TestKeys();
+	TestGenerate();
+	TestCache();
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,206 @@
+#include "SharedFrameRing.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+
+int main() {
+	std::fprintf(stderr, "the readers are forked processes\n");
+	return unigles::test::SkipExitCode;
+}
+
+#else
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace unigles;
+
+// A writer streams 720p NV12 frames through a four slot ring to reader processes: two
+// that keep up, one that takes 20 ms per frame and one that is killed while registered.
+// Every frame a reader releases as intact must hold exactly what was written for its
+// sequence, in order; the slow reader must lose frames rather than hold the writer up;
+// the dead reader must be reclaimed without evicting the live ones. Writer throughput
+// and per-reader latency are printed.
+
+static const unsigned Width = 1280;
+static const unsigned Height = 720;
+static const size_t FrameBytes = Width * Height * 3 / 2;
+static const unsigned FrameCount = 600;
+
+static int64_t Now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Fill(uint8_t* data, size_t bytes, uint64_t sequence) {
+	uint64_t value = sequence * 0x9E3779B97F4A7C15ull;
+	for (size_t i = 0; i + 8 <= bytes; i += 8) {
+		std::memcpy(data + i, &value, 8);
+		value += 0x632BE59BD9B4E019ull;
+	}
+}
+
+static bool Holds(const uint8_t* data, size_t bytes, uint64_t sequence) {
+	uint64_t value = sequence * 0x9E3779B97F4A7C15ull;
+	for (size_t i = 0; i + 8 <= bytes; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, data + i, 8);
+		if (word != value) {
+			return false;
+		}
+		value += 0x632BE59BD9B4E019ull;
+	}
+	return true;
+}
+
+// Runs in the child; its checks decide the exit code.
+static int Read(const std::string& name, unsigned id, unsigned sleepMicroseconds, unsigned frames, bool expectSkips) {
+	SharedFrameReader reader;
+	for (int attempt = 0; attempt < 1000 && !reader.Open(name); attempt++) {
+		usleep(1000);
+	}
+	if (!CHECK(reader.IsOpen())) {
+		return unigles::test::TestResult();
+	}
+	unsigned intact = 0;
+	unsigned corrupt = 0;
+	bool ordered = true;
+	uint64_t last = 0;
+	std::vector<double> latencies;
+	while (intact < frames && reader.GetWriterIdleMilliseconds() < 500.0) {
+		SharedFrameView view;
+		if (!reader.Acquire(view)) {
+			continue;
+		}
+		double latency = (Now() - view.info.timestamp) / 1000.0;
+		ordered = ordered && view.sequence > last;
+		last = view.sequence;
+		bool holds = view.info.frameNumber == view.sequence && view.info.bytes == FrameBytes &&
+			Holds(view.data, size_t(view.info.bytes), view.sequence);
+		if (sleepMicroseconds != 0) {
+			usleep(sleepMicroseconds);
+		}
+		// A frame overwritten while it was read may hold anything; one released as intact
+		// must be exactly what was written.
+		if (reader.Release(view)) {
+			corrupt += holds ? 0 : 1;
+			intact++;
+			latencies.push_back(latency);
+		}
+	}
+	const SharedReaderStats& stats = reader.GetStats();
+	CHECK(corrupt == 0);
+	CHECK(ordered);
+	CHECK(intact > 0);
+	CHECK(stats.evicted == 0);
+	CHECK(stats.frames == intact + stats.torn);
+	if (expectSkips) {
+		CHECK(stats.skipped > 0);
+	}
+	std::sort(latencies.begin(), latencies.end());
+	std::printf("reader %u: %u intact, %llu skipped, %llu torn, latency p50 %.1f us, p99 %.1f us\n", id, intact,
+		(unsigned long long)stats.skipped, (unsigned long long)stats.torn, latencies.empty() ? 0.0 : latencies[latencies.size() / 2],
+		latencies.empty() ? 0.0 : latencies[latencies.size() * 99 / 100]);
+	std::fflush(stdout);
+	return unigles::test::TestResult();
+}
+
+static void Publish(SharedFrameWriter& writer, uint64_t sequence) {
+	uint8_t* slot = writer.BeginWrite();
+	Fill(slot, FrameBytes, sequence);
+	SharedFrameInfo info;
+	info.width = Width;
+	info.height = Height;
+	info.format = MakeFourCC('N', 'V', '1', '2');
+	info.planeCount = 2;
+	info.planeOffsets[1] = Width * Height;
+	info.planeStrides[0] = Width;
+	info.planeStrides[1] = Width;
+	info.bytes = FrameBytes;
+	info.frameNumber = sequence;
+	info.timestamp = Now();
+	CHECK(writer.Publish(info) == sequence);
+}
+
+int main() {
+	const std::string name = "/unigles-ring-test-" + std::to_string(getpid());
+	SharedFrameWriter writer;
+	if (!writer.Create(name, 4, FrameBytes, 8)) {
+		std::fprintf(stderr, "no POSIX shared memory\n");
+		return unigles::test::SkipExitCode;
+	}
+	std::fflush(stdout);
+	const unsigned sleeps[] = { 0, 0, 20000 };
+	std::vector<pid_t> readers;
+	for (unsigned id = 0; id < 3; id++) {
+		pid_t child = fork();
+		if (child == 0) {
+			bool slow = sleeps[id] != 0;
+			_exit(Read(name, id, sleeps[id], slow ? 20 : FrameCount, slow));
+		}
+		readers.push_back(child);
+	}
+	pid_t victim = fork();
+	if (victim == 0) {
+		SharedFrameReader reader;
+		while (!reader.Open(name)) {
+			usleep(1000);
+		}
+		for (;;) {
+			pause();
+		}
+	}
+	// Every reader is registered before the first frame.
+	for (int attempt = 0; attempt < 2000 && writer.GetReaders().size() < 4; attempt++) {
+		usleep(1000);
+	}
+	CHECK(writer.GetReaders().size() == 4);
+
+	// As fast as the writer can go.
+	int64_t start = Now();
+	for (uint64_t sequence = 1; sequence <= FrameCount / 2; sequence++) {
+		Publish(writer, sequence);
+	}
+	double seconds = (Now() - start) / 1.0e9;
+	std::printf("writer: %u frames in %.3f s, %.0f fps, %.2f GB/s\n", FrameCount / 2, seconds, FrameCount / 2 / seconds,
+		FrameCount / 2 * double(FrameBytes) / seconds / 1.0e9);
+	std::fflush(stdout);
+	CHECK(writer.GetStats().slowFrames > 0);
+
+	// Then at camera pace, with the silent reader killed and reclaimed on the way.
+	kill(victim, SIGKILL);
+	waitpid(victim, nullptr, 0);
+	unsigned reclaimed = 0;
+	for (uint64_t sequence = FrameCount / 2 + 1; sequence <= FrameCount; sequence++) {
+		Publish(writer, sequence);
+		usleep(1000);
+		if (sequence % 50 == 0) {
+			reclaimed += writer.ReclaimStaleReaders(200.0);
+		}
+	}
+	CHECK(reclaimed == 1);
+	CHECK(writer.GetStats().reclaimed == 1);
+	CHECK(writer.GetStats().published == FrameCount);
+
+	for (pid_t child : readers) {
+		int status = 0;
+		waitpid(child, &status, 0);
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+	writer.Close();
+	// The creator removed the name.
+	SharedFrameReader late;
+	CHECK(!late.Open(name));
+	return unigles::test::TestResult();
+}
+
+#endif
@@ -0,0 +1,164 @@
+#include "StatsOverlay.h"
+#include "EglTestContext.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace unigles;
+
+// Rectangles, glyphs and graph bars each add one quad to the batch, blanks and empty
+// bars none, and the batch stops growing at MaxQuads; text is measured and bounded the
+// way it is laid out. Drawn on a pbuffer, the batch lands on the pixels it covers and
+// nowhere else, blends by its alpha, leaves the GL state it changed as it found it,
+// and its atlas and buffers are counted while the overlay lives. Needs an EGL display,
+// like StreamingUploaderTest.
+
+static const unsigned Width = 64;
+static const unsigned Height = 48;
+
+// RGBA of the pixel at x, y counted from the top left, like the overlay's coordinates.
+static const uint8_t* Pixel(const std::vector<uint8_t>& rgba, unsigned x, unsigned y) {
+	return &rgba[((Height - 1 - y) * Width + x) * 4];
+}
+
+static bool IsColor(const uint8_t* pixel, uint8_t r, uint8_t g, uint8_t b) {
+	const int tolerance = 2;
+	return std::abs(pixel[0] - r) <= tolerance && std::abs(pixel[1] - g) <= tolerance && std::abs(pixel[2] - b) <= tolerance;
+}
+
+static std::vector<uint8_t> ReadPixels() {
+	std::vector<uint8_t> rgba(Width * Height * 4);
+	glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+	return rgba;
+}
+
+static void TestBatching(StatsOverlay& overlay) {
+	overlay.SetScale(2);
+	overlay.Begin();
+	CHECK(overlay.GetQuadCount() == 0);
+	float left, top, right, bottom;
+	CHECK(!overlay.GetBounds(left, top, right, bottom));
+
+	overlay.AddRect(4.0f, 6.0f, 10.0f, 3.0f, 0xFFFFFFFF);
+	CHECK(overlay.GetQuadCount() == 1);
+	// Blanks advance without a quad; lower case draws like upper case.
+	overlay.AddText(10.0f, 20.0f, "Ab c\nD", 0xFFFFFFFF);
+	CHECK(overlay.GetQuadCount() == 5);
+	CHECK(overlay.GetBounds(left, top, right, bottom));
+	// The second line starts back at x and one line height down.
+	const float advance = float((StatsOverlay::GlyphWidth + 1) * 2);
+	CHECK(left == 4.0f && top == 6.0f);
+	CHECK(right == 10.0f + 3 * advance + StatsOverlay::GlyphWidth * 2);
+	CHECK(bottom == 20.0f + overlay.GetLineHeight() + StatsOverlay::GlyphHeight * 2);
+
+	unsigned width = 0;
+	unsigned height = 0;
+	overlay.MeasureText("Ab c\nD", width, height);
+	CHECK(width == 4 * unsigned(advance) && height == 2 * overlay.GetLineHeight());
+	overlay.MeasureText("", width, height);
+	CHECK(width == 0 && height == 0);
+
+	// Zero samples draw nothing; samples over the maximum fill the height and no more.
+	overlay.Begin();
+	overlay.AddGraph(0.0f, 0.0f, 40.0f, 10.0f, std::vector<double>({ 1.0, 0.0, 4.0, 2.0 }), 2.0, 0xFFFFFFFF);
+	CHECK(overlay.GetQuadCount() == 3);
+	CHECK(overlay.GetBounds(left, top, right, bottom) && top == 0.0f && bottom == 10.0f && left == 0.0f);
+	overlay.AddGraph(0.0f, 0.0f, 40.0f, 10.0f, std::vector<double>(), 2.0, 0xFFFFFFFF);
+	overlay.AddGraph(0.0f, 0.0f, 40.0f, 10.0f, std::vector<double>({ 1.0 }), 0.0, 0xFFFFFFFF);
+	CHECK(overlay.GetQuadCount() == 3);
+
+	overlay.Begin();
+	for (unsigned i = 0; i < StatsOverlay::MaxQuads + 10; i++) {
+		overlay.AddRect(0.0f, 0.0f, 1.0f, 1.0f, 0xFFFFFFFF);
+	}
+	CHECK(overlay.GetQuadCount() == StatsOverlay::MaxQuads);
+	overlay.Begin();
+}
+
+static void TestDraw(StatsOverlay& overlay) {
+	// State the overlay must hand back.
+	GLuint program = test::CreateTestProgram(
+		"attribute vec2 position;\nvoid main() { gl_Position = vec4(position, 0.0, 1.0); }\n",
+		"precision mediump float;\nvoid main() { gl_FragColor = vec4(1.0); }\n", "position");
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glUseProgram(program);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glDisable(GL_BLEND);
+	glEnable(GL_CULL_FACE);
+
+	glViewport(0, 0, Width, Height);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	overlay.SetScale(1);
+	overlay.Begin();
+	overlay.AddRect(8.0f, 8.0f, 16.0f, 8.0f, 0xFF0000FF);
+	overlay.AddRect(30.0f, 8.0f, 10.0f, 10.0f, 0x00FF0080);
+	overlay.AddText(40.0f, 30.0f, "T", 0xFFFFFFFF);
+	overlay.Draw(Width, Height);
+	std::vector<uint8_t> rgba = ReadPixels();
+
+	CHECK(IsColor(Pixel(rgba, 8, 8), 255, 0, 0) && IsColor(Pixel(rgba, 23, 15), 255, 0, 0));
+	CHECK(IsColor(Pixel(rgba, 7, 8), 0, 0, 0) && IsColor(Pixel(rgba, 24, 8), 0, 0, 0) && IsColor(Pixel(rgba, 8, 16), 0, 0, 0));
+	// Half the green over black.
+	CHECK(IsColor(Pixel(rgba, 35, 12), 0, 128, 0));
+	// A T: the top row across, the middle column down, nothing beside its stem.
+	for (unsigned x = 40; x < 45; x++) {
+		CHECK(IsColor(Pixel(rgba, x, 30), 255, 255, 255));
+	}
+	for (unsigned y = 30; y < 37; y++) {
+		CHECK(IsColor(Pixel(rgba, 42, y), 255, 255, 255));
+	}
+	CHECK(IsColor(Pixel(rgba, 40, 33), 0, 0, 0) && IsColor(Pixel(rgba, 44, 36), 0, 0, 0) && IsColor(Pixel(rgba, 42, 37), 0, 0, 0));
+	// Nothing outside the bounds.
+	float left, top, right, bottom;
+	CHECK(overlay.GetBounds(left, top, right, bottom));
+	unsigned stray = 0;
+	for (unsigned y = 0; y < Height; y++) {
+		for (unsigned x = 0; x < Width; x++) {
+			bool inside = x >= left && x < right && y >= top && y < bottom;
+			stray += !inside && !IsColor(Pixel(rgba, x, y), 0, 0, 0);
+		}
+	}
+	CHECK(stray == 0);
+
+	GLint current = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+	CHECK(GLuint(current) == program);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &current);
+	CHECK(GLuint(current) == buffer);
+	CHECK(!glIsEnabled(GL_BLEND) && glIsEnabled(GL_CULL_FACE));
+	CHECK(glGetError() == GL_NO_ERROR);
+
+	// An empty batch leaves the framebuffer alone.
+	overlay.Begin();
+	glClear(GL_COLOR_BUFFER_BIT);
+	overlay.Draw(Width, Height);
+	rgba = ReadPixels();
+	CHECK(IsColor(Pixel(rgba, 8, 8), 0, 0, 0));
+
+	glUseProgram(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDisable(GL_CULL_FACE);
+	glDeleteBuffers(1, &buffer);
+	glDeleteProgram(program);
+}
+
+int main() {
+	test::EglTestContext egl;
+	if (!test::CreateEglTestContext(Width, Height, egl)) {
+		std::fprintf(stderr, "no EGL display with GLES2 pbuffers\n");
+		return unigles::test::SkipExitCode;
+	}
+	ResourceTracker tracker;
+	{
+		StatsOverlay overlay(&tracker);
+		TestBatching(overlay);
+		TestDraw(overlay);
+		CHECK(tracker.GetUsage().size() == 1 && tracker.GetUsage()[0].live == 3);
+	}
+	CHECK(tracker.GetLiveBytes(ResourceHeap::Gl) == 0);
+	return unigles::test::TestResult();
+}
@@ -0,0 +1,122 @@
+#include "StreamingUploader.h"
+#include "EglTestContext.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace unigles;
+
+// Streams frames with a few dirty row bands each through the uploader and reads the
+// newest texture pair back after every upload: whatever set a frame lands in, it must
+// hold the whole frame, with the bands changed while the set was in flight caught up.
+// Needs an EGL display; ctest runs it on Mesa's surfaceless platform and reports it as
+// skipped where there is none.
+
+static const unsigned Width = 64;
+static const unsigned Height = 48;
+static const unsigned BandRows = 16;
+
+static const char* VertexShader =
+	"attribute vec2 position;\n"
+	"varying vec2 uv;\n"
+	"void main() {\n"
+	"	uv = position * 0.5 + 0.5;\n"
+	"	gl_Position = vec4(position, 0.0, 1.0);\n"
+	"}\n";
+static const char* FragmentShader =
+	"precision mediump float;\n"
+	"uniform sampler2D plane;\n"
+	"varying vec2 uv;\n"
+	"void main() {\n"
+	"	gl_FragColor = texture2D(plane, uv);\n"
+	"}\n";
+
+// Draws the texture one texel per pixel into the bottom left corner of the pbuffer and
+// reads it back, one byte per texel and channel.
+static std::vector<uint8_t> ReadTexture(GLuint texture, unsigned width, unsigned height, unsigned channels) {
+	static const float quad[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+	glViewport(0, 0, width, height);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, quad);
+	glEnableVertexAttribArray(0);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	std::vector<uint8_t> rgba(size_t(width) * height * 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+	// Luminance reads back in red and alpha in alpha.
+	std::vector<uint8_t> texels(size_t(width) * height * channels);
+	for (size_t i = 0; i < size_t(width) * height; i++) {
+		texels[i * channels] = rgba[i * 4];
+		if (channels == 2) {
+			texels[i * 2 + 1] = rgba[i * 4 + 3];
+		}
+	}
+	return texels;
+}
+
+static void ChangeBand(Nv12Frame& frame, unsigned band) {
+	frame.dirtyBands[band] = 1;
+	for (unsigned y = band * BandRows; y < (band + 1) * BandRows; y++) {
+		frame.luma[y * Width + unsigned(std::rand()) % Width] ^= 0x5a;
+		frame.chroma[(y / 2) * Width + unsigned(std::rand()) % Width] ^= 0x33;
+	}
+}
+
+int main() {
+	unigles::test::EglTestContext egl;
+	if (!unigles::test::CreateEglTestContext(Width, Height, egl)) {
+		std::fprintf(stderr, "no EGL display with GLES2 pbuffers\n");
+		return unigles::test::SkipExitCode;
+	}
+	GLuint program = unigles::test::CreateTestProgram(VertexShader, FragmentShader, "position");
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "plane"), 0);
+
+	std::srand(29);
+	std::vector<uint8_t> luma(Width * Height);
+	std::vector<uint8_t> chroma(Width * Height / 2);
+	for (uint8_t& value : luma) {
+		value = uint8_t(std::rand());
+	}
+	for (uint8_t& value : chroma) {
+		value = uint8_t(std::rand());
+	}
+	Nv12Frame frame;
+	frame.Assign(luma.data(), Width, chroma.data(), Width, Width, Height);
+	frame.sequence = 1;
+
+	StreamingUploader uploader(3);
+	const unsigned bandCount = Height / BandRows;
+	const size_t frameBytes = luma.size() + chroma.size();
+	for (unsigned index = 0; index < 12; index++) {
+		if (index > 0) {
+			// Change one band, or none, and say so.
+			frame.bandRows = BandRows;
+			frame.dirtyBands.assign(bandCount, 0);
+			frame.sequence++;
+			if (index == 5) {
+				// The sixth frame follows a dropped one, whose change it does not list.
+				ChangeBand(frame, 0);
+				frame.dirtyBands[0] = 0;
+				frame.sequence++;
+			}
+			if (index % 4 != 3) {
+				ChangeBand(frame, unsigned(std::rand()) % bandCount);
+			}
+		}
+		uploader.Upload(frame);
+		CHECK(uploader.HasFrame());
+		CHECK(ReadTexture(uploader.GetLumaTexture(), Width, Height, 1) == frame.luma);
+		CHECK(ReadTexture(uploader.GetChromaTexture(), Width / 2, Height / 2, 2) == frame.chroma);
+	}
+	CHECK(glGetError() == GL_NO_ERROR);
+
+	const StreamingUploadStats& stats = uploader.GetStats();
+	CHECK(stats.frames == 12);
+	// Every set starts with a whole frame, and so does the one after the gap.
+	CHECK(stats.bytes >= 4 * frameBytes && stats.bytes < 12 * frameBytes);
+	CHECK(stats.bandsSkipped > 0);
+	glDeleteProgram(program);
+	return unigles::test::TestResult();
+}
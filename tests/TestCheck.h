@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdio>
+
+// Just enough of a test framework for the portable tests: a failed CHECK is reported
+// with its location and the test carries on, so one run shows every failure, and
+// TestResult() turns the count into the exit code ctest looks at.
+namespace unigles {
+	namespace test {
+		// ctest reports a test that exits with this code as skipped, see SKIP_RETURN_CODE.
+		const int SkipExitCode = 77;
+
+		inline unsigned& FailureCount() {
+			static unsigned failures = 0;
+			return failures;
+		}
+
+		inline bool Check(bool condition, const char* expression, const char* file, int line) {
+			if (!condition) {
+				std::fprintf(stderr, "%s(%d): CHECK(%s) failed\n", file, line, expression);
+				FailureCount()++;
+			}
+			return condition;
+		}
+
+		inline int TestResult() {
+			if (FailureCount() != 0) {
+				std::fprintf(stderr, "%u checks failed\n", FailureCount());
+				return 1;
+			}
+			return 0;
+		}
+	}
+}
+
+#define CHECK(condition) unigles::test::Check(bool(condition), #condition, __FILE__, __LINE__)
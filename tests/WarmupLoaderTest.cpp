@@ -0,0 +1,154 @@
+#include "WarmupLoader.h"
+#include "EglTestContext.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace unigles;
+
+// Tasks run one after another in the order they were added, GL and other tasks alike,
+// and every one gets a timing. A texture a GL task fills on the loader's shared context
+// draws on the render context once the loader is ready. A task that throws, or a GL task
+// without a context, is reported failed without stopping the others, and Wait gives up
+// after its timeout while a task is still running. Needs an EGL display, like
+// StreamingUploaderTest.
+
+static const unsigned Size = 4;
+
+static const char* VertexShader =
+	"attribute vec2 position;\n"
+	"varying vec2 uv;\n"
+	"void main() {\n"
+	"	uv = position * 0.5 + 0.5;\n"
+	"	gl_Position = vec4(position, 0.0, 1.0);\n"
+	"}\n";
+static const char* FragmentShader =
+	"precision mediump float;\n"
+	"uniform sampler2D image;\n"
+	"varying vec2 uv;\n"
+	"void main() {\n"
+	"	gl_FragColor = texture2D(image, uv);\n"
+	"}\n";
+
+static std::vector<uint8_t> Pattern() {
+	std::vector<uint8_t> rgba(Size * Size * 4);
+	for (size_t i = 0; i < rgba.size(); i++) {
+		rgba[i] = uint8_t(i * 37 + 11);
+	}
+	return rgba;
+}
+
+static void TestOrderAndSharing(const test::EglTestContext& egl) {
+	WarmupLoader loader(egl.display, egl.config, egl.context);
+	std::vector<std::string> order;
+	GLuint texture = 0;
+	bool hadContext = false;
+	loader.AddTask("read", [&] { order.push_back("read"); });
+	loader.AddGlTask("texture", [&] {
+		order.push_back("texture");
+		hadContext = eglGetCurrentContext() != EGL_NO_CONTEXT && eglGetCurrentContext() != egl.context;
+		std::vector<uint8_t> rgba = Pattern();
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, Size, Size, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+	});
+	loader.AddTask("compile", [&] { order.push_back("compile"); });
+	CHECK(!loader.IsReady());
+	loader.Start();
+	CHECK(loader.Wait(10000));
+	CHECK(loader.IsReady() && loader.Succeeded());
+	CHECK(order == std::vector<std::string>({ "read", "texture", "compile" }));
+	CHECK(hadContext);
+
+	const std::vector<WarmupTaskTiming>& timings = loader.GetTimings();
+	CHECK(timings.size() == 3);
+	double sum = 0.0;
+	for (size_t i = 0; i < timings.size() && i < order.size(); i++) {
+		CHECK(timings[i].name == order[i] && timings[i].succeeded && timings[i].milliseconds >= 0.0);
+		sum += timings[i].milliseconds;
+	}
+	CHECK(loader.GetTotalMilliseconds() >= sum);
+
+	// The loader's context is gone; the texture lives on in the share group.
+	CHECK(texture != 0 && glIsTexture(texture));
+	GLuint program = test::CreateTestProgram(VertexShader, FragmentShader, "position");
+	static const float quad[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "image"), 0);
+	glViewport(0, 0, Size, Size);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, quad);
+	glEnableVertexAttribArray(0);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	std::vector<uint8_t> pixels(Size * Size * 4);
+	glReadPixels(0, 0, Size, Size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	CHECK(pixels == Pattern());
+	CHECK(glGetError() == GL_NO_ERROR);
+	glDeleteProgram(program);
+	glDeleteTextures(1, &texture);
+}
+
+static void TestFailures(const test::EglTestContext& egl) {
+	WarmupLoader loader(egl.display, egl.config, egl.context);
+	unsigned ran = 0;
+	loader.AddTask("first", [&] { ran++; });
+	loader.AddTask("throws", [&] { ran++; throw std::runtime_error("missing file"); });
+	loader.AddGlTask("gl", [&] { ran++; });
+	loader.Start();
+	CHECK(loader.Wait(10000));
+	CHECK(!loader.Succeeded() && ran == 3);
+	const std::vector<WarmupTaskTiming>& timings = loader.GetTimings();
+	CHECK(timings.size() == 3 && timings[0].succeeded && !timings[1].succeeded && timings[2].succeeded);
+
+	// Without a display GL tasks cannot run; the others still do.
+	WarmupLoader noDisplay(EGL_NO_DISPLAY, egl.config, egl.context);
+	bool glRan = false;
+	bool otherRan = false;
+	noDisplay.AddGlTask("gl", [&] { glRan = true; });
+	noDisplay.AddTask("other", [&] { otherRan = true; });
+	noDisplay.Start();
+	CHECK(noDisplay.Wait(10000));
+	CHECK(!noDisplay.Succeeded() && !glRan && otherRan);
+	CHECK(noDisplay.GetTimings().size() == 2 && !noDisplay.GetTimings()[0].succeeded && noDisplay.GetTimings()[1].succeeded);
+
+	// Nothing to do is ready at once, and successful.
+	WarmupLoader empty(egl.display, egl.config, egl.context);
+	empty.Start();
+	CHECK(empty.Wait(10000) && empty.Succeeded() && empty.GetTimings().empty());
+}
+
+static void TestTimeout(const test::EglTestContext& egl) {
+	WarmupLoader loader(egl.display, egl.config, egl.context);
+	std::atomic<bool> release(false);
+	loader.AddTask("slow", [&] {
+		while (!release) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+	loader.Start();
+	CHECK(!loader.Wait(20));
+	CHECK(!loader.IsReady());
+	release = true;
+	CHECK(loader.Wait(10000) && loader.Succeeded());
+}
+
+int main() {
+	test::EglTestContext egl;
+	if (!test::CreateEglTestContext(Size, Size, egl)) {
+		std::fprintf(stderr, "no EGL display with GLES2 pbuffers\n");
+		return unigles::test::SkipExitCode;
+	}
+	TestOrderAndSharing(egl);
+	TestFailures(egl);
+	TestTimeout(egl);
+	return unigles::test::TestResult();
+}
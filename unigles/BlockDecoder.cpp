@@ -0,0 +1,631 @@
+#include "BlockDecoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace unigles;
+
+namespace {
+	// GL internal formats, from the ETC2 (ES 3.0), S3TC, RGTC and BPTC specifications.
+	const CompressedFormatInfo Formats[] = {
+		{ "unknown", 0, 0, 0, false, false },
+		{ "ETC1 RGB", 8, 0x8D64, 0, false, true },
+		{ "ETC2 RGB", 8, 0x9274, 147, false, true },
+		{ "ETC2 sRGB", 8, 0x9275, 148, true, true },
+		{ "ETC2 RGB A1", 8, 0x9276, 149, false, true },
+		{ "ETC2 sRGB A1", 8, 0x9277, 150, true, true },
+		{ "ETC2 RGBA", 16, 0x9278, 151, false, true },
+		{ "ETC2 sRGB A8", 16, 0x9279, 152, true, true },
+		{ "EAC R11", 8, 0x9270, 153, false, true },
+		{ "EAC R11 signed", 8, 0x9271, 154, false, false },
+		{ "EAC RG11", 16, 0x9272, 155, false, true },
+		{ "EAC RG11 signed", 16, 0x9273, 156, false, false },
+		{ "BC1 RGB", 8, 0x83F0, 131, false, true },
+		{ "BC1 sRGB", 8, 0x8C4C, 132, true, true },
+		{ "BC1 RGBA", 8, 0x83F1, 133, false, true },
+		{ "BC1 sRGB A", 8, 0x8C4D, 134, true, true },
+		{ "BC2", 16, 0x83F2, 135, false, true },
+		{ "BC2 sRGB", 16, 0x8C4E, 136, true, true },
+		{ "BC3", 16, 0x83F3, 137, false, true },
+		{ "BC3 sRGB", 16, 0x8C4F, 138, true, true },
+		{ "BC4", 8, 0x8DBB, 139, false, true },
+		{ "BC4 signed", 8, 0x8DBC, 140, false, false },
+		{ "BC5", 16, 0x8DBD, 141, false, true },
+		{ "BC5 signed", 16, 0x8DBE, 142, false, false },
+		{ "BC6H ufloat", 16, 0x8E8F, 143, false, false },
+		{ "BC6H sfloat", 16, 0x8E8E, 144, false, false },
+		{ "BC7", 16, 0x8E8C, 145, false, true },
+		{ "BC7 sRGB", 16, 0x8E8D, 146, true, true },
+	};
+
+	const int EtcModifiers[8][2] = {
+		{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+	};
+
+	const int EtcDistances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+	const int EacModifiers[16][8] = {
+		{ -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 }, { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+		{ -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 }, { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+		{ -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 }, { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+		{ -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 }, { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 },
+	};
+
+	// BC7 partitions, bit i of an entry (two bits for three subsets) giving the subset of pixel i.
+	const uint16_t Bc7Partitions2[64] = {
+		0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80, 0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+		0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE, 0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+		0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A, 0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+		0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C, 0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22,
+	};
+
+	const uint32_t Bc7Partitions3[64] = {
+		0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+		0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+		0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+		0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+		0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+		0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+		0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+		0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254,
+	};
+
+	// Pixel whose index drops its top bit in the second (and third) subset.
+	const uint8_t Bc7Anchor2[64] = {
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+		15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+		6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+	};
+
+	const uint8_t Bc7Anchor3Second[64] = {
+		3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+		3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+		8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+		3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3,
+	};
+
+	const uint8_t Bc7Anchor3Third[64] = {
+		15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+		15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+		15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+		15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8,
+	};
+
+	const uint8_t Bc7Weights2[4] = { 0, 21, 43, 64 };
+	const uint8_t Bc7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	const uint8_t Bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct Bc7Mode {
+		unsigned subsets;
+		unsigned partitionBits;
+		unsigned rotationBits;
+		unsigned indexSelectionBits;
+		unsigned colorBits;
+		unsigned alphaBits;
+		unsigned endpointPBits;		// One per endpoint
+		unsigned sharedPBits;		// One per subset
+		unsigned indexBits;
+		unsigned secondaryIndexBits;
+	};
+
+	const Bc7Mode Bc7Modes[8] = {
+		{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+		{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+		{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+		{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+		{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+		{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+		{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+		{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+	};
+
+	inline uint8_t Clamp255(int value) {
+		return uint8_t(std::min(255, std::max(0, value)));
+	}
+
+	inline uint64_t ReadBigEndian64(const uint8_t* block) {
+		uint64_t value = 0;
+		for (int i = 0; i < 8; i++) {
+			value = (value << 8) | block[i];
+		}
+		return value;
+	}
+
+	inline unsigned Bits(uint64_t value, unsigned high, unsigned low) {
+		return unsigned((value >> low) & ((uint64_t(1) << (high - low + 1)) - 1));
+	}
+
+	inline int SignExtend3(unsigned value) {
+		return value >= 4 ? int(value) - 8 : int(value);
+	}
+
+	inline void SetPixel(uint8_t* pixels, unsigned x, unsigned y, int r, int g, int b, int a) {
+		uint8_t* pixel = pixels + (y * 4 + x) * 4;
+		pixel[0] = Clamp255(r);
+		pixel[1] = Clamp255(g);
+		pixel[2] = Clamp255(b);
+		pixel[3] = Clamp255(a);
+	}
+
+	// Little endian bit reader over one 128-bit BC7 block.
+	class BlockBits {
+	public:
+		explicit BlockBits(const uint8_t* block) : mBlock(block), mPosition(0) {}
+
+		unsigned Read(unsigned count) {
+			unsigned value = 0;
+			for (unsigned i = 0; i < count; i++, mPosition++) {
+				value |= unsigned((mBlock[mPosition >> 3] >> (mPosition & 7)) & 1) << i;
+			}
+			return value;
+		}
+
+	private:
+		const uint8_t* mBlock;
+		unsigned mPosition;
+	};
+
+	void DecodeEtcSubblocks(uint64_t bits, bool differential, bool punchThrough, bool opaque, uint8_t* pixels) {
+		int base[2][3];
+		if (differential) {
+			for (int c = 0; c < 3; c++) {
+				unsigned value = Bits(bits, 63 - 8 * c, 59 - 8 * c);
+				// Valid data never overflows here (ETC2 uses it for other modes); wrap it anyway.
+				unsigned second = unsigned(int(value) + SignExtend3(Bits(bits, 58 - 8 * c, 56 - 8 * c))) & 31;
+				base[0][c] = (value << 3) | (value >> 2);
+				base[1][c] = (second << 3) | (second >> 2);
+			}
+		} else {
+			for (int c = 0; c < 3; c++) {
+				base[0][c] = Bits(bits, 63 - 8 * c, 60 - 8 * c) * 17;
+				base[1][c] = Bits(bits, 59 - 8 * c, 56 - 8 * c) * 17;
+			}
+		}
+		unsigned table[2] = { Bits(bits, 39, 37), Bits(bits, 36, 34) };
+		bool flip = (bits >> 32) & 1;
+		for (unsigned x = 0; x < 4; x++) {
+			for (unsigned y = 0; y < 4; y++) {
+				unsigned i = x * 4 + y;
+				unsigned subblock = flip ? (y >= 2) : (x >= 2);
+				unsigned index = unsigned(((bits >> (16 + i)) & 1) << 1 | ((bits >> i) & 1));
+				int modifier = EtcModifiers[table[subblock]][index & 1];
+				if (index & 2) {
+					modifier = -modifier;
+				}
+				if (punchThrough && !opaque) {
+					if (index == 2) {
+						SetPixel(pixels, x, y, 0, 0, 0, 0);
+						continue;
+					}
+					if (index == 0) {
+						modifier = 0;
+					}
+				}
+				const int* color = base[subblock];
+				SetPixel(pixels, x, y, color[0] + modifier, color[1] + modifier, color[2] + modifier, 255);
+			}
+		}
+	}
+
+	void DecodePaintColors(uint64_t bits, const int (*paint)[3], bool punchThrough, bool opaque, uint8_t* pixels) {
+		for (unsigned x = 0; x < 4; x++) {
+			for (unsigned y = 0; y < 4; y++) {
+				unsigned i = x * 4 + y;
+				unsigned index = unsigned(((bits >> (16 + i)) & 1) << 1 | ((bits >> i) & 1));
+				if (punchThrough && !opaque && index == 2) {
+					SetPixel(pixels, x, y, 0, 0, 0, 0);
+				} else {
+					SetPixel(pixels, x, y, paint[index][0], paint[index][1], paint[index][2], 255);
+				}
+			}
+		}
+	}
+
+	void DecodeBc2Alpha(const uint8_t* block, uint8_t* pixels) {
+		for (unsigned i = 0; i < 16; i++) {
+			unsigned alpha = (block[i / 2] >> ((i & 1) * 4)) & 15;
+			pixels[i * 4 + 3] = uint8_t(alpha * 17);
+		}
+	}
+
+	inline uint8_t Bc7Interpolate(unsigned e0, unsigned e1, unsigned weight) {
+		return uint8_t(((64 - weight) * e0 + weight * e1 + 32) >> 6);
+	}
+
+	inline unsigned Bc7Expand(unsigned value, unsigned bits) {
+		value <<= 8 - bits;
+		return value | (value >> bits);
+	}
+
+	const uint8_t* Bc7WeightTable(unsigned bits) {
+		return bits == 2 ? Bc7Weights2 : bits == 3 ? Bc7Weights3 : Bc7Weights4;
+	}
+}
+
+const CompressedFormatInfo& unigles::GetFormatInfo(CompressedFormat format) {
+	return Formats[unsigned(format)];
+}
+
+CompressedFormat unigles::FormatFromGl(uint32_t glInternalFormat) {
+	for (unsigned i = 1; i < sizeof(Formats) / sizeof(Formats[0]); i++) {
+		if (Formats[i].glFormat == glInternalFormat) {
+			return CompressedFormat(i);
+		}
+	}
+	return CompressedFormat::Unknown;
+}
+
+CompressedFormat unigles::FormatFromVulkan(uint32_t vkFormat) {
+	for (unsigned i = 1; i < sizeof(Formats) / sizeof(Formats[0]); i++) {
+		if (vkFormat != 0 && Formats[i].vkFormat == vkFormat) {
+			return CompressedFormat(i);
+		}
+	}
+	return CompressedFormat::Unknown;
+}
+
+size_t unigles::CompressedImageSize(CompressedFormat format, unsigned width, unsigned height) {
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * GetFormatInfo(format).blockBytes;
+}
+
+void unigles::DecodeEtc1Block(const uint8_t* block, uint8_t* pixels) {
+	uint64_t bits = ReadBigEndian64(block);
+	DecodeEtcSubblocks(bits, (bits >> 33) & 1, false, true, pixels);
+}
+
+void unigles::DecodeEtc2Block(const uint8_t* block, uint8_t* pixels, bool punchThrough) {
+	uint64_t bits = ReadBigEndian64(block);
+	// Punch-through blocks give up the individual mode for the opaque flag.
+	bool differential = punchThrough || ((bits >> 33) & 1);
+	bool opaque = !punchThrough || ((bits >> 33) & 1);
+	if (!differential) {
+		DecodeEtcSubblocks(bits, false, false, true, pixels);
+		return;
+	}
+
+	// ETC2 hides its extra modes in differential blocks whose second base color overflows.
+	int red = int(Bits(bits, 63, 59)) + SignExtend3(Bits(bits, 58, 56));
+	int green = int(Bits(bits, 55, 51)) + SignExtend3(Bits(bits, 50, 48));
+	int blue = int(Bits(bits, 47, 43)) + SignExtend3(Bits(bits, 42, 40));
+	if (red < 0 || red > 31) {
+		// T mode: one color, and a second one with a distance either side of it.
+		int first[3] = { int(Bits(bits, 60, 59) << 2 | Bits(bits, 57, 56)), int(Bits(bits, 55, 52)), int(Bits(bits, 51, 48)) };
+		int second[3] = { int(Bits(bits, 47, 44)), int(Bits(bits, 43, 40)), int(Bits(bits, 39, 36)) };
+		int distance = EtcDistances[Bits(bits, 35, 34) << 1 | Bits(bits, 32, 32)];
+		int paint[4][3];
+		for (int c = 0; c < 3; c++) {
+			first[c] *= 17;
+			second[c] *= 17;
+			paint[0][c] = first[c];
+			paint[1][c] = second[c] + distance;
+			paint[2][c] = second[c];
+			paint[3][c] = second[c] - distance;
+		}
+		DecodePaintColors(bits, paint, punchThrough, opaque, pixels);
+	} else if (green < 0 || green > 31) {
+		// H mode: two colors, each with a distance either side; their order stores a bit.
+		int first[3] = { int(Bits(bits, 62, 59)), int(Bits(bits, 58, 56) << 1 | Bits(bits, 52, 52)), int(Bits(bits, 51, 51) << 3 | Bits(bits, 49, 47)) };
+		int second[3] = { int(Bits(bits, 46, 43)), int(Bits(bits, 42, 39)), int(Bits(bits, 38, 35)) };
+		unsigned order = (first[0] << 8 | first[1] << 4 | first[2]) >= (second[0] << 8 | second[1] << 4 | second[2]) ? 1 : 0;
+		int distance = EtcDistances[Bits(bits, 34, 34) << 2 | Bits(bits, 32, 32) << 1 | order];
+		int paint[4][3];
+		for (int c = 0; c < 3; c++) {
+			first[c] *= 17;
+			second[c] *= 17;
+			paint[0][c] = first[c] + distance;
+			paint[1][c] = first[c] - distance;
+			paint[2][c] = second[c] + distance;
+			paint[3][c] = second[c] - distance;
+		}
+		DecodePaintColors(bits, paint, punchThrough, opaque, pixels);
+	} else if (blue < 0 || blue > 31) {
+		// Planar mode: a gradient through the origin, horizontal and vertical colors.
+		int origin[3] = {
+			int(Bits(bits, 62, 57)),
+			int(Bits(bits, 56, 56) << 6 | Bits(bits, 54, 49)),
+			int(Bits(bits, 48, 48) << 5 | Bits(bits, 44, 43) << 3 | Bits(bits, 41, 39)),
+		};
+		int horizontal[3] = { int(Bits(bits, 38, 34) << 1 | Bits(bits, 32, 32)), int(Bits(bits, 31, 25)), int(Bits(bits, 24, 19)) };
+		int vertical[3] = { int(Bits(bits, 18, 13)), int(Bits(bits, 12, 6)), int(Bits(bits, 5, 0)) };
+		const int bitCount[3] = { 6, 7, 6 };
+		for (int c = 0; c < 3; c++) {
+			int shift = 8 - bitCount[c];
+			int drop = bitCount[c] - shift;
+			origin[c] = (origin[c] << shift) | (origin[c] >> drop);
+			horizontal[c] = (horizontal[c] << shift) | (horizontal[c] >> drop);
+			vertical[c] = (vertical[c] << shift) | (vertical[c] >> drop);
+		}
+		for (unsigned y = 0; y < 4; y++) {
+			for (unsigned x = 0; x < 4; x++) {
+				int color[3];
+				for (int c = 0; c < 3; c++) {
+					color[c] = (int(x) * (horizontal[c] - origin[c]) + int(y) * (vertical[c] - origin[c]) + 4 * origin[c] + 2) >> 2;
+				}
+				SetPixel(pixels, x, y, color[0], color[1], color[2], 255);
+			}
+		}
+	} else {
+		DecodeEtcSubblocks(bits, true, punchThrough, opaque, pixels);
+	}
+}
+
+void unigles::DecodeEacBlock(const uint8_t* block, uint8_t* pixels, unsigned channel, bool elevenBit) {
+	uint64_t bits = ReadBigEndian64(block);
+	int base = int(Bits(bits, 63, 56));
+	int multiplier = int(Bits(bits, 55, 52));
+	const int* modifiers = EacModifiers[Bits(bits, 51, 48)];
+	for (unsigned x = 0; x < 4; x++) {
+		for (unsigned y = 0; y < 4; y++) {
+			unsigned i = x * 4 + y;
+			int modifier = modifiers[Bits(bits, 47 - 3 * i, 45 - 3 * i)];
+			int value;
+			if (elevenBit) {
+				int wide = multiplier ? base * 8 + 4 + modifier * multiplier * 8 : base * 8 + 4 + modifier;
+				wide = std::min(2047, std::max(0, wide));
+				value = (wide * 255 + 1023) / 2047;
+			} else {
+				value = base + modifier * multiplier;
+			}
+			pixels[(y * 4 + x) * 4 + channel] = Clamp255(value);
+		}
+	}
+}
+
+void unigles::DecodeBc1Block(const uint8_t* block, uint8_t* pixels, bool allowTransparent, bool fourColors) {
+	unsigned c0 = block[0] | block[1] << 8;
+	unsigned c1 = block[2] | block[3] << 8;
+	int colors[4][4];
+	const unsigned endpoints[2] = { c0, c1 };
+	for (int e = 0; e < 2; e++) {
+		unsigned r = (endpoints[e] >> 11) & 31;
+		unsigned g = (endpoints[e] >> 5) & 63;
+		unsigned b = endpoints[e] & 31;
+		colors[e][0] = (r << 3) | (r >> 2);
+		colors[e][1] = (g << 2) | (g >> 4);
+		colors[e][2] = (b << 3) | (b >> 2);
+		colors[e][3] = 255;
+	}
+	for (int c = 0; c < 3; c++) {
+		if (c0 > c1 || fourColors) {
+			colors[2][c] = (2 * colors[0][c] + colors[1][c] + 1) / 3;
+			colors[3][c] = (colors[0][c] + 2 * colors[1][c] + 1) / 3;
+		} else {
+			colors[2][c] = (colors[0][c] + colors[1][c] + 1) / 2;
+			colors[3][c] = 0;
+		}
+	}
+	colors[2][3] = 255;
+	colors[3][3] = c0 > c1 || fourColors || !allowTransparent ? 255 : 0;
+	uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | uint32_t(block[7]) << 24;
+	for (unsigned i = 0; i < 16; i++) {
+		const int* color = colors[(indices >> (2 * i)) & 3];
+		SetPixel(pixels, i & 3, i >> 2, color[0], color[1], color[2], color[3]);
+	}
+}
+
+void unigles::DecodeBc4Block(const uint8_t* block, uint8_t* pixels, unsigned channel) {
+	int values[8];
+	values[0] = block[0];
+	values[1] = block[1];
+	if (values[0] > values[1]) {
+		for (int i = 1; i < 7; i++) {
+			values[i + 1] = ((7 - i) * values[0] + i * values[1] + 3) / 7;
+		}
+	} else {
+		for (int i = 1; i < 5; i++) {
+			values[i + 1] = ((5 - i) * values[0] + i * values[1] + 2) / 5;
+		}
+		values[6] = 0;
+		values[7] = 255;
+	}
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++) {
+		indices |= uint64_t(block[2 + i]) << (8 * i);
+	}
+	for (unsigned i = 0; i < 16; i++) {
+		pixels[i * 4 + channel] = uint8_t(values[(indices >> (3 * i)) & 7]);
+	}
+}
+
+void unigles::DecodeBc7Block(const uint8_t* block, uint8_t* pixels) {
+	unsigned mode = 0;
+	while (mode < 8 && !(block[0] & (1 << mode))) {
+		mode++;
+	}
+	if (mode == 8) {
+		// Reserved encoding: decoders return transparent black.
+		memset(pixels, 0, 64);
+		return;
+	}
+	const Bc7Mode& info = Bc7Modes[mode];
+	BlockBits bits(block);
+	bits.Read(mode + 1);
+	unsigned partition = bits.Read(info.partitionBits);
+	unsigned rotation = bits.Read(info.rotationBits);
+	unsigned indexSelection = bits.Read(info.indexSelectionBits);
+
+	// Endpoints are stored channel by channel: all reds, then greens, blues and alphas.
+	unsigned endpoints[6][4];
+	unsigned endpointCount = info.subsets * 2;
+	for (unsigned c = 0; c < 3; c++) {
+		for (unsigned e = 0; e < endpointCount; e++) {
+			endpoints[e][c] = bits.Read(info.colorBits);
+		}
+	}
+	for (unsigned e = 0; e < endpointCount; e++) {
+		endpoints[e][3] = info.alphaBits ? bits.Read(info.alphaBits) : 255;
+	}
+	unsigned colorBits = info.colorBits;
+	unsigned alphaBits = info.alphaBits;
+	if (info.endpointPBits || info.sharedPBits) {
+		unsigned pBits[6];
+		if (info.endpointPBits) {
+			for (unsigned e = 0; e < endpointCount; e++) {
+				pBits[e] = bits.Read(1);
+			}
+		} else {
+			for (unsigned s = 0; s < info.subsets; s++) {
+				pBits[2 * s] = pBits[2 * s + 1] = bits.Read(1);
+			}
+		}
+		for (unsigned e = 0; e < endpointCount; e++) {
+			for (unsigned c = 0; c < 3; c++) {
+				endpoints[e][c] = endpoints[e][c] << 1 | pBits[e];
+			}
+			if (alphaBits) {
+				endpoints[e][3] = endpoints[e][3] << 1 | pBits[e];
+			}
+		}
+		colorBits++;
+		if (alphaBits) {
+			alphaBits++;
+		}
+	}
+	for (unsigned e = 0; e < endpointCount; e++) {
+		for (unsigned c = 0; c < 3; c++) {
+			endpoints[e][c] = Bc7Expand(endpoints[e][c], colorBits);
+		}
+		if (alphaBits) {
+			endpoints[e][3] = Bc7Expand(endpoints[e][3], alphaBits);
+		}
+	}
+
+	unsigned subsetOf[16];
+	bool anchor[16] = {};
+	anchor[0] = true;
+	for (unsigned i = 0; i < 16; i++) {
+		if (info.subsets == 2) {
+			subsetOf[i] = (Bc7Partitions2[partition] >> i) & 1;
+		} else if (info.subsets == 3) {
+			subsetOf[i] = (Bc7Partitions3[partition] >> (2 * i)) & 3;
+		} else {
+			subsetOf[i] = 0;
+		}
+	}
+	if (info.subsets == 2) {
+		anchor[Bc7Anchor2[partition]] = true;
+	} else if (info.subsets == 3) {
+		anchor[Bc7Anchor3Second[partition]] = true;
+		anchor[Bc7Anchor3Third[partition]] = true;
+	}
+
+	unsigned indices[16];
+	unsigned secondary[16];
+	for (unsigned i = 0; i < 16; i++) {
+		indices[i] = bits.Read(anchor[i] ? info.indexBits - 1 : info.indexBits);
+	}
+	if (info.secondaryIndexBits) {
+		for (unsigned i = 0; i < 16; i++) {
+			secondary[i] = bits.Read(i == 0 ? info.secondaryIndexBits - 1 : info.secondaryIndexBits);
+		}
+	}
+
+	for (unsigned i = 0; i < 16; i++) {
+		const unsigned* e0 = endpoints[2 * subsetOf[i]];
+		const unsigned* e1 = endpoints[2 * subsetOf[i] + 1];
+		uint8_t* pixel = pixels + i * 4;
+		unsigned colorWeight, alphaWeight;
+		if (info.secondaryIndexBits) {
+			// The selection bit decides which index set drives color and which alpha.
+			const uint8_t* primaryWeights = Bc7WeightTable(info.indexBits);
+			const uint8_t* secondaryWeights = Bc7WeightTable(info.secondaryIndexBits);
+			colorWeight = indexSelection ? secondaryWeights[secondary[i]] : primaryWeights[indices[i]];
+			alphaWeight = indexSelection ? primaryWeights[indices[i]] : secondaryWeights[secondary[i]];
+		} else {
+			colorWeight = alphaWeight = Bc7WeightTable(info.indexBits)[indices[i]];
+		}
+		for (unsigned c = 0; c < 3; c++) {
+			pixel[c] = Bc7Interpolate(e0[c], e1[c], colorWeight);
+		}
+		pixel[3] = Bc7Interpolate(e0[3], e1[3], alphaWeight);
+		if (rotation) {
+			std::swap(pixel[3], pixel[rotation - 1]);
+		}
+	}
+}
+
+bool unigles::DecodeBlocks(CompressedFormat format, const uint8_t* data, size_t size, unsigned width, unsigned height, uint8_t* rgba) {
+	const CompressedFormatInfo& info = GetFormatInfo(format);
+	if (!info.decodable || size < CompressedImageSize(format, width, height)) {
+		return false;
+	}
+	unsigned blocksX = (width + 3) / 4;
+	unsigned blocksY = (height + 3) / 4;
+	uint8_t pixels[64];
+	for (unsigned by = 0; by < blocksY; by++) {
+		for (unsigned bx = 0; bx < blocksX; bx++) {
+			const uint8_t* block = data + (size_t(by) * blocksX + bx) * info.blockBytes;
+			switch (format) {
+			case CompressedFormat::Etc1Rgb:
+				DecodeEtc1Block(block, pixels);
+				break;
+			case CompressedFormat::Etc2Rgb:
+			case CompressedFormat::Etc2Srgb:
+				DecodeEtc2Block(block, pixels, false);
+				break;
+			case CompressedFormat::Etc2RgbA1:
+			case CompressedFormat::Etc2SrgbA1:
+				DecodeEtc2Block(block, pixels, true);
+				break;
+			case CompressedFormat::Etc2Rgba:
+			case CompressedFormat::Etc2SrgbA8:
+				DecodeEtc2Block(block + 8, pixels, false);
+				DecodeEacBlock(block, pixels, 3, false);
+				break;
+			case CompressedFormat::EacR11:
+			case CompressedFormat::EacRg11:
+				memset(pixels, 0, sizeof(pixels));
+				for (unsigned i = 0; i < 16; i++) {
+					pixels[i * 4 + 3] = 255;
+				}
+				DecodeEacBlock(block, pixels, 0, true);
+				if (format == CompressedFormat::EacRg11) {
+					DecodeEacBlock(block + 8, pixels, 1, true);
+				}
+				break;
+			case CompressedFormat::Bc1Rgb:
+			case CompressedFormat::Bc1Srgb:
+				DecodeBc1Block(block, pixels, false, false);
+				break;
+			case CompressedFormat::Bc1Rgba:
+			case CompressedFormat::Bc1SrgbA:
+				DecodeBc1Block(block, pixels, true, false);
+				break;
+			case CompressedFormat::Bc2:
+			case CompressedFormat::Bc2Srgb:
+				DecodeBc1Block(block + 8, pixels, false, true);
+				DecodeBc2Alpha(block, pixels);
+				break;
+			case CompressedFormat::Bc3:
+			case CompressedFormat::Bc3Srgb:
+				DecodeBc1Block(block + 8, pixels, false, true);
+				DecodeBc4Block(block, pixels, 3);
+				break;
+			case CompressedFormat::Bc4:
+			case CompressedFormat::Bc5:
+				memset(pixels, 0, sizeof(pixels));
+				for (unsigned i = 0; i < 16; i++) {
+					pixels[i * 4 + 3] = 255;
+				}
+				DecodeBc4Block(block, pixels, 0);
+				if (format == CompressedFormat::Bc5) {
+					DecodeBc4Block(block + 8, pixels, 1);
+				}
+				break;
+			case CompressedFormat::Bc7:
+			case CompressedFormat::Bc7Srgb:
+				DecodeBc7Block(block, pixels);
+				break;
+			default:
+				return false;
+			}
+			unsigned columns = std::min(4u, width - bx * 4);
+			unsigned rows = std::min(4u, height - by * 4);
+			for (unsigned y = 0; y < rows; y++) {
+				memcpy(rgba + ((size_t(by) * 4 + y) * width + bx * 4) * 4, pixels + y * 16, columns * 4);
+			}
+		}
+	}
+	return true;
+}
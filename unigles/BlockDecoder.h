@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace unigles {
+	// Block compressed formats the asset loader knows, each with its GL internal format.
+	enum class CompressedFormat {
+		Unknown,
+		Etc1Rgb,
+		Etc2Rgb,
+		Etc2Srgb,
+		Etc2RgbA1,
+		Etc2SrgbA1,
+		Etc2Rgba,
+		Etc2SrgbA8,
+		EacR11,
+		EacR11Signed,
+		EacRg11,
+		EacRg11Signed,
+		Bc1Rgb,
+		Bc1Srgb,
+		Bc1Rgba,
+		Bc1SrgbA,
+		Bc2,
+		Bc2Srgb,
+		Bc3,
+		Bc3Srgb,
+		Bc4,
+		Bc4Signed,
+		Bc5,
+		Bc5Signed,
+		Bc6hUfloat,
+		Bc6hSfloat,
+		Bc7,
+		Bc7Srgb,
+	};
+
+	struct CompressedFormatInfo {
+		const char* name;
+		unsigned blockBytes;	// Every format uses 4x4 blocks
+		uint32_t glFormat;
+		uint32_t vkFormat;		// As stored in KTX2 files
+		bool srgb;
+		// Whether DecodeBlocks() can turn it into RGBA8. Signed and float formats cannot:
+		// they have no faithful 8-bit unsigned form.
+		bool decodable;
+	};
+
+	const CompressedFormatInfo& GetFormatInfo(CompressedFormat format);
+	CompressedFormat FormatFromGl(uint32_t glInternalFormat);
+	CompressedFormat FormatFromVulkan(uint32_t vkFormat);
+
+	// Bytes of one compressed image of the given size.
+	size_t CompressedImageSize(CompressedFormat format, unsigned width, unsigned height);
+
+	// Decodes a whole image to tightly packed RGBA8, clipping the blocks at the right and
+	// bottom edges. sRGB formats keep their encoded values. Single and dual channel
+	// formats fill the missing color channels with zero and alpha with 255, as GL
+	// samples them. Returns false for formats that are not decodable or short data.
+	bool DecodeBlocks(CompressedFormat format, const uint8_t* data, size_t size, unsigned width, unsigned height, uint8_t* rgba);
+
+	// Decoders for one 4x4 block, writing 16 RGBA8 pixels in row order.
+	void DecodeEtc1Block(const uint8_t* block, uint8_t* pixels);
+	void DecodeEtc2Block(const uint8_t* block, uint8_t* pixels, bool punchThrough);
+	void DecodeEacBlock(const uint8_t* block, uint8_t* pixels, unsigned channel, bool elevenBit);
+	// Without allowTransparent the fourth color of the three color mode is opaque black;
+	// fourColors ignores the endpoint order, as the color half of BC2 and BC3 does.
+	void DecodeBc1Block(const uint8_t* block, uint8_t* pixels, bool allowTransparent, bool fourColors);
+	void DecodeBc4Block(const uint8_t* block, uint8_t* pixels, unsigned channel);
+	void DecodeBc7Block(const uint8_t* block, uint8_t* pixels);
+}
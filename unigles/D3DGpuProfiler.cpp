@@ -0,0 +1,123 @@
+#include "pch.h"
+#include "D3DGpuProfiler.h"
+
+using namespace Microsoft::WRL;
+
+D3DGpuProfiler::D3DGpuProfiler(ComPtr<ID3D11Device> device, unigles::GpuProfileLog& log) :
+	mDevice(device),
+	mLog(log),
+	mSupported(false),
+	mFrames(Latency),
+	mCurrent(0),
+	mInFrame(false),
+	mInPass(false) {
+	if (mDevice->GetFeatureLevel() < D3D_FEATURE_LEVEL_10_0) {
+		return;
+	}
+	D3D11_QUERY_DESC desc = {};
+	desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	for (Frame& frame : mFrames) {
+		if (FAILED(mDevice->CreateQuery(&desc, frame.disjoint.GetAddressOf()))) {
+			return;
+		}
+	}
+	mSupported = true;
+}
+
+D3DGpuProfiler::~D3DGpuProfiler() {}
+
+UINT D3DGpuProfiler::Timestamp(Frame& frame) {
+	if (frame.used == frame.timestamps.size()) {
+		D3D11_QUERY_DESC desc = {};
+		desc.Query = D3D11_QUERY_TIMESTAMP;
+		ComPtr<ID3D11Query> query;
+		if (FAILED(mDevice->CreateQuery(&desc, query.GetAddressOf()))) {
+			mSupported = false;
+			return 0;
+		}
+		frame.timestamps.push_back(query);
+	}
+	mContext->End(frame.timestamps[frame.used].Get());
+	return frame.used++;
+}
+
+void D3DGpuProfiler::BeginFrame(ComPtr<ID3D11DeviceContext> context) {
+	mContext = context;
+	if (!mSupported) {
+		return;
+	}
+	Collect();
+	Frame& frame = mFrames[mCurrent];
+	if (frame.pending) {
+		// Still not back after Latency frames; drop it rather than wait.
+		frame.pending = false;
+		mLog.AddDiscarded(1);
+	}
+	frame.used = 0;
+	frame.passes.clear();
+	mContext->Begin(frame.disjoint.Get());
+	mInFrame = true;
+}
+
+void D3DGpuProfiler::BeginPass(const std::string& name) {
+	mPassName = name;
+	mPassStart = std::chrono::steady_clock::now();
+	mInPass = true;
+	if (!mSupported || !mInFrame) {
+		return;
+	}
+	Frame& frame = mFrames[mCurrent];
+	UINT begin = Timestamp(frame);
+	frame.passes.push_back(Pass{ name, begin, begin });
+}
+
+void D3DGpuProfiler::EndPass() {
+	if (!mInPass) {
+		return;
+	}
+	mInPass = false;
+	if (mSupported && mInFrame) {
+		Frame& frame = mFrames[mCurrent];
+		frame.passes.back().end = Timestamp(frame);
+	}
+	mLog.AddCpu(mPassName, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mPassStart).count());
+}
+
+void D3DGpuProfiler::EndFrame() {
+	if (!mSupported || !mInFrame) {
+		return;
+	}
+	mInFrame = false;
+	Frame& frame = mFrames[mCurrent];
+	mContext->End(frame.disjoint.Get());
+	frame.pending = !frame.passes.empty();
+	mCurrent = (mCurrent + 1) % Latency;
+}
+
+void D3DGpuProfiler::Collect() {
+	// Oldest first; the disjoint query completes after every timestamp inside it.
+	for (UINT i = 0; i < Latency; i++) {
+		Frame& frame = mFrames[(mCurrent + i) % Latency];
+		if (!frame.pending) {
+			continue;
+		}
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+		if (mContext->GetData(frame.disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+			return;
+		}
+		frame.pending = false;
+		if (disjoint.Disjoint || disjoint.Frequency == 0) {
+			mLog.AddDiscarded(1);
+			continue;
+		}
+		for (const Pass& pass : frame.passes) {
+			UINT64 begin = 0;
+			UINT64 end = 0;
+			if (mContext->GetData(frame.timestamps[pass.begin].Get(), &begin, sizeof(begin), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+				mContext->GetData(frame.timestamps[pass.end].Get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+				continue;
+			}
+			mLog.AddGpu(pass.name, double(end - begin) * 1000.0 / double(disjoint.Frequency));
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "GpuProfileLog.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Brackets D3D11 passes with timestamp queries inside a per-frame disjoint query.
+// Results are read back Latency frames later with DONOTFLUSH, so profiling never waits
+// on the GPU. Feature level 9_x has no timestamp queries; there only CPU submission
+// times are logged.
+class D3DGpuProfiler {
+public:
+	static const UINT Latency = 4;
+
+	D3DGpuProfiler(Microsoft::WRL::ComPtr<ID3D11Device> device, unigles::GpuProfileLog& log);
+	virtual ~D3DGpuProfiler();
+
+	bool IsSupported() const { return mSupported; }
+
+	void BeginFrame(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	void BeginPass(const std::string& name);
+	void EndPass();
+	void EndFrame();
+
+private:
+	struct Pass {
+		std::string name;
+		UINT begin;		// Indices into Frame::timestamps
+		UINT end;
+	};
+
+	struct Frame {
+		Microsoft::WRL::ComPtr<ID3D11Query> disjoint;
+		std::vector<Microsoft::WRL::ComPtr<ID3D11Query>> timestamps;
+		std::vector<Pass> passes;
+		UINT used = 0;
+		bool pending = false;
+	};
+
+	UINT Timestamp(Frame& frame);
+	void Collect();
+
+	Microsoft::WRL::ComPtr<ID3D11Device> mDevice;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> mContext;
+	unigles::GpuProfileLog& mLog;
+	bool mSupported;
+	std::vector<Frame> mFrames;
+	UINT mCurrent;
+	bool mInFrame;
+	bool mInPass;
+	std::string mPassName;
+	std::chrono::steady_clock::time_point mPassStart;
+};
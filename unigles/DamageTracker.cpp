@@ -0,0 +1,268 @@
+#include "DamageTracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace unigles;
+
+bool DamageRect::operator==(const DamageRect& other) const {
+	if (Empty() || other.Empty()) {
+		return Empty() == other.Empty();
+	}
+	return x == other.x && y == other.y && width == other.width && height == other.height;
+}
+
+DamageRect unigles::MakeDamageRect(int x, int y, int width, int height) {
+	DamageRect rect;
+	rect.x = x;
+	rect.y = y;
+	rect.width = width;
+	rect.height = height;
+	return rect;
+}
+
+DamageRect unigles::UnionRects(const DamageRect& a, const DamageRect& b) {
+	if (a.Empty()) {
+		return b;
+	}
+	if (b.Empty()) {
+		return a;
+	}
+	int left = (std::min)(a.x, b.x);
+	int top = (std::min)(a.y, b.y);
+	int right = (std::max)(a.x + a.width, b.x + b.width);
+	int bottom = (std::max)(a.y + a.height, b.y + b.height);
+	return MakeDamageRect(left, top, right - left, bottom - top);
+}
+
+DamageRect unigles::IntersectRects(const DamageRect& a, const DamageRect& b) {
+	int left = (std::max)(a.x, b.x);
+	int top = (std::max)(a.y, b.y);
+	int right = (std::min)(a.x + a.width, b.x + b.width);
+	int bottom = (std::min)(a.y + a.height, b.y + b.height);
+	if (a.Empty() || b.Empty() || right <= left || bottom <= top) {
+		return DamageRect();
+	}
+	return MakeDamageRect(left, top, right - left, bottom - top);
+}
+
+DamageRect unigles::ProjectBounds(const Aabb& bounds, const float* viewProjection, int width, int height) {
+	DamageRect surface = MakeDamageRect(0, 0, width, height);
+	float left = 1.0f;
+	float right = -1.0f;
+	float bottom = 1.0f;
+	float top = -1.0f;
+	for (int corner = 0; corner < 8; corner++) {
+		float point[3] = {
+			(corner & 1) ? bounds.max[0] : bounds.min[0],
+			(corner & 2) ? bounds.max[1] : bounds.min[1],
+			(corner & 4) ? bounds.max[2] : bounds.min[2],
+		};
+		float clip[4];
+		for (int row = 0; row < 4; row++) {
+			clip[row] = viewProjection[12 + row];
+			for (int column = 0; column < 3; column++) {
+				clip[row] += viewProjection[column * 4 + row] * point[column];
+			}
+		}
+		// Behind or at the eye the projection flips; give up on a tight bound.
+		if (clip[3] <= 1.0e-4f) {
+			return surface;
+		}
+		float x = clip[0] / clip[3];
+		float y = clip[1] / clip[3];
+		left = (std::min)(left, x);
+		right = (std::max)(right, x);
+		bottom = (std::min)(bottom, y);
+		top = (std::max)(top, y);
+	}
+	if (right < left || top < bottom) {
+		return DamageRect();
+	}
+	// A pixel of slack on each side for rasterization rounding at the edges.
+	int x0 = int(std::floor((left * 0.5f + 0.5f) * width)) - 1;
+	int x1 = int(std::ceil((right * 0.5f + 0.5f) * width)) + 1;
+	int y0 = int(std::floor((0.5f - top * 0.5f) * height)) - 1;
+	int y1 = int(std::ceil((0.5f - bottom * 0.5f) * height)) + 1;
+	return IntersectRects(MakeDamageRect(x0, y0, x1 - x0, y1 - y0), surface);
+}
+
+const char* unigles::PresentMethodName(PresentMethod method) {
+	switch (method) {
+	case PresentMethod::SwapWithDamage:
+		return "swap with damage";
+	case PresentMethod::PostSubBuffer:
+		return "post sub buffer";
+	default:
+		return "full swap";
+	}
+}
+
+DamageTracker::DamageTracker(unsigned maxRects, double fullFraction) :
+	mMaxRects(maxRects < 1 ? 1 : maxRects),
+	mFullFraction(fullFraction),
+	mWidth(0),
+	mHeight(0),
+	mInvalid(true),
+	mFull(true),
+	mFullPresentTotal(0.0),
+	mPartialPresentTotal(0.0),
+	mPresentedTotal(0.0),
+	mRepaintedTotal(0.0) {
+}
+
+void DamageTracker::BeginFrame(int width, int height) {
+	if (width != mWidth || height != mHeight) {
+		mWidth = width;
+		mHeight = height;
+		mInvalid = true;
+	}
+	for (Layer& layer : mLayers) {
+		layer.set = false;
+	}
+}
+
+void DamageTracker::SetLayer(unsigned layer, const DamageRect& bounds, bool changed) {
+	if (layer >= mLayers.size()) {
+		mLayers.resize(layer + 1);
+	}
+	Layer& entry = mLayers[layer];
+	entry.bounds = bounds;
+	entry.set = true;
+	entry.changed = changed;
+}
+
+void DamageTracker::Invalidate() {
+	mInvalid = true;
+}
+
+void DamageTracker::Resolve() {
+	DamageRect surface = MakeDamageRect(0, 0, mWidth, mHeight);
+	mDamage.clear();
+	for (const Layer& layer : mLayers) {
+		DamageRect bounds = layer.set ? IntersectRects(layer.bounds, surface) : DamageRect();
+		if (layer.set && !layer.changed && bounds == layer.last) {
+			continue;
+		}
+		if (!layer.last.Empty()) {
+			mDamage.push_back(layer.last);
+		}
+		if (!bounds.Empty()) {
+			mDamage.push_back(bounds);
+		}
+	}
+	MergeDamage();
+	int64_t area = 0;
+	for (const DamageRect& rect : mDamage) {
+		area += rect.Area();
+	}
+	mFull = mInvalid || area >= int64_t(mFullFraction * double(surface.Area()));
+	if (mFull) {
+		mDamage.assign(1, surface);
+	}
+}
+
+void DamageTracker::MergeDamage() {
+	// Overlapping rectangles are merged outright; past the limit, the pair whose bounds
+	// add the least area that neither covered. Damage is a handful of rectangles.
+	for (;;) {
+		size_t bestA = 0;
+		size_t bestB = 0;
+		int64_t bestWaste = -1;
+		bool overlap = false;
+		for (size_t a = 0; a < mDamage.size() && !overlap; a++) {
+			for (size_t b = a + 1; b < mDamage.size(); b++) {
+				if (!IntersectRects(mDamage[a], mDamage[b]).Empty()) {
+					bestA = a;
+					bestB = b;
+					overlap = true;
+					break;
+				}
+				int64_t waste = UnionRects(mDamage[a], mDamage[b]).Area() - mDamage[a].Area() - mDamage[b].Area();
+				if (bestWaste < 0 || waste < bestWaste) {
+					bestA = a;
+					bestB = b;
+					bestWaste = waste;
+				}
+			}
+		}
+		if (!overlap && mDamage.size() <= mMaxRects) {
+			return;
+		}
+		mDamage[bestA] = UnionRects(mDamage[bestA], mDamage[bestB]);
+		mDamage.erase(mDamage.begin() + bestB);
+	}
+}
+
+std::vector<int32_t> DamageTracker::GetEglRects() const {
+	std::vector<int32_t> rects;
+	for (const DamageRect& rect : mDamage) {
+		rects.push_back(rect.x);
+		rects.push_back(mHeight - rect.y - rect.height);
+		rects.push_back(rect.width);
+		rects.push_back(rect.height);
+	}
+	return rects;
+}
+
+DamageRect DamageTracker::GetRepaintBounds(unsigned bufferAge) const {
+	DamageRect surface = MakeDamageRect(0, 0, mWidth, mHeight);
+	if (mFull || bufferAge == 0 || bufferAge - 1 > mHistory.size()) {
+		return surface;
+	}
+	DamageRect bounds;
+	for (const DamageRect& rect : mDamage) {
+		bounds = UnionRects(bounds, rect);
+	}
+	// The buffer missed every frame presented since it was last shown.
+	for (unsigned frame = 0; frame + 1 < bufferAge; frame++) {
+		bounds = UnionRects(bounds, mHistory[frame]);
+	}
+	return bounds;
+}
+
+void DamageTracker::EndFrame(double presentMilliseconds, bool partial, const DamageRect& repainted) {
+	DamageRect surface = MakeDamageRect(0, 0, mWidth, mHeight);
+	DamageRect bounds;
+	int64_t presented = 0;
+	for (const DamageRect& rect : mDamage) {
+		bounds = UnionRects(bounds, rect);
+		presented += rect.Area();
+	}
+	mHistory.insert(mHistory.begin(), bounds);
+	if (mHistory.size() > HistoryFrames) {
+		mHistory.pop_back();
+	}
+	for (Layer& layer : mLayers) {
+		layer.last = layer.set ? IntersectRects(layer.bounds, surface) : DamageRect();
+	}
+	mInvalid = false;
+
+	mStats.frames++;
+	if (partial) {
+		mStats.partialFrames++;
+		mPartialPresentTotal += presentMilliseconds;
+	} else {
+		mFullPresentTotal += presentMilliseconds;
+		presented = surface.Area();
+	}
+	if (surface.Area() > 0) {
+		mPresentedTotal += double(presented) / surface.Area();
+		mRepaintedTotal += double(IntersectRects(repainted, surface).Area()) / surface.Area();
+	}
+	uint64_t fullFrames = mStats.frames - mStats.partialFrames;
+	mStats.presentedFraction = mPresentedTotal / mStats.frames;
+	mStats.repaintedFraction = mRepaintedTotal / mStats.frames;
+	mStats.fullPresentMilliseconds = fullFrames > 0 ? mFullPresentTotal / fullFrames : 0.0;
+	mStats.partialPresentMilliseconds = mStats.partialFrames > 0 ? mPartialPresentTotal / mStats.partialFrames : 0.0;
+	mStats.savedMilliseconds = fullFrames > 0 && mStats.partialFrames > 0 ?
+		mStats.partialFrames * (mStats.fullPresentMilliseconds - mStats.partialPresentMilliseconds) : 0.0;
+}
+
+void DamageTracker::ResetStats() {
+	mStats = DamageStats();
+	mFullPresentTotal = 0.0;
+	mPartialPresentTotal = 0.0;
+	mPresentedTotal = 0.0;
+	mRepaintedTotal = 0.0;
+}
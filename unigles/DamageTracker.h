@@ -0,0 +1,116 @@
+#pragma once
+
+#include "SceneBvh.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace unigles {
+	// Pixels from the top left corner of the surface, like the overlay's coordinates.
+	struct DamageRect {
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+
+		bool Empty() const { return width <= 0 || height <= 0; }
+		int64_t Area() const { return Empty() ? 0 : int64_t(width) * height; }
+		bool operator==(const DamageRect& other) const;
+		bool operator!=(const DamageRect& other) const { return !(*this == other); }
+	};
+
+	DamageRect MakeDamageRect(int x, int y, int width, int height);
+	// Smallest rectangle holding both; an empty one adds nothing.
+	DamageRect UnionRects(const DamageRect& a, const DamageRect& b);
+	DamageRect IntersectRects(const DamageRect& a, const DamageRect& b);
+
+	// Screen bounds of a world box under a column major view-projection matrix, rounded
+	// out to whole pixels. A box reaching behind the camera covers the whole surface.
+	DamageRect ProjectBounds(const Aabb& bounds, const float* viewProjection, int width, int height);
+
+	// How a frame reaches the screen.
+	enum class PresentMethod {
+		Full,			// eglSwapBuffers
+		SwapWithDamage,	// EGL_KHR_swap_buffers_with_damage, several rectangles
+		PostSubBuffer,	// EGL_NV_post_sub_buffer, their bounding rectangle
+	};
+
+	const char* PresentMethodName(PresentMethod method);
+
+	struct DamageStats {
+		uint64_t frames = 0;
+		uint64_t partialFrames = 0;		// Presented with damage rather than whole
+		double presentedFraction = 0.0;	// Mean share of the surface presented
+		double repaintedFraction = 0.0;	// Mean share of the surface drawn
+		double fullPresentMilliseconds = 0.0;		// Mean present time of whole frames
+		double partialPresentMilliseconds = 0.0;	// Mean present time of partial frames
+		// Partial frames times the difference of the means; zero until both were seen.
+		double savedMilliseconds = 0.0;
+	};
+
+	// Works out what changed on the surface since the last frame from the bounds of the
+	// layers drawn on it, so a frame can be presented as a few damage rectangles and
+	// drawn only where the back buffer is out of date. Each frame:
+	//   BeginFrame, SetLayer for everything drawn, Resolve, draw inside GetRepaintBounds,
+	//   present GetDamage, EndFrame.
+	// A layer left out of a frame damages where it was. Not thread safe.
+	class DamageTracker {
+	public:
+		// Damage is merged down to at most maxRects rectangles, and presented whole once it
+		// covers fullFraction of the surface, where partial presents stop paying off.
+		explicit DamageTracker(unsigned maxRects = 4, double fullFraction = 0.75);
+
+		// A new size damages everything.
+		void BeginFrame(int width, int height);
+		// Bounds of a layer this frame. Unchanged means it looks exactly like last frame;
+		// moved or changed, it damages both its old and its new bounds.
+		void SetLayer(unsigned layer, const DamageRect& bounds, bool changed = true);
+		// Damages the whole surface next frame, as after a new surface or a lost device
+		// whose back buffers hold nothing.
+		void Invalidate();
+
+		// Compares the layers with the last frame; call after the last SetLayer.
+		void Resolve();
+		bool IsFull() const { return mFull; }
+		// Clipped to the surface; the whole surface when IsFull.
+		const std::vector<DamageRect>& GetDamage() const { return mDamage; }
+		// Rectangles for EGL: x, y from the bottom left, width, height.
+		std::vector<int32_t> GetEglRects() const;
+		// What to draw into a back buffer holding the frame of bufferAge presents ago. Zero
+		// for a buffer whose contents are unknown, which is redrawn whole.
+		DamageRect GetRepaintBounds(unsigned bufferAge) const;
+
+		// Partial when the frame went out as damage rather than whole.
+		void EndFrame(double presentMilliseconds, bool partial, const DamageRect& repainted);
+		const DamageStats& GetStats() const { return mStats; }
+		void ResetStats();
+
+	private:
+		struct Layer {
+			DamageRect bounds;
+			bool set = false;
+			bool changed = false;
+			DamageRect last;	// Bounds it was presented with last frame
+		};
+
+		// Damage bounds of the frames presented before this one, newest first.
+		static const unsigned HistoryFrames = 4;
+
+		void MergeDamage();
+
+		unsigned mMaxRects;
+		double mFullFraction;
+		int mWidth;
+		int mHeight;
+		bool mInvalid;
+		bool mFull;
+		std::vector<Layer> mLayers;
+		std::vector<DamageRect> mDamage;
+		std::vector<DamageRect> mHistory;
+		DamageStats mStats;
+		double mFullPresentTotal;
+		double mPartialPresentTotal;
+		double mPresentedTotal;
+		double mRepaintedTotal;
+	};
+}
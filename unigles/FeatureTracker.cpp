@@ -0,0 +1,782 @@
+#include "FeatureTracker.h"
+#include "Simd.h"
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using namespace unigles;
+
+// The Bresenham circle of radius 3 around a FAST candidate, clockwise from the top.
+static const int CircleX[16] = { 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1 };
+static const int CircleY[16] = { -3, -3, -2, -1, 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3 };
+static const unsigned CircleRadius = 3;
+static const unsigned ArcLength = 9;
+
+// Lucas-Kanade window. Rows are padded to 16 values whose last column has no gradient,
+// so every row is two vectors of eight.
+static const int HalfWindow = 7;
+static const unsigned WindowSize = 2 * HalfWindow + 1;
+static const unsigned PaddedWidth = 16;
+// Source pixels are copied into a patch first, with the coordinates clamped where the
+// window reaches past the edge, so the kernels never see the image borders.
+static const unsigned PatchStride = 32;
+static const unsigned PatchRows = WindowSize + 3;
+// Resampled values carry 5 fractional bits; bilinear weights are 1/16384 units.
+static const unsigned WeightBits = 14;
+static const unsigned ValueShift = WeightBits - 5;
+static const unsigned PointsPerTask = 16;
+
+template <typename Fn>
+static void ForEach(TaskPool* pool, unsigned count, const Fn& fn) {
+	if (pool) {
+		pool->Run(count, fn);
+	} else {
+		for (unsigned i = 0; i < count; i++) {
+			fn(i);
+		}
+	}
+}
+
+static inline bool IsCorner(const uint8_t* p, const int* offsets, unsigned threshold) {
+	int center = p[0];
+	int high = center + int(threshold);
+	int low = center - int(threshold);
+	unsigned brightRun = 0, darkRun = 0;
+	for (unsigned k = 0; k < 16 + ArcLength - 1; k++) {
+		int value = p[offsets[k & 15]];
+		brightRun = value > high ? brightRun + 1 : 0;
+		darkRun = value < low ? darkRun + 1 : 0;
+		if (brightRun >= ArcLength || darkRun >= ArcLength) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Largest threshold the pixel still passes: the best arc's smallest difference, less one.
+// The minima and maxima of the sixteen arcs are built from those of arcs of 2, 4 and 8,
+// over the differences written twice round the circle.
+template <bool Vectorized>
+static unsigned CornerScore(const uint8_t* p, const int* offsets) {
+	int16_t differences[32];
+	for (unsigned k = 0; k < 32; k++) {
+		differences[k] = int16_t(p[offsets[k & 15]] - p[0]);
+	}
+#if defined(UNIGLES_SIMD_SSE2)
+	if (Vectorized) {
+		int16_t low[32], high[32];
+		for (unsigned k = 0; k < 32; k += 8) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(low + k), _mm_loadu_si128(reinterpret_cast<const __m128i*>(differences + k)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(high + k), _mm_loadu_si128(reinterpret_cast<const __m128i*>(differences + k)));
+		}
+		for (unsigned span = 1; span < 8; span *= 2) {
+			for (unsigned k = 0; k + span + 8 <= 32; k += 8) {
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low + k));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low + k + span));
+				__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high + k));
+				__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high + k + span));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(low + k), _mm_min_epi16(a, b));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(high + k), _mm_max_epi16(c, d));
+			}
+		}
+		__m128i bright = _mm_setzero_si128(), dark = _mm_setzero_si128();
+		for (unsigned k = 0; k < 16; k += 8) {
+			__m128i last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(differences + k + ArcLength - 1));
+			bright = _mm_max_epi16(bright, _mm_min_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(low + k)), last));
+			dark = _mm_max_epi16(dark, _mm_sub_epi16(_mm_setzero_si128(),
+				_mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(high + k)), last)));
+		}
+		__m128i best = _mm_max_epi16(bright, dark);
+		best = _mm_max_epi16(best, _mm_srli_si128(best, 8));
+		best = _mm_max_epi16(best, _mm_srli_si128(best, 4));
+		best = _mm_max_epi16(best, _mm_srli_si128(best, 2));
+		return unsigned(int16_t(_mm_cvtsi128_si32(best)) - 1);
+	}
+#elif defined(UNIGLES_SIMD_NEON)
+	if (Vectorized) {
+		int16_t low[32], high[32];
+		for (unsigned k = 0; k < 32; k += 8) {
+			vst1q_s16(low + k, vld1q_s16(differences + k));
+			vst1q_s16(high + k, vld1q_s16(differences + k));
+		}
+		for (unsigned span = 1; span < 8; span *= 2) {
+			for (unsigned k = 0; k + span + 8 <= 32; k += 8) {
+				vst1q_s16(low + k, vminq_s16(vld1q_s16(low + k), vld1q_s16(low + k + span)));
+				vst1q_s16(high + k, vmaxq_s16(vld1q_s16(high + k), vld1q_s16(high + k + span)));
+			}
+		}
+		int16x8_t bright = vdupq_n_s16(0), dark = vdupq_n_s16(0);
+		for (unsigned k = 0; k < 16; k += 8) {
+			int16x8_t last = vld1q_s16(differences + k + ArcLength - 1);
+			bright = vmaxq_s16(bright, vminq_s16(vld1q_s16(low + k), last));
+			dark = vmaxq_s16(dark, vnegq_s16(vmaxq_s16(vld1q_s16(high + k), last)));
+		}
+		int16x8_t best = vmaxq_s16(bright, dark);
+		int16x4_t folded = vmax_s16(vget_low_s16(best), vget_high_s16(best));
+		folded = vpmax_s16(folded, folded);
+		folded = vpmax_s16(folded, folded);
+		return unsigned(vget_lane_s16(folded, 0) - 1);
+	}
+#endif
+	int16_t low[32], high[32];
+	for (unsigned k = 0; k < 32; k++) {
+		low[k] = high[k] = differences[k];
+	}
+	for (unsigned span = 1; span < 8; span *= 2) {
+		for (unsigned k = 0; k + span < 32; k++) {
+			low[k] = (std::min)(low[k], low[k + span]);
+			high[k] = (std::max)(high[k], high[k + span]);
+		}
+	}
+	int best = 0;
+	for (unsigned k = 0; k < 16; k++) {
+		int last = differences[k + ArcLength - 1];
+		best = (std::max)(best, (std::max)((std::min)(int(low[k]), last), -(std::max)(int(high[k]), last)));
+	}
+	return unsigned(best - 1);
+}
+
+// Sets flags[x - x0] for the corners among pixels [x0, x1) of a row at least 3 pixels
+// inside the image.
+template <bool Vectorized>
+static void FastRow(const uint8_t* row, const int* offsets, unsigned x0, unsigned x1, unsigned width, unsigned threshold,
+	uint8_t* flags) {
+	unsigned x = x0;
+#if defined(UNIGLES_SIMD_SSE2)
+	if (Vectorized) {
+		// SSE2 only compares signed bytes; the bias maps unsigned order onto them. The
+		// thresholds saturate, where the scalar test's can never be passed either.
+		const __m128i bias = _mm_set1_epi8(char(0x80));
+		const __m128i limit = _mm_set1_epi8(char((std::min)(threshold, 255u)));
+		const __m128i one = _mm_set1_epi8(1);
+		const __m128i arc = _mm_set1_epi8(char(ArcLength));
+		for (; x + 16 <= x1 && x + 16 + CircleRadius <= width; x += 16) {
+			const uint8_t* p = row + x;
+			__m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i high = _mm_xor_si128(_mm_adds_epu8(center, limit), bias);
+			__m128i low = _mm_xor_si128(_mm_subs_epu8(center, limit), bias);
+			__m128i bright[16], dark[16];
+			for (unsigned k = 0; k < 16; k++) {
+				__m128i value = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + offsets[k])), bias);
+				bright[k] = _mm_cmpgt_epi8(value, high);
+				dark[k] = _mm_cmpgt_epi8(low, value);
+			}
+			// Any arc of nine holds two neighbouring compass points.
+			__m128i brightPairs = _mm_or_si128(
+				_mm_or_si128(_mm_and_si128(bright[0], bright[4]), _mm_and_si128(bright[4], bright[8])),
+				_mm_or_si128(_mm_and_si128(bright[8], bright[12]), _mm_and_si128(bright[12], bright[0])));
+			__m128i darkPairs = _mm_or_si128(
+				_mm_or_si128(_mm_and_si128(dark[0], dark[4]), _mm_and_si128(dark[4], dark[8])),
+				_mm_or_si128(_mm_and_si128(dark[8], dark[12]), _mm_and_si128(dark[12], dark[0])));
+			if (_mm_movemask_epi8(_mm_or_si128(brightPairs, darkPairs)) == 0) {
+				memset(flags + x - x0, 0, 16);
+				continue;
+			}
+			// Runs of passing pixels, counted round the circle and then nine past the start.
+			__m128i brightRun = _mm_setzero_si128(), brightBest = _mm_setzero_si128();
+			__m128i darkRun = _mm_setzero_si128(), darkBest = _mm_setzero_si128();
+			for (unsigned k = 0; k < 16 + ArcLength - 1; k++) {
+				brightRun = _mm_and_si128(_mm_sub_epi8(brightRun, bright[k & 15]), bright[k & 15]);
+				darkRun = _mm_and_si128(_mm_sub_epi8(darkRun, dark[k & 15]), dark[k & 15]);
+				brightBest = _mm_max_epu8(brightBest, brightRun);
+				darkBest = _mm_max_epu8(darkBest, darkRun);
+			}
+			__m128i best = _mm_max_epu8(brightBest, darkBest);
+			__m128i corner = _mm_cmpeq_epi8(_mm_max_epu8(best, arc), best);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(flags + x - x0), _mm_and_si128(corner, one));
+		}
+	}
+#elif defined(UNIGLES_SIMD_NEON)
+	if (Vectorized) {
+		const uint8x16_t limit = vdupq_n_u8(uint8_t((std::min)(threshold, 255u)));
+		const uint8x16_t one = vdupq_n_u8(1);
+		const uint8x16_t arc = vdupq_n_u8(uint8_t(ArcLength));
+		for (; x + 16 <= x1 && x + 16 + CircleRadius <= width; x += 16) {
+			const uint8_t* p = row + x;
+			uint8x16_t center = vld1q_u8(p);
+			uint8x16_t high = vqaddq_u8(center, limit);
+			uint8x16_t low = vqsubq_u8(center, limit);
+			uint8x16_t bright[16], dark[16];
+			for (unsigned k = 0; k < 16; k++) {
+				uint8x16_t value = vld1q_u8(p + offsets[k]);
+				bright[k] = vcgtq_u8(value, high);
+				dark[k] = vcltq_u8(value, low);
+			}
+			uint8x16_t pairs = vorrq_u8(
+				vorrq_u8(vorrq_u8(vandq_u8(bright[0], bright[4]), vandq_u8(bright[4], bright[8])),
+					vorrq_u8(vandq_u8(bright[8], bright[12]), vandq_u8(bright[12], bright[0]))),
+				vorrq_u8(vorrq_u8(vandq_u8(dark[0], dark[4]), vandq_u8(dark[4], dark[8])),
+					vorrq_u8(vandq_u8(dark[8], dark[12]), vandq_u8(dark[12], dark[0]))));
+			uint64x2_t any = vreinterpretq_u64_u8(pairs);
+			if ((vgetq_lane_u64(any, 0) | vgetq_lane_u64(any, 1)) == 0) {
+				memset(flags + x - x0, 0, 16);
+				continue;
+			}
+			uint8x16_t brightRun = vdupq_n_u8(0), brightBest = vdupq_n_u8(0);
+			uint8x16_t darkRun = vdupq_n_u8(0), darkBest = vdupq_n_u8(0);
+			for (unsigned k = 0; k < 16 + ArcLength - 1; k++) {
+				brightRun = vandq_u8(vsubq_u8(brightRun, bright[k & 15]), bright[k & 15]);
+				darkRun = vandq_u8(vsubq_u8(darkRun, dark[k & 15]), dark[k & 15]);
+				brightBest = vmaxq_u8(brightBest, brightRun);
+				darkBest = vmaxq_u8(darkBest, darkRun);
+			}
+			uint8x16_t corner = vcgeq_u8(vmaxq_u8(brightBest, darkBest), arc);
+			vst1q_u8(flags + x - x0, vandq_u8(corner, one));
+		}
+	}
+#endif
+	for (; x < x1; x++) {
+		flags[x - x0] = IsCorner(row + x, offsets, threshold) ? 1 : 0;
+	}
+}
+
+template <bool Vectorized>
+static void DetectCornersImpl(const uint8_t* image, size_t stride, unsigned width, unsigned height, const FeatureSettings& settings,
+	unsigned x0, unsigned y0, unsigned x1, unsigned y1, std::vector<FastCorner>& corners) {
+	corners.clear();
+	if (width <= 2 * CircleRadius || height <= 2 * CircleRadius) {
+		return;
+	}
+	x0 = (std::max)(x0, CircleRadius);
+	y0 = (std::max)(y0, CircleRadius);
+	x1 = (std::min)(x1, width - CircleRadius);
+	y1 = (std::min)(y1, height - CircleRadius);
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+	int offsets[16];
+	for (unsigned k = 0; k < 16; k++) {
+		offsets[k] = CircleX[k] + CircleY[k] * int(stride);
+	}
+
+	// Scores, plus one so zero means no corner, over the block and the ring of pixels
+	// around it that suppression compares with.
+	unsigned mapX0 = x0 > CircleRadius ? x0 - 1 : x0;
+	unsigned mapY0 = y0 > CircleRadius ? y0 - 1 : y0;
+	unsigned mapX1 = (std::min)(x1 + 1, width - CircleRadius);
+	unsigned mapY1 = (std::min)(y1 + 1, height - CircleRadius);
+	unsigned mapWidth = mapX1 - mapX0;
+	std::vector<uint16_t> scores(size_t(mapWidth) * (mapY1 - mapY0));
+	std::vector<uint8_t> flags(mapWidth);
+	for (unsigned y = mapY0; y < mapY1; y++) {
+		const uint8_t* row = image + size_t(y) * stride;
+		FastRow<Vectorized>(row, offsets, mapX0, mapX1, width, settings.fastThreshold, flags.data());
+		uint16_t* scoreRow = &scores[size_t(y - mapY0) * mapWidth];
+		for (unsigned x = mapX0; x < mapX1; x++) {
+			if (flags[x - mapX0]) {
+				scoreRow[x - mapX0] = uint16_t(CornerScore<Vectorized>(row + x, offsets) + 1);
+			}
+		}
+	}
+
+	// A corner survives when it beats its eight neighbours. Of equal ones, the first in
+	// raster order wins, wherever the block boundaries fall.
+	auto scoreAt = [&](unsigned x, unsigned y) -> unsigned {
+		if (x < mapX0 || x >= mapX1 || y < mapY0 || y >= mapY1) {
+			return 0;
+		}
+		return scores[size_t(y - mapY0) * mapWidth + (x - mapX0)];
+	};
+	for (unsigned y = y0; y < y1; y++) {
+		const uint16_t* scoreRow = &scores[size_t(y - mapY0) * mapWidth];
+		for (unsigned x = x0; x < x1; x++) {
+			unsigned score = scoreRow[x - mapX0];
+			if (score == 0 ||
+				scoreAt(x - 1, y - 1) >= score || scoreAt(x, y - 1) >= score || scoreAt(x + 1, y - 1) >= score || scoreAt(x - 1, y) >= score ||
+				scoreAt(x + 1, y) > score || scoreAt(x - 1, y + 1) > score || scoreAt(x, y + 1) > score || scoreAt(x + 1, y + 1) > score) {
+				continue;
+			}
+			FastCorner corner;
+			corner.x = x;
+			corner.y = y;
+			corner.score = score - 1;
+			corners.push_back(corner);
+		}
+	}
+	auto stronger = [](const FastCorner& a, const FastCorner& b) {
+		return a.score != b.score ? a.score > b.score : (a.y != b.y ? a.y < b.y : a.x < b.x);
+	};
+	if (corners.size() > settings.maxPerTile) {
+		std::partial_sort(corners.begin(), corners.begin() + settings.maxPerTile, corners.end(), stronger);
+		corners.resize(settings.maxPerTile);
+	} else {
+		std::sort(corners.begin(), corners.end(), stronger);
+	}
+}
+
+void unigles::DetectCorners(const uint8_t* image, size_t stride, unsigned width, unsigned height, const FeatureSettings& settings,
+	unsigned x0, unsigned y0, unsigned x1, unsigned y1, std::vector<FastCorner>& corners) {
+	DetectCornersImpl<true>(image, stride, width, height, settings, x0, y0, x1, y1, corners);
+}
+
+void unigles::DetectCornersScalar(const uint8_t* image, size_t stride, unsigned width, unsigned height, const FeatureSettings& settings,
+	unsigned x0, unsigned y0, unsigned x1, unsigned y1, std::vector<FastCorner>& corners) {
+	DetectCornersImpl<false>(image, stride, width, height, settings, x0, y0, x1, y1, corners);
+}
+
+// Copies PatchStride columns of rows [y0, y0 + rows) from x0, clamping at the edges.
+static void ExtractPatch(const PyramidLevel& level, int x0, int y0, unsigned rows, uint8_t* patch) {
+	int width = int(level.width);
+	int height = int(level.height);
+	const uint8_t* pixels = level.pixels.data();
+	if (x0 >= 0 && y0 >= 0 && x0 + int(PatchStride) <= width && y0 + int(rows) <= height) {
+		for (unsigned row = 0; row < rows; row++) {
+			memcpy(patch + row * PatchStride, pixels + size_t(y0 + int(row)) * width + x0, PatchStride);
+		}
+		return;
+	}
+	for (unsigned row = 0; row < rows; row++) {
+		const uint8_t* source = pixels + size_t((std::min)((std::max)(y0 + int(row), 0), height - 1)) * width;
+		for (unsigned column = 0; column < PatchStride; column++) {
+			patch[row * PatchStride + column] = source[(std::min)((std::max)(x0 + int(column), 0), width - 1)];
+		}
+	}
+}
+
+// Bilinear weights of the fraction of x and y, summing to 1 << WeightBits.
+static void BilinearWeights(double x, double y, int16_t weights[4]) {
+	double a = x - std::floor(x);
+	double b = y - std::floor(y);
+	const double scale = double(1 << WeightBits);
+	weights[0] = int16_t((1.0 - a) * (1.0 - b) * scale + 0.5);
+	weights[1] = int16_t(a * (1.0 - b) * scale + 0.5);
+	weights[2] = int16_t((1.0 - a) * b * scale + 0.5);
+	weights[3] = int16_t((1 << WeightBits) - weights[0] - weights[1] - weights[2]);
+}
+
+// count values, a multiple of eight, between patch rows a and b and the columns after.
+template <bool Vectorized>
+static void InterpolateRow(const uint8_t* a, const uint8_t* b, const int16_t* weights, int16_t* out, unsigned count) {
+	unsigned i = 0;
+#if defined(UNIGLES_SIMD_SSE2)
+	if (Vectorized) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i top = _mm_set1_epi32(int(uint16_t(weights[0]) | (uint32_t(uint16_t(weights[1])) << 16)));
+		const __m128i bottom = _mm_set1_epi32(int(uint16_t(weights[2]) | (uint32_t(uint16_t(weights[3])) << 16)));
+		const __m128i round = _mm_set1_epi32(1 << (ValueShift - 1));
+		for (; i + 8 <= count; i += 8) {
+			__m128i a0 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + i)), zero);
+			__m128i a1 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + i + 1)), zero);
+			__m128i b0 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + i)), zero);
+			__m128i b1 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + i + 1)), zero);
+			// Pixel pairs side by side, so one multiply-add weighs both columns.
+			__m128i low = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a0, a1), top), _mm_madd_epi16(_mm_unpacklo_epi16(b0, b1), bottom));
+			__m128i high = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a0, a1), top), _mm_madd_epi16(_mm_unpackhi_epi16(b0, b1), bottom));
+			low = _mm_srai_epi32(_mm_add_epi32(low, round), ValueShift);
+			high = _mm_srai_epi32(_mm_add_epi32(high, round), ValueShift);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(low, high));
+		}
+	}
+#elif defined(UNIGLES_SIMD_NEON)
+	if (Vectorized) {
+		for (; i + 8 <= count; i += 8) {
+			int16x8_t a0 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(a + i)));
+			int16x8_t a1 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(a + i + 1)));
+			int16x8_t b0 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(b + i)));
+			int16x8_t b1 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(b + i + 1)));
+			int32x4_t low = vmull_n_s16(vget_low_s16(a0), weights[0]);
+			low = vmlal_n_s16(low, vget_low_s16(a1), weights[1]);
+			low = vmlal_n_s16(low, vget_low_s16(b0), weights[2]);
+			low = vmlal_n_s16(low, vget_low_s16(b1), weights[3]);
+			int32x4_t high = vmull_n_s16(vget_high_s16(a0), weights[0]);
+			high = vmlal_n_s16(high, vget_high_s16(a1), weights[1]);
+			high = vmlal_n_s16(high, vget_high_s16(b0), weights[2]);
+			high = vmlal_n_s16(high, vget_high_s16(b1), weights[3]);
+			vst1q_s16(out + i, vcombine_s16(vqmovn_s32(vrshrq_n_s32(low, ValueShift)), vqmovn_s32(vrshrq_n_s32(high, ValueShift))));
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		int sum = a[i] * weights[0] + a[i + 1] * weights[1] + b[i] * weights[2] + b[i + 1] * weights[3];
+		out[i] = int16_t((sum + (1 << (ValueShift - 1))) >> ValueShift);
+	}
+}
+
+// Sums of (next - previous) times the gradients over one padded window row. Each
+// product stays below 2^26, so eight of them fit the 32-bit lanes.
+template <bool Vectorized>
+static void AccumulateRow(const int16_t* next, const int16_t* previous, const int16_t* gradientX, const int16_t* gradientY,
+	int64_t& sumX, int64_t& sumY) {
+	unsigned i = 0;
+#if defined(UNIGLES_SIMD_SSE2)
+	if (Vectorized) {
+		__m128i accumulatorX = _mm_setzero_si128();
+		__m128i accumulatorY = _mm_setzero_si128();
+		for (; i < PaddedWidth; i += 8) {
+			__m128i difference = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(next + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i)));
+			accumulatorX = _mm_add_epi32(accumulatorX, _mm_madd_epi16(difference, _mm_loadu_si128(reinterpret_cast<const __m128i*>(gradientX + i))));
+			accumulatorY = _mm_add_epi32(accumulatorY, _mm_madd_epi16(difference, _mm_loadu_si128(reinterpret_cast<const __m128i*>(gradientY + i))));
+		}
+		int32_t lanesX[4], lanesY[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanesX), accumulatorX);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanesY), accumulatorY);
+		sumX += int64_t(lanesX[0]) + lanesX[1] + lanesX[2] + lanesX[3];
+		sumY += int64_t(lanesY[0]) + lanesY[1] + lanesY[2] + lanesY[3];
+	}
+#elif defined(UNIGLES_SIMD_NEON)
+	if (Vectorized) {
+		int32x4_t accumulatorX = vdupq_n_s32(0);
+		int32x4_t accumulatorY = vdupq_n_s32(0);
+		for (; i < PaddedWidth; i += 8) {
+			int16x8_t difference = vsubq_s16(vld1q_s16(next + i), vld1q_s16(previous + i));
+			int16x8_t x = vld1q_s16(gradientX + i);
+			int16x8_t y = vld1q_s16(gradientY + i);
+			accumulatorX = vmlal_s16(accumulatorX, vget_low_s16(difference), vget_low_s16(x));
+			accumulatorX = vmlal_s16(accumulatorX, vget_high_s16(difference), vget_high_s16(x));
+			accumulatorY = vmlal_s16(accumulatorY, vget_low_s16(difference), vget_low_s16(y));
+			accumulatorY = vmlal_s16(accumulatorY, vget_high_s16(difference), vget_high_s16(y));
+		}
+		int64x2_t pairsX = vpaddlq_s32(accumulatorX);
+		int64x2_t pairsY = vpaddlq_s32(accumulatorY);
+		sumX += vgetq_lane_s64(pairsX, 0) + vgetq_lane_s64(pairsX, 1);
+		sumY += vgetq_lane_s64(pairsY, 0) + vgetq_lane_s64(pairsY, 1);
+	}
+#endif
+	for (; i < PaddedWidth; i++) {
+		int difference = next[i] - previous[i];
+		sumX += difference * gradientX[i];
+		sumY += difference * gradientY[i];
+	}
+}
+
+// One padded window row of values and central differences from three resampled rows
+// that start a column early, and its share of the structure tensor.
+template <bool Vectorized>
+static void GradientRow(const int16_t* above, const int16_t* middle, const int16_t* below,
+	int16_t* values, int16_t* gradientX, int16_t* gradientY, int64_t& a11, int64_t& a12, int64_t& a22) {
+#if defined(UNIGLES_SIMD_SSE2)
+	if (Vectorized) {
+		const __m128i window = _mm_set_epi16(0, -1, -1, -1, -1, -1, -1, -1);
+		__m128i sum11 = _mm_setzero_si128(), sum12 = _mm_setzero_si128(), sum22 = _mm_setzero_si128();
+		for (unsigned i = 0; i < PaddedWidth; i += 8) {
+			__m128i mask = i + 8 < PaddedWidth ? _mm_set1_epi16(-1) : window;
+			__m128i x = _mm_and_si128(_mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(middle + i + 2)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(middle + i))), mask);
+			__m128i y = _mm_and_si128(_mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(below + i + 1)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(above + i + 1))), mask);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(middle + i + 1)), mask));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(gradientX + i), x);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(gradientY + i), y);
+			sum11 = _mm_add_epi32(sum11, _mm_madd_epi16(x, x));
+			sum12 = _mm_add_epi32(sum12, _mm_madd_epi16(x, y));
+			sum22 = _mm_add_epi32(sum22, _mm_madd_epi16(y, y));
+		}
+		int32_t lanes[3][4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[0]), sum11);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[1]), sum12);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[2]), sum22);
+		a11 += int64_t(lanes[0][0]) + lanes[0][1] + lanes[0][2] + lanes[0][3];
+		a12 += int64_t(lanes[1][0]) + lanes[1][1] + lanes[1][2] + lanes[1][3];
+		a22 += int64_t(lanes[2][0]) + lanes[2][1] + lanes[2][2] + lanes[2][3];
+		return;
+	}
+#elif defined(UNIGLES_SIMD_NEON)
+	if (Vectorized) {
+		const int16_t lastLane[8] = { -1, -1, -1, -1, -1, -1, -1, 0 };
+		int32x4_t sum11 = vdupq_n_s32(0), sum12 = vdupq_n_s32(0), sum22 = vdupq_n_s32(0);
+		for (unsigned i = 0; i < PaddedWidth; i += 8) {
+			int16x8_t mask = i + 8 < PaddedWidth ? vdupq_n_s16(-1) : vld1q_s16(lastLane);
+			int16x8_t x = vandq_s16(vsubq_s16(vld1q_s16(middle + i + 2), vld1q_s16(middle + i)), mask);
+			int16x8_t y = vandq_s16(vsubq_s16(vld1q_s16(below + i + 1), vld1q_s16(above + i + 1)), mask);
+			vst1q_s16(values + i, vandq_s16(vld1q_s16(middle + i + 1), mask));
+			vst1q_s16(gradientX + i, x);
+			vst1q_s16(gradientY + i, y);
+			sum11 = vmlal_s16(vmlal_s16(sum11, vget_low_s16(x), vget_low_s16(x)), vget_high_s16(x), vget_high_s16(x));
+			sum12 = vmlal_s16(vmlal_s16(sum12, vget_low_s16(x), vget_low_s16(y)), vget_high_s16(x), vget_high_s16(y));
+			sum22 = vmlal_s16(vmlal_s16(sum22, vget_low_s16(y), vget_low_s16(y)), vget_high_s16(y), vget_high_s16(y));
+		}
+		int64x2_t pairs11 = vpaddlq_s32(sum11), pairs12 = vpaddlq_s32(sum12), pairs22 = vpaddlq_s32(sum22);
+		a11 += vgetq_lane_s64(pairs11, 0) + vgetq_lane_s64(pairs11, 1);
+		a12 += vgetq_lane_s64(pairs12, 0) + vgetq_lane_s64(pairs12, 1);
+		a22 += vgetq_lane_s64(pairs22, 0) + vgetq_lane_s64(pairs22, 1);
+		return;
+	}
+#endif
+	for (unsigned i = 0; i < PaddedWidth; i++) {
+		bool inside = i < WindowSize;
+		int x = inside ? middle[i + 2] - middle[i] : 0;
+		int y = inside ? below[i + 1] - above[i + 1] : 0;
+		values[i] = inside ? middle[i + 1] : 0;
+		gradientX[i] = int16_t(x);
+		gradientY[i] = int16_t(y);
+		a11 += x * x;
+		a12 += x * y;
+		a22 += y * y;
+	}
+}
+
+// The previous frame's window around a point, resampled once per level.
+struct FlowWindow {
+	int16_t values[WindowSize][PaddedWidth];
+	int16_t gradientX[WindowSize][PaddedWidth];	// Central differences, so twice the gradient
+	int16_t gradientY[WindowSize][PaddedWidth];
+	double a11, a12, a22;						// Structure tensor of the gradients
+};
+
+template <bool Vectorized>
+static void PrepareWindow(const PyramidLevel& level, double x, double y, FlowWindow& window) {
+	// One more row and column on every side for the differences.
+	double left = x - HalfWindow - 1;
+	double top = y - HalfWindow - 1;
+	uint8_t patch[PatchRows * PatchStride];
+	ExtractPatch(level, int(std::floor(left)), int(std::floor(top)), WindowSize + 3, patch);
+	int16_t weights[4];
+	BilinearWeights(left, top, weights);
+	int16_t values[WindowSize + 2][PaddedWidth + 8];
+	for (unsigned row = 0; row < WindowSize + 2; row++) {
+		InterpolateRow<Vectorized>(patch + row * PatchStride, patch + (row + 1) * PatchStride, weights, values[row], PaddedWidth + 8);
+	}
+	int64_t a11 = 0, a12 = 0, a22 = 0;
+	for (unsigned row = 0; row < WindowSize; row++) {
+		GradientRow<Vectorized>(values[row], values[row + 1], values[row + 2],
+			window.values[row], window.gradientX[row], window.gradientY[row], a11, a12, a22);
+	}
+	window.a11 = double(a11);
+	window.a12 = double(a12);
+	window.a22 = double(a22);
+}
+
+// Mismatch of the current frame's window at x, y against the previous one.
+template <bool Vectorized>
+static void CompareWindow(const PyramidLevel& level, const FlowWindow& window, double x, double y,
+	int64_t* sumX, int64_t* sumY, int64_t* absolute) {
+	double left = x - HalfWindow;
+	double top = y - HalfWindow;
+	uint8_t patch[PatchRows * PatchStride];
+	ExtractPatch(level, int(std::floor(left)), int(std::floor(top)), WindowSize + 1, patch);
+	int16_t weights[4];
+	BilinearWeights(left, top, weights);
+	int16_t values[PaddedWidth];
+	for (unsigned row = 0; row < WindowSize; row++) {
+		InterpolateRow<Vectorized>(patch + row * PatchStride, patch + (row + 1) * PatchStride, weights, values, PaddedWidth);
+		if (absolute) {
+			for (unsigned column = 0; column < WindowSize; column++) {
+				*absolute += std::abs(values[column] - window.values[row][column]);
+			}
+		} else {
+			AccumulateRow<Vectorized>(values, window.values[row], window.gradientX[row], window.gradientY[row], *sumX, *sumY);
+		}
+	}
+}
+
+template <bool Vectorized>
+static bool TrackPointImpl(const GaussianPyramid& previous, const GaussianPyramid& current, const FeatureSettings& settings,
+	float x, float y, float& nextX, float& nextY, float& error) {
+	unsigned levels = (std::min)(previous.GetLevelCount(), current.GetLevelCount());
+	if (levels == 0) {
+		return false;
+	}
+	const double pixels = double(WindowSize * WindowSize);
+	// Values carry 5 fractional bits and the gradients are central differences, so the
+	// tensor is in 1/4096 and the mismatch sums in 1/2048 of levels squared per pixel.
+	const double tensorScale = 1.0 / (64.0 * 64.0);
+	double guessX = std::ldexp(double(nextX), -int(levels - 1));
+	double guessY = std::ldexp(double(nextY), -int(levels - 1));
+	FlowWindow window;
+	for (unsigned level = levels; level-- > 0;) {
+		const PyramidLevel& source = previous.GetLevel(level);
+		const PyramidLevel& target = current.GetLevel(level);
+		double pointX = std::ldexp(double(x), -int(level));
+		double pointY = std::ldexp(double(y), -int(level));
+		PrepareWindow<Vectorized>(source, pointX, pointY, window);
+		double determinant = window.a11 * window.a22 - window.a12 * window.a12;
+		double trace = window.a11 + window.a22;
+		double minEigenvalue = 0.5 * (trace - std::sqrt((window.a11 - window.a22) * (window.a11 - window.a22) + 4.0 * window.a12 * window.a12));
+		if (minEigenvalue * tensorScale / pixels < settings.minEigenvalue || determinant <= 0.0) {
+			// Coarse levels may blur a small corner away; the finer ones still see it.
+			if (level == 0) {
+				return false;
+			}
+		} else {
+			for (unsigned iteration = 0; iteration < settings.maxIterations; iteration++) {
+				int64_t sumX = 0, sumY = 0;
+				CompareWindow<Vectorized>(target, window, guessX, guessY, &sumX, &sumY, nullptr);
+				// The step solving G d = -b, with G and b back in levels and pixels.
+				double stepX = -2.0 * (window.a22 * double(sumX) - window.a12 * double(sumY)) / determinant;
+				double stepY = -2.0 * (window.a11 * double(sumY) - window.a12 * double(sumX)) / determinant;
+				guessX += stepX;
+				guessY += stepY;
+				if (guessX < -HalfWindow || guessY < -HalfWindow ||
+					guessX > double(target.width - 1) + HalfWindow || guessY > double(target.height - 1) + HalfWindow) {
+					return false;
+				}
+				if (stepX * stepX + stepY * stepY < double(settings.epsilon) * settings.epsilon) {
+					break;
+				}
+			}
+		}
+		if (level > 0) {
+			guessX *= 2.0;
+			guessY *= 2.0;
+		}
+	}
+	const PyramidLevel& finest = current.GetLevel(0);
+	if (guessX < 0.0 || guessY < 0.0 || guessX > double(finest.width - 1) || guessY > double(finest.height - 1)) {
+		return false;
+	}
+	int64_t absolute = 0;
+	CompareWindow<Vectorized>(finest, window, guessX, guessY, nullptr, nullptr, &absolute);
+	nextX = float(guessX);
+	nextY = float(guessY);
+	error = float(double(absolute) / (32.0 * pixels));
+	return error <= settings.maxError;
+}
+
+bool unigles::TrackPoint(const GaussianPyramid& previous, const GaussianPyramid& current, const FeatureSettings& settings,
+	float x, float y, float& nextX, float& nextY, float& error) {
+	return TrackPointImpl<true>(previous, current, settings, x, y, nextX, nextY, error);
+}
+
+bool unigles::TrackPointScalar(const GaussianPyramid& previous, const GaussianPyramid& current, const FeatureSettings& settings,
+	float x, float y, float& nextX, float& nextY, float& error) {
+	return TrackPointImpl<false>(previous, current, settings, x, y, nextX, nextY, error);
+}
+
+FeatureTracker::FeatureTracker(const FeatureSettings& settings) :
+	mSettings(settings),
+	mNextId(0),
+	mFrames(0),
+	mLastMilliseconds(0.0) {}
+
+void FeatureTracker::Reset() {
+	mFeatures.clear();
+	mStats = FeatureStats();
+}
+
+void FeatureTracker::Process(const GaussianPyramid& previous, const GaussianPyramid& current, std::vector<FeaturePoint>& features,
+	TaskPool* pool) {
+	Run(previous, current, pool ? pool : &TaskPool::Default(), true);
+	features = mFeatures;
+}
+
+void FeatureTracker::ProcessScalar(const GaussianPyramid& previous, const GaussianPyramid& current, std::vector<FeaturePoint>& features) {
+	Run(previous, current, nullptr, false);
+	features = mFeatures;
+}
+
+void FeatureTracker::Run(const GaussianPyramid& previous, const GaussianPyramid& current, TaskPool* pool, bool vectorized) {
+	auto start = std::chrono::steady_clock::now();
+	mFrames++;
+	mStats = FeatureStats();
+	if (current.GetLevelCount() == 0) {
+		mFeatures.clear();
+		mLastMilliseconds = 0.0;
+		return;
+	}
+	const PyramidLevel& image = current.GetLevel(0);
+	if (previous.GetLevelCount() == 0 || previous.GetLevel(0).width != image.width || previous.GetLevel(0).height != image.height) {
+		mFeatures.clear();
+	}
+
+	// Every point starts from where its last motion would take it.
+	unsigned count = unsigned(mFeatures.size());
+	mTracked.resize(count);
+	mTrackedStatus.assign(count, 0);
+	ForEach(pool, (count + PointsPerTask - 1) / PointsPerTask, [&](unsigned task) {
+		unsigned end = (std::min)(count, (task + 1) * PointsPerTask);
+		for (unsigned i = task * PointsPerTask; i < end; i++) {
+			const FeaturePoint& point = mFeatures[i];
+			FeaturePoint& next = mTracked[i];
+			next = point;
+			next.x = point.x + point.dx;
+			next.y = point.y + point.dy;
+			bool found = vectorized ?
+				TrackPoint(previous, current, mSettings, point.x, point.y, next.x, next.y, next.error) :
+				TrackPointScalar(previous, current, mSettings, point.x, point.y, next.x, next.y, next.error);
+			next.dx = next.x - point.x;
+			next.dy = next.y - point.y;
+			next.age = point.age + 1;
+			mTrackedStatus[i] = found ? 1 : 0;
+		}
+	});
+	mFeatures.clear();
+	for (unsigned i = 0; i < count; i++) {
+		if (mTrackedStatus[i]) {
+			mFeatures.push_back(mTracked[i]);
+		}
+	}
+	mStats.tracked = unsigned(mFeatures.size());
+	mStats.lost = count - mStats.tracked;
+	auto tracked = std::chrono::steady_clock::now();
+	mStats.trackMilliseconds = std::chrono::duration<double, std::milli>(tracked - start).count();
+
+	if (mFeatures.size() < mSettings.maxFeatures) {
+		Detect(image, pool, vectorized);
+	}
+	auto end = std::chrono::steady_clock::now();
+	mStats.detectMilliseconds = std::chrono::duration<double, std::milli>(end - tracked).count();
+	mLastMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void FeatureTracker::Detect(const PyramidLevel& image, TaskPool* pool, bool vectorized) {
+	unsigned tileSize = (std::max)(mSettings.tileSize, 16u);
+	unsigned tilesX = (image.width + tileSize - 1) / tileSize;
+	unsigned tilesY = (image.height + tileSize - 1) / tileSize;
+	mTileCorners.resize(size_t(tilesX) * tilesY);
+	ForEach(pool, tilesX * tilesY, [&](unsigned tile) {
+		unsigned x0 = (tile % tilesX) * tileSize;
+		unsigned y0 = (tile / tilesX) * tileSize;
+		unsigned x1 = (std::min)(x0 + tileSize, image.width);
+		unsigned y1 = (std::min)(y0 + tileSize, image.height);
+		if (vectorized) {
+			DetectCorners(image.pixels.data(), image.width, image.width, image.height, mSettings, x0, y0, x1, y1, mTileCorners[tile]);
+		} else {
+			DetectCornersScalar(image.pixels.data(), image.width, image.width, image.height, mSettings, x0, y0, x1, y1, mTileCorners[tile]);
+		}
+	});
+	mCandidates.clear();
+	for (const std::vector<FastCorner>& corners : mTileCorners) {
+		mCandidates.insert(mCandidates.end(), corners.begin(), corners.end());
+	}
+	std::sort(mCandidates.begin(), mCandidates.end(), [](const FastCorner& a, const FastCorner& b) {
+		return a.score != b.score ? a.score > b.score : (a.y != b.y ? a.y < b.y : a.x < b.x);
+	});
+
+	// A grid of minDistance cells: a corner is only taken when its cell and the eight
+	// around it are empty, which keeps it at least that far from any other feature.
+	unsigned cell = (std::max)(mSettings.minDistance, 1u);
+	unsigned gridWidth = image.width / cell + 1;
+	unsigned gridHeight = image.height / cell + 1;
+	mOccupied.assign(size_t(gridWidth) * gridHeight, 0);
+	auto cellOf = [&](float x, float y, unsigned& cx, unsigned& cy) {
+		cx = (std::min)(unsigned((std::max)(x, 0.0f)) / cell, gridWidth - 1);
+		cy = (std::min)(unsigned((std::max)(y, 0.0f)) / cell, gridHeight - 1);
+	};
+	for (const FeaturePoint& point : mFeatures) {
+		unsigned cx, cy;
+		cellOf(point.x, point.y, cx, cy);
+		mOccupied[size_t(cy) * gridWidth + cx] = 1;
+	}
+	for (const FastCorner& corner : mCandidates) {
+		if (mFeatures.size() >= mSettings.maxFeatures) {
+			break;
+		}
+		unsigned cx, cy;
+		cellOf(float(corner.x), float(corner.y), cx, cy);
+		bool available = true;
+		for (unsigned y = cy > 0 ? cy - 1 : 0; y <= (std::min)(cy + 1, gridHeight - 1) && available; y++) {
+			for (unsigned x = cx > 0 ? cx - 1 : 0; x <= (std::min)(cx + 1, gridWidth - 1); x++) {
+				if (mOccupied[size_t(y) * gridWidth + x]) {
+					available = false;
+					break;
+				}
+			}
+		}
+		if (!available) {
+			continue;
+		}
+		mOccupied[size_t(cy) * gridWidth + cx] = 1;
+		FeaturePoint point;
+		point.x = float(corner.x);
+		point.y = float(corner.y);
+		point.id = ++mNextId;
+		point.score = corner.score;
+		mFeatures.push_back(point);
+		mStats.detected++;
+	}
+}
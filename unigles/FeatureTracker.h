@@ -0,0 +1,116 @@
+#pragma once
+
+#include "GaussianPyramid.h"
+#include "Nv12FrameBuffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace unigles {
+	class TaskPool;
+
+	struct FeatureSettings {
+		// Nine contiguous pixels of the radius 3 circle must all differ from the center by
+		// more than this, in the same direction, for a FAST corner.
+		unsigned fastThreshold = 20;
+		// Corners are found in tiles of tileSize pixels, and only the maxPerTile strongest of
+		// each are kept, so new features spread over the frame.
+		unsigned tileSize = 64;
+		unsigned maxPerTile = 4;
+		// Detection tops the tracked points up to maxFeatures, with new corners at least
+		// minDistance pixels from every other feature.
+		unsigned maxFeatures = 400;
+		unsigned minDistance = 8;
+		// Lucas-Kanade iterations per pyramid level, which stop early once a step is
+		// shorter than epsilon pixels.
+		unsigned maxIterations = 10;
+		float epsilon = 0.03f;
+		// Mean squared gradient of the window along its weakest direction, in levels per
+		// pixel squared; flatter windows cannot be tracked.
+		float minEigenvalue = 2.0f;
+		// Mean absolute difference between the tracked windows, in levels, above which a
+		// point is taken to be lost, typically because it was occluded.
+		float maxError = 24.0f;
+	};
+
+	struct FastCorner {
+		unsigned x = 0;
+		unsigned y = 0;
+		unsigned score = 0;		// Largest threshold at which it is still a corner
+	};
+
+	// FAST-9 corners in [x0, x1) x [y0, y1) of an 8-bit image that are stronger than their
+	// eight neighbours, strongest first and at most maxPerTile of them. Pixels within 3 of
+	// the edge are never corners. Sixteen pixels are tested at once, after a check of the
+	// four compass points of the circle rejects most of them. Bit exact with the scalar
+	// version.
+	void DetectCorners(const uint8_t* image, size_t stride, unsigned width, unsigned height, const FeatureSettings& settings,
+		unsigned x0, unsigned y0, unsigned x1, unsigned y1, std::vector<FastCorner>& corners);
+	void DetectCornersScalar(const uint8_t* image, size_t stride, unsigned width, unsigned height, const FeatureSettings& settings,
+		unsigned x0, unsigned y0, unsigned x1, unsigned y1, std::vector<FastCorner>& corners);
+
+	// Pyramidal Lucas-Kanade with a 15x15 window: follows the point at x, y of previous's
+	// level 0 into current, coarse to fine over the levels both have. nextX and nextY hold
+	// a guess on entry and the position on return; error gets the mean absolute
+	// difference of the windows. False when the point is lost: its window is too flat,
+	// it left the image or error exceeds maxError. Windows are resampled in fixed point,
+	// so the result is bit exact with the scalar version.
+	bool TrackPoint(const GaussianPyramid& previous, const GaussianPyramid& current, const FeatureSettings& settings,
+		float x, float y, float& nextX, float& nextY, float& error);
+	bool TrackPointScalar(const GaussianPyramid& previous, const GaussianPyramid& current, const FeatureSettings& settings,
+		float x, float y, float& nextX, float& nextY, float& error);
+
+	struct FeatureStats {
+		unsigned tracked = 0;		// In the last frame
+		unsigned lost = 0;
+		unsigned detected = 0;
+		double trackMilliseconds = 0.0;
+		double detectMilliseconds = 0.0;
+
+		double PointsPerMillisecond() const { return trackMilliseconds > 0.0 ? (tracked + lost) / trackMilliseconds : 0.0; }
+	};
+
+	// Sparse feature tracking on the CPU: the points of the last frame are followed into
+	// the new one, and FAST corners of the new frame replace the ones lost. Works on the
+	// Gaussian pyramids of consecutive luma planes, so the caller keeps the previous
+	// frame's pyramid alive and builds one per frame.
+	class FeatureTracker {
+	public:
+		explicit FeatureTracker(const FeatureSettings& settings = FeatureSettings());
+
+		void SetSettings(const FeatureSettings& settings) { mSettings = settings; }
+		const FeatureSettings& GetSettings() const { return mSettings; }
+
+		// previous must be the pyramid current was the last time; after Reset(), or when
+		// the size changed, the points are detected afresh. features gets the points of
+		// current. Points and tiles go over the pool, TaskPool::Default() when null.
+		void Process(const GaussianPyramid& previous, const GaussianPyramid& current, std::vector<FeaturePoint>& features,
+			TaskPool* pool = nullptr);
+		// Single threaded reference the vectorized version is checked against.
+		void ProcessScalar(const GaussianPyramid& previous, const GaussianPyramid& current, std::vector<FeaturePoint>& features);
+		void Reset();
+
+		const std::vector<FeaturePoint>& GetFeatures() const { return mFeatures; }
+		const FeatureStats& GetStats() const { return mStats; }
+		uint64_t GetFrameCount() const { return mFrames; }
+		double GetLastMilliseconds() const { return mLastMilliseconds; }
+
+	private:
+		void Run(const GaussianPyramid& previous, const GaussianPyramid& current, TaskPool* pool, bool vectorized);
+		void Detect(const PyramidLevel& image, TaskPool* pool, bool vectorized);
+
+		FeatureSettings mSettings;
+		std::vector<FeaturePoint> mFeatures;
+		// Scratch kept from frame to frame.
+		std::vector<FeaturePoint> mTracked;
+		std::vector<uint8_t> mTrackedStatus;
+		std::vector<std::vector<FastCorner>> mTileCorners;
+		std::vector<FastCorner> mCandidates;
+		std::vector<uint8_t> mOccupied;
+		uint32_t mNextId;
+		FeatureStats mStats;
+		uint64_t mFrames;
+		double mLastMilliseconds;
+	};
+}
@@ -0,0 +1,33 @@
+#include "FrameHub.h"
+
+#include <cmath>
+
+using namespace unigles;
+
+FrameRateGate::FrameRateGate(double framesPerSecond, int64_t ticksPerSecond) :
+	mPeriod(framesPerSecond > 0.0 ? int64_t(std::llround(ticksPerSecond / framesPerSecond)) : 0),
+	mNext(0),
+	mStarted(false) {
+}
+
+bool FrameRateGate::Admit(int64_t timestamp) {
+	if (mPeriod <= 0) {
+		return true;
+	}
+	// A clock that went back, as after a capture restart, starts the schedule over.
+	if (mStarted && timestamp < mNext - 2 * mPeriod) {
+		mStarted = false;
+	}
+	// An eighth of a period early still counts, so a frame a hair ahead of the schedule
+	// is not passed over for the next one, a whole source interval later.
+	if (mStarted && timestamp < mNext - mPeriod / 8) {
+		return false;
+	}
+	// After a gap the schedule restarts from this frame rather than bursting to catch up.
+	if (!mStarted || timestamp - mNext >= mPeriod) {
+		mNext = timestamp;
+	}
+	mNext += mPeriod;
+	mStarted = true;
+	return true;
+}
@@ -0,0 +1,452 @@
+#pragma once
+
+#include "PipelineEdge.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	template <typename T>
+	struct FramePoolState;
+
+	template <typename T>
+	struct FrameSlot {
+		T payload;
+		uint64_t sequence = 0;
+		int64_t timestamp = 0;
+		std::atomic<unsigned> references{ 0 };
+		// Keeps the pool alive while the frame is out; dropped when the frame comes back.
+		std::shared_ptr<FramePoolState<T>> pool;
+	};
+
+	template <typename T>
+	struct FramePoolState {
+		std::mutex mutex;
+		std::vector<std::unique_ptr<FrameSlot<T>>> slots;
+		std::vector<FrameSlot<T>*> free;
+		unsigned capacity = 0;
+		uint64_t exhausted = 0;
+	};
+
+	// Reference to a pooled frame. Copies share the frame through an atomic count, and
+	// the buffer goes back to its pool when the last copy is released, on whichever
+	// thread that happens and even if the pool itself is gone by then. A published frame
+	// is shared by every consumer, so only the producer may write to it, before publishing.
+	template <typename T>
+	class FrameHandle {
+	public:
+		FrameHandle() :
+			mSlot(nullptr) {
+		}
+
+		FrameHandle(const FrameHandle& other) :
+			mSlot(other.mSlot) {
+			if (mSlot) {
+				mSlot->references.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		FrameHandle(FrameHandle&& other) :
+			mSlot(other.mSlot) {
+			other.mSlot = nullptr;
+		}
+
+		FrameHandle& operator=(FrameHandle other) {
+			std::swap(mSlot, other.mSlot);
+			return *this;
+		}
+
+		~FrameHandle() {
+			Reset();
+		}
+
+		void Reset() {
+			if (mSlot && mSlot->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				// The last slot to come back may take the pool down with it, after the unlock.
+				std::shared_ptr<FramePoolState<T>> pool = std::move(mSlot->pool);
+				std::lock_guard<std::mutex> lock(pool->mutex);
+				pool->free.push_back(mSlot);
+			}
+			mSlot = nullptr;
+		}
+
+		explicit operator bool() const { return mSlot != nullptr; }
+		const T& operator*() const { return mSlot->payload; }
+		const T* operator->() const { return &mSlot->payload; }
+		// The payload while this is the frame's only reference, null once it is shared.
+		T* GetMutable() const { return mSlot && mSlot->references.load(std::memory_order_acquire) == 1 ? &mSlot->payload : nullptr; }
+
+		// Assigned by the hub when the frame is published.
+		uint64_t GetSequence() const { return mSlot ? mSlot->sequence : 0; }
+		int64_t GetTimestamp() const { return mSlot ? mSlot->timestamp : 0; }
+		unsigned GetUseCount() const { return mSlot ? mSlot->references.load(std::memory_order_relaxed) : 0; }
+
+	private:
+		template <typename> friend class FramePool;
+		template <typename> friend class FrameHub;
+
+		explicit FrameHandle(FrameSlot<T>* slot) :
+			mSlot(slot) {
+		}
+
+		FrameSlot<T>* mSlot;
+	};
+
+	struct FramePoolStats {
+		unsigned allocated = 0;
+		unsigned free = 0;
+		uint64_t exhausted = 0;		// Acquires refused because every buffer was out
+	};
+
+	// Buffers allocated on demand up to a capacity and recycled as their handles are
+	// released, so payloads like frames keep their storage from one use to the next.
+	template <typename T>
+	class FramePool {
+	public:
+		// Zero capacity allocates whenever no buffer is free.
+		explicit FramePool(unsigned capacity = 0) :
+			mState(std::make_shared<FramePoolState<T>>()) {
+			mState->capacity = capacity;
+		}
+
+		// Empty when every buffer is out and the pool is at capacity.
+		FrameHandle<T> Acquire() {
+			std::lock_guard<std::mutex> lock(mState->mutex);
+			FrameSlot<T>* slot = nullptr;
+			if (!mState->free.empty()) {
+				slot = mState->free.back();
+				mState->free.pop_back();
+			} else if (mState->capacity == 0 || mState->slots.size() < mState->capacity) {
+				mState->slots.emplace_back(new FrameSlot<T>());
+				slot = mState->slots.back().get();
+			} else {
+				mState->exhausted++;
+				return FrameHandle<T>();
+			}
+			slot->references.store(1, std::memory_order_relaxed);
+			slot->sequence = 0;
+			slot->timestamp = 0;
+			slot->pool = mState;
+			return FrameHandle<T>(slot);
+		}
+
+		FramePoolStats GetStats() const {
+			std::lock_guard<std::mutex> lock(mState->mutex);
+			FramePoolStats stats;
+			stats.allocated = unsigned(mState->slots.size());
+			stats.free = unsigned(mState->free.size());
+			stats.exhausted = mState->exhausted;
+			return stats;
+		}
+
+	private:
+		std::shared_ptr<FramePoolState<T>> mState;
+	};
+
+	// Picks the frames of a stream that a subscriber at a lower rate takes: evenly spaced,
+	// without drifting, and taking a frame a little early so timestamp jitter does not
+	// make it skip one. Zero frames per second takes every frame.
+	class FrameRateGate {
+	public:
+		FrameRateGate(double framesPerSecond, int64_t ticksPerSecond);
+
+		bool Admit(int64_t timestamp);
+
+	private:
+		int64_t mPeriod;
+		int64_t mNext;
+		bool mStarted;
+	};
+
+	struct FrameSubscription {
+		std::string name;
+		// Empty for the published frames themselves, otherwise a format added to the hub.
+		std::string format;
+		double framesPerSecond = 0.0;	// Zero for every frame
+		unsigned depth = 1;				// Frames queued before the oldest is replaced
+	};
+
+	struct SubscriberStats {
+		std::string name;
+		std::string format;
+		uint64_t offered = 0;		// Frames due at the subscriber's rate
+		uint64_t skipped = 0;		// Frames published while it was not due
+		uint64_t missed = 0;		// Due, but there was no buffer to convert into or the conversion failed
+		EdgeStats delivery;			// Frames taken, and frames replaced before it took them
+		uint64_t sequenceLag = 0;	// Frames published since the one it took last
+		// From a frame's timestamp to the subscriber taking it.
+		double lastLagMilliseconds = 0.0;
+		double meanLagMilliseconds = 0.0;
+		double maxLagMilliseconds = 0.0;
+	};
+
+	struct FrameFormatStats {
+		std::string format;
+		uint64_t conversions = 0;
+		uint64_t failures = 0;
+		double milliseconds = 0.0;	// Spent converting, in total
+		FramePoolStats pool;
+	};
+
+	// Fans published frames out to subscribers that each take them at their own rate and
+	// in their own format. A format is converted once per frame, into a pooled buffer
+	// shared by every subscriber of that format that is due, and only when one is due.
+	// Subscribers get handles, so nothing is copied and a buffer is recycled when the
+	// last of them lets go. Each subscriber has its own latest-wins queue, so a slow one
+	// only loses its own frames. One producer; any number of consumer threads.
+	template <typename T>
+	class FrameHub {
+	public:
+		typedef unsigned SubscriberId;
+		// Fills target from source; false when the frame could not be converted. The
+		// target is a recycled buffer and may hold an older frame of the same format.
+		typedef std::function<bool(const T& source, T& target)> Converter;
+
+		// Timestamps and the now given to TryPop are in ticksPerSecond units.
+		explicit FrameHub(unsigned sourceBuffers = 4, int64_t ticksPerSecond = 10000000) :
+			mSourcePool(sourceBuffers),
+			mTicksPerSecond(ticksPerSecond),
+			mPublished(0),
+			mNextId(1) {
+		}
+
+		void AddFormat(const std::string& format, Converter convert, unsigned buffers = 4) {
+			if (format.empty()) {
+				throw std::invalid_argument("the published frames' format has no name");
+			}
+			std::lock_guard<std::mutex> lock(mMutex);
+			std::shared_ptr<Format> entry(new Format(buffers));
+			entry->stats.format = format;
+			entry->convert = convert;
+			for (auto& existing : mFormats) {
+				if (existing->stats.format == format) {
+					existing = entry;
+					return;
+				}
+			}
+			mFormats.push_back(entry);
+		}
+
+		SubscriberId Subscribe(const FrameSubscription& subscription) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (!subscription.format.empty() && !FindFormat(subscription.format)) {
+				throw std::invalid_argument("unknown frame format " + subscription.format);
+			}
+			EdgeSettings settings;
+			settings.policy = EdgePolicy::LatestWins;
+			settings.capacity = (std::max)(subscription.depth, 1u);
+			std::shared_ptr<Subscriber> subscriber(new Subscriber(mNextId++, subscription, mTicksPerSecond, settings));
+			mSubscribers.push_back(subscriber);
+			return subscriber->id;
+		}
+
+		// Frames it has queued are released; handles it already took stay valid.
+		void Unsubscribe(SubscriberId id) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			mSubscribers.erase(std::remove_if(mSubscribers.begin(), mSubscribers.end(), [id](const std::shared_ptr<Subscriber>& subscriber) {
+				return subscriber->id == id;
+			}), mSubscribers.end());
+		}
+
+		// A buffer for the producer to fill and publish; empty when all are out, in which
+		// case the frame is best dropped at the source.
+		FrameHandle<T> Acquire() {
+			return mSourcePool.Acquire();
+		}
+
+		void Publish(FrameHandle<T> frame, int64_t timestamp) {
+			if (!frame) {
+				return;
+			}
+			std::vector<std::shared_ptr<Subscriber>> due;
+			std::vector<std::shared_ptr<Format>> formats;
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				frame.mSlot->sequence = ++mPublished;
+				frame.mSlot->timestamp = timestamp;
+				for (const auto& subscriber : mSubscribers) {
+					if (!subscriber->gate.Admit(timestamp)) {
+						subscriber->stats.skipped++;
+						continue;
+					}
+					subscriber->stats.offered++;
+					due.push_back(subscriber);
+					const std::string& format = subscriber->stats.format;
+					if (!format.empty() && std::find_if(formats.begin(), formats.end(), [&](const std::shared_ptr<Format>& entry) {
+						return entry->stats.format == format;
+					}) == formats.end()) {
+						formats.push_back(FindFormat(format));
+					}
+				}
+			}
+
+			// Conversions run outside the lock, so consumers never wait for them.
+			std::vector<FrameHandle<T>> converted;
+			for (const auto& format : formats) {
+				converted.push_back(Convert(*format, frame, timestamp));
+			}
+			for (const auto& subscriber : due) {
+				FrameHandle<T> delivered = frame;
+				for (size_t i = 0; i < formats.size() && !subscriber->stats.format.empty(); i++) {
+					if (formats[i]->stats.format == subscriber->stats.format) {
+						delivered = converted[i];
+					}
+				}
+				if (delivered) {
+					subscriber->edge.Push(std::move(delivered), timestamp);
+				} else {
+					std::lock_guard<std::mutex> lock(mMutex);
+					subscriber->stats.missed++;
+				}
+			}
+		}
+
+		// Takes the oldest frame queued for the subscriber; now is for the lag metrics.
+		bool TryPop(SubscriberId id, FrameHandle<T>& frame, int64_t now) {
+			std::shared_ptr<Subscriber> subscriber = FindSubscriber(id);
+			if (!subscriber || !subscriber->edge.TryPop(frame, now)) {
+				return false;
+			}
+			double lag = double(now - frame.GetTimestamp()) * 1000.0 / mTicksPerSecond;
+			std::lock_guard<std::mutex> lock(mMutex);
+			subscriber->lastSequence = frame.GetSequence();
+			subscriber->stats.lastLagMilliseconds = lag;
+			subscriber->stats.maxLagMilliseconds = (std::max)(subscriber->stats.maxLagMilliseconds, lag);
+			subscriber->lagSum += lag;
+			subscriber->lagCount++;
+			return true;
+		}
+
+		std::vector<SubscriberStats> GetSubscriberStats() const {
+			std::lock_guard<std::mutex> lock(mMutex);
+			std::vector<SubscriberStats> result;
+			for (const auto& subscriber : mSubscribers) {
+				result.push_back(StatsOf(*subscriber));
+			}
+			return result;
+		}
+
+		SubscriberStats GetSubscriberStats(SubscriberId id) const {
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (const auto& subscriber : mSubscribers) {
+				if (subscriber->id == id) {
+					return StatsOf(*subscriber);
+				}
+			}
+			return SubscriberStats();
+		}
+
+		std::vector<FrameFormatStats> GetFormatStats() const {
+			std::lock_guard<std::mutex> lock(mMutex);
+			std::vector<FrameFormatStats> result;
+			for (const auto& format : mFormats) {
+				FrameFormatStats stats = format->stats;
+				stats.pool = format->pool.GetStats();
+				result.push_back(stats);
+			}
+			return result;
+		}
+
+		FramePoolStats GetSourcePoolStats() const { return mSourcePool.GetStats(); }
+
+		uint64_t GetPublishedCount() const {
+			std::lock_guard<std::mutex> lock(mMutex);
+			return mPublished;
+		}
+
+	private:
+		struct Format {
+			explicit Format(unsigned buffers) :
+				pool(buffers) {
+			}
+
+			FramePool<T> pool;
+			Converter convert;
+			FrameFormatStats stats;
+		};
+
+		struct Subscriber {
+			Subscriber(SubscriberId subscriberId, const FrameSubscription& subscription, int64_t ticksPerSecond, const EdgeSettings& settings) :
+				id(subscriberId),
+				gate(subscription.framesPerSecond, ticksPerSecond),
+				edge(subscription.name, settings),
+				lastSequence(0),
+				lagSum(0.0),
+				lagCount(0) {
+				stats.name = subscription.name;
+				stats.format = subscription.format;
+			}
+
+			SubscriberId id;
+			FrameRateGate gate;
+			PipelineEdge<FrameHandle<T>> edge;
+			SubscriberStats stats;
+			uint64_t lastSequence;
+			double lagSum;
+			uint64_t lagCount;
+		};
+
+		std::shared_ptr<Format> FindFormat(const std::string& format) const {
+			for (const auto& entry : mFormats) {
+				if (entry->stats.format == format) {
+					return entry;
+				}
+			}
+			return nullptr;
+		}
+
+		SubscriberStats StatsOf(const Subscriber& subscriber) const {
+			SubscriberStats stats = subscriber.stats;
+			stats.delivery = subscriber.edge.GetStats();
+			stats.sequenceLag = mPublished - subscriber.lastSequence;
+			stats.meanLagMilliseconds = subscriber.lagCount > 0 ? subscriber.lagSum / subscriber.lagCount : 0.0;
+			return stats;
+		}
+
+		std::shared_ptr<Subscriber> FindSubscriber(SubscriberId id) const {
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (const auto& subscriber : mSubscribers) {
+				if (subscriber->id == id) {
+					return subscriber;
+				}
+			}
+			return nullptr;
+		}
+
+		FrameHandle<T> Convert(Format& format, const FrameHandle<T>& source, int64_t timestamp) {
+			FrameHandle<T> target = format.pool.Acquire();
+			bool converted = false;
+			auto start = std::chrono::steady_clock::now();
+			if (target) {
+				target.mSlot->sequence = source.GetSequence();
+				target.mSlot->timestamp = timestamp;
+				converted = format.convert(*source, target.mSlot->payload);
+			}
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (converted) {
+				format.stats.conversions++;
+			} else if (target) {
+				format.stats.failures++;
+			}
+			format.stats.milliseconds += milliseconds;
+			return converted ? target : FrameHandle<T>();
+		}
+
+		FramePool<T> mSourcePool;
+		int64_t mTicksPerSecond;
+		mutable std::mutex mMutex;
+		std::vector<std::shared_ptr<Format>> mFormats;
+		std::vector<std::shared_ptr<Subscriber>> mSubscribers;
+		uint64_t mPublished;
+		SubscriberId mNextId;
+	};
+}
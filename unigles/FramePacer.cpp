@@ -0,0 +1,124 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace unigles;
+
+// A timestamp step beyond this (one second) is a new stream, not a late frame.
+static const int64_t MaxTimestampGap = 10000000;
+static const double TicksPerMillisecond = 10000.0;
+
+FramePacer::FramePacer(const PacerSettings& settings) :
+	mSettings(settings),
+	mOffset(0),
+	mInterval(0),
+	mLastTimestamp(0),
+	mHasTimestamp(false),
+	mHasPresented(false),
+	mPresentedDue(0),
+	mPresentedTimestamp(0),
+	mPresentedDisplay(0),
+	mStalled(false) {
+	mSettings.depth = std::min(mSettings.depth, MaxDepth);
+	mSettings.window = std::max(mSettings.window, 1u);
+}
+
+void FramePacer::SetDepth(unsigned depth) {
+	mSettings.depth = std::min(depth, MaxDepth);
+}
+
+void FramePacer::Reset() {
+	mQueue.clear();
+	RestartClock();
+	mInterval = 0;
+}
+
+void FramePacer::RestartClock() {
+	mDelays.clear();
+	mHasTimestamp = false;
+	mHasPresented = false;
+	mStalled = false;
+}
+
+int64_t FramePacer::DueTime(const Entry& entry) const {
+	return entry.timestamp + mOffset + int64_t(mSettings.depth) * mInterval;
+}
+
+bool FramePacer::Push(uint64_t id, int64_t timestamp, int64_t arrival) {
+	mStats.pushed++;
+	if (mHasTimestamp) {
+		int64_t delta = timestamp - mLastTimestamp;
+		if (delta <= 0 || delta > MaxTimestampGap) {
+			// Queued frames belong to the old mapping and could never become due in order.
+			mQueue.clear();
+			RestartClock();
+			mStats.resets++;
+		} else if (mInterval == 0) {
+			mInterval = delta;
+		} else if (delta < 3 * mInterval) {
+			// Gaps from frames the source dropped would drag the estimate up; leave them out.
+			mInterval += (delta - mInterval) / 8;
+		}
+	}
+	mLastTimestamp = timestamp;
+	mHasTimestamp = true;
+
+	// The least delayed recent arrival is the transport latency; everything above it is
+	// jitter the buffer has to hide.
+	mDelays.push_back(arrival - timestamp);
+	if (mDelays.size() > mSettings.window) {
+		mDelays.pop_front();
+	}
+	mOffset = *std::min_element(mDelays.begin(), mDelays.end());
+
+	mQueue.push_back(Entry{ id, timestamp, arrival });
+	// Depth frames waiting behind the one about to become due, plus one arriving early.
+	bool kept = true;
+	while (mQueue.size() > mSettings.depth + 2) {
+		mQueue.pop_front();
+		mStats.overflowed++;
+		kept = false;
+	}
+	return kept;
+}
+
+PacerDecision FramePacer::Select(int64_t displayTime) {
+	PacerDecision decision;
+	if (mInterval == 0 && mSettings.depth > 0) {
+		// A buffered frame's slot depends on the interval, known from the second frame on;
+		// showing the first at once would only stall until the buffer filled.
+		return decision;
+	}
+	size_t due = 0;
+	while (due < mQueue.size() && DueTime(mQueue[due]) <= displayTime) {
+		due++;
+	}
+	if (due == 0) {
+		// However many vsyncs a stall lasts, it is one underrun.
+		if (!mStalled && mHasPresented && mInterval > 0 && displayTime - mPresentedDue > mInterval * 3 / 2) {
+			mStats.underruns++;
+			mStalled = true;
+		}
+		return decision;
+	}
+
+	const Entry entry = mQueue[due - 1];
+	decision.present = true;
+	decision.id = entry.id;
+	decision.skipped = unsigned(due - 1);
+	mStats.presented++;
+	mStats.skipped += due - 1;
+	mStats.latency.Add((displayTime - entry.arrival) / TicksPerMillisecond);
+	if (mHasPresented) {
+		int64_t error = (displayTime - mPresentedDisplay) - (entry.timestamp - mPresentedTimestamp);
+		mStats.judder.Add(std::llabs(error) / TicksPerMillisecond);
+	}
+	mHasPresented = true;
+	mStalled = false;
+	mPresentedDue = DueTime(entry);
+	mPresentedTimestamp = entry.timestamp;
+	mPresentedDisplay = displayTime;
+	mQueue.erase(mQueue.begin(), mQueue.begin() + due);
+	return decision;
+}
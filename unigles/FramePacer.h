@@ -0,0 +1,92 @@
+#pragma once
+
+#include "GpuProfileLog.h"
+
+#include <cstdint>
+#include <deque>
+
+namespace unigles {
+	struct PacerSettings {
+		// Frames held back to absorb arrival jitter, 0 to MaxDepth. Every frame of depth
+		// adds one camera frame interval of latency.
+		unsigned depth = 1;
+		// Arrivals over which the camera to local clock offset is tracked.
+		unsigned window = 120;
+	};
+
+	struct PacerDecision {
+		bool present = false;	// False repeats the frame already on screen
+		uint64_t id = 0;		// Frame to show when present is set
+		unsigned skipped = 0;	// Older frames dropped in favour of it
+	};
+
+	struct PacingStats {
+		uint64_t pushed = 0;
+		uint64_t presented = 0;
+		uint64_t skipped = 0;		// Due frames replaced by a newer one before any vsync showed them
+		uint64_t overflowed = 0;	// Dropped on arrival because the buffer was full
+		uint64_t underruns = 0;		// Stalls that kept a frame on screen past its slot, each counted once
+		uint64_t resets = 0;		// Timestamp discontinuities that restarted the clock mapping
+		uint64_t failed = 0;		// Presented frames the display side could not show after all
+		// Time from arrival to display, and the difference between the display interval and
+		// the timestamp interval of consecutive presented frames, in milliseconds.
+		RollingStatistic latency;
+		RollingStatistic judder;
+	};
+
+	// Jitter buffer between a frame source with presentation timestamps and a display
+	// that samples it once per vsync. Each frame is due at its timestamp mapped to the
+	// local clock by the smallest arrival delay seen recently, plus depth frame intervals;
+	// every vsync shows the newest frame that is due, so frames keep their original
+	// spacing while the latency stays bounded by the depth. Timestamps and local times are
+	// in the same unit, 100 ns ticks as delivered by the capture source. Not thread safe.
+	class FramePacer {
+	public:
+		static const unsigned MaxDepth = 2;
+
+		explicit FramePacer(const PacerSettings& settings = PacerSettings());
+
+		void SetDepth(unsigned depth);
+		unsigned GetDepth() const { return mSettings.depth; }
+
+		// Queues a frame; ids must increase. Returns false if the oldest queued frame had
+		// to be dropped to keep the buffer within its depth.
+		bool Push(uint64_t id, int64_t timestamp, int64_t arrival);
+		// Picks the frame for the vsync shown at displayTime. Frames are removed from the
+		// front of the queue only, the presented one included.
+		PacerDecision Select(int64_t displayTime);
+		// Drops every queued frame and the clock mapping.
+		void Reset();
+		// Counts a presented frame that was dropped on the way to the screen.
+		void ReportFailed() { mStats.failed++; }
+
+		size_t GetQueuedCount() const { return mQueue.size(); }
+		// Camera frame interval estimated from the timestamps.
+		int64_t GetFrameInterval() const { return mInterval; }
+		const PacingStats& GetStats() const { return mStats; }
+
+	private:
+		struct Entry {
+			uint64_t id;
+			int64_t timestamp;
+			int64_t arrival;
+		};
+
+		int64_t DueTime(const Entry& entry) const;
+		void RestartClock();
+
+		PacerSettings mSettings;
+		std::deque<Entry> mQueue;
+		std::deque<int64_t> mDelays;	// arrival - timestamp of the recent frames
+		int64_t mOffset;
+		int64_t mInterval;
+		int64_t mLastTimestamp;
+		bool mHasTimestamp;
+		bool mHasPresented;
+		int64_t mPresentedDue;
+		int64_t mPresentedTimestamp;
+		int64_t mPresentedDisplay;
+		bool mStalled;	// The current underrun is counted
+		PacingStats mStats;
+	};
+}
@@ -0,0 +1,221 @@
+#include "GaussianPyramid.h"
+#include "Simd.h"
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace unigles;
+
+// Target columns per strip; the five ring rows of a strip take 2.5 KB.
+static const unsigned StripWidth = 256;
+// Target rows per task. Each task filters the three source rows it shares with the band
+// above again.
+static const unsigned BandRows = 32;
+static const unsigned RingRows = 5;
+
+static inline unsigned ClampIndex(int index, unsigned size) {
+	return unsigned((std::min)((std::max)(index, 0), int(size) - 1));
+}
+
+// Horizontal taps of target column x, weights summing to 16.
+static inline uint16_t FilterPixel(const uint8_t* row, unsigned width, unsigned x) {
+	int center = 2 * int(x);
+	return uint16_t(row[ClampIndex(center - 2, width)] + row[ClampIndex(center + 2, width)] +
+		4 * (row[ClampIndex(center - 1, width)] + row[ClampIndex(center + 1, width)]) + 6 * row[ClampIndex(center, width)]);
+}
+
+// Target columns [x0, x1) of one source row, unnormalized.
+static void FilterRow(const uint8_t* row, unsigned width, unsigned x0, unsigned x1, uint16_t* out) {
+	unsigned x = x0;
+	// The first column reaches past the left edge.
+	for (; x < x1 && x < 1; x++) {
+		out[x - x0] = FilterPixel(row, width, x);
+	}
+#if defined(UNIGLES_SIMD_SSE2)
+	// Three loads two bytes apart give the even and odd pixels around eight target columns.
+	const __m128i mask = _mm_set1_epi16(0x00FF);
+	for (; x + 8 <= x1 && 2 * x + 18 <= width; x += 8) {
+		const uint8_t* p = row + 2 * x - 2;
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 4));
+		__m128i center = _mm_and_si128(b, mask);
+		__m128i sum = _mm_add_epi16(_mm_and_si128(a, mask), _mm_and_si128(c, mask));
+		sum = _mm_add_epi16(sum, _mm_slli_epi16(_mm_add_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)), 2));
+		sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(center, 2), _mm_slli_epi16(center, 1)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x - x0), sum);
+	}
+#elif defined(UNIGLES_SIMD_NEON)
+	const uint8x8_t six = vdup_n_u8(6);
+	for (; x + 8 <= x1 && 2 * x + 18 <= width; x += 8) {
+		const uint8_t* p = row + 2 * x - 2;
+		uint8x8x2_t a = vld2_u8(p);
+		uint8x8x2_t b = vld2_u8(p + 2);
+		uint8x8x2_t c = vld2_u8(p + 4);
+		uint16x8_t sum = vaddl_u8(a.val[0], c.val[0]);
+		sum = vaddq_u16(sum, vshlq_n_u16(vaddl_u8(a.val[1], b.val[1]), 2));
+		sum = vmlal_u8(sum, b.val[0], six);
+		vst1q_u16(out + x - x0, sum);
+	}
+#endif
+	for (; x < x1; x++) {
+		out[x - x0] = FilterPixel(row, width, x);
+	}
+}
+
+// Vertical taps over five filtered rows. The sum stays below 65536, so it fits 16 bits
+// unsigned until it is normalized.
+static void FilterColumns(const uint16_t* const* rows, uint8_t* out, unsigned count) {
+	unsigned i = 0;
+#if defined(UNIGLES_SIMD_SSE2)
+	const __m128i round = _mm_set1_epi16(128);
+	for (; i + 8 <= count; i += 8) {
+		__m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[0] + i));
+		__m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[1] + i));
+		__m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[2] + i));
+		__m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[3] + i));
+		__m128i r4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[4] + i));
+		__m128i sum = _mm_add_epi16(_mm_add_epi16(r0, r4), round);
+		sum = _mm_add_epi16(sum, _mm_slli_epi16(_mm_add_epi16(r1, r3), 2));
+		sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(r2, 2), _mm_slli_epi16(r2, 1)));
+		__m128i result = _mm_srli_epi16(sum, 8);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(result, result));
+	}
+#elif defined(UNIGLES_SIMD_NEON)
+	for (; i + 8 <= count; i += 8) {
+		uint16x8_t sum = vaddq_u16(vld1q_u16(rows[0] + i), vld1q_u16(rows[4] + i));
+		sum = vaddq_u16(sum, vshlq_n_u16(vaddq_u16(vld1q_u16(rows[1] + i), vld1q_u16(rows[3] + i)), 2));
+		sum = vmlaq_n_u16(sum, vld1q_u16(rows[2] + i), 6);
+		vst1_u8(out + i, vrshrn_n_u16(sum, 8));
+	}
+#endif
+	for (; i < count; i++) {
+		unsigned sum = rows[0][i] + rows[4][i] + 4 * (rows[1][i] + rows[3][i]) + 6 * rows[2][i];
+		out[i] = uint8_t((sum + 128) >> 8);
+	}
+}
+
+void unigles::PyramidDownBlock(const uint8_t* source, size_t sourceStride, unsigned sourceWidth, unsigned sourceHeight,
+	uint8_t* target, size_t targetStride, unsigned x0, unsigned y0, unsigned x1, unsigned y1) {
+	uint16_t ring[RingRows][StripWidth];
+	for (unsigned strip = x0; strip < x1; strip += StripWidth) {
+		unsigned end = (std::min)(strip + StripWidth, x1);
+		// Source rows 2y - 2 to 2y + 2 feed target row y; the next row reuses three of them.
+		int next = 2 * int(y0) - 2;
+		for (unsigned y = y0; y < y1; y++) {
+			for (; next <= 2 * int(y) + 2; next++) {
+				const uint8_t* row = source + size_t(ClampIndex(next, sourceHeight)) * sourceStride;
+				FilterRow(row, sourceWidth, strip, end, ring[(next + RingRows) % RingRows]);
+			}
+			const uint16_t* rows[RingRows];
+			for (unsigned tap = 0; tap < RingRows; tap++) {
+				rows[tap] = ring[(2 * y + tap + RingRows - 2) % RingRows];
+			}
+			FilterColumns(rows, target + size_t(y) * targetStride + strip, end - strip);
+		}
+	}
+}
+
+void unigles::PyramidDownScalar(const uint8_t* source, size_t sourceStride, unsigned sourceWidth, unsigned sourceHeight,
+	uint8_t* target, size_t targetStride) {
+	static const int weights[5] = { 1, 4, 6, 4, 1 };
+	unsigned width = (sourceWidth + 1) / 2;
+	unsigned height = (sourceHeight + 1) / 2;
+	for (unsigned y = 0; y < height; y++) {
+		for (unsigned x = 0; x < width; x++) {
+			int sum = 0;
+			for (int j = 0; j < 5; j++) {
+				const uint8_t* row = source + size_t(ClampIndex(2 * int(y) + j - 2, sourceHeight)) * sourceStride;
+				for (int i = 0; i < 5; i++) {
+					sum += weights[j] * weights[i] * row[ClampIndex(2 * int(x) + i - 2, sourceWidth)];
+				}
+			}
+			target[size_t(y) * targetStride + x] = uint8_t((sum + 128) >> 8);
+		}
+	}
+}
+
+GaussianPyramid::GaussianPyramid(unsigned levels) :
+	mRequestedLevels(0),
+	mFrames(0),
+	mLastMilliseconds(0.0) {
+	SetLevelCount(levels);
+}
+
+void GaussianPyramid::SetLevelCount(unsigned levels) {
+	mRequestedLevels = (std::min)((std::max)(levels, 1u), MaxLevels);
+}
+
+size_t GaussianPyramid::GetBytes() const {
+	size_t bytes = 0;
+	for (const PyramidLevel& level : mLevels) {
+		bytes += level.pixels.size();
+	}
+	return bytes;
+}
+
+void GaussianPyramid::PrepareLevels(const uint8_t* luma, size_t stride, unsigned width, unsigned height) {
+	mFrames++;
+	unsigned count = 0;
+	if (width > 0 && height > 0) {
+		unsigned w = width;
+		unsigned h = height;
+		for (count = 1; count < mRequestedLevels && (w > 1 || h > 1); count++) {
+			w = (w + 1) / 2;
+			h = (h + 1) / 2;
+		}
+	}
+	mLevels.resize(count);
+	for (unsigned level = 0; level < count; level++) {
+		PyramidLevel& entry = mLevels[level];
+		entry.width = level == 0 ? width : (mLevels[level - 1].width + 1) / 2;
+		entry.height = level == 0 ? height : (mLevels[level - 1].height + 1) / 2;
+		entry.pixels.resize(size_t(entry.width) * entry.height);
+		entry.milliseconds = 0.0;
+	}
+	if (count > 0) {
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned y = 0; y < height; y++) {
+			memcpy(&mLevels[0].pixels[size_t(y) * width], luma + size_t(y) * stride, width);
+		}
+		mLevels[0].milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void GaussianPyramid::Build(const uint8_t* luma, size_t stride, unsigned width, unsigned height, TaskPool* pool) {
+	auto start = std::chrono::steady_clock::now();
+	PrepareLevels(luma, stride, width, height);
+	if (!pool) {
+		pool = &TaskPool::Default();
+	}
+	for (unsigned level = 1; level < mLevels.size(); level++) {
+		auto levelStart = std::chrono::steady_clock::now();
+		const PyramidLevel& source = mLevels[level - 1];
+		PyramidLevel& target = mLevels[level];
+		unsigned strips = (target.width + StripWidth - 1) / StripWidth;
+		unsigned bands = (target.height + BandRows - 1) / BandRows;
+		pool->Run(strips * bands, [&](unsigned block) {
+			unsigned x0 = (block % strips) * StripWidth;
+			unsigned y0 = (block / strips) * BandRows;
+			PyramidDownBlock(source.pixels.data(), source.width, source.width, source.height, target.pixels.data(), target.width,
+				x0, y0, (std::min)(x0 + StripWidth, target.width), (std::min)(y0 + BandRows, target.height));
+		});
+		target.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - levelStart).count();
+	}
+	mLastMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void GaussianPyramid::BuildScalar(const uint8_t* luma, size_t stride, unsigned width, unsigned height) {
+	auto start = std::chrono::steady_clock::now();
+	PrepareLevels(luma, stride, width, height);
+	for (unsigned level = 1; level < mLevels.size(); level++) {
+		auto levelStart = std::chrono::steady_clock::now();
+		const PyramidLevel& source = mLevels[level - 1];
+		PyramidLevel& target = mLevels[level];
+		PyramidDownScalar(source.pixels.data(), source.width, source.width, source.height, target.pixels.data(), target.width);
+		target.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - levelStart).count();
+	}
+	mLastMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace unigles {
+	class TaskPool;
+
+	// Halves an 8-bit image with the separable 5-tap binomial kernel [1 4 6 4 1] / 16 on
+	// both axes, sampling every other pixel and replicating the edges. The target is
+	// (width + 1) / 2 by (height + 1) / 2; this fills [x0, x1) x [y0, y1) of it. Each
+	// source row is filtered horizontally once into a small ring of 16-bit rows that the
+	// vertical filter reads while they are still in cache, in strips of a few hundred
+	// columns. Bit exact with the scalar version.
+	void PyramidDownBlock(const uint8_t* source, size_t sourceStride, unsigned sourceWidth, unsigned sourceHeight,
+		uint8_t* target, size_t targetStride, unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+	// Straight 5x5 reference of the whole target.
+	void PyramidDownScalar(const uint8_t* source, size_t sourceStride, unsigned sourceWidth, unsigned sourceHeight,
+		uint8_t* target, size_t targetStride);
+
+	struct PyramidLevel {
+		unsigned width = 0;
+		unsigned height = 0;
+		std::vector<uint8_t> pixels;	// width * height, packed
+		double milliseconds = 0.0;		// Spent on this level by the last build
+	};
+
+	// Gaussian luma pyramid on the CPU for trackers and other multi-scale consumers.
+	// Level 0 is a copy of the image and every further level halves the one before,
+	// until the requested count or a single pixel. The levels keep their buffers from
+	// build to build. TextureBridge builds the same levels on the GPU.
+	class GaussianPyramid {
+	public:
+		static const unsigned MaxLevels = 8;
+
+		explicit GaussianPyramid(unsigned levels = 4);
+
+		void SetLevelCount(unsigned levels);
+		unsigned GetRequestedLevels() const { return mRequestedLevels; }
+
+		// Every level is split into blocks over the pool, TaskPool::Default() when null.
+		void Build(const uint8_t* luma, size_t stride, unsigned width, unsigned height, TaskPool* pool = nullptr);
+		// Single threaded reference the vectorized version is checked against.
+		void BuildScalar(const uint8_t* luma, size_t stride, unsigned width, unsigned height);
+
+		// Levels of the last build.
+		unsigned GetLevelCount() const { return unsigned(mLevels.size()); }
+		const PyramidLevel& GetLevel(unsigned level) const { return mLevels[level]; }
+		size_t GetBytes() const;
+
+		uint64_t GetFrameCount() const { return mFrames; }
+		double GetLastMilliseconds() const { return mLastMilliseconds; }
+
+	private:
+		void PrepareLevels(const uint8_t* luma, size_t stride, unsigned width, unsigned height);
+
+		std::vector<PyramidLevel> mLevels;
+		unsigned mRequestedLevels;
+		uint64_t mFrames;
+		double mLastMilliseconds;
+	};
+}
@@ -0,0 +1,148 @@
+#include "GlGpuProfiler.h"
+
+#include <EGL/egl.h>
+
+#include <cstring>
+
+using namespace unigles;
+
+static bool HasExtension(const char* name) {
+	const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+	if (!extensions) {
+		return false;
+	}
+	size_t length = strlen(name);
+	for (const char* p = strstr(extensions, name); p; p = strstr(p + length, name)) {
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+			return true;
+		}
+	}
+	return false;
+}
+
+GlTimerQueries GlTimerQueries::Load() {
+	GlTimerQueries queries;
+	if (!HasExtension("GL_EXT_disjoint_timer_query")) {
+		return queries;
+	}
+	queries.genQueries = reinterpret_cast<PFNGLGENQUERIESEXTPROC>(eglGetProcAddress("glGenQueriesEXT"));
+	queries.deleteQueries = reinterpret_cast<PFNGLDELETEQUERIESEXTPROC>(eglGetProcAddress("glDeleteQueriesEXT"));
+	queries.beginQuery = reinterpret_cast<PFNGLBEGINQUERYEXTPROC>(eglGetProcAddress("glBeginQueryEXT"));
+	queries.endQuery = reinterpret_cast<PFNGLENDQUERYEXTPROC>(eglGetProcAddress("glEndQueryEXT"));
+	queries.getQueryObjectuiv = reinterpret_cast<PFNGLGETQUERYOBJECTUIVEXTPROC>(eglGetProcAddress("glGetQueryObjectuivEXT"));
+	queries.getQueryObjectui64v = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(eglGetProcAddress("glGetQueryObjectui64vEXT"));
+	queries.getIntegerv = glGetIntegerv;
+	return queries;
+}
+
+bool GlTimerQueries::IsComplete() const {
+	return genQueries && deleteQueries && beginQuery && endQuery && getQueryObjectuiv && getQueryObjectui64v && getIntegerv;
+}
+
+GlGpuProfiler::GlGpuProfiler(GpuProfileLog& log) :
+	GlGpuProfiler(log, GlTimerQueries::Load()) {}
+
+GlGpuProfiler::GlGpuProfiler(GpuProfileLog& log, const GlTimerQueries& queries) :
+	mLog(log),
+	mFrames(Latency),
+	mCurrent(0),
+	mInPass(false),
+	mQueries(queries),
+	mSupported(queries.IsComplete()) {}
+
+GlGpuProfiler::~GlGpuProfiler() {
+	if (!IsSupported()) {
+		return;
+	}
+	for (Frame& frame : mFrames) {
+		if (!frame.queries.empty()) {
+			mQueries.deleteQueries(GLsizei(frame.queries.size()), frame.queries.data());
+		}
+	}
+}
+
+void GlGpuProfiler::BeginFrame() {
+	if (!IsSupported()) {
+		return;
+	}
+	Collect();
+	Frame& frame = mFrames[mCurrent];
+	if (frame.pending) {
+		// Still not back after Latency frames; drop it rather than wait.
+		frame.pending = false;
+		mLog.AddDiscarded(1);
+	}
+	frame.passes.clear();
+}
+
+void GlGpuProfiler::BeginPass(const std::string& name) {
+	mPassName = name;
+	mPassStart = std::chrono::steady_clock::now();
+	mInPass = true;
+	if (!IsSupported()) {
+		return;
+	}
+	Frame& frame = mFrames[mCurrent];
+	if (frame.passes.size() == frame.queries.size()) {
+		GLuint query = 0;
+		mQueries.genQueries(1, &query);
+		frame.queries.push_back(query);
+	}
+	GLuint query = frame.queries[frame.passes.size()];
+	frame.passes.push_back(Pass{ name, query });
+	mQueries.beginQuery(GL_TIME_ELAPSED_EXT, query);
+}
+
+void GlGpuProfiler::EndPass() {
+	if (!mInPass) {
+		return;
+	}
+	mInPass = false;
+	if (IsSupported()) {
+		mQueries.endQuery(GL_TIME_ELAPSED_EXT);
+	}
+	mLog.AddCpu(mPassName, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mPassStart).count());
+}
+
+void GlGpuProfiler::EndFrame() {
+	if (!IsSupported()) {
+		return;
+	}
+	Frame& frame = mFrames[mCurrent];
+	frame.pending = !frame.passes.empty();
+	mCurrent = (mCurrent + 1) % Latency;
+}
+
+void GlGpuProfiler::Collect() {
+	// Oldest first; a frame is complete once its last query is.
+	for (unsigned i = 0; i < Latency; i++) {
+		Frame& frame = mFrames[(mCurrent + i) % Latency];
+		if (!frame.pending) {
+			continue;
+		}
+		GLuint available = 0;
+		mQueries.getQueryObjectuiv(frame.passes.back().query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+		if (!available) {
+			return;
+		}
+		frame.pending = false;
+		// A disjoint operation (clock change, context switch) invalidates every query in flight.
+		GLint disjoint = 0;
+		mQueries.getIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+		if (disjoint) {
+			for (Frame& other : mFrames) {
+				if (other.pending) {
+					other.pending = false;
+					mLog.AddDiscarded(1);
+				}
+			}
+			mLog.AddDiscarded(1);
+			return;
+		}
+		for (const Pass& pass : frame.passes) {
+			GLuint64 nanoseconds = 0;
+			mQueries.getQueryObjectui64v(pass.query, GL_QUERY_RESULT_EXT, &nanoseconds);
+			mLog.AddGpu(pass.name, nanoseconds / 1.0e6);
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "GpuProfileLog.h"
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	// Entry points of EXT_disjoint_timer_query, with the getter of GL_GPU_DISJOINT_EXT.
+	// The profiler loads the driver's; tests hand it their own.
+	struct GlTimerQueries {
+		PFNGLGENQUERIESEXTPROC genQueries = nullptr;
+		PFNGLDELETEQUERIESEXTPROC deleteQueries = nullptr;
+		PFNGLBEGINQUERYEXTPROC beginQuery = nullptr;
+		PFNGLENDQUERYEXTPROC endQuery = nullptr;
+		PFNGLGETQUERYOBJECTUIVEXTPROC getQueryObjectuiv = nullptr;
+		PFNGLGETQUERYOBJECTUI64VEXTPROC getQueryObjectui64v = nullptr;
+		void (GL_APIENTRYP getIntegerv)(GLenum pname, GLint* data) = nullptr;
+
+		// Needs a current context. Leaves every entry null without the extension.
+		static GlTimerQueries Load();
+		bool IsComplete() const;
+	};
+
+	// Brackets GL passes with EXT_disjoint_timer_query elapsed-time queries. Results are
+	// collected Latency frames later, only once the driver reports them available, so
+	// profiling never waits on the GPU. Without the extension only CPU submission times
+	// are logged. Passes may not nest, a limit of GL_TIME_ELAPSED_EXT.
+	class GlGpuProfiler {
+	public:
+		static const unsigned Latency = 4;
+
+		// Needs a current context; the queries belong to it.
+		explicit GlGpuProfiler(GpuProfileLog& log);
+		GlGpuProfiler(GpuProfileLog& log, const GlTimerQueries& queries);
+		~GlGpuProfiler();
+
+		bool IsSupported() const { return mSupported; }
+
+		void BeginFrame();
+		void BeginPass(const std::string& name);
+		void EndPass();
+		void EndFrame();
+
+	private:
+		struct Pass {
+			std::string name;
+			GLuint query;
+		};
+
+		struct Frame {
+			std::vector<Pass> passes;
+			std::vector<GLuint> queries;	// Pool the passes draw from, reused every time round
+			bool pending = false;
+		};
+
+		void Collect();
+
+		GpuProfileLog& mLog;
+		std::vector<Frame> mFrames;
+		unsigned mCurrent;
+		bool mInPass;
+		std::string mPassName;
+		std::chrono::steady_clock::time_point mPassStart;
+
+		GlTimerQueries mQueries;
+		bool mSupported;
+	};
+
+	// Times one pass for as long as it is in scope.
+	class GlGpuPassScope {
+	public:
+		GlGpuPassScope(GlGpuProfiler& profiler, const std::string& name) : mProfiler(profiler) { mProfiler.BeginPass(name); }
+		~GlGpuPassScope() { mProfiler.EndPass(); }
+
+	private:
+		GlGpuPassScope(const GlGpuPassScope&) = delete;
+		GlGpuPassScope& operator=(const GlGpuPassScope&) = delete;
+
+		GlGpuProfiler& mProfiler;
+	};
+}
@@ -0,0 +1,96 @@
+#include "GpuProfileLog.h"
+
+#include <algorithm>
+
+using namespace unigles;
+
+RollingStatistic::RollingStatistic(unsigned window) :
+	mWindow(window < 1 ? 1 : window),
+	mNext(0),
+	mCount(0),
+	mLast(0.0) {}
+
+void RollingStatistic::Add(double value) {
+	if (mSamples.size() < mWindow) {
+		mSamples.push_back(value);
+	} else {
+		mSamples[mNext] = value;
+		mNext = (mNext + 1) % unsigned(mSamples.size());
+	}
+	mCount++;
+	mLast = value;
+}
+
+double RollingStatistic::GetMean() const {
+	if (mSamples.empty()) {
+		return 0.0;
+	}
+	double sum = 0.0;
+	for (double sample : mSamples) {
+		sum += sample;
+	}
+	return sum / mSamples.size();
+}
+
+double RollingStatistic::GetMax() const {
+	return mSamples.empty() ? 0.0 : *std::max_element(mSamples.begin(), mSamples.end());
+}
+
+void RollingStatistic::CopySamples(std::vector<double>& samples) const {
+	// Until the window fills mNext stays at 0, which is also where the oldest sample is.
+	samples.assign(mSamples.begin() + mNext, mSamples.end());
+	samples.insert(samples.end(), mSamples.begin(), mSamples.begin() + mNext);
+}
+
+GpuProfileLog::GpuProfileLog() :
+	mDiscarded(0) {}
+
+GpuProfileLog::Entry& GpuProfileLog::Find(const std::string& pass) {
+	// A handful of passes; keeping them in first-seen order reads better than sorting.
+	for (Entry& entry : mEntries) {
+		if (entry.name == pass) {
+			return entry;
+		}
+	}
+	mEntries.push_back(Entry{ pass, RollingStatistic(), RollingStatistic() });
+	return mEntries.back();
+}
+
+void GpuProfileLog::AddCpu(const std::string& pass, double milliseconds) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	Find(pass).cpu.Add(milliseconds);
+}
+
+void GpuProfileLog::AddGpu(const std::string& pass, double milliseconds) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	Find(pass).gpu.Add(milliseconds);
+}
+
+void GpuProfileLog::AddDiscarded(uint64_t frames) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	mDiscarded += frames;
+}
+
+std::vector<PassTiming> GpuProfileLog::GetPasses() const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::vector<PassTiming> passes;
+	for (const Entry& entry : mEntries) {
+		PassTiming timing;
+		timing.name = entry.name;
+		timing.cpuMean = entry.cpu.GetMean();
+		timing.cpuMax = entry.cpu.GetMax();
+		timing.cpuLast = entry.cpu.GetLast();
+		timing.cpuSamples = entry.cpu.GetCount();
+		timing.gpuMean = entry.gpu.GetMean();
+		timing.gpuMax = entry.gpu.GetMax();
+		timing.gpuLast = entry.gpu.GetLast();
+		timing.gpuSamples = entry.gpu.GetCount();
+		passes.push_back(timing);
+	}
+	return passes;
+}
+
+uint64_t GpuProfileLog::GetDiscardedFrames() const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mDiscarded;
+}
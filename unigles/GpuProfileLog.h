@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	// Mean and maximum over the most recent samples.
+	class RollingStatistic {
+	public:
+		explicit RollingStatistic(unsigned window = 120);
+
+		void Add(double value);
+		uint64_t GetCount() const { return mCount; }
+		double GetLast() const { return mLast; }
+		double GetMean() const;
+		double GetMax() const;
+		// Samples still in the window, oldest first.
+		void CopySamples(std::vector<double>& samples) const;
+
+	private:
+		std::vector<double> mSamples;
+		unsigned mWindow;
+		unsigned mNext;
+		uint64_t mCount;
+		double mLast;
+	};
+
+	struct PassTiming {
+		std::string name;
+		// Command submission on the CPU, and execution on the GPU read back from timer queries.
+		double cpuMean, cpuMax, cpuLast;
+		double gpuMean, gpuMax, gpuLast;
+		uint64_t cpuSamples, gpuSamples;
+	};
+
+	// Rolling CPU and GPU timings per named pass. GPU samples arrive a few frames after
+	// their CPU counterparts; passes whose backend has no timer queries only get CPU samples.
+	// Safe to feed and read from different threads.
+	class GpuProfileLog {
+	public:
+		GpuProfileLog();
+
+		void AddCpu(const std::string& pass, double milliseconds);
+		void AddGpu(const std::string& pass, double milliseconds);
+		// Counts frames whose GPU results were thrown away (disjoint or not read back in time).
+		void AddDiscarded(uint64_t frames);
+
+		std::vector<PassTiming> GetPasses() const;
+		uint64_t GetDiscardedFrames() const;
+
+	private:
+		struct Entry {
+			std::string name;
+			RollingStatistic cpu;
+			RollingStatistic gpu;
+		};
+
+		Entry& Find(const std::string& pass);
+
+		mutable std::mutex mMutex;
+		std::vector<Entry> mEntries;
+		uint64_t mDiscarded;
+	};
+}
@@ -0,0 +1,141 @@
+#include "GpuResourceRegistry.h"
+
+#include <algorithm>
+
+using namespace unigles;
+
+GpuResourceRegistry::GpuResourceRegistry() :
+	mNextHandle(1) {}
+
+GpuResourceRegistry::Handle GpuResourceRegistry::Register(GpuDomain domain, const std::string& name, std::function<void()> create, std::function<void()> release) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	Handle handle = mNextHandle++;
+	mEntries.push_back(Entry{ handle, domain, name, std::move(create), std::move(release) });
+	return handle;
+}
+
+void GpuResourceRegistry::Unregister(Handle handle) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	mEntries.erase(std::remove_if(mEntries.begin(), mEntries.end(), [handle](const Entry& entry) {
+		return entry.handle == handle;
+	}), mEntries.end());
+}
+
+void GpuResourceRegistry::SetLossProbe(GpuDomain domain, std::function<bool()> probe) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	State(domain).probe = std::move(probe);
+}
+
+std::vector<GpuResourceRegistry::Entry> GpuResourceRegistry::EntriesOf(GpuDomain domain) const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::vector<Entry> entries;
+	for (const Entry& entry : mEntries) {
+		if (entry.domain == domain) {
+			entries.push_back(entry);
+		}
+	}
+	return entries;
+}
+
+bool GpuResourceRegistry::CheckLost(GpuDomain domain) {
+	std::function<bool()> probe;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		DomainState& state = State(domain);
+		if (state.lost) {
+			return true;
+		}
+		if (state.injected) {
+			state.injected = false;
+		} else {
+			probe = state.probe;
+			if (!probe) {
+				return false;
+			}
+		}
+	}
+	// Callbacks run outside the lock so they can use the registry themselves.
+	if (probe && !probe()) {
+		return false;
+	}
+	ReportLost(domain);
+	return true;
+}
+
+void GpuResourceRegistry::ReportLost(GpuDomain domain) {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		DomainState& state = State(domain);
+		if (state.lost) {
+			return;
+		}
+		state.lost = true;
+		state.lostAt = std::chrono::steady_clock::now();
+		state.stats.losses++;
+	}
+	std::vector<Entry> entries = EntriesOf(domain);
+	for (auto entry = entries.rbegin(); entry != entries.rend(); ++entry) {
+		if (entry->release) {
+			entry->release();
+		}
+	}
+}
+
+bool GpuResourceRegistry::IsLost(GpuDomain domain) const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return State(domain).lost;
+}
+
+bool GpuResourceRegistry::Recreate(GpuDomain domain) {
+	std::vector<Entry> entries = EntriesOf(domain);
+	bool succeeded = true;
+	for (const Entry& entry : entries) {
+		if (!entry.create) {
+			continue;
+		}
+		try {
+			entry.create();
+		} catch (...) {
+			succeeded = false;
+			break;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	DomainState& state = State(domain);
+	if (!succeeded) {
+		state.stats.failedRebuilds++;
+		if (!state.lost) {
+			// A first creation that failed is a loss the next attempt recovers from.
+			state.lost = true;
+			state.lostAt = std::chrono::steady_clock::now();
+		}
+		return false;
+	}
+	if (state.lost) {
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - state.lostAt).count();
+		state.lost = false;
+		state.stats.recoveries++;
+		state.stats.lastMilliseconds = milliseconds;
+		state.stats.worstMilliseconds = (std::max)(state.stats.worstMilliseconds, milliseconds);
+	}
+	return true;
+}
+
+void GpuResourceRegistry::InjectLoss(GpuDomain domain) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	State(domain).injected = true;
+}
+
+GpuRecoveryStats GpuResourceRegistry::GetStats(GpuDomain domain) const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return State(domain).stats;
+}
+
+std::vector<std::string> GpuResourceRegistry::GetNames(GpuDomain domain) const {
+	std::vector<std::string> names;
+	for (const Entry& entry : EntriesOf(domain)) {
+		names.push_back(entry.name);
+	}
+	return names;
+}
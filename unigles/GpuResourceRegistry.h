@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	// Each domain is lost and rebuilt independently of the other.
+	enum class GpuDomain {
+		Gl,		// The EGL context and everything created on it or shared with it
+		D3D,	// The camera's Direct3D device and the conversion resources created on it
+	};
+
+	struct GpuRecoveryStats {
+		uint64_t losses = 0;
+		uint64_t recoveries = 0;
+		uint64_t failedRebuilds = 0;
+		// From the loss being noticed to every resource of the domain existing again.
+		double lastMilliseconds = 0.0;
+		double worstMilliseconds = 0.0;
+	};
+
+	// Keeps a create and a release callback for every GPU resource, grouped by domain.
+	// When a domain is lost its resources are released in reverse order and, once the
+	// device or context is back, recreated from their descriptions in registration
+	// order, so only what died is rebuilt and the owners keep their settings.
+	class GpuResourceRegistry {
+	public:
+		typedef unsigned Handle;
+
+		GpuResourceRegistry();
+
+		// Create may be empty for resources that are created lazily by their owner;
+		// release must drop every reference without assuming the device still works.
+		Handle Register(GpuDomain domain, const std::string& name, std::function<void()> create, std::function<void()> release);
+		void Unregister(Handle handle);
+
+		// Probe the domain's device for loss, e.g. GetDeviceRemovedReason().
+		void SetLossProbe(GpuDomain domain, std::function<bool()> probe);
+		// Runs the probe (and any injected fault) and releases the domain on loss.
+		// Returns true while the domain is lost.
+		bool CheckLost(GpuDomain domain);
+		// For call sites that saw a loss themselves, like a failing eglSwapBuffers.
+		void ReportLost(GpuDomain domain);
+		bool IsLost(GpuDomain domain) const;
+		// Creates every resource of the domain. Returns false when one of them failed;
+		// the domain then stays lost and the next call tries again.
+		bool Recreate(GpuDomain domain);
+
+		// Fault injection: the next CheckLost() of the domain reports a loss.
+		void InjectLoss(GpuDomain domain);
+
+		GpuRecoveryStats GetStats(GpuDomain domain) const;
+		std::vector<std::string> GetNames(GpuDomain domain) const;
+
+	private:
+		static const unsigned DomainCount = 2;
+
+		struct Entry {
+			Handle handle;
+			GpuDomain domain;
+			std::string name;
+			std::function<void()> create;
+			std::function<void()> release;
+		};
+
+		struct DomainState {
+			bool lost = false;
+			bool injected = false;
+			std::chrono::steady_clock::time_point lostAt;
+			std::function<bool()> probe;
+			GpuRecoveryStats stats;
+		};
+
+		std::vector<Entry> EntriesOf(GpuDomain domain) const;
+		DomainState& State(GpuDomain domain) { return mDomains[unsigned(domain)]; }
+		const DomainState& State(GpuDomain domain) const { return mDomains[unsigned(domain)]; }
+
+		mutable std::mutex mMutex;
+		std::vector<Entry> mEntries;
+		DomainState mDomains[DomainCount];
+		Handle mNextHandle;
+	};
+}
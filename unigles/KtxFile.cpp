@@ -0,0 +1,289 @@
+#include "KtxFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace unigles;
+
+static const uint8_t Ktx1Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint8_t Ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint32_t Ktx1Endianness = 0x04030201;
+static const uint32_t Ktx1SwappedEndianness = 0x01020304;
+static const size_t Ktx1HeaderSize = 64;
+static const size_t Ktx2HeaderSize = 80;
+static const size_t Ktx2LevelIndexEntrySize = 24;
+
+static uint32_t ReadUint32(const uint8_t* data, bool swap) {
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	if (swap) {
+		value = (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+	}
+	return value;
+}
+
+static uint64_t ReadUint64(const uint8_t* data) {
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+MappedFile::MappedFile() :
+	mData(nullptr),
+	mSize(0),
+	mFile(nullptr),
+	mMapping(nullptr) {
+}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const std::string& path) {
+	Close();
+	int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	if (length <= 0) {
+		return false;
+	}
+	std::wstring widePath(length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], length);
+
+	HANDLE file = CreateFile2(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || uint64_t(size.QuadPart) > SIZE_MAX) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingFromApp(file, nullptr, PAGE_READONLY, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFileFromApp(mapping, FILE_MAP_READ, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	mFile = file;
+	mMapping = mapping;
+	mData = static_cast<const uint8_t*>(view);
+	mSize = size_t(size.QuadPart);
+	return true;
+}
+
+void MappedFile::Close() {
+	if (mData != nullptr) {
+		UnmapViewOfFile(mData);
+	}
+	if (mMapping != nullptr) {
+		CloseHandle(mMapping);
+	}
+	if (mFile != nullptr) {
+		CloseHandle(mFile);
+	}
+	mData = nullptr;
+	mSize = 0;
+	mFile = nullptr;
+	mMapping = nullptr;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path) {
+	Close();
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size <= 0) {
+		close(file);
+		return false;
+	}
+	// The mapping keeps the file alive on its own.
+	void* view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+	mData = static_cast<const uint8_t*>(view);
+	mSize = size_t(status.st_size);
+	return true;
+}
+
+void MappedFile::Close() {
+	if (mData != nullptr) {
+		munmap(const_cast<uint8_t*>(mData), mSize);
+	}
+	mData = nullptr;
+	mSize = 0;
+}
+
+#endif
+
+KtxTexture::KtxTexture() :
+	mVersion(0),
+	mFormat(CompressedFormat::Unknown) {
+}
+
+size_t KtxTexture::GetDataSize() const {
+	size_t size = 0;
+	for (const KtxLevel& level : mLevels) {
+		size += level.size;
+	}
+	return size;
+}
+
+bool KtxTexture::Fail(const std::string& error) {
+	mLevels.clear();
+	mError = error;
+	return false;
+}
+
+bool KtxTexture::Parse(const uint8_t* data, size_t size) {
+	mVersion = 0;
+	mFormat = CompressedFormat::Unknown;
+	mLevels.clear();
+	mError.clear();
+	if (data == nullptr || size < sizeof(Ktx1Identifier)) {
+		return Fail("too short for a KTX file");
+	}
+	if (memcmp(data, Ktx1Identifier, sizeof(Ktx1Identifier)) == 0) {
+		mVersion = 1;
+		return ParseVersion1(data, size);
+	}
+	if (memcmp(data, Ktx2Identifier, sizeof(Ktx2Identifier)) == 0) {
+		mVersion = 2;
+		return ParseVersion2(data, size);
+	}
+	return Fail("not a KTX file");
+}
+
+bool KtxTexture::CheckShape(uint32_t width, uint32_t height, uint32_t depth, uint32_t layers, uint32_t faces, uint32_t levels) {
+	if (width == 0 || height == 0) {
+		return Fail("empty or one dimensional texture");
+	}
+	if (depth > 1 || layers > 1 || faces != 1) {
+		return Fail("only 2D textures are supported");
+	}
+	unsigned maxLevels = 1;
+	while (maxLevels < 32 && ((std::max)(width, height) >> maxLevels) > 0) {
+		maxLevels++;
+	}
+	if (levels > maxLevels) {
+		return Fail("more mip levels than the size allows");
+	}
+	return true;
+}
+
+bool KtxTexture::ParseVersion1(const uint8_t* data, size_t size) {
+	if (size < Ktx1HeaderSize) {
+		return Fail("truncated KTX header");
+	}
+	uint32_t endianness = ReadUint32(data + 12, false);
+	if (endianness != Ktx1Endianness && endianness != Ktx1SwappedEndianness) {
+		return Fail("bad KTX endianness marker");
+	}
+	// Block data is a byte stream; only the header and image sizes need swapping.
+	bool swap = endianness == Ktx1SwappedEndianness;
+	uint32_t glType = ReadUint32(data + 16, swap);
+	uint32_t glInternalFormat = ReadUint32(data + 28, swap);
+	uint32_t width = ReadUint32(data + 36, swap);
+	uint32_t height = ReadUint32(data + 40, swap);
+	uint32_t depth = ReadUint32(data + 44, swap);
+	uint32_t layers = ReadUint32(data + 48, swap);
+	uint32_t faces = ReadUint32(data + 52, swap);
+	uint32_t levels = (std::max)(ReadUint32(data + 56, swap), 1u);
+	uint32_t keyValueBytes = ReadUint32(data + 60, swap);
+
+	mFormat = FormatFromGl(glInternalFormat);
+	if (glType != 0 || mFormat == CompressedFormat::Unknown) {
+		return Fail("not a supported compressed format");
+	}
+	if (!CheckShape(width, height, depth, layers, faces, levels)) {
+		return false;
+	}
+	size_t offset = Ktx1HeaderSize;
+	if (keyValueBytes > size - offset) {
+		return Fail("truncated key/value data");
+	}
+	offset += keyValueBytes;
+	for (uint32_t level = 0; level < levels; level++) {
+		if (size - offset < 4) {
+			return Fail("truncated mip level size");
+		}
+		size_t imageSize = ReadUint32(data + offset, swap);
+		offset += 4;
+		unsigned levelWidth = (std::max)(width >> level, 1u);
+		unsigned levelHeight = (std::max)(height >> level, 1u);
+		if (imageSize != CompressedImageSize(mFormat, levelWidth, levelHeight)) {
+			return Fail("mip level size does not match its dimensions");
+		}
+		if (imageSize > size - offset) {
+			return Fail("truncated mip level");
+		}
+		mLevels.push_back(KtxLevel{ data + offset, imageSize, levelWidth, levelHeight });
+		// Levels are padded to four bytes; block sizes already are.
+		offset += (imageSize + 3) & ~size_t(3);
+		offset = (std::min)(offset, size);
+	}
+	return true;
+}
+
+bool KtxTexture::ParseVersion2(const uint8_t* data, size_t size) {
+	if (size < Ktx2HeaderSize) {
+		return Fail("truncated KTX2 header");
+	}
+	uint32_t vkFormat = ReadUint32(data + 12, false);
+	uint32_t width = ReadUint32(data + 20, false);
+	uint32_t height = ReadUint32(data + 24, false);
+	uint32_t depth = ReadUint32(data + 28, false);
+	uint32_t layers = ReadUint32(data + 32, false);
+	uint32_t faces = ReadUint32(data + 36, false);
+	uint32_t levels = (std::max)(ReadUint32(data + 40, false), 1u);
+	uint32_t supercompression = ReadUint32(data + 44, false);
+
+	mFormat = FormatFromVulkan(vkFormat);
+	if (mFormat == CompressedFormat::Unknown) {
+		return Fail("not a supported compressed format");
+	}
+	if (supercompression != 0) {
+		return Fail("supercompressed KTX2 files are not supported");
+	}
+	if (!CheckShape(width, height, depth, layers, faces, levels)) {
+		return false;
+	}
+	if (levels * Ktx2LevelIndexEntrySize > size - Ktx2HeaderSize) {
+		return Fail("truncated level index");
+	}
+	for (uint32_t level = 0; level < levels; level++) {
+		const uint8_t* entry = data + Ktx2HeaderSize + level * Ktx2LevelIndexEntrySize;
+		uint64_t offset = ReadUint64(entry);
+		uint64_t length = ReadUint64(entry + 8);
+		unsigned levelWidth = (std::max)(width >> level, 1u);
+		unsigned levelHeight = (std::max)(height >> level, 1u);
+		if (length != CompressedImageSize(mFormat, levelWidth, levelHeight)) {
+			return Fail("mip level size does not match its dimensions");
+		}
+		if (offset > size || length > size - offset) {
+			return Fail("truncated mip level");
+		}
+		mLevels.push_back(KtxLevel{ data + offset, size_t(length), levelWidth, levelHeight });
+	}
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "BlockDecoder.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	// Read-only view of a whole file through the page cache, so texture data goes from
+	// disk to the driver without an intermediate copy.
+	class MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Path in UTF-8. Closes whatever was open before.
+		bool Open(const std::string& path);
+		void Close();
+
+		bool IsOpen() const { return mData != nullptr; }
+		const uint8_t* GetData() const { return mData; }
+		size_t GetSize() const { return mSize; }
+
+	private:
+		const uint8_t* mData;
+		size_t mSize;
+		void* mFile;		// HANDLE on Windows, unused elsewhere
+		void* mMapping;		// HANDLE on Windows, unused elsewhere
+	};
+
+	struct KtxLevel {
+		const uint8_t* data;	// Points into the parsed buffer
+		size_t size;
+		unsigned width;
+		unsigned height;
+	};
+
+	// A 2D block compressed texture and its mip chain, as stored in a KTX 1.1 or KTX 2.0
+	// container. Arrays, cube maps, 3D textures and supercompressed KTX2 files are
+	// refused rather than half loaded.
+	class KtxTexture {
+	public:
+		KtxTexture();
+
+		// The levels point into data, which has to outlive them.
+		bool Parse(const uint8_t* data, size_t size);
+
+		unsigned GetVersion() const { return mVersion; }
+		CompressedFormat GetFormat() const { return mFormat; }
+		unsigned GetWidth() const { return mLevels.empty() ? 0 : mLevels[0].width; }
+		unsigned GetHeight() const { return mLevels.empty() ? 0 : mLevels[0].height; }
+		// Level 0 first.
+		const std::vector<KtxLevel>& GetLevels() const { return mLevels; }
+		// Sum of the level sizes.
+		size_t GetDataSize() const;
+		const std::string& GetError() const { return mError; }
+
+	private:
+		bool ParseVersion1(const uint8_t* data, size_t size);
+		bool ParseVersion2(const uint8_t* data, size_t size);
+		bool CheckShape(uint32_t width, uint32_t height, uint32_t depth, uint32_t layers, uint32_t faces, uint32_t levels);
+		bool Fail(const std::string& error);
+
+		unsigned mVersion;
+		CompressedFormat mFormat;
+		std::vector<KtxLevel> mLevels;
+		std::string mError;
+	};
+}
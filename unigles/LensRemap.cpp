@@ -0,0 +1,445 @@
+#include "LensRemap.h"
+#include "Nv12FrameBuffer.h"
+#include "Simd.h"
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace unigles;
+
+// Output pixels per task. A tile of the corrected image reads a compact patch of the
+// source, so both stay in cache while it is resampled.
+static const unsigned TileWidth = 64;
+static const unsigned TileHeight = 32;
+static const unsigned MaxChannels = 4;
+
+// Source coordinates beyond this many pixels outside the image are clamped, which
+// keeps the fixed point interpolation within 32 bits.
+static const double FixedCoordinateLimit = 32768.0;
+
+// Video range black.
+static const uint8_t LumaBorder[1] = { 16 };
+static const uint8_t ChromaBorder[2] = { 128, 128 };
+
+namespace {
+	// Neighbours and weights of up to one tile row, one entry per output byte.
+	struct RemapRow {
+		uint16_t p00[TileWidth * MaxChannels];
+		uint16_t p01[TileWidth * MaxChannels];
+		uint16_t p10[TileWidth * MaxChannels];
+		uint16_t p11[TileWidth * MaxChannels];
+		uint16_t fx[TileWidth * MaxChannels];
+		uint16_t fy[TileWidth * MaxChannels];
+	};
+}
+
+bool LensModel::IsIdentity() const {
+	if (fx <= 0.0 || fy <= 0.0) {
+		return true;
+	}
+	return k1 == 0.0 && k2 == 0.0 && k3 == 0.0 && p1 == 0.0 && p2 == 0.0 && zoom == 1.0;
+}
+
+LensModel LensModel::ScaledTo(unsigned w, unsigned h) const {
+	LensModel scaled = *this;
+	if (width == 0 || height == 0) {
+		return scaled;
+	}
+	double scaleX = double(w) / width;
+	double scaleY = double(h) / height;
+	scaled.width = w;
+	scaled.height = h;
+	scaled.fx = fx * scaleX;
+	scaled.fy = fy * scaleY;
+	// Pixel centers sit at integers, so the edges of the image scale, not pixel 0.
+	scaled.cx = (cx + 0.5) * scaleX - 0.5;
+	scaled.cy = (cy + 0.5) * scaleY - 0.5;
+	return scaled;
+}
+
+void LensModel::MapToSource(double x, double y, double& sourceX, double& sourceY) const {
+	if (fx <= 0.0 || fy <= 0.0) {
+		sourceX = x;
+		sourceY = y;
+		return;
+	}
+	double u = (x - cx) / (fx * zoom);
+	double v = (y - cy) / (fy * zoom);
+	double r2 = u * u + v * v;
+	double radial = 1.0 + r2 * (k1 + r2 * (k2 + r2 * k3));
+	double du = u * radial + 2.0 * p1 * u * v + p2 * (r2 + 2.0 * u * u);
+	double dv = v * radial + p1 * (r2 + 2.0 * v * v) + 2.0 * p2 * u * v;
+	sourceX = fx * du + cx;
+	sourceY = fy * dv + cy;
+}
+
+void RemapTable::Lookup(double x, double y, double& sourceX, double& sourceY) const {
+	double gx = x / step;
+	double gy = y / step;
+	// Outside the grid the edge cells extrapolate.
+	unsigned column = unsigned((std::min)((std::max)(std::floor(gx), 0.0), double(gridWidth - 2)));
+	unsigned row = unsigned((std::min)((std::max)(std::floor(gy), 0.0), double(gridHeight - 2)));
+	double tx = gx - column;
+	double ty = gy - row;
+	const float* top = &coords[(row * gridWidth + column) * 2];
+	const float* bottom = top + gridWidth * 2;
+	for (unsigned axis = 0; axis < 2; axis++) {
+		double upper = top[axis] * (1.0 - tx) + top[axis + 2] * tx;
+		double lower = bottom[axis] * (1.0 - tx) + bottom[axis + 2] * tx;
+		(axis == 0 ? sourceX : sourceY) = upper * (1.0 - ty) + lower * ty;
+	}
+}
+
+std::vector<uint16_t> RemapTable::PackUnorm16() const {
+	std::vector<uint16_t> packed(coords.size());
+	for (size_t i = 0; i < coords.size(); i++) {
+		double size = (i & 1) ? height : width;
+		double normalized = (coords[i] + 0.5) / size;
+		double encoded = (std::min)(1.0, (std::max)(0.0, (normalized + 0.5) * 0.5));
+		packed[i] = uint16_t(std::lround(encoded * 65535.0));
+	}
+	return packed;
+}
+
+size_t RemapTable::GetBytes() const {
+	return coords.capacity() * sizeof(float) + fixedCoords.capacity() * sizeof(int32_t);
+}
+
+static unsigned StepShift(unsigned step) {
+	unsigned shift = 1;
+	while (shift < 5 && (2u << shift) <= step) {
+		shift++;
+	}
+	return shift;
+}
+
+RemapTable unigles::BuildRemapTable(const LensModel& lens, unsigned width, unsigned height, unsigned step) {
+	RemapTable table;
+	unsigned shift = StepShift(step);
+	// The last nodes lie up to a cell past the image, where the polynomial soon runs away;
+	// small images get finer cells so that overshoot stays small.
+	while (shift > 1 && (4u << shift) > (std::min)(width, height)) {
+		shift--;
+	}
+	table.width = width;
+	table.height = height;
+	table.step = 1u << shift;
+	if (width == 0 || height == 0) {
+		return table;
+	}
+	// The last node lands on or past the last pixel, so every pixel has a cell.
+	table.gridWidth = (std::max)(2u, (width + table.step - 2) / table.step + 1);
+	table.gridHeight = (std::max)(2u, (height + table.step - 2) / table.step + 1);
+	table.coords.resize(size_t(table.gridWidth) * table.gridHeight * 2);
+	table.fixedCoords.resize(table.coords.size());
+
+	LensModel scaled = lens.ScaledTo(width, height);
+	size_t node = 0;
+	for (unsigned row = 0; row < table.gridHeight; row++) {
+		for (unsigned column = 0; column < table.gridWidth; column++, node += 2) {
+			double source[2];
+			scaled.MapToSource(double(column * table.step), double(row * table.step), source[0], source[1]);
+			for (unsigned axis = 0; axis < 2; axis++) {
+				double clamped = (std::min)(FixedCoordinateLimit, (std::max)(-FixedCoordinateLimit, source[axis]));
+				table.coords[node + axis] = float(clamped);
+				table.fixedCoords[node + axis] = int32_t(std::lround(clamped * (1 << RemapTable::FractionBits)));
+			}
+		}
+	}
+	return table;
+}
+
+// One axis of the nodes' coordinates, interpolated down to row ty of the cell; in
+// 1/32 pixels times step.
+static inline int32_t InterpolateColumn(const RemapTable& table, unsigned cellY, unsigned ty, unsigned column, unsigned axis) {
+	const int32_t* top = &table.fixedCoords[(size_t(cellY) * table.gridWidth + column) * 2 + axis];
+	return top[0] * int32_t(table.step - ty) + top[table.gridWidth * 2] * int32_t(ty);
+}
+
+// From 1/32 pixels times step squared to 1/32 pixels.
+static inline int32_t RoundCoordinate(int32_t value, unsigned shift) {
+	return (value + (1 << (2 * shift - 1))) >> (2 * shift);
+}
+
+template <unsigned Channels>
+static inline void GatherPixel(const uint8_t* source, size_t stride, unsigned width, unsigned height,
+	const uint8_t* border, int32_t sourceX, int32_t sourceY, RemapRow& row, unsigned entry) {
+	// Coordinates within half a pixel of the edge clamp, like a texture sampler's.
+	const int32_t half = 1 << (RemapTable::FractionBits - 1);
+	if (sourceX < -half || sourceY < -half ||
+		sourceX > int32_t(width << RemapTable::FractionBits) - half || sourceY > int32_t(height << RemapTable::FractionBits) - half) {
+		for (unsigned c = 0; c < Channels; c++) {
+			row.p00[entry + c] = row.p01[entry + c] = row.p10[entry + c] = row.p11[entry + c] = border[c];
+			row.fx[entry + c] = row.fy[entry + c] = 0;
+		}
+		return;
+	}
+	int32_t ix = sourceX >> RemapTable::FractionBits;
+	int32_t iy = sourceY >> RemapTable::FractionBits;
+	unsigned left = unsigned((std::max)(ix, 0)) * Channels;
+	unsigned right = unsigned((std::min)(ix + 1, int32_t(width - 1))) * Channels;
+	const uint8_t* top = source + size_t((std::max)(iy, 0)) * stride;
+	const uint8_t* bottom = source + size_t((std::min)(iy + 1, int32_t(height - 1))) * stride;
+	uint16_t weightX = uint16_t(sourceX & ((1 << RemapTable::FractionBits) - 1));
+	uint16_t weightY = uint16_t(sourceY & ((1 << RemapTable::FractionBits) - 1));
+	for (unsigned c = 0; c < Channels; c++) {
+		row.p00[entry + c] = top[left + c];
+		row.p01[entry + c] = top[right + c];
+		row.p10[entry + c] = bottom[left + c];
+		row.p11[entry + c] = bottom[right + c];
+		row.fx[entry + c] = weightX;
+		row.fy[entry + c] = weightY;
+	}
+}
+
+static inline uint8_t BlendPixel(const RemapRow& row, unsigned i) {
+	const int scale = 1 << RemapTable::FractionBits;
+	int top = row.p00[i] * (scale - row.fx[i]) + row.p01[i] * row.fx[i];
+	int bottom = row.p10[i] * (scale - row.fx[i]) + row.p11[i] * row.fx[i];
+	// Both weights sum to 32, so the result needs no clamping.
+	return uint8_t((top * (scale - row.fy[i]) + bottom * row.fy[i] + 512) >> 10);
+}
+
+static void BlendRowScalar(const RemapRow& row, uint8_t* target, unsigned count) {
+	for (unsigned i = 0; i < count; i++) {
+		target[i] = BlendPixel(row, i);
+	}
+}
+
+static void BlendRow(const RemapRow& row, uint8_t* target, unsigned count) {
+	unsigned i = 0;
+#if defined(UNIGLES_SIMD_SSE2)
+	// Horizontal blends stay within 16 bits; the vertical one pairs them up for madd.
+	const __m128i scale = _mm_set1_epi16(1 << RemapTable::FractionBits);
+	const __m128i round = _mm_set1_epi32(512);
+	for (; i + 8 <= count; i += 8) {
+		__m128i fx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.fx + i));
+		__m128i fy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.fy + i));
+		__m128i inverseX = _mm_sub_epi16(scale, fx);
+		__m128i inverseY = _mm_sub_epi16(scale, fy);
+		__m128i top = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row.p00 + i)), inverseX),
+			_mm_mullo_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row.p01 + i)), fx));
+		__m128i bottom = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row.p10 + i)), inverseX),
+			_mm_mullo_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row.p11 + i)), fx));
+		__m128i low = _mm_madd_epi16(_mm_unpacklo_epi16(top, bottom), _mm_unpacklo_epi16(inverseY, fy));
+		__m128i high = _mm_madd_epi16(_mm_unpackhi_epi16(top, bottom), _mm_unpackhi_epi16(inverseY, fy));
+		low = _mm_srai_epi32(_mm_add_epi32(low, round), 10);
+		high = _mm_srai_epi32(_mm_add_epi32(high, round), 10);
+		__m128i result = _mm_packs_epi32(low, high);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(target + i), _mm_packus_epi16(result, result));
+	}
+#elif defined(UNIGLES_SIMD_NEON)
+	const uint16x8_t scale = vdupq_n_u16(1 << RemapTable::FractionBits);
+	for (; i + 8 <= count; i += 8) {
+		uint16x8_t fx = vld1q_u16(row.fx + i);
+		uint16x8_t fy = vld1q_u16(row.fy + i);
+		uint16x8_t inverseX = vsubq_u16(scale, fx);
+		uint16x8_t inverseY = vsubq_u16(scale, fy);
+		uint16x8_t top = vmlaq_u16(vmulq_u16(vld1q_u16(row.p00 + i), inverseX), vld1q_u16(row.p01 + i), fx);
+		uint16x8_t bottom = vmlaq_u16(vmulq_u16(vld1q_u16(row.p10 + i), inverseX), vld1q_u16(row.p11 + i), fx);
+		uint32x4_t low = vmlal_u16(vmull_u16(vget_low_u16(top), vget_low_u16(inverseY)), vget_low_u16(bottom), vget_low_u16(fy));
+		uint32x4_t high = vmlal_u16(vmull_u16(vget_high_u16(top), vget_high_u16(inverseY)), vget_high_u16(bottom), vget_high_u16(fy));
+		vst1_u8(target + i, vmovn_u16(vcombine_u16(vrshrn_n_u32(low, 10), vrshrn_n_u32(high, 10))));
+	}
+#endif
+	for (; i < count; i++) {
+		target[i] = BlendPixel(row, i);
+	}
+}
+
+template <unsigned Channels>
+static void RemapTileImpl(const RemapTable& table, const uint8_t* source, size_t sourceStride, uint8_t* target, size_t targetStride,
+	const uint8_t* border, unsigned x0, unsigned y0, unsigned x1, unsigned y1) {
+	unsigned shift = StepShift(table.step);
+	RemapRow row;
+	for (unsigned y = y0; y < y1; y++) {
+		unsigned cellY = (std::min)(y >> shift, table.gridHeight - 2);
+		unsigned ty = y - (cellY << shift);
+		uint8_t* out = target + size_t(y) * targetStride;
+		for (unsigned chunk = x0; chunk < x1; chunk += TileWidth) {
+			unsigned end = (std::min)(chunk + TileWidth, x1);
+			unsigned entry = 0;
+			unsigned x = chunk;
+			while (x < end) {
+				// Within a cell the coordinates are linear along the row, so they advance
+				// by a constant step per pixel.
+				unsigned cellX = (std::min)(x >> shift, table.gridWidth - 2);
+				unsigned cellEnd = cellX == table.gridWidth - 2 ? end : (std::min)(end, (cellX + 1) << shift);
+				int32_t leftX = InterpolateColumn(table, cellY, ty, cellX, 0);
+				int32_t rightX = InterpolateColumn(table, cellY, ty, cellX + 1, 0);
+				int32_t leftY = InterpolateColumn(table, cellY, ty, cellX, 1);
+				int32_t rightY = InterpolateColumn(table, cellY, ty, cellX + 1, 1);
+				int32_t tx = int32_t(x - (cellX << shift));
+				int32_t sourceX = leftX * (int32_t(table.step) - tx) + rightX * tx;
+				int32_t sourceY = leftY * (int32_t(table.step) - tx) + rightY * tx;
+				for (; x < cellEnd; x++, entry += Channels) {
+					GatherPixel<Channels>(source, sourceStride, table.width, table.height, border,
+						RoundCoordinate(sourceX, shift), RoundCoordinate(sourceY, shift), row, entry);
+					sourceX += rightX - leftX;
+					sourceY += rightY - leftY;
+				}
+			}
+			BlendRow(row, out + size_t(chunk) * Channels, entry);
+		}
+	}
+}
+
+template <unsigned Channels>
+static void RemapTileScalarImpl(const RemapTable& table, const uint8_t* source, size_t sourceStride, uint8_t* target, size_t targetStride,
+	const uint8_t* border, unsigned x0, unsigned y0, unsigned x1, unsigned y1) {
+	unsigned shift = StepShift(table.step);
+	RemapRow row;
+	for (unsigned y = y0; y < y1; y++) {
+		unsigned cellY = (std::min)(y >> shift, table.gridHeight - 2);
+		unsigned ty = y - (cellY << shift);
+		for (unsigned x = x0; x < x1; x++) {
+			unsigned cellX = (std::min)(x >> shift, table.gridWidth - 2);
+			int32_t tx = int32_t(x - (cellX << shift));
+			int32_t sourceX = InterpolateColumn(table, cellY, ty, cellX, 0) * (int32_t(table.step) - tx) +
+				InterpolateColumn(table, cellY, ty, cellX + 1, 0) * tx;
+			int32_t sourceY = InterpolateColumn(table, cellY, ty, cellX, 1) * (int32_t(table.step) - tx) +
+				InterpolateColumn(table, cellY, ty, cellX + 1, 1) * tx;
+			GatherPixel<Channels>(source, sourceStride, table.width, table.height, border,
+				RoundCoordinate(sourceX, shift), RoundCoordinate(sourceY, shift), row, 0);
+			BlendRowScalar(row, target + size_t(y) * targetStride + size_t(x) * Channels, Channels);
+		}
+	}
+}
+
+void unigles::RemapTile(const RemapTable& table, const uint8_t* source, size_t sourceStride, uint8_t* target, size_t targetStride,
+	unsigned channels, const uint8_t* border, unsigned x0, unsigned y0, unsigned x1, unsigned y1) {
+	// The gather is specialized per pixel size; it is the part that does not vectorize.
+	switch (channels) {
+	case 1:
+		RemapTileImpl<1>(table, source, sourceStride, target, targetStride, border, x0, y0, x1, y1);
+		break;
+	case 2:
+		RemapTileImpl<2>(table, source, sourceStride, target, targetStride, border, x0, y0, x1, y1);
+		break;
+	case 3:
+		RemapTileImpl<3>(table, source, sourceStride, target, targetStride, border, x0, y0, x1, y1);
+		break;
+	case 4:
+		RemapTileImpl<4>(table, source, sourceStride, target, targetStride, border, x0, y0, x1, y1);
+		break;
+	}
+}
+
+void unigles::RemapTileScalar(const RemapTable& table, const uint8_t* source, size_t sourceStride, uint8_t* target, size_t targetStride,
+	unsigned channels, const uint8_t* border, unsigned x0, unsigned y0, unsigned x1, unsigned y1) {
+	switch (channels) {
+	case 1:
+		RemapTileScalarImpl<1>(table, source, sourceStride, target, targetStride, border, x0, y0, x1, y1);
+		break;
+	case 2:
+		RemapTileScalarImpl<2>(table, source, sourceStride, target, targetStride, border, x0, y0, x1, y1);
+		break;
+	case 3:
+		RemapTileScalarImpl<3>(table, source, sourceStride, target, targetStride, border, x0, y0, x1, y1);
+		break;
+	case 4:
+		RemapTileScalarImpl<4>(table, source, sourceStride, target, targetStride, border, x0, y0, x1, y1);
+		break;
+	}
+}
+
+RemapTableCache::RemapTableCache(unsigned step) :
+	mStep(step),
+	mVersion(0),
+	mBuilds(0) {}
+
+void RemapTableCache::SetLens(const LensModel& lens) {
+	mLens = lens;
+	mTables.clear();
+	mVersion++;
+}
+
+const RemapTable& RemapTableCache::Get(unsigned width, unsigned height) {
+	for (size_t i = 0; i < mTables.size(); i++) {
+		if (mTables[i]->width == width && mTables[i]->height == height) {
+			// Most recently used last, so the one evicted is the one unused the longest.
+			std::rotate(mTables.begin() + i, mTables.begin() + i + 1, mTables.end());
+			return *mTables.back();
+		}
+	}
+	if (mTables.size() >= MaxTables) {
+		mTables.erase(mTables.begin());
+	}
+	mTables.emplace_back(new RemapTable(BuildRemapTable(mLens, width, height, mStep)));
+	mBuilds++;
+	return *mTables.back();
+}
+
+size_t RemapTableCache::GetBytes() const {
+	size_t bytes = 0;
+	for (const std::unique_ptr<RemapTable>& table : mTables) {
+		bytes += table->GetBytes();
+	}
+	return bytes;
+}
+
+LensCorrector::LensCorrector(const LensModel& lens) :
+	mFrames(0),
+	mLastMilliseconds(0.0) {
+	mTables.SetLens(lens);
+}
+
+void LensCorrector::PrepareTarget(const Nv12Frame& source, Nv12Frame& target) {
+	mFrames++;
+	target.width = source.width;
+	target.height = source.height;
+	target.sequence = source.sequence;
+	target.timestamp = source.timestamp;
+	target.luma.resize(source.luma.size());
+	target.chroma.resize(source.chroma.size());
+	target.bandRows = 0;
+	target.dirtyBands.clear();
+	target.features.clear();
+}
+
+void LensCorrector::Process(const Nv12Frame& source, Nv12Frame& target, TaskPool* pool) {
+	auto start = std::chrono::steady_clock::now();
+	PrepareTarget(source, target);
+	if (source.width > 0 && source.height > 0) {
+		if (!pool) {
+			pool = &TaskPool::Default();
+		}
+		const RemapTable& luma = mTables.Get(source.width, source.height);
+		const RemapTable& chroma = mTables.Get(source.ChromaWidth(), source.ChromaHeight());
+		unsigned lumaColumns = (luma.width + TileWidth - 1) / TileWidth;
+		unsigned lumaTiles = lumaColumns * ((luma.height + TileHeight - 1) / TileHeight);
+		unsigned chromaColumns = (chroma.width + TileWidth - 1) / TileWidth;
+		unsigned chromaTiles = chromaColumns * ((chroma.height + TileHeight - 1) / TileHeight);
+		pool->Run(lumaTiles + chromaTiles, [&](unsigned tile) {
+			bool isLuma = tile < lumaTiles;
+			const RemapTable& table = isLuma ? luma : chroma;
+			unsigned index = isLuma ? tile : tile - lumaTiles;
+			unsigned columns = isLuma ? lumaColumns : chromaColumns;
+			unsigned channels = isLuma ? 1 : 2;
+			unsigned x0 = (index % columns) * TileWidth;
+			unsigned y0 = (index / columns) * TileHeight;
+			RemapTile(table, isLuma ? source.luma.data() : source.chroma.data(), size_t(table.width) * channels,
+				isLuma ? target.luma.data() : target.chroma.data(), size_t(table.width) * channels, channels,
+				isLuma ? LumaBorder : ChromaBorder, x0, y0, (std::min)(x0 + TileWidth, table.width), (std::min)(y0 + TileHeight, table.height));
+		});
+	}
+	mLastMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void LensCorrector::ProcessScalar(const Nv12Frame& source, Nv12Frame& target) {
+	auto start = std::chrono::steady_clock::now();
+	PrepareTarget(source, target);
+	if (source.width > 0 && source.height > 0) {
+		const RemapTable& luma = mTables.Get(source.width, source.height);
+		const RemapTable& chroma = mTables.Get(source.ChromaWidth(), source.ChromaHeight());
+		RemapTileScalar(luma, source.luma.data(), luma.width, target.luma.data(), luma.width, 1, LumaBorder,
+			0, 0, luma.width, luma.height);
+		RemapTileScalar(chroma, source.chroma.data(), size_t(chroma.width) * 2, target.chroma.data(), size_t(chroma.width) * 2, 2, ChromaBorder,
+			0, 0, chroma.width, chroma.height);
+	}
+	mLastMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
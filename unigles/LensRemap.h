@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace unigles {
+	class TaskPool;
+	struct Nv12Frame;
+
+	// Pinhole camera with Brown-Conrady distortion, in OpenCV's convention: pixel centers
+	// at integer coordinates, three radial and two tangential coefficients. A model with
+	// no focal length, or no distortion at zoom 1, leaves images as they are.
+	struct LensModel {
+		unsigned width = 0;		// Resolution the calibration was made at
+		unsigned height = 0;
+		double fx = 0.0;
+		double fy = 0.0;
+		double cx = 0.0;
+		double cy = 0.0;
+		double k1 = 0.0;
+		double k2 = 0.0;
+		double k3 = 0.0;
+		double p1 = 0.0;
+		double p2 = 0.0;
+		// Focal length of the corrected image relative to the camera's. Below 1 keeps
+		// the corners that barrel distortion pulls out of the frame; above 1 crops.
+		double zoom = 1.0;
+
+		bool IsIdentity() const;
+		// The same lens at another resolution of the sensor, such as a binned mode or
+		// the chroma plane.
+		LensModel ScaledTo(unsigned w, unsigned h) const;
+		// Where the corrected image's pixel at x, y lies in the camera image. Exact;
+		// the tables below approximate it.
+		void MapToSource(double x, double y, double& sourceX, double& sourceY) const;
+	};
+
+	// Source coordinates of a corrected image at the nodes of a coarse grid, every step
+	// pixels on both axes. Distortion is smooth, so interpolating between nodes stays
+	// within a few hundredths of a pixel of the model at a small fraction of the size.
+	struct RemapTable {
+		static const unsigned FractionBits = 5;
+
+		unsigned width = 0;			// Of the corrected image, and of its source
+		unsigned height = 0;
+		unsigned step = 0;			// Power of two
+		unsigned gridWidth = 0;
+		unsigned gridHeight = 0;
+		std::vector<float> coords;			// Source x, y per node
+		std::vector<int32_t> fixedCoords;	// The same in 1/32 pixels, for the CPU kernels
+
+		// Bilinear between the nodes around x, y.
+		void Lookup(double x, double y, double& sourceX, double& sourceY) const;
+		// Normalized source coordinates offset by half and halved, so [-0.5, 1.5] fits
+		// 16-bit unorm: filterable at every feature level, at half the size of floats.
+		std::vector<uint16_t> PackUnorm16() const;
+		size_t GetBytes() const;
+	};
+
+	// Steps other than powers of two from 2 to 32 are rounded to one, and images smaller
+	// than four steps get a finer grid.
+	RemapTable BuildRemapTable(const LensModel& lens, unsigned width, unsigned height, unsigned step = 8);
+
+	// Resamples the corrected pixels in [x0, x1) x [y0, y1) of target, which is as large as
+	// the table, from a source of the same size with 1 to 4 interleaved bytes per pixel.
+	// Pixels that map outside the source get the border value. Bit exact with the scalar
+	// version.
+	void RemapTile(const RemapTable& table, const uint8_t* source, size_t sourceStride, uint8_t* target, size_t targetStride,
+		unsigned channels, const uint8_t* border, unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+	void RemapTileScalar(const RemapTable& table, const uint8_t* source, size_t sourceStride, uint8_t* target, size_t targetStride,
+		unsigned channels, const uint8_t* border, unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+
+	// Tables of one lens for every resolution asked for, built on first use.
+	class RemapTableCache {
+	public:
+		static const unsigned MaxTables = 4;
+
+		explicit RemapTableCache(unsigned step = 8);
+
+		// Drops every table built for the previous lens.
+		void SetLens(const LensModel& lens);
+		const LensModel& GetLens() const { return mLens; }
+		// Stays valid until the lens changes or MaxTables other resolutions were asked for.
+		const RemapTable& Get(unsigned width, unsigned height);
+		// Incremented by SetLens, so copies of the tables elsewhere know to refresh.
+		uint64_t GetVersion() const { return mVersion; }
+		uint64_t GetBuildCount() const { return mBuilds; }
+		// Of every table held.
+		size_t GetBytes() const;
+
+	private:
+		LensModel mLens;
+		unsigned mStep;
+		std::vector<std::unique_ptr<RemapTable>> mTables;	// Newest last
+		uint64_t mVersion;
+		uint64_t mBuilds;
+	};
+
+	// Lens correction of NV12 frames on the CPU: both planes are resampled through
+	// their own table, tile by tile over the pool. TextureBridge applies the same
+	// tables inside its conversion draw.
+	class LensCorrector {
+	public:
+		explicit LensCorrector(const LensModel& lens = LensModel());
+
+		void SetLens(const LensModel& lens) { mTables.SetLens(lens); }
+		const LensModel& GetLens() const { return mTables.GetLens(); }
+		bool IsEnabled() const { return !mTables.GetLens().IsIdentity(); }
+
+		// Writes the corrected source to target, which takes its size, sequence and
+		// timestamp. Every row moves, so target is marked dirty as a whole. Tiles go
+		// over the pool, TaskPool::Default() when null.
+		void Process(const Nv12Frame& source, Nv12Frame& target, TaskPool* pool = nullptr);
+		// Single threaded reference the vectorized version is checked against.
+		void ProcessScalar(const Nv12Frame& source, Nv12Frame& target);
+
+		uint64_t GetFrameCount() const { return mFrames; }
+		double GetLastMilliseconds() const { return mLastMilliseconds; }
+		// Of the remap tables, one per plane size.
+		size_t GetBytes() const { return mTables.GetBytes(); }
+
+	private:
+		void PrepareTarget(const Nv12Frame& source, Nv12Frame& target);
+
+		RemapTableCache mTables;
+		uint64_t mFrames;
+		double mLastMilliseconds;
+	};
+}
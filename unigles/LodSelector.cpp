@@ -0,0 +1,64 @@
+#include "LodSelector.h"
+
+#include <algorithm>
+
+using namespace unigles;
+
+// Closer than this the error is treated as at this distance instead of blowing up.
+static const float MinDistance = 1.0e-3f;
+
+LodSelector::LodSelector(const LodSettings& settings) :
+	mSettings(settings),
+	mPixelsPerUnit(1.0f) {}
+
+float LodSelector::PixelsPerUnit(const float* projection, unsigned viewportHeight) {
+	// projection[5] is the cotangent of half the vertical field of view.
+	return 0.5f * viewportHeight * projection[5];
+}
+
+void LodSelector::BeginFrame(float pixelsPerUnit) {
+	mPixelsPerUnit = pixelsPerUnit;
+	mStats = LodStats();
+}
+
+float LodSelector::ScreenError(float geometricError, float distance) const {
+	return geometricError * mPixelsPerUnit / std::max(distance, MinDistance);
+}
+
+unsigned LodSelector::SelectMesh(const std::vector<MeshLod>& levels, float distance, unsigned current) {
+	if (levels.empty()) {
+		return 0;
+	}
+	// Errors grow with the level, so the last level that fits is the coarsest acceptable.
+	unsigned selected = 0;
+	for (unsigned level = 1; level < levels.size(); level++) {
+		float limit = mSettings.maxScreenError * (level > current ? 1.0f - mSettings.hysteresis : 1.0f);
+		if (ScreenError(levels[level].geometricError, distance) <= limit) {
+			selected = level;
+		}
+	}
+	mStats.trianglesFull += levels[0].triangles;
+	mStats.trianglesDrawn += levels[selected].triangles;
+	if (selected != current) {
+		mStats.switches++;
+	}
+	return selected;
+}
+
+unsigned LodSelector::SelectTexture(unsigned fullWidth, unsigned fullHeight, unsigned levels, float footprint, unsigned current) {
+	float needed = footprint * mSettings.texelsPerPixel;
+	unsigned selected = 0;
+	for (unsigned level = 1; level < levels; level++) {
+		unsigned extent = std::max(std::max(fullWidth, fullHeight) >> level, 1u);
+		float usable = extent * (level > current ? 1.0f - mSettings.hysteresis : 1.0f);
+		if (usable >= needed) {
+			selected = level;
+		}
+	}
+	mStats.texelsFull += uint64_t(fullWidth) * fullHeight;
+	mStats.texelsSampled += uint64_t(std::max(fullWidth >> selected, 1u)) * std::max(fullHeight >> selected, 1u);
+	if (selected != current) {
+		mStats.switches++;
+	}
+	return selected;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace unigles {
+	struct LodSettings {
+		// Largest geometric error, in pixels on screen, a mesh level may show.
+		float maxScreenError = 1.0f;
+		// Texels a texture variant must offer per pixel of on-screen footprint.
+		float texelsPerPixel = 1.0f;
+		// A coarser level is only taken once it fits with this much to spare, so an
+		// object sitting on a threshold does not flip between levels every frame.
+		float hysteresis = 0.2f;
+	};
+
+	// One level of a mesh LOD chain, finest first.
+	struct MeshLod {
+		float geometricError;	// World units the level deviates from the full mesh
+		uint32_t triangles;
+	};
+
+	struct LodStats {
+		uint64_t trianglesFull = 0;
+		uint64_t trianglesDrawn = 0;
+		uint64_t texelsFull = 0;
+		uint64_t texelsSampled = 0;
+		uint32_t switches = 0;		// Objects whose level changed this frame
+
+		double TriangleSavings() const { return trianglesFull ? 1.0 - double(trianglesDrawn) / double(trianglesFull) : 0.0; }
+		double TexelSavings() const { return texelsFull ? 1.0 - double(texelsSampled) / double(texelsFull) : 0.0; }
+	};
+
+	// Picks mesh levels by projected screen-space error and texture variants by
+	// on-screen footprint. Callers keep each object's level between frames and pass
+	// it back in, which is what the hysteresis works against.
+	class LodSelector {
+	public:
+		explicit LodSelector(const LodSettings& settings = LodSettings());
+
+		// Pixels covered by one world unit at view distance one, from a GL projection
+		// matrix (column major) and the viewport height.
+		static float PixelsPerUnit(const float* projection, unsigned viewportHeight);
+
+		// Clears the statistics of the previous frame.
+		void BeginFrame(float pixelsPerUnit);
+		// distance is the view depth of the object. Returns the new level.
+		unsigned SelectMesh(const std::vector<MeshLod>& levels, float distance, unsigned current);
+		// Variants halve the full size per level. footprint is the larger on-screen
+		// extent of the textured surface in pixels. Returns the new level.
+		unsigned SelectTexture(unsigned fullWidth, unsigned fullHeight, unsigned levels, float footprint, unsigned current);
+
+		float ScreenError(float geometricError, float distance) const;
+		const LodSettings& GetSettings() const { return mSettings; }
+		const LodStats& GetStats() const { return mStats; }
+
+	private:
+		LodSettings mSettings;
+		LodStats mStats;
+		float mPixelsPerUnit;
+	};
+}
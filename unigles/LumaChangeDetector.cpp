@@ -0,0 +1,129 @@
+#include "LumaChangeDetector.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace unigles;
+
+LumaChangeDetector::LumaChangeDetector(const ChangeDetectorSettings& settings) :
+	mSettings(settings),
+	mWidth(0),
+	mHeight(0),
+	mTilesX(0),
+	mTilesY(0),
+	mQuietCount(0),
+	mHasReference(false),
+	mActive(true) {
+	mSettings.tileSize = std::max(1u, mSettings.tileSize);
+	mSettings.rowStep = std::max(1u, mSettings.rowStep);
+}
+
+void LumaChangeDetector::Reset() {
+	mHasReference = false;
+	mActive = true;
+	mQuietCount = 0;
+	mStats = ChangeDetectorStats();
+}
+
+void LumaChangeDetector::Resize(unsigned width, unsigned height) {
+	mWidth = width;
+	mHeight = height;
+	mTilesX = (width + mSettings.tileSize - 1) / mSettings.tileSize;
+	mTilesY = (height + mSettings.tileSize - 1) / mSettings.tileSize;
+	unsigned sampledRows = (height + mSettings.rowStep - 1) / mSettings.rowStep;
+	mReference.assign(size_t(sampledRows) * width, 0);
+	mTileSad.assign(size_t(mTilesX) * mTilesY, 0);
+	mTileSamples.assign(size_t(mTilesX) * mTilesY, 0);
+	mDirtyMask.assign(size_t(mTilesX) * mTilesY, 1);
+	mHasReference = false;
+	mActive = true;
+	mQuietCount = 0;
+}
+
+void LumaChangeDetector::StoreReference(const uint8_t* luma, size_t stride) {
+	uint8_t* target = mReference.data();
+	for (unsigned y = 0; y < mHeight; y += mSettings.rowStep) {
+		memcpy(target, luma + y * stride, mWidth);
+		target += mWidth;
+	}
+	mHasReference = true;
+}
+
+uint32_t LumaChangeDetector::RowSad(const uint8_t* a, const uint8_t* b, unsigned count) {
+	uint32_t sum = 0;
+	unsigned i = 0;
+#if defined(UNIGLES_SIMD_SSE2)
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16) {
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+	}
+	sum = uint32_t(_mm_cvtsi128_si32(acc)) + uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#elif defined(UNIGLES_SIMD_NEON)
+	uint32x4_t acc = vdupq_n_u32(0);
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+		acc = vpadalq_u16(acc, vpaddlq_u8(diff));
+	}
+	uint64x2_t pairs = vpaddlq_u32(acc);
+	sum = uint32_t(vgetq_lane_u64(pairs, 0) + vgetq_lane_u64(pairs, 1));
+#endif
+	for (; i < count; i++) {
+		sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+	}
+	return sum;
+}
+
+bool LumaChangeDetector::Process(const uint8_t* luma, unsigned width, unsigned height, size_t stride) {
+	mStats.frames++;
+	if (width != mWidth || height != mHeight) {
+		Resize(width, height);
+	}
+	if (!mHasReference) {
+		StoreReference(luma, stride);
+		std::fill(mDirtyMask.begin(), mDirtyMask.end(), uint8_t(1));
+		return true;
+	}
+
+	std::fill(mTileSad.begin(), mTileSad.end(), 0u);
+	std::fill(mTileSamples.begin(), mTileSamples.end(), 0u);
+	const uint8_t* reference = mReference.data();
+	for (unsigned y = 0; y < mHeight; y += mSettings.rowStep) {
+		const uint8_t* row = luma + y * stride;
+		unsigned tileRow = (y / mSettings.tileSize) * mTilesX;
+		for (unsigned tx = 0; tx < mTilesX; tx++) {
+			unsigned x = tx * mSettings.tileSize;
+			unsigned count = std::min(mSettings.tileSize, mWidth - x);
+			mTileSad[tileRow + tx] += RowSad(row + x, reference + x, count);
+			mTileSamples[tileRow + tx] += count;
+		}
+		reference += mWidth;
+	}
+
+	// Hysteresis: an active scene keeps tiles dirty down to the lower release level,
+	// and it takes quietFrames calm frames in a row before skipping starts.
+	float level = float(mSettings.threshold) * (mActive ? mSettings.releaseRatio : 1.0f);
+	bool changed = false;
+	for (size_t i = 0; i < mTileSad.size(); i++) {
+		bool dirty = float(mTileSad[i]) > level * float(mTileSamples[i]);
+		mDirtyMask[i] = dirty ? 1 : 0;
+		changed = changed || dirty;
+	}
+	if (changed) {
+		mActive = true;
+		mQuietCount = 0;
+	} else if (mActive && ++mQuietCount >= mSettings.quietFrames) {
+		mActive = false;
+	}
+
+	bool process = changed || mActive;
+	if (process) {
+		StoreReference(luma, stride);
+	} else {
+		std::fill(mDirtyMask.begin(), mDirtyMask.end(), uint8_t(0));
+		mStats.skipped++;
+	}
+	return process;
+}
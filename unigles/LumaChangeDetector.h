@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace unigles {
+	struct ChangeDetectorSettings {
+		// Tile edge in pixels of the plane handed to Process().
+		unsigned tileSize = 16;
+		// Only every n-th row is compared; columns are always compared in full.
+		unsigned rowStep = 1;
+		// Mean absolute luma difference (0..255) that marks a tile as changed.
+		unsigned threshold = 6;
+		// While the scene is active a tile stays dirty above threshold * releaseRatio.
+		float releaseRatio = 0.5f;
+		// Number of consecutive quiet frames before frames start being skipped.
+		unsigned quietFrames = 3;
+	};
+
+	struct ChangeDetectorStats {
+		uint64_t frames = 0;
+		uint64_t skipped = 0;
+
+		double SkipRate() const { return frames ? double(skipped) / double(frames) : 0.0; }
+	};
+
+	// Compares a luma plane against the last frame that was let through, tile by tile.
+	// The reference only moves forward on processed frames, so slow drifts still
+	// accumulate into a change instead of hiding below the threshold forever.
+	class LumaChangeDetector {
+	public:
+		explicit LumaChangeDetector(const ChangeDetectorSettings& settings = ChangeDetectorSettings());
+
+		// Returns true when the frame differs enough from the reference to be processed.
+		bool Process(const uint8_t* luma, unsigned width, unsigned height, size_t stride);
+		void Reset();
+
+		const ChangeDetectorSettings& GetSettings() const { return mSettings; }
+		const ChangeDetectorStats& GetStats() const { return mStats; }
+		// One byte per tile, row major, non-zero for tiles that changed in the last processed frame.
+		const std::vector<uint8_t>& GetDirtyMask() const { return mDirtyMask; }
+		unsigned GetTilesX() const { return mTilesX; }
+		unsigned GetTilesY() const { return mTilesY; }
+
+		// Sum of absolute differences between two rows; exposed for the benchmarks.
+		static uint32_t RowSad(const uint8_t* a, const uint8_t* b, unsigned count);
+
+	private:
+		void Resize(unsigned width, unsigned height);
+		void StoreReference(const uint8_t* luma, size_t stride);
+
+		ChangeDetectorSettings mSettings;
+		ChangeDetectorStats mStats;
+		unsigned mWidth, mHeight;
+		unsigned mTilesX, mTilesY;
+		unsigned mQuietCount;
+		bool mHasReference;
+		bool mActive;
+		std::vector<uint8_t> mReference;
+		std::vector<uint32_t> mTileSad;
+		std::vector<uint32_t> mTileSamples;
+		std::vector<uint8_t> mDirtyMask;
+	};
+}
@@ -0,0 +1,283 @@
+#include "LumaStatistics.h"
+#include "Simd.h"
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace unigles;
+
+// Rows handed to one task when no tiles dictate the band height.
+static const unsigned BandRows = 64;
+
+static void PrepareResult(unsigned width, unsigned height, const LumaStatisticsSettings& settings, LumaStatistics& result) {
+	memset(result.histogram, 0, sizeof(result.histogram));
+	result.tileSize = settings.tileSize;
+	if (settings.tileSize) {
+		result.tilesX = (width + settings.tileSize - 1) / settings.tileSize;
+		result.tilesY = (height + settings.tileSize - 1) / settings.tileSize;
+	} else {
+		result.tilesX = result.tilesY = 0;
+	}
+	result.tiles.assign(size_t(result.tilesX) * result.tilesY, LumaTileStatistics());
+}
+
+static void AccumulateTile(LumaTileStatistics& tile, uint32_t sum, uint32_t count, uint8_t min, uint8_t max) {
+	tile.sum += sum;
+	tile.count += count;
+	tile.min = std::min(tile.min, min);
+	tile.max = std::max(tile.max, max);
+}
+
+static void RowSumMinMax(const uint8_t* row, unsigned count, uint32_t& sum, uint8_t& min, uint8_t& max) {
+	unsigned i = 0;
+	sum = 0;
+	min = 255;
+	max = 0;
+#if defined(UNIGLES_SIMD_SSE2)
+	if (count >= 16) {
+		__m128i zero = _mm_setzero_si128();
+		__m128i vsum = zero;
+		__m128i vmin = _mm_set1_epi8(-1);
+		__m128i vmax = zero;
+		for (; i + 16 <= count; i += 16) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+			vsum = _mm_add_epi64(vsum, _mm_sad_epu8(v, zero));
+			vmin = _mm_min_epu8(vmin, v);
+			vmax = _mm_max_epu8(vmax, v);
+		}
+		vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 8));
+		vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 4));
+		vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 2));
+		vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 1));
+		vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 8));
+		vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 4));
+		vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 2));
+		vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 1));
+		sum = uint32_t(_mm_cvtsi128_si32(vsum)) + uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(vsum, 8)));
+		min = uint8_t(_mm_cvtsi128_si32(vmin));
+		max = uint8_t(_mm_cvtsi128_si32(vmax));
+	}
+#elif defined(UNIGLES_SIMD_NEON)
+	if (count >= 16) {
+		uint32x4_t vsum = vdupq_n_u32(0);
+		uint8x16_t vmin = vdupq_n_u8(255);
+		uint8x16_t vmax = vdupq_n_u8(0);
+		for (; i + 16 <= count; i += 16) {
+			uint8x16_t v = vld1q_u8(row + i);
+			vsum = vpadalq_u16(vsum, vpaddlq_u8(v));
+			vmin = vminq_u8(vmin, v);
+			vmax = vmaxq_u8(vmax, v);
+		}
+		uint8x8_t dmin = vpmin_u8(vget_low_u8(vmin), vget_high_u8(vmin));
+		uint8x8_t dmax = vpmax_u8(vget_low_u8(vmax), vget_high_u8(vmax));
+		dmin = vpmin_u8(dmin, dmin);
+		dmin = vpmin_u8(dmin, dmin);
+		dmin = vpmin_u8(dmin, dmin);
+		dmax = vpmax_u8(dmax, dmax);
+		dmax = vpmax_u8(dmax, dmax);
+		dmax = vpmax_u8(dmax, dmax);
+		uint64x2_t pairs = vpaddlq_u32(vsum);
+		sum = uint32_t(vgetq_lane_u64(pairs, 0) + vgetq_lane_u64(pairs, 1));
+		min = vget_lane_u8(dmin, 0);
+		max = vget_lane_u8(dmax, 0);
+	}
+#endif
+	for (; i < count; i++) {
+		sum += row[i];
+		min = std::min(min, row[i]);
+		max = std::max(max, row[i]);
+	}
+}
+
+static void RowHistogram(const uint8_t* row, unsigned count, uint32_t (*histograms)[256]) {
+	// Four interleaved sub-histograms keep runs of equal pixels from serializing
+	// on the same counter.
+	unsigned i = 0;
+	for (; i + 4 <= count; i += 4) {
+		uint32_t quad;
+		memcpy(&quad, row + i, sizeof(quad));
+		histograms[0][quad & 0xff]++;
+		histograms[1][(quad >> 8) & 0xff]++;
+		histograms[2][(quad >> 16) & 0xff]++;
+		histograms[3][quad >> 24]++;
+	}
+	for (; i < count; i++) {
+		histograms[0][row[i]]++;
+	}
+}
+
+uint8_t LumaStatistics::Percentile(double fraction) const {
+	if (count == 0) {
+		return 0;
+	}
+	fraction = std::min(1.0, std::max(0.0, fraction));
+	uint64_t target = std::max<uint64_t>(1, uint64_t(std::ceil(fraction * double(count))));
+	uint64_t cumulative = 0;
+	for (int i = 0; i < 256; i++) {
+		cumulative += histogram[i];
+		if (cumulative >= target) {
+			return uint8_t(i);
+		}
+	}
+	return 255;
+}
+
+void LumaStatistics::Finalize() {
+	uint64_t total = 0;
+	uint64_t weighted = 0;
+	int first = -1, last = -1;
+	for (int i = 0; i < 256; i++) {
+		if (histogram[i] == 0) {
+			continue;
+		}
+		total += histogram[i];
+		weighted += uint64_t(histogram[i]) * i;
+		if (first < 0) {
+			first = i;
+		}
+		last = i;
+	}
+	count = total;
+	mean = total ? double(weighted) / double(total) : 0.0;
+	min = uint8_t(std::max(first, 0));
+	max = uint8_t(std::max(last, 0));
+}
+
+void unigles::ComputeLumaStatistics(const uint8_t* luma, unsigned width, unsigned height, size_t stride,
+	const LumaStatisticsSettings& settings, LumaStatistics& result, TaskPool* pool) {
+	PrepareResult(width, height, settings, result);
+	if (!pool) {
+		pool = &TaskPool::Default();
+	}
+
+	// Bands follow tile rows so that no two tasks ever touch the same tile.
+	unsigned bandRows = settings.tileSize ? settings.tileSize * std::max(1u, BandRows / settings.tileSize) : BandRows;
+	unsigned bands = (height + bandRows - 1) / bandRows;
+	std::vector<uint32_t> bandHistograms(size_t(bands) * 4 * 256, 0);
+
+	pool->Run(bands, [&](unsigned band) {
+		uint32_t (*histograms)[256] = reinterpret_cast<uint32_t (*)[256]>(&bandHistograms[size_t(band) * 4 * 256]);
+		unsigned y0 = band * bandRows;
+		unsigned y1 = std::min(height, y0 + bandRows);
+		for (unsigned y = y0; y < y1; y++) {
+			const uint8_t* row = luma + y * stride;
+			RowHistogram(row, width, histograms);
+			if (!settings.tileSize) {
+				continue;
+			}
+			LumaTileStatistics* tileRow = &result.tiles[size_t(y / settings.tileSize) * result.tilesX];
+			for (unsigned tx = 0; tx < result.tilesX; tx++) {
+				unsigned x = tx * settings.tileSize;
+				unsigned count = std::min(settings.tileSize, width - x);
+				uint32_t sum;
+				uint8_t min, max;
+				RowSumMinMax(row + x, count, sum, min, max);
+				AccumulateTile(tileRow[tx], sum, count, min, max);
+			}
+		}
+	});
+
+	for (size_t i = 0; i < size_t(bands) * 4; i++) {
+		const uint32_t* histogram = &bandHistograms[i * 256];
+		for (int bin = 0; bin < 256; bin++) {
+			result.histogram[bin] += histogram[bin];
+		}
+	}
+	result.Finalize();
+}
+
+void unigles::ComputeLumaStatisticsScalar(const uint8_t* luma, unsigned width, unsigned height, size_t stride,
+	const LumaStatisticsSettings& settings, LumaStatistics& result) {
+	PrepareResult(width, height, settings, result);
+	for (unsigned y = 0; y < height; y++) {
+		const uint8_t* row = luma + y * stride;
+		for (unsigned x = 0; x < width; x++) {
+			uint8_t value = row[x];
+			result.histogram[value]++;
+			if (settings.tileSize) {
+				LumaTileStatistics& tile = result.tiles[size_t(y / settings.tileSize) * result.tilesX + x / settings.tileSize];
+				AccumulateTile(tile, value, 1, value, value);
+			}
+		}
+	}
+	result.Finalize();
+}
+
+LumaStatisticsWorker::LumaStatisticsWorker(const LumaStatisticsSettings& settings) :
+	mSettings(settings),
+	mHasPending(false),
+	mBusy(false),
+	mHasResult(false),
+	mStopping(false),
+	mReplaced(0) {
+	mThread = std::thread(&LumaStatisticsWorker::WorkerLoop, this);
+}
+
+LumaStatisticsWorker::~LumaStatisticsWorker() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWake.notify_all();
+	mThread.join();
+}
+
+void LumaStatisticsWorker::Submit(std::shared_ptr<const std::vector<uint8_t>> plane, unsigned width, unsigned height, size_t stride, uint64_t frame) {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mHasPending) {
+			mReplaced++;
+		}
+		mPending.plane = std::move(plane);
+		mPending.width = width;
+		mPending.height = height;
+		mPending.stride = stride;
+		mPending.frame = frame;
+		mHasPending = true;
+	}
+	mWake.notify_one();
+}
+
+bool LumaStatisticsWorker::GetLatest(LumaStatistics& result) const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mHasResult) {
+		result = mLatest;
+	}
+	return mHasResult;
+}
+
+bool LumaStatisticsWorker::IsIdle() const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return !mHasPending && !mBusy;
+}
+
+uint64_t LumaStatisticsWorker::GetReplacedCount() const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mReplaced;
+}
+
+void LumaStatisticsWorker::WorkerLoop() {
+	LumaStatistics scratch;
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		mWake.wait(lock, [this]() { return mStopping || mHasPending; });
+		if (mStopping) {
+			return;
+		}
+		Job job = std::move(mPending);
+		mHasPending = false;
+		mBusy = true;
+		lock.unlock();
+
+		ComputeLumaStatistics(job.plane->data(), job.width, job.height, job.stride, mSettings, scratch);
+		scratch.frame = job.frame;
+		job.plane.reset();
+
+		lock.lock();
+		std::swap(mLatest, scratch);
+		mHasResult = true;
+		mBusy = false;
+	}
+}
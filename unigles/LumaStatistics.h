@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace unigles {
+	class TaskPool;
+
+	struct LumaTileStatistics {
+		uint32_t sum = 0;
+		uint32_t count = 0;
+		uint8_t min = 255;
+		uint8_t max = 0;
+
+		float Mean() const { return count ? float(sum) / float(count) : 0.0f; }
+	};
+
+	struct LumaStatistics {
+		// Frame the statistics belong to, as numbered by whoever produced them.
+		uint64_t frame = 0;
+		uint64_t count = 0;
+		double mean = 0.0;
+		uint8_t min = 0;
+		uint8_t max = 0;
+		uint32_t histogram[256] = {};
+
+		// Per-tile results, empty unless tiles were requested.
+		unsigned tileSize = 0;
+		unsigned tilesX = 0;
+		unsigned tilesY = 0;
+		std::vector<LumaTileStatistics> tiles;
+
+		// Smallest luma value that at least the given fraction (0..1) of the pixels do not exceed.
+		uint8_t Percentile(double fraction) const;
+		// Derives count, mean, min and max from the histogram.
+		void Finalize();
+	};
+
+	struct LumaStatisticsSettings {
+		// Edge of the per-tile statistics in pixels; zero skips them.
+		unsigned tileSize = 0;
+	};
+
+	// Vectorized kernel, split in row bands over the pool (TaskPool::Default() when null).
+	void ComputeLumaStatistics(const uint8_t* luma, unsigned width, unsigned height, size_t stride,
+		const LumaStatisticsSettings& settings, LumaStatistics& result, TaskPool* pool = nullptr);
+	// Straightforward single threaded version the vectorized kernel is checked against.
+	void ComputeLumaStatisticsScalar(const uint8_t* luma, unsigned width, unsigned height, size_t stride,
+		const LumaStatisticsSettings& settings, LumaStatistics& result);
+
+	// Runs the kernel on its own thread. Submit() never waits: a plane submitted while
+	// the previous one is still queued replaces it, and results are picked up later.
+	class LumaStatisticsWorker {
+	public:
+		explicit LumaStatisticsWorker(const LumaStatisticsSettings& settings = LumaStatisticsSettings());
+		~LumaStatisticsWorker();
+
+		void Submit(std::shared_ptr<const std::vector<uint8_t>> plane, unsigned width, unsigned height, size_t stride, uint64_t frame);
+		// Copies the newest finished result; returns false if there is none yet.
+		bool GetLatest(LumaStatistics& result) const;
+		// True when nothing is queued or being computed, so the worker holds no plane and
+		// the caller may refill the one it submitted last.
+		bool IsIdle() const;
+		uint64_t GetReplacedCount() const;
+
+	private:
+		void WorkerLoop();
+
+		struct Job {
+			std::shared_ptr<const std::vector<uint8_t>> plane;
+			unsigned width, height;
+			size_t stride;
+			uint64_t frame;
+		};
+
+		LumaStatisticsSettings mSettings;
+		mutable std::mutex mMutex;
+		std::condition_variable mWake;
+		Job mPending;
+		bool mHasPending;
+		bool mBusy;
+		bool mHasResult;
+		bool mStopping;
+		uint64_t mReplaced;
+		LumaStatistics mLatest;
+		std::thread mThread;
+	};
+}
@@ -24,6 +24,26 @@ struct Matrix4
     float m[4][4];
 };
 
+// Column major like the matrices above, so the result applies b first, then a.
+inline static Matrix4 MultiplyMatrices(const Matrix4& a, const Matrix4& b)
+{
+    Matrix4 result(0.0f, 0.0f, 0.0f, 0.0f,
+                   0.0f, 0.0f, 0.0f, 0.0f,
+                   0.0f, 0.0f, 0.0f, 0.0f,
+                   0.0f, 0.0f, 0.0f, 0.0f);
+    for (int column = 0; column < 4; column++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                result.m[column][row] += a.m[k][row] * b.m[column][k];
+            }
+        }
+    }
+    return result;
+}
+
 inline static Matrix4 SimpleModelMatrix(float radians)
 {
     float cosine = cosf(radians);
@@ -0,0 +1,21 @@
+#include "Nv12FrameBuffer.h"
+
+#include <cstring>
+
+using namespace unigles;
+
+void Nv12Frame::Assign(const uint8_t* lumaPlane, size_t lumaStride, const uint8_t* chromaPlane, size_t chromaStride, unsigned w, unsigned h) {
+	width = w;
+	height = h;
+	luma.resize(size_t(width) * height);
+	chroma.resize(size_t(ChromaWidth()) * 2 * ChromaHeight());
+	for (unsigned y = 0; y < height; y++) {
+		memcpy(&luma[size_t(y) * width], lumaPlane + y * lumaStride, width);
+	}
+	size_t chromaRow = size_t(ChromaWidth()) * 2;
+	for (unsigned y = 0; y < ChromaHeight(); y++) {
+		memcpy(&chroma[y * chromaRow], chromaPlane + y * chromaStride, chromaRow);
+	}
+	dirtyBands.clear();
+	features.clear();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace unigles {
+	// A corner followed from frame to frame by FeatureTracker.
+	struct FeaturePoint {
+		float x = 0.0f;			// Luma pixels, centers at integer coordinates
+		float y = 0.0f;
+		float dx = 0.0f;		// Motion since the previous frame; zero for new points
+		float dy = 0.0f;
+		float error = 0.0f;		// Mean absolute difference of the tracked windows, in levels
+		uint32_t id = 0;		// Stays with the point while it is tracked
+		uint32_t age = 0;		// Frames it has been tracked for
+		unsigned score = 0;		// FAST score when it was detected
+	};
+
+	// A CPU-side NV12 image with tightly packed planes.
+	struct Nv12Frame {
+		unsigned width = 0;
+		unsigned height = 0;
+		uint64_t sequence = 0;
+		int64_t timestamp = 0;			// 100 ns units, as delivered by the capture source
+		std::vector<uint8_t> luma;		// width * height
+		std::vector<uint8_t> chroma;	// interleaved UV, ChromaWidth() * 2 * ChromaHeight()
+		// Rows changed since the previous published frame, in bands of bandRows luma rows.
+		// An empty list means the whole frame changed. Consumers that see a gap in
+		// sequence missed a frame and must treat the whole frame as changed.
+		unsigned bandRows = 0;
+		std::vector<uint8_t> dirtyBands;
+		// Features tracked on the luma plane, when the producer runs a tracker.
+		std::vector<FeaturePoint> features;
+
+		unsigned ChromaWidth() const { return (width + 1) / 2; }
+		unsigned ChromaHeight() const { return (height + 1) / 2; }
+		// Copies strided planes in, marks the whole frame dirty and drops the features.
+		void Assign(const uint8_t* lumaPlane, size_t lumaStride, const uint8_t* chromaPlane, size_t chromaStride, unsigned w, unsigned h);
+		bool IsBandDirty(unsigned band) const { return dirtyBands.empty() || (band < dirtyBands.size() && dirtyBands[band]); }
+	};
+}
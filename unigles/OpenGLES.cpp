@@ -13,7 +13,12 @@ OpenGLES::OpenGLES() :
 	mCameraSurface(EGL_NO_SURFACE),
 	mCameraTextureHandle(nullptr),
 	mCameraWidth(0),
-	mCameraHeight(0) {
+	mCameraHeight(0),
+	mPresentMethod(unigles::PresentMethod::Full),
+	mSwapBuffersWithDamage(nullptr),
+	mPostSubBuffer(nullptr),
+	mBufferAge(false),
+	mResources(nullptr) {
 	Initialize();
 }
 
@@ -33,6 +38,20 @@ void OpenGLES::Initialize() {
 		EGL_NONE
 	};
 
+	const EGLint preservedConfigAttributes[] =
+	{
+		// Same as above, on a config whose window surfaces can keep their contents across
+		// swaps, so a partial present only has to redraw the damage.
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 8,
+		EGL_STENCIL_SIZE, 8,
+		EGL_SURFACE_TYPE, EGL_WINDOW_BIT | EGL_PBUFFER_BIT | EGL_SWAP_BEHAVIOR_PRESERVED_BIT,
+		EGL_NONE
+	};
+
 	const EGLint contextAttributes[] =
 	{
 		EGL_CONTEXT_CLIENT_VERSION, 2,
@@ -125,9 +144,12 @@ void OpenGLES::Initialize() {
 	}
 
 	EGLint numConfigs = 0;
-	if ((eglChooseConfig(mEglDisplay, configAttributes, &mEglConfig, 1, &numConfigs) == EGL_FALSE) || (numConfigs == 0)) {
-		throw Exception::CreateException(E_FAIL, L"Failed to choose first EGLConfig");
+	if ((eglChooseConfig(mEglDisplay, preservedConfigAttributes, &mEglConfig, 1, &numConfigs) == EGL_FALSE) || (numConfigs == 0)) {
+		if ((eglChooseConfig(mEglDisplay, configAttributes, &mEglConfig, 1, &numConfigs) == EGL_FALSE) || (numConfigs == 0)) {
+			throw Exception::CreateException(E_FAIL, L"Failed to choose first EGLConfig");
+		}
 	}
+	FindPresentMethod();
 
 	mEglContext = eglCreateContext(mEglDisplay, mEglConfig, EGL_NO_CONTEXT, contextAttributes);
 	if (mEglContext == EGL_NO_CONTEXT) {
@@ -135,19 +157,51 @@ void OpenGLES::Initialize() {
 	}
 }
 
+static bool HasExtension(const char* extensions, const char* name) {
+	if (!extensions) {
+		return false;
+	}
+	size_t length = strlen(name);
+	for (const char* found = strstr(extensions, name); found; found = strstr(found + length, name)) {
+		// Whole names only: EGL_EXT_foo is not EGL_EXT_foo_bar.
+		if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == '\0')) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void OpenGLES::FindPresentMethod() {
+	// Damage rectangles let the compositor touch only what changed; several beat one.
+	const char* extensions = eglQueryString(mEglDisplay, EGL_EXTENSIONS);
+	mPresentMethod = unigles::PresentMethod::Full;
+	mSwapBuffersWithDamage = nullptr;
+	mPostSubBuffer = nullptr;
+	if (HasExtension(extensions, "EGL_KHR_swap_buffers_with_damage")) {
+		mSwapBuffersWithDamage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(eglGetProcAddress("eglSwapBuffersWithDamageKHR"));
+	}
+	if (mSwapBuffersWithDamage) {
+		mPresentMethod = unigles::PresentMethod::SwapWithDamage;
+	} else if (HasExtension(extensions, "EGL_NV_post_sub_buffer")) {
+		mPostSubBuffer = reinterpret_cast<PFNEGLPOSTSUBBUFFERNVPROC>(eglGetProcAddress("eglPostSubBufferNV"));
+		if (mPostSubBuffer) {
+			mPresentMethod = unigles::PresentMethod::PostSubBuffer;
+		}
+	}
+	mBufferAge = HasExtension(extensions, "EGL_EXT_buffer_age");
+}
+
 void OpenGLES::BindCameraSurface(HANDLE texture, int width, int height) {
 	if (mCameraTextureHandle == texture && mCameraWidth == width && mCameraHeight == height) {
 		return;
 	}
 
+	// The previous pbuffer wraps a texture the bridge replaced or is about to drop.
+	ReleaseCameraSurface();
 	mCameraTextureHandle = texture;
 	mCameraWidth = width;
 	mCameraHeight = height;
 
-	if (mCameraSurface != EGL_NO_SURFACE) {
-		eglReleaseTexImage(mEglDisplay, mCameraSurface, EGL_BACK_BUFFER);
-	}
-
 	if (mCameraTextureHandle) {
 		EGLint attributes[] = {
 			EGL_WIDTH, (EGLint)mCameraWidth,
@@ -163,10 +217,39 @@ void OpenGLES::BindCameraSurface(HANDLE texture, int width, int height) {
 			return;
 		}
 		eglBindTexImage(mEglDisplay, mCameraSurface, EGL_BACK_BUFFER);
+		if (mResources) {
+			// The shared texture as ANGLE opened it; the bridge counts the same pixels on the D3D heap.
+			mCameraSurfaceMemory = mResources->Track(unigles::ResourceHeap::Gl, "Camera pbuffer", "BGRA8 shared",
+				unigles::ImageBytes(unsigned(mCameraWidth), unsigned(mCameraHeight), 4));
+		}
+	}
+}
+
+void OpenGLES::ReleaseCameraSurface() {
+	if (mCameraSurface != EGL_NO_SURFACE) {
+		eglReleaseTexImage(mEglDisplay, mCameraSurface, EGL_BACK_BUFFER);
+		eglDestroySurface(mEglDisplay, mCameraSurface);
+		mCameraSurface = EGL_NO_SURFACE;
 	}
+	mCameraSurfaceMemory.Reset();
+	mCameraTextureHandle = nullptr;
+	mCameraWidth = 0;
+	mCameraHeight = 0;
+}
+
+void OpenGLES::SetResourceTracker(unigles::ResourceTracker* resources) {
+	mCameraSurfaceMemory.Reset();
+	mResources = resources;
 }
 
 void OpenGLES::Cleanup() {
+	// The camera pbuffer dies with the display; forget it so the next bind recreates it.
+	mCameraSurface = EGL_NO_SURFACE;
+	mCameraSurfaceMemory.Reset();
+	mCameraTextureHandle = nullptr;
+	mCameraWidth = 0;
+	mCameraHeight = 0;
+
 	if (mEglDisplay != EGL_NO_DISPLAY && mEglContext != EGL_NO_CONTEXT) {
 		eglDestroyContext(mEglDisplay, mEglContext);
 		mEglContext = EGL_NO_CONTEXT;
@@ -199,6 +282,8 @@ EGLSurface OpenGLES::CreateSurface(SwapChainPanel^ panel, const Size* renderSurf
 		// EGL_ANGLE_SURFACE_RENDER_TO_BACK_BUFFER is part of the same optimization as EGL_ANGLE_DISPLAY_ALLOW_RENDER_TO_BACK_BUFFER (see above).
 		// If you have compilation issues with it then please update your Visual Studio templates.
 		EGL_ANGLE_SURFACE_RENDER_TO_BACK_BUFFER, EGL_TRUE,
+		// Sub-buffer posts have to be asked for when the surface is created; without them the list ends here.
+		mPresentMethod == unigles::PresentMethod::PostSubBuffer ? EGL_POST_SUB_BUFFER_SUPPORTED_NV : EGL_NONE, EGL_TRUE,
 		EGL_NONE
 	};
 
@@ -221,6 +306,13 @@ EGLSurface OpenGLES::CreateSurface(SwapChainPanel^ panel, const Size* renderSurf
 		throw Exception::CreateException(E_FAIL, L"Failed to create EGL surface");
 	}
 
+	EGLint surfaceType = 0;
+	eglGetConfigAttrib(mEglDisplay, mEglConfig, EGL_SURFACE_TYPE, &surfaceType);
+	if (surfaceType & EGL_SWAP_BEHAVIOR_PRESERVED_BIT) {
+		// Failing leaves the contents undefined after a swap, which only costs full redraws.
+		eglSurfaceAttrib(mEglDisplay, surface, EGL_SWAP_BEHAVIOR, EGL_BUFFER_PRESERVED);
+	}
+
 	return surface;
 }
 
@@ -241,6 +333,47 @@ void OpenGLES::MakeCurrent(const EGLSurface surface) {
 	}
 }
 
+void OpenGLES::ReleaseCurrent() {
+	eglMakeCurrent(mEglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
 EGLBoolean OpenGLES::SwapBuffers(const EGLSurface surface) {
 	return (eglSwapBuffers(mEglDisplay, surface));
 }
+
+EGLBoolean OpenGLES::SwapBuffers(const EGLSurface surface, const std::vector<int32_t>& damage) {
+	// No damage to a swap with damage would mean all of it; a full swap says the same.
+	if (damage.empty()) {
+		return SwapBuffers(surface);
+	}
+	if (mSwapBuffersWithDamage) {
+		std::vector<EGLint> rects(damage.begin(), damage.end());
+		return mSwapBuffersWithDamage(mEglDisplay, surface, rects.data(), EGLint(rects.size() / 4));
+	}
+	if (mPostSubBuffer) {
+		// One rectangle only: their bounds.
+		EGLint left = damage[0];
+		EGLint bottom = damage[1];
+		EGLint right = damage[0] + damage[2];
+		EGLint top = damage[1] + damage[3];
+		for (size_t i = 4; i + 3 < damage.size(); i += 4) {
+			left = (std::min)(left, EGLint(damage[i]));
+			bottom = (std::min)(bottom, EGLint(damage[i + 1]));
+			right = (std::max)(right, EGLint(damage[i] + damage[i + 2]));
+			top = (std::max)(top, EGLint(damage[i + 1] + damage[i + 3]));
+		}
+		return mPostSubBuffer(mEglDisplay, surface, left, bottom, right - left, top - bottom);
+	}
+	return SwapBuffers(surface);
+}
+
+unsigned OpenGLES::GetBufferAge(const EGLSurface surface) {
+	EGLint value = 0;
+	if (mBufferAge) {
+		return eglQuerySurface(mEglDisplay, surface, EGL_BUFFER_AGE_EXT, &value) == EGL_TRUE && value > 0 ? unsigned(value) : 0;
+	}
+	if (eglQuerySurface(mEglDisplay, surface, EGL_SWAP_BEHAVIOR, &value) == EGL_TRUE && value == EGL_BUFFER_PRESERVED) {
+		return 1;
+	}
+	return 0;
+}
@@ -1,5 +1,10 @@
 #pragma once
 
+#include "DamageTracker.h"
+#include "ResourceTracker.h"
+
+#include <vector>
+
 class OpenGLES {
 public:
 	OpenGLES();
@@ -9,13 +14,33 @@ public:
 	void GetSurfaceDimensions(const EGLSurface surface, EGLint *width, EGLint *height);
 	void DestroySurface(const EGLSurface surface);
 	void MakeCurrent(const EGLSurface surface);
+	// Leaves the calling thread without a current context, so another thread can make it current.
+	void ReleaseCurrent();
 	EGLBoolean SwapBuffers(const EGLSurface surface);
+	// Presents only the damage, as EGL rectangles (x, y from the bottom left, width, height),
+	// through the best method the display has; a full swap without one or without damage.
+	EGLBoolean SwapBuffers(const EGLSurface surface, const std::vector<int32_t>& damage);
+	unigles::PresentMethod GetPresentMethod() const { return mPresentMethod; }
+	// Presents since the current back buffer was last shown, 1 when its contents are kept
+	// from one frame to the next, 0 when they are unknown.
+	unsigned GetBufferAge(const EGLSurface surface);
 	void BindCameraSurface(HANDLE texture, int width, int height);
+	// Unbinds and destroys the camera pbuffer; the next bind creates a new one.
+	void ReleaseCameraSurface();
 	void Reset();
 
+	// Counts the camera pbuffer; null stops counting it. The tracker must outlive the binding.
+	void SetResourceTracker(unigles::ResourceTracker* resources);
+
+	// For contexts that share objects with the render context, like the warm-up loader's.
+	EGLDisplay GetDisplay() const { return mEglDisplay; }
+	EGLConfig GetConfig() const { return mEglConfig; }
+	EGLContext GetContext() const { return mEglContext; }
+
 private:
 	void Initialize();
 	void Cleanup();
+	void FindPresentMethod();
 
 private:
 	EGLDisplay mEglDisplay;
@@ -25,4 +50,12 @@ private:
 	EGLSurface mCameraSurface;
 	HANDLE mCameraTextureHandle;
 	UINT mCameraWidth, mCameraHeight;
+
+	unigles::PresentMethod mPresentMethod;
+	PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC mSwapBuffersWithDamage;
+	PFNEGLPOSTSUBBUFFERNVPROC mPostSubBuffer;
+	bool mBufferAge;
+
+	unigles::ResourceTracker* mResources;
+	unigles::TrackedResource mCameraSurfaceMemory;
 };
@@ -1,6 +1,9 @@
 ﻿#include "pch.h"
 #include "OpenGLESPage.xaml.h"
-#include "SimpleRenderer.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
 
 using namespace unigles;
 using namespace Platform;
@@ -9,17 +12,236 @@ using namespace Windows::Foundation;
 using namespace Windows::Media::Capture;
 using namespace Windows::Devices::Enumeration;
 
+// The HUD text is rebuilt a few times a second; numbers changing every frame cannot be read.
+static const unsigned HudRefreshFrames = 15;
+static const double FrameBudgetMilliseconds = 1000.0 / 60.0;
+
+// Jitter buffer depth in camera frames; dropped to zero while the render loop falls behind.
+static const unsigned PacingDepth = 1;
+
+// CPU frames are also exported to other processes through a shared-memory ring under
+// this name. Readers that stop calling in for the timeout lose their place.
+static const char* FrameExportName = "unigles-frames";
+static const unsigned FrameExportSlots = 4;
+static const double FrameExportReaderTimeoutMilliseconds = 2000.0;
+
+// Levels of the luma pyramid built for trackers, counting the full resolution image.
+static const unsigned PyramidLevels = 4;
+
+// What the render loop draws, as layers of the damage tracker.
+static const unsigned CubeLayer = 0;
+static const unsigned HudLayer = 1;
+
+// The clock of the frame pacer, in the 100 ns units of the camera timestamps.
+static int64_t PacerNow() {
+	typedef std::chrono::duration<int64_t, std::ratio<1, 10000000>> Ticks;
+	return std::chrono::duration_cast<Ticks>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static EdgeSettings CameraEdgeSettings() {
+	EdgeSettings settings;
+	// The camera thread must never wait for the render loop; a frame that sat a quarter
+	// of a second is not worth pacing any more.
+	settings.policy = EdgePolicy::LatestWins;
+	settings.capacity = FramePacer::MaxDepth + 2;
+	settings.highWater = 2;
+	settings.maxAge = 2500000;
+	return settings;
+}
+
+static void AppendEdgeStats(std::ostringstream& out, const std::string& stage, EdgePolicy policy, const EdgeStats& stats) {
+	out << stage.c_str() << " (" << ToString(policy) << "): " << stats.delivered << " of " << stats.pushed << " delivered";
+	for (unsigned reason = 0; reason < DropReasonCount; reason++) {
+		if (stats.drops[reason] > 0) {
+			out << ", " << stats.drops[reason] << " " << ToString(DropReason(reason));
+		}
+	}
+	out << ", high water " << stats.highWaterMark << std::endl;
+}
+
+static void AppendPassTimings(std::ostringstream& out, const GpuProfileLog& log) {
+	for (const PassTiming& pass : log.GetPasses()) {
+		out << pass.name.c_str() << ": cpu " << pass.cpuMean << " ms";
+		if (pass.gpuSamples > 0) {
+			out << ", gpu " << pass.gpuMean << " ms (max " << pass.gpuMax << ")";
+		}
+		out << std::endl;
+	}
+}
+
+// Texture files named in Assets\Textures\textures.txt, one per line relative to it; lines
+// starting with # are comments. Without the list no textures are loaded.
+static std::vector<std::string> TextureAssetPaths() {
+	std::wstring folder = std::wstring(Windows::ApplicationModel::Package::Current->InstalledLocation->Path->Data()) + L"\\Assets\\Textures\\";
+	int length = WideCharToMultiByte(CP_UTF8, 0, folder.c_str(), -1, nullptr, 0, nullptr, nullptr);
+	std::string utf8Folder(length, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, folder.c_str(), -1, &utf8Folder[0], length, nullptr, nullptr);
+	utf8Folder.resize(length - 1);
+
+	std::vector<std::string> paths;
+	std::ifstream list((folder + L"textures.txt").c_str());
+	std::string line;
+	while (std::getline(list, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (!line.empty() && line[0] != '#') {
+			paths.push_back(utf8Folder + line);
+		}
+	}
+	return paths;
+}
+
+// Checks a render loop run against Assets\PerfBudgets.txt and leaves the report in
+// perf_report.json in the app's local folder, where a replay run or a tester picks it up.
+static void WritePerfRun(const PerfRecorder& recorder) {
+	std::wstring budgetsPath = std::wstring(Windows::ApplicationModel::Package::Current->InstalledLocation->Path->Data()) + L"\\Assets\\PerfBudgets.txt";
+	std::ifstream budgetsFile(budgetsPath.c_str());
+	std::ostringstream budgetsText;
+	budgetsText << budgetsFile.rdbuf();
+	std::vector<PerfBudget> budgets;
+	std::string error;
+	if (!ParsePerfBudgets(budgetsText.str(), budgets, &error)) {
+		OutputDebugStringA(("PerfBudgets.txt " + error + "\n").c_str());
+		budgets.clear();
+	}
+
+	std::wstring reportPath = std::wstring(Windows::Storage::ApplicationData::Current->LocalFolder->Path->Data()) + L"\\perf_report.json";
+	std::ofstream report(reportPath.c_str());
+	WritePerfReport(report, recorder, CheckPerfBudgets(recorder, budgets));
+}
+
+// The post-processing graph of Assets\PostProcessing.txt; empty, for the fixed
+// conversion, when the file declares no passes or does not parse.
+static PostProcessGraph LoadPostProcessing() {
+	std::wstring graphPath = std::wstring(Windows::ApplicationModel::Package::Current->InstalledLocation->Path->Data()) + L"\\Assets\\PostProcessing.txt";
+	std::ifstream graphFile(graphPath.c_str());
+	std::ostringstream graphText;
+	graphText << graphFile.rdbuf();
+	PostProcessGraph graph;
+	std::string error;
+	if (!ParsePostProcessGraph(graphText.str(), graph, &error)) {
+		OutputDebugStringA(("PostProcessing.txt " + error + "\n").c_str());
+		graph = PostProcessGraph();
+	}
+	return graph;
+}
+
+// Every allocation is recorded in debug builds; release builds only keep the counters.
+static TrackingLevel ResourceTrackingLevel() {
+#if _DEBUG
+	return TrackingLevel::Detailed;
+#else
+	return TrackingLevel::Counters;
+#endif
+}
+
+// For the software path's buffers, which keep one record that follows their size from
+// their first allocation on.
+static void TrackHostBuffer(ResourceTracker& tracker, TrackedResource& resource, const char* subsystem, const char* format, uint64_t bytes) {
+	if (!resource.IsTracked()) {
+		if (bytes != 0) {
+			resource = tracker.Track(ResourceHeap::Host, subsystem, format, bytes);
+		}
+	} else if (resource.GetBytes() != bytes) {
+		resource.Resize(bytes);
+	}
+}
+
+static ChangeDetectorSettings CpuChangeDetectorSettings() {
+	// Full resolution luma: coarser tiles and sampled rows keep the comparison cheap,
+	// and the tile rows double as the uploader's row bands.
+	ChangeDetectorSettings settings;
+	settings.tileSize = 64;
+	settings.rowStep = 4;
+	return settings;
+}
+
+// Calibration of the wide angle module, at its full resolution; other modes scale it.
+static LensModel CameraLens() {
+	LensModel lens;
+	lens.width = 1920;
+	lens.height = 1080;
+	lens.fx = 1050.0;
+	lens.fy = 1050.0;
+	lens.cx = 959.5;
+	lens.cy = 539.5;
+	lens.k1 = -0.32;
+	lens.k2 = 0.12;
+	lens.k3 = -0.02;
+	// Keeps most of the corners that straightening the edges pushes out of the frame.
+	lens.zoom = 0.85;
+	return lens;
+}
+
 OpenGLESPage::OpenGLESPage() :
 	OpenGLESPage(nullptr) {}
 
 OpenGLESPage::OpenGLESPage(OpenGLES* openGLES) :
 	mOpenGLES(openGLES),
+	mResourceTracker(ResourceTrackingLevel()),
 	mRenderSurface(EGL_NO_SURFACE),
 	mMediaCapture(nullptr),
-	mFrameCount(0) {
+	mHudFrames(0),
+	mDroppedFrames(0),
+	mPartialPresents(true),
+	mSkipUnchangedFrames(true),
+	mDenoiseFrames(true),
+	mCorrectLens(false),
+	mBuildPyramids(true),
+	mTrackFeatures(true),
+	mConvertedCount(0),
+	mPaceFrames(true),
+	mCameraEdge("Camera", CameraEdgeSettings()),
+	mCameraBacklog(false),
+	mPacedFrameIds(0),
+	mCpuPreview(0),
+	mExportFrames(true),
+	mCpuChangeDetector(CpuChangeDetectorSettings()),
+	mCpuStatisticsPlane(std::make_shared<std::vector<uint8_t>>()),
+	mCpuPyramidWrite(0),
+	mCpuFrameSequence(0) {
 	InitializeComponent();
 
-	mTextureBridge = new TextureBridge();
+	FrameSubscription preview;
+	preview.name = "Preview";
+	mCpuPreview = mCpuFrames.Subscribe(preview);
+
+	// Registered first, so released last: whatever a domain still holds once all of its
+	// owners let go leaked.
+	mGpuResources.Register(GpuDomain::D3D, "Leak check", nullptr, [this]() {
+		ReportLeaks(ResourceHeap::D3D);
+	});
+	mGpuResources.Register(GpuDomain::Gl, "Leak check", nullptr, [this]() {
+		ReportLeaks(ResourceHeap::Gl);
+	});
+	if (mOpenGLES) {
+		mOpenGLES->SetResourceTracker(&mResourceTracker);
+		mGpuResources.Register(GpuDomain::Gl, "Camera pbuffer", nullptr, [this]() {
+			mOpenGLES->ReleaseCameraSurface();
+		});
+	}
+	mTextureBridge = new TextureBridge(mGpuResources, mResourceTracker);
+	RegisterGlResources();
+	mTextureBridge->EnableChangeDetection(mSkipUnchangedFrames);
+	mTextureBridge->EnableStatistics(true);
+	mTextureBridge->EnableDenoising(mDenoiseFrames);
+	if (mCorrectLens) {
+		mTextureBridge->SetLensModel(CameraLens());
+		mCpuLens.SetLens(CameraLens());
+	}
+	mTextureBridge->EnablePyramid(mBuildPyramids ? PyramidLevels : 0);
+	mTextureBridge->SetPostProcessing(LoadPostProcessing());
+	for (GaussianPyramid& pyramid : mCpuPyramids) {
+		pyramid.SetLevelCount(PyramidLevels);
+	}
+	mCameraEdge.SetPressureCallback([this](bool pressure) {
+		mCameraBacklog = pressure;
+	});
+
+	if (mOpenGLES) {
+		StartWarmup();
+	}
 
 	Windows::UI::Core::CoreWindow^ window = Windows::UI::Xaml::Window::Current->CoreWindow;
 
@@ -32,7 +254,46 @@ OpenGLESPage::OpenGLESPage(OpenGLES* openGLES) :
 
 OpenGLESPage::~OpenGLESPage() {
 	StopRenderLoop();
-	DestroyRenderSurface();
+
+	// Releasing both domains runs their leak checks with nothing left that should hold memory.
+	{
+		// The render thread holds the lock for as long as it runs and gives up the context
+		// when it stops, so from here on nothing draws with the objects released below, and
+		// with the context current on this thread they are really deleted.
+		critical_section::scoped_lock lock(mRenderSurfaceCriticalSection);
+		mWarmup.reset();
+		bool current = false;
+		if (mOpenGLES) {
+			try {
+				mOpenGLES->MakeCurrent(mRenderSurface);
+				current = true;
+			} catch (Exception^) {
+			}
+		}
+		if (!current) {
+			OutputDebugStringA("GL resources released without a current context; the leak check only sees their records\n");
+		}
+		mGpuResources.ReportLost(GpuDomain::Gl);
+		if (current) {
+			mOpenGLES->ReleaseCurrent();
+		}
+		DestroyRenderSurface();
+	}
+	{
+		critical_section::scoped_lock frameLock(mFrameCriticalSection);
+		mGpuResources.ReportLost(GpuDomain::D3D);
+	}
+	mCpuFrameMemory.Reset();
+	mCpuLensMemory.Reset();
+	mCpuDenoiserMemory.Reset();
+	mCpuStatisticsMemory.Reset();
+	mCpuPyramidMemory.Reset();
+	mFrameExport.Close();
+	mFrameExportMemory.Reset();
+	ReportLeaks(ResourceHeap::Host);
+	if (mOpenGLES) {
+		mOpenGLES->SetResourceTracker(nullptr);
+	}
 }
 
 void OpenGLESPage::OnPageLoaded(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e) {
@@ -88,11 +349,16 @@ void OpenGLESPage::RecoverFromLostDevice() {
 	{
 		critical_section::scoped_lock lock(mRenderSurfaceCriticalSection);
 
+		// Only the GL side is rebuilt; the camera reader and the D3D conversion keep running.
+		mGpuResources.ReportLost(GpuDomain::Gl);
 		DestroyRenderSurface();
 		mOpenGLES->Reset();
 		CreateRenderSurface();
 	}
 
+	// Everything the old context shared went away with it; rebuild it off the render thread.
+	StartWarmup();
+
 	StartRenderLoop();
 }
 
@@ -107,38 +373,322 @@ void OpenGLESPage::StartRenderLoop() {
 		critical_section::scoped_lock lock(mRenderSurfaceCriticalSection);
 
 		mOpenGLES->MakeCurrent(mRenderSurface);
-		SimpleRenderer renderer;
+		// Given up on every way out, so the page can make the context current elsewhere.
+		struct CurrentContext {
+			OpenGLES* openGLES;
+			~CurrentContext() { openGLES->ReleaseCurrent(); }
+		} current = { mOpenGLES };
+		while (!mWarmup->Wait(50)) {
+			if (action->Status != Windows::Foundation::AsyncStatus::Started) {
+				return;
+			}
+		}
+		if (!mStartupTimer.HasFirstFrame()) {
+			mStartupTimer.MarkReady();
+		}
+		if ((mGpuResources.IsLost(GpuDomain::Gl) || !mRenderer || !mUploader || !mGlProfiler || !mOverlay) &&
+			!mGpuResources.Recreate(GpuDomain::Gl)) {
+			// Warm-up could not prepare them (no shared context) and neither can we.
+			ShowMessage(L"Cannot create GL resources");
+			return;
+		}
+		SimpleRenderer& renderer = *mRenderer;
+		StreamingUploader& uploader = *mUploader;
+		mPerfRecorder.Clear();
+		GlGpuProfiler& profiler = *mGlProfiler;
+		StatsOverlay& overlay = *mOverlay;
+		std::chrono::steady_clock::time_point lastPresent;
+		UINT64 drawnFrameVersion = 0;
+		EGLint drawnWidth = 0;
+		EGLint drawnHeight = 0;
+		// The surface may be new, and nothing that was on it can be trusted.
+		mDamage.Invalidate();
+		mDamage.ResetStats();
 
 		while (action->Status == Windows::Foundation::AsyncStatus::Started) {
+			if (mGpuResources.CheckLost(GpuDomain::Gl)) {
+				RequestRecovery();
+				return;
+			}
+
 			EGLint panelWidth = 0;
 			EGLint panelHeight = 0;
 			mOpenGLES->GetSurfaceDimensions(mRenderSurface, &panelWidth, &panelHeight);
 
+			// The frame shown by this iteration reaches the screen about one refresh from now.
+			bool pacedPending = mPaceFrames && ConvertPacedFrame(PacerNow() + int64_t(FrameBudgetMilliseconds * 10000.0));
+			UINT64 frameVersion = 0;
+			{
+				critical_section::scoped_lock frameLock(mFrameCriticalSection);
+				frameVersion = mTextureBridge->GetFrameVersion();
+			}
+			profiler.BeginFrame();
+			FrameHandle<Nv12Frame> cpuFrame;
+			if (mCpuFrames.TryPop(mCpuPreview, cpuFrame, PacerNow())) {
+				{
+					GlGpuPassScope pass(profiler, "Upload");
+					PerfScope perf(mPerfRecorder, "Upload");
+					uploader.Upload(*cpuFrame);
+				}
+				renderer.SetCameraPlanes(uploader.GetLumaTexture(), uploader.GetChromaTexture());
+				critical_section::scoped_lock frameLock(mFrameCriticalSection);
+				mUploadStats = uploader.GetStats();
+			}
+			if (mSkipUnchangedFrames && !cpuFrame && !pacedPending && frameVersion != 0 && frameVersion == drawnFrameVersion &&
+				panelWidth == drawnWidth && panelHeight == drawnHeight) {
+				// Nothing new to show: wait for the next converted frame instead of redrawing.
+				mFrameConvertedEvent.wait(100);
+				mFrameConvertedEvent.reset();
+				continue;
+			}
+
 			// Logic to update the scene could go here
 			renderer.UpdateWindowSize(panelWidth, panelHeight);
 			{
 				critical_section::scoped_lock frameLock(mFrameCriticalSection);
 				mOpenGLES->BindCameraSurface(mTextureBridge->GetTextureHandle(), mTextureBridge->GetTextureWidth(), mTextureBridge->GetTextureHeight());
+				renderer.SetCameraTextureLevels(mTextureBridge->GetSourceWidth(), mTextureBridge->GetSourceHeight(), TextureBridge::TextureLevels);
 			}
-			renderer.Draw();
+
+			// The cube turns and the HUD graph scrolls every frame; the background never
+			// changes, so everything outside them can stay as it is on screen.
+			BuildHud(overlay);
+			mDamage.BeginFrame(panelWidth, panelHeight);
+			mDamage.SetLayer(CubeLayer, renderer.GetNextDrawBounds());
+			float hudLeft, hudTop, hudRight, hudBottom;
+			if (overlay.GetBounds(hudLeft, hudTop, hudRight, hudBottom)) {
+				int left = int(std::floor(hudLeft));
+				int top = int(std::floor(hudTop));
+				mDamage.SetLayer(HudLayer, MakeDamageRect(left, top, int(std::ceil(hudRight)) - left, int(std::ceil(hudBottom)) - top));
+			}
+			mDamage.Resolve();
+			// Only what the back buffer is missing is drawn; a buffer of unknown age gets all of it.
+			DamageRect repaint = mDamage.GetRepaintBounds(mPartialPresents ? mOpenGLES->GetBufferAge(mRenderSurface) : 0);
+			glEnable(GL_SCISSOR_TEST);
+			glScissor(repaint.x, panelHeight - repaint.y - repaint.height, repaint.width, repaint.height);
+			{
+				GlGpuPassScope pass(profiler, "Cube");
+				PerfScope perf(mPerfRecorder, "Cube");
+				renderer.Draw();
+			}
+			const RenderCounts& counts = renderer.GetRenderCounts();
+			mPerfRecorder.AddCount("Cube", "draws", counts.drawCalls);
+			mPerfRecorder.AddCount("Cube", "programs", counts.programChanges);
+			mPerfRecorder.AddCount("Cube", "textures", counts.textureBinds);
+			{
+				// Picked up by the next converted frame; a distant camera face gets a smaller variant.
+				critical_section::scoped_lock frameLock(mFrameCriticalSection);
+				mTextureBridge->SetTextureLevel(renderer.GetCameraTextureLevel());
+			}
+			{
+				GlGpuPassScope pass(profiler, "HUD");
+				PerfScope perf(mPerfRecorder, "HUD");
+				overlay.Draw(panelWidth, panelHeight);
+			}
+			glDisable(GL_SCISSOR_TEST);
+			profiler.EndFrame();
+			if (drawnFrameVersion != 0 && frameVersion > drawnFrameVersion + 1) {
+				mDroppedFrames += frameVersion - drawnFrameVersion - 1;
+			}
+			drawnFrameVersion = frameVersion;
+			drawnWidth = panelWidth;
+			drawnHeight = panelHeight;
 
 			// The call to eglSwapBuffers might not be successful (i.e. due to Device Lost)
 			// If the call fails, then we must reinitialize EGL and the GL resources.
-			if (mOpenGLES->SwapBuffers(mRenderSurface) != GL_TRUE) {
-				// XAML objects like the SwapChainPanel must only be manipulated on the UI thread.
-				swapChainPanel->Dispatcher->RunAsync(Windows::UI::Core::CoreDispatcherPriority::High, ref new Windows::UI::Core::DispatchedHandler([=]() {
-					RecoverFromLostDevice();
-				}, CallbackContext::Any));
-
+			bool partial = mPartialPresents && !mDamage.IsFull() && !mDamage.GetDamage().empty() &&
+				mOpenGLES->GetPresentMethod() != PresentMethod::Full;
+			bool swapped = false;
+			auto swapStart = std::chrono::steady_clock::now();
+			{
+				PerfScope perf(mPerfRecorder, "Swap");
+				swapped = (partial ? mOpenGLES->SwapBuffers(mRenderSurface, mDamage.GetEglRects()) : mOpenGLES->SwapBuffers(mRenderSurface)) == GL_TRUE;
+			}
+			if (!swapped) {
+				RequestRecovery();
 				return;
 			}
+			auto now = std::chrono::steady_clock::now();
+			mDamage.EndFrame(std::chrono::duration<double, std::milli>(now - swapStart).count(), partial, repaint);
+			mPerfRecorder.AddCount("Swap", "partial", partial ? 1 : 0);
+			mPerfRecorder.AddCount("Swap", "repainted pixels", uint64_t(repaint.Area()));
+			if (lastPresent != std::chrono::steady_clock::time_point()) {
+				double frameMilliseconds = std::chrono::duration<double, std::milli>(now - lastPresent).count();
+				mFrameTimes.Add(frameMilliseconds);
+				mPerfRecorder.AddTime("Frame", frameMilliseconds);
+			}
+			mPerfRecorder.EndFrame();
+			lastPresent = now;
+			if (!mStartupTimer.HasFirstFrame()) {
+				mStartupTimer.MarkFirstFrame();
+				std::ostringstream startup;
+				startup << "First frame after " << int(mStartupTimer.GetFirstFrameMilliseconds()) << " ms (ready after "
+					<< int(mStartupTimer.GetReadyMilliseconds()) << " ms, warm-up " << int(mWarmup->GetTotalMilliseconds()) << " ms)";
+				for (const WarmupTaskTiming& timing : mWarmup->GetTimings()) {
+					startup << std::endl << timing.name.c_str() << ": " << timing.milliseconds << " ms" << (timing.succeeded ? "" : " (failed)");
+				}
+				GpuRecoveryStats recovery = mGpuResources.GetStats(GpuDomain::Gl);
+				if (recovery.recoveries > 0) {
+					startup << std::endl << "GL rebuilt " << recovery.recoveries << " times, last in " << int(recovery.lastMilliseconds) << " ms";
+				}
+				mStartupText = startup.str();
+			}
 		}
+		WritePerfRun(mPerfRecorder);
 	});
 
 	// Run task on a dedicated high priority background thread.
 	mRenderLoopWorker = Windows::System::Threading::ThreadPool::RunAsync(workItemHandler, Windows::System::Threading::WorkItemPriority::High, Windows::System::Threading::WorkItemOptions::TimeSliced);
 }
 
+void OpenGLESPage::StartWarmup() {
+	mStartupTimer.Start();
+	// Waits for a loader that is still running before its objects are replaced.
+	mWarmup.reset();
+	mWarmup.reset(new WarmupLoader(mOpenGLES->GetDisplay(), mOpenGLES->GetConfig(), mOpenGLES->GetContext()));
+	mWarmup->AddGlTask("GL resources", [this]() {
+		if (!mGpuResources.Recreate(GpuDomain::Gl)) {
+			throw std::runtime_error("GL resources could not be created");
+		}
+	});
+	mWarmup->AddTask("Conversion shaders", [this]() {
+		mTextureBridge->PrecompileShaders();
+	});
+	mWarmup->Start();
+}
+
+void OpenGLESPage::RegisterGlResources() {
+	// Destroying them without a current context is harmless: after a loss the names died
+	// with the context. At shutdown the page makes the context current to release them.
+	mGpuResources.Register(GpuDomain::Gl, "Renderer", [this]() {
+		mRenderer.reset(new SimpleRenderer(mResourceTracker));
+	}, [this]() {
+		mRenderer.reset();
+	});
+	mGpuResources.Register(GpuDomain::Gl, "Streaming textures", [this]() {
+		mUploader.reset(new StreamingUploader());
+		mUploader->SetResourceTracker(&mResourceTracker);
+	}, [this]() {
+		mUploader.reset();
+	});
+	mGpuResources.Register(GpuDomain::Gl, "Timer queries", [this]() {
+		mGlProfiler.reset(new GlGpuProfiler(mGlProfileLog));
+	}, [this]() {
+		mGlProfiler.reset();
+	});
+	mGpuResources.Register(GpuDomain::Gl, "Stats overlay", [this]() {
+		mOverlay.reset(new StatsOverlay(&mResourceTracker));
+	}, [this]() {
+		mOverlay.reset();
+	});
+	// Files that are missing or that neither the GPU nor the decoder handles are counted
+	// as failed; they do not fail the domain.
+	std::vector<std::string> texturePaths = TextureAssetPaths();
+	mGpuResources.Register(GpuDomain::Gl, "Texture assets", [this, texturePaths]() {
+		mTextureAssets.reset(new TextureAssetLoader());
+		mTextureAssets->SetResourceTracker(&mResourceTracker);
+		for (const std::string& path : texturePaths) {
+			mTextureAssets->Load(path);
+		}
+	}, [this]() {
+		mTextureAssets.reset();
+	});
+}
+
+void OpenGLESPage::ReportLeaks(ResourceHeap heap) {
+	ResourceLeaks leaks = mResourceTracker.CheckReleased(heap);
+	if (!leaks.Empty()) {
+		OutputDebugStringA(("Leaked " + leaks.Describe() + "\n").c_str());
+	}
+}
+
+void OpenGLESPage::BuildHud(StatsOverlay& overlay) {
+	if (mHudFrames++ % HudRefreshFrames == 0) {
+		std::ostringstream hud;
+		hud.setf(std::ios::fixed);
+		hud.precision(2);
+		double frameMilliseconds = mFrameTimes.GetMean();
+		hud << "FPS " << (frameMilliseconds > 0.0 ? 1000.0 / frameMilliseconds : 0.0) << ", frame " << frameMilliseconds
+			<< " ms (max " << mFrameTimes.GetMax() << ")" << std::endl;
+		AppendPassTimings(hud, mTextureBridge->GetProfileLog());
+		AppendPassTimings(hud, mGlProfileLog);
+		const CullStats& cull = mRenderer->GetCullStats();
+		hud << "Culled " << cull.culled << " of " << cull.objects << " objects (" << cull.nodesTested << " nodes, "
+			<< cull.milliseconds << " ms)" << std::endl;
+		const LodStats& lod = mRenderer->GetLodStats();
+		hud << "LOD saves " << int(lod.TriangleSavings() * 100.0 + 0.5) << "% triangles, " << int(lod.TexelSavings() * 100.0 + 0.5)
+			<< "% texels (camera level " << mRenderer->GetCameraTextureLevel() << ")" << std::endl;
+		const ShaderVariantStats& variants = mRenderer->GetShaderVariantStats();
+		hud << "Shader variants " << mRenderer->GetShaderVariantCount() << ", compiled in " << variants.compileMilliseconds
+			<< " ms (max " << variants.maxCompileMilliseconds << "), " << variants.misses << " on demand" << std::endl;
+		if (mTextureAssets) {
+			const TextureAssetStats& textures = mTextureAssets->GetStats();
+			if (textures.loaded + textures.failed > 0) {
+				hud << "Textures " << textures.loaded << " (" << textures.decoded << " decoded, " << textures.failed << " failed): "
+					<< textures.gpuBytes / 1048576.0 << " MB on GPU from " << textures.fileBytes / 1048576.0 << " MB, loaded in "
+					<< textures.TotalMilliseconds() << " ms" << std::endl;
+			}
+		}
+		const DamageStats& damage = mDamage.GetStats();
+		if (damage.frames > 0) {
+			hud << "Present " << PresentMethodName(mOpenGLES->GetPresentMethod()) << ": " << 100 * damage.partialFrames / damage.frames
+				<< "% partial, " << damage.presentedFraction * 100.0 << "% shown, " << damage.repaintedFraction * 100.0 << "% drawn, "
+				<< damage.partialPresentMilliseconds << " ms vs " << damage.fullPresentMilliseconds << " full (saved "
+				<< damage.savedMilliseconds << " ms)" << std::endl;
+		}
+		// The process total, then what the tracker attributes to each heap.
+		hud << "Memory " << (Windows::System::MemoryManager::AppMemoryUsage >> 20) << " MB:";
+		for (ResourceHeap heap : { ResourceHeap::Gl, ResourceHeap::D3D, ResourceHeap::Host }) {
+			hud << " " << ResourceHeapName(heap) << " " << mResourceTracker.GetLiveBytes(heap) / 1048576.0 << " MB (peak "
+				<< mResourceTracker.GetPeakBytes(heap) / 1048576.0 << ")";
+		}
+		hud << ", " << mResourceTracker.GetLeakCount() << " leaked" << std::endl;
+		SubscriberStats preview = mCpuFrames.GetSubscriberStats(mCpuPreview);
+		hud << "Dropped " << mDroppedFrames << " converted, " << preview.delivery.Dropped() << " uploaded (lag "
+			<< preview.meanLagMilliseconds << " ms, max " << preview.maxLagMilliseconds << ")" << std::endl;
+		if (mPaceFrames) {
+			AppendEdgeStats(hud, mCameraEdge.GetStage(), mCameraEdge.GetSettings().policy, mCameraEdge.GetStats());
+			const PacingStats& pacing = mFramePacer.GetStats();
+			hud << "Pacing depth " << mFramePacer.GetDepth() << ": latency " << pacing.latency.GetMean() << " ms (max " << pacing.latency.GetMax()
+				<< "), judder " << pacing.judder.GetMean() << " ms (max " << pacing.judder.GetMax() << "), " << pacing.skipped << " skipped, "
+				<< pacing.overflowed << " overflowed, " << pacing.underruns << " underruns, " << pacing.failed << " failed" << std::endl;
+		}
+		if (!mStartupText.empty()) {
+			hud << mStartupText << std::endl;
+		}
+		{
+			critical_section::scoped_lock lock(mStatusCriticalSection);
+			hud << mStatusText;
+		}
+		mHudText = hud.str();
+	}
+
+	const float margin = 8.0f;
+	const float padding = 6.0f;
+	const float graphHeight = 48.0f;
+	unsigned textWidth = 0;
+	unsigned textHeight = 0;
+	overlay.MeasureText(mHudText, textWidth, textHeight);
+	float graphWidth = (std::max)(240.0f, float(textWidth));
+	double graphMax = (std::max)(2.0 * FrameBudgetMilliseconds, mFrameTimes.GetMax());
+	float x = margin + padding;
+	float y = margin + padding;
+
+	overlay.Begin();
+	overlay.AddRect(margin, margin, graphWidth + 2.0f * padding, graphHeight + textHeight + 3.0f * padding, 0x000000A0);
+	mFrameTimes.CopySamples(mFrameSamples);
+	overlay.AddGraph(x, y, graphWidth, graphHeight, mFrameSamples, graphMax, 0x40E040FF);
+	overlay.AddRect(x, y + graphHeight - float(graphHeight * FrameBudgetMilliseconds / graphMax), graphWidth, 1.0f, 0xE04040FF);
+	overlay.AddText(x, y + graphHeight + padding, mHudText, 0xFFFFFFFF);
+}
+
+void OpenGLESPage::RequestRecovery() {
+	// XAML objects like the SwapChainPanel must only be manipulated on the UI thread.
+	swapChainPanel->Dispatcher->RunAsync(Windows::UI::Core::CoreDispatcherPriority::High, ref new Windows::UI::Core::DispatchedHandler([=]() {
+		RecoverFromLostDevice();
+	}, CallbackContext::Any));
+}
+
 void OpenGLESPage::StopRenderLoop() {
 	if (mRenderLoopWorker) {
 		mRenderLoopWorker->Cancel();
@@ -224,17 +774,95 @@ void unigles::OpenGLESPage::OnFrameArrived(Windows::Media::Capture::Frames::Medi
 	}
 	successes++;
 	auto vmf = frame->VideoMediaFrame;
-	std::wostringstream messageOut;
-	messageOut.str(L"");
+	std::ostringstream messageOut;
 	if (vmf) {
 		auto d3dSurface = vmf->Direct3DSurface;
 		if (d3dSurface) {
-			critical_section::scoped_lock frameWriteLock(mFrameCriticalSection);
 			using namespace Windows::Graphics::DirectX::Direct3D11;
 			using namespace Microsoft::WRL;
 			ComPtr<IDXGISurface> nativeSurface;
 			GetDXGIInterface(d3dSurface, nativeSurface.GetAddressOf());
-			mTextureBridge->ReadData(nativeSurface);
+			if (mPaceFrames) {
+				// Converted on the render thread when it is due; the camera thread only queues it.
+				QueuePacedFrame(frame, nativeSurface);
+			} else {
+				critical_section::scoped_lock frameWriteLock(mFrameCriticalSection);
+				if (mTextureBridge->ReadData(nativeSurface)) {
+					mFrameConvertedEvent.set();
+				}
+			}
+			if (++mConvertedCount % 30 == 0) {
+				{
+					// The render thread converts paced frames, and with them updates these counters.
+					critical_section::scoped_lock frameLock(mFrameCriticalSection);
+					if (mTextureBridge->IsChangeDetectionEnabled()) {
+						auto& stats = mTextureBridge->GetChangeDetector().GetStats();
+						messageOut << "Skipped " << stats.skipped << " of " << stats.frames << " frames ("
+							<< int(stats.SkipRate() * 100.0 + 0.5) << "%)" << std::endl;
+					}
+					GpuRecoveryStats recovery = mGpuResources.GetStats(GpuDomain::D3D);
+					if (recovery.recoveries > 0) {
+						messageOut << "D3D rebuilt " << recovery.recoveries << " times, last in " << int(recovery.lastMilliseconds)
+							<< " ms, worst " << int(recovery.worstMilliseconds) << " ms" << std::endl;
+					}
+					LumaStatistics luma;
+					if (mTextureBridge->GetLatestStatistics(luma)) {
+						messageOut << "Luma mean " << int(luma.mean + 0.5) << " p5 " << int(luma.Percentile(0.05))
+							<< " p95 " << int(luma.Percentile(0.95)) << std::endl;
+					}
+				}
+				ReportStatus(messageOut.str());
+			}
+			return;
+		} else if (vmf->SoftwareBitmap) {
+			if (ReadSoftwareBitmap(vmf->SoftwareBitmap, frame->SystemRelativeTime ? frame->SystemRelativeTime->Value.Duration : 0)) {
+				mFrameConvertedEvent.set();
+			}
+			if (++mConvertedCount % 30 == 0) {
+				StreamingUploadStats upload;
+				{
+					critical_section::scoped_lock frameLock(mFrameCriticalSection);
+					upload = mUploadStats;
+				}
+				messageOut << "Upload " << int(upload.MegabytesPerSecond()) << " MB/s, last " << upload.lastMilliseconds << " ms, "
+					<< upload.stalls << " stalls, " << mCpuFrames.GetSubscriberStats(mCpuPreview).delivery.Dropped() << " dropped" << std::endl;
+				if (mDenoiseFrames) {
+					messageOut << "Denoise " << mCpuDenoiser.GetLastMilliseconds() << " ms" << std::endl;
+				}
+				if (mCpuLens.IsEnabled()) {
+					messageOut << "Lens correction " << mCpuLens.GetLastMilliseconds() << " ms" << std::endl;
+				}
+				if (mBuildPyramids) {
+					const GaussianPyramid& pyramid = mCpuPyramids[1 - mCpuPyramidWrite];
+					messageOut << "Pyramid " << pyramid.GetLastMilliseconds() << " ms:";
+					for (unsigned level = 1; level < pyramid.GetLevelCount(); level++) {
+						messageOut << " " << pyramid.GetLevel(level).milliseconds;
+					}
+					messageOut << std::endl;
+				}
+				if (mTrackFeatures) {
+					const FeatureStats& features = mCpuFeatures.GetStats();
+					messageOut << "Features " << mCpuFeatures.GetFeatures().size() << ", " << features.lost << " lost, " << features.detected
+						<< " new, " << int(features.PointsPerMillisecond()) << " points/ms, detection " << features.detectMilliseconds << " ms" << std::endl;
+				}
+				if (mFrameExport.IsOpen()) {
+					mFrameExport.ReclaimStaleReaders(FrameExportReaderTimeoutMilliseconds);
+					const SharedWriterStats& exported = mFrameExport.GetStats();
+					messageOut << "Exported " << exported.published << " frames to " << exported.readers << " readers, "
+						<< exported.slowFrames << " while one was slow" << std::endl;
+				}
+				if (mSkipUnchangedFrames) {
+					auto& stats = mCpuChangeDetector.GetStats();
+					messageOut << "Skipped " << stats.skipped << " of " << stats.frames << " frames ("
+						<< int(stats.SkipRate() * 100.0 + 0.5) << "%)" << std::endl;
+				}
+				LumaStatistics luma;
+				if (mCpuStatistics.GetLatest(luma)) {
+					messageOut << "Luma mean " << int(luma.mean + 0.5) << " p5 " << int(luma.Percentile(0.05))
+						<< " p95 " << int(luma.Percentile(0.95)) << std::endl;
+				}
+				ReportStatus(messageOut.str());
+			}
 			return;
 		} else {
 			messageOut << "No D3D output";
@@ -242,13 +870,200 @@ void unigles::OpenGLESPage::OnFrameArrived(Windows::Media::Capture::Frames::Medi
 	} else {
 		messageOut << "No video frame";
 	}
-	auto message = ref new String(messageOut.str().c_str());
+	ReportStatus(messageOut.str());
+}
+
+void unigles::OpenGLESPage::QueuePacedFrame(Windows::Media::Capture::Frames::MediaFrameReference^ frame, Microsoft::WRL::ComPtr<IDXGISurface> surface) {
+	// Without a timestamp the frame is paced by its arrival.
+	int64_t arrival = PacerNow();
+	int64_t timestamp = frame->SystemRelativeTime ? frame->SystemRelativeTime->Value.Duration : arrival;
+	mCameraEdge.Push(PacedFrame{ frame, surface, timestamp, arrival }, arrival);
+	mFrameConvertedEvent.set();
+}
+
+bool unigles::OpenGLESPage::ConvertPacedFrame(int64_t displayTime) {
+	PacedFrame arrived;
+	while (mCameraEdge.TryPop(arrived, PacerNow())) {
+		mFramePacer.Push(++mPacedFrameIds, arrived.timestamp, arrived.arrival);
+		mPacedFrames.push_back(std::move(arrived));
+		// The pacer only ever drops from the front of its queue.
+		while (mPacedFrames.size() > mFramePacer.GetQueuedCount()) {
+			mPacedFrames.pop_front();
+		}
+	}
+	// A backlog means buffering only adds latency; show frames as soon as they are due.
+	mFramePacer.SetDepth(mCameraBacklog ? 0 : PacingDepth);
+	PacerDecision decision = mFramePacer.Select(displayTime);
+	if (decision.present) {
+		// The presented frame is the last one Select() removed; the ones ahead of it were skipped.
+		size_t removed = mPacedFrames.size() - mFramePacer.GetQueuedCount();
+		Microsoft::WRL::ComPtr<IDXGISurface> surface = mPacedFrames[removed - 1].surface;
+		mPacedFrames.erase(mPacedFrames.begin(), mPacedFrames.begin() + removed);
+		bool converted = false;
+		{
+			critical_section::scoped_lock frameLock(mFrameCriticalSection);
+			try {
+				converted = mTextureBridge->ReadData(surface);
+			} catch (Exception^) {
+				// The bridge handles a removed device itself; what it lets through belongs to
+				// this frame, like a surface it cannot read. GL is not affected, so the frame is
+				// dropped and the next one tried; only a device that went away after all is lost.
+				mFramePacer.ReportFailed();
+				mGpuResources.CheckLost(GpuDomain::D3D);
+			}
+		}
+		// As for unpaced frames; an unchanged frame leaves the version, so the loop can skip the redraw.
+		if (converted) {
+			mFrameConvertedEvent.set();
+		}
+	}
+	return !mPacedFrames.empty();
+}
+
+bool unigles::OpenGLESPage::ReadSoftwareBitmap(Windows::Graphics::Imaging::SoftwareBitmap^ bitmap, int64_t timestamp) {
+	using namespace Windows::Graphics::Imaging;
+	using namespace Microsoft::WRL;
+	if (bitmap->BitmapPixelFormat != BitmapPixelFormat::Nv12) {
+		bitmap = SoftwareBitmap::Convert(bitmap, BitmapPixelFormat::Nv12);
+	}
+	BitmapBuffer^ buffer = bitmap->LockBuffer(BitmapBufferAccessMode::Read);
+	IMemoryBufferReference^ reference = buffer->CreateReference();
+	ComPtr<IMemoryBufferByteAccess> access;
+	BYTE* data = nullptr;
+	UINT32 capacity = 0;
+	if (FAILED(reinterpret_cast<IInspectable*>(reference)->QueryInterface(IID_PPV_ARGS(&access))) ||
+		FAILED(access->GetBuffer(&data, &capacity)) || buffer->GetPlaneCount() < 2) {
+		delete reference;
+		delete buffer;
+		return false;
+	}
+	BitmapPlaneDescription lumaPlane = buffer->GetPlaneDescription(0);
+	BitmapPlaneDescription chromaPlane = buffer->GetPlaneDescription(1);
+	unsigned width = unsigned(lumaPlane.Width);
+	unsigned height = unsigned(lumaPlane.Height);
+	const uint8_t* luma = data + lumaPlane.StartIndex;
+
+	bool publish = true;
+	std::vector<uint8_t> dirtyBands;
+	if (mSkipUnchangedFrames) {
+		publish = mCpuChangeDetector.Process(luma, width, height, lumaPlane.Stride);
+		if (publish) {
+			// Collapse the tile mask to one flag per tile row for the uploader.
+			const std::vector<uint8_t>& mask = mCpuChangeDetector.GetDirtyMask();
+			unsigned tilesX = mCpuChangeDetector.GetTilesX();
+			dirtyBands.assign(mCpuChangeDetector.GetTilesY(), 0);
+			for (size_t tile = 0; tile < mask.size(); tile++) {
+				dirtyBands[tile / tilesX] |= mask[tile] ? 1 : 0;
+			}
+		}
+	}
+	FrameHandle<Nv12Frame> frame;
+	if (publish) {
+		frame = mCpuFrames.Acquire();
+		if (!frame) {
+			// Every buffer is still with a subscriber. The gap in sequence makes the
+			// uploader refresh the bands this frame changed.
+			++mCpuFrameSequence;
+			publish = false;
+		}
+	}
+	if (publish) {
+		Nv12Frame& target = *frame.GetMutable();
+		if (mCpuLens.IsEnabled()) {
+			mCpuDistorted.Assign(luma, lumaPlane.Stride, data + chromaPlane.StartIndex, chromaPlane.Stride, width, height);
+			mCpuLens.Process(mCpuDistorted, target);
+		} else {
+			target.Assign(luma, lumaPlane.Stride, data + chromaPlane.StartIndex, chromaPlane.Stride, width, height);
+		}
+		// Recycled buffers end up the size of the camera frame, as does the image the
+		// lens correction reads.
+		uint64_t buffers = mCpuFrames.GetSourcePoolStats().allocated + (mCpuLens.IsEnabled() ? 1 : 0);
+		uint64_t frameBytes = buffers * uint64_t(target.luma.size() + target.chroma.size());
+		TrackHostBuffer(mResourceTracker, mCpuFrameMemory, "CPU frames", "NV12", frameBytes);
+		TrackHostBuffer(mResourceTracker, mCpuLensMemory, "CPU lens remap", "RG32F+RG32I", mCpuLens.GetBytes());
+		// The correction moves rows, so the camera image's dirty bands say nothing about it.
+		if (mSkipUnchangedFrames && !mCpuLens.IsEnabled()) {
+			target.bandRows = mCpuChangeDetector.GetSettings().tileSize;
+			target.dirtyBands.swap(dirtyBands);
+		} else {
+			target.bandRows = 0;
+		}
+		if (mDenoiseFrames) {
+			// Clean bands take what the denoiser last made of them, which is what the
+			// uploader kept, so the dirty list stays valid for the filtered frame.
+			mCpuDenoiser.Process(target);
+		}
+		TrackHostBuffer(mResourceTracker, mCpuDenoiserMemory, "CPU denoise history", "NV12", mCpuDenoiser.GetBytes());
+		if (mCpuStatistics.IsIdle()) {
+			// Frames that arrive while the worker is busy are not sampled.
+			mCpuStatisticsPlane->assign(target.luma.begin(), target.luma.end());
+			mCpuStatistics.Submit(mCpuStatisticsPlane, target.width, target.height, target.width, mCpuFrameSequence + 1);
+			TrackHostBuffer(mResourceTracker, mCpuStatisticsMemory, "CPU statistics", "R8", mCpuStatisticsPlane->capacity());
+		}
+		if (mBuildPyramids || mTrackFeatures) {
+			// From the frame the subscribers see, so features line up with the preview.
+			GaussianPyramid& pyramid = mCpuPyramids[mCpuPyramidWrite];
+			pyramid.Build(target.luma.data(), target.width, target.width, target.height);
+			if (mTrackFeatures) {
+				mCpuFeatures.Process(mCpuPyramids[1 - mCpuPyramidWrite], pyramid, target.features);
+			}
+			mCpuPyramidWrite = 1 - mCpuPyramidWrite;
+			uint64_t pyramidBytes = mCpuPyramids[0].GetBytes() + mCpuPyramids[1].GetBytes();
+			TrackHostBuffer(mResourceTracker, mCpuPyramidMemory, "CPU pyramid", "R8", pyramidBytes);
+		}
+		target.sequence = ++mCpuFrameSequence;
+		target.timestamp = timestamp;
+		if (mExportFrames) {
+			ExportFrame(target);
+		}
+		mCpuFrames.Publish(std::move(frame), timestamp);
+	}
+
+	// Closing the reference and the buffer unlocks the bitmap.
+	delete reference;
+	delete buffer;
+	return publish;
+}
+
+void OpenGLESPage::ExportFrame(const Nv12Frame& frame) {
+	size_t lumaBytes = frame.luma.size();
+	size_t bytes = lumaBytes + frame.chroma.size();
+	if (!mFrameExport.IsOpen() || mFrameExport.GetSlotBytes() < bytes) {
+		// Sized for the camera's frames. Readers of a ring that had to grow see its
+		// writer go idle and reopen.
+		mFrameExportMemory.Reset();
+		if (!mFrameExport.Create(FrameExportName, FrameExportSlots, bytes)) {
+			// Readers of an earlier ring still hold the name; tried again next frame.
+			return;
+		}
+		mFrameExportMemory = mResourceTracker.Track(ResourceHeap::Host, "Frame export", "NV12 shared", mFrameExport.GetRegionBytes());
+	}
+	uint8_t* slot = mFrameExport.BeginWrite();
+	memcpy(slot, frame.luma.data(), lumaBytes);
+	memcpy(slot + lumaBytes, frame.chroma.data(), frame.chroma.size());
+	SharedFrameInfo info;
+	info.width = frame.width;
+	info.height = frame.height;
+	info.format = MakeFourCC('N', 'V', '1', '2');
+	info.planeCount = 2;
+	info.planeOffsets[1] = uint32_t(lumaBytes);
+	info.planeStrides[0] = frame.width;
+	info.planeStrides[1] = frame.ChromaWidth() * 2;
+	info.bytes = bytes;
+	info.timestamp = frame.timestamp;
+	info.frameNumber = frame.sequence;
+	mFrameExport.Publish(info);
+}
+
+void unigles::OpenGLESPage::ReportStatus(const std::string& message) {
+	// Picked up by the HUD on its next refresh.
+	critical_section::scoped_lock lock(mStatusCriticalSection);
+	mStatusText = message;
+}
+
+void unigles::OpenGLESPage::ShowMessage(Platform::String^ message) {
 	Messages->Dispatcher->RunAsync(Windows::UI::Core::CoreDispatcherPriority::Normal,
 		ref new Windows::UI::Core::DispatchedHandler([=]() {
-		mFrameCount++;
-		if (mFrameCount == 10) {
-			Messages->Text = message;
-			mFrameCount = 0;
-		}
+		Messages->Text = message;
 	}, CallbackContext::Any));
 }
@@ -1,7 +1,36 @@
 ﻿#pragma once
 
 #include "OpenGLES.h"
+#include "DamageTracker.h"
+#include "FeatureTracker.h"
+#include "FrameHub.h"
+#include "FramePacer.h"
+#include "GaussianPyramid.h"
+#include "GlGpuProfiler.h"
+#include "GpuProfileLog.h"
+#include "GpuResourceRegistry.h"
 #include "TextureBridge.h"
+#include "LensRemap.h"
+#include "LumaChangeDetector.h"
+#include "LumaStatistics.h"
+#include "Nv12FrameBuffer.h"
+#include "PerfRecorder.h"
+#include "PipelineEdge.h"
+#include "ResourceTracker.h"
+#include "SharedFrameRing.h"
+#include "StreamingUploader.h"
+#include "TemporalDenoiser.h"
+#include "TextureAssetLoader.h"
+#include "SimpleRenderer.h"
+#include "StatsOverlay.h"
+#include "WarmupLoader.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include "OpenGLESPage.g.h"
 
 namespace unigles {
@@ -20,12 +49,25 @@ namespace unigles {
 		void CreateRenderSurface();
 		void DestroyRenderSurface();
 		void RecoverFromLostDevice();
+		void RequestRecovery();
 		void StartRenderLoop();
 		void StopRenderLoop();
+		void StartWarmup();
+		void RegisterGlResources();
+		void ReportLeaks(ResourceHeap heap);
+		void ReportStatus(const std::string& message);
+		void ShowMessage(Platform::String^ message);
+		// Fills the overlay's batch; the render loop draws it after the cube.
+		void BuildHud(StatsOverlay& overlay);
+		bool ReadSoftwareBitmap(Windows::Graphics::Imaging::SoftwareBitmap^ bitmap, int64_t timestamp);
+		void ExportFrame(const Nv12Frame& frame);
+		void QueuePacedFrame(Windows::Media::Capture::Frames::MediaFrameReference^ frame, Microsoft::WRL::ComPtr<IDXGISurface> surface);
+		bool ConvertPacedFrame(int64_t displayTime);
 		Concurrency::task<void> InitCamera();
 
-		int mFrameCount;
 		OpenGLES* mOpenGLES;
+		// Memory of everything below that allocates; declared first so it goes last.
+		ResourceTracker mResourceTracker;
 
 		EGLSurface mRenderSurface;     // This surface is associated with a swapChainPanel on the page
 		Concurrency::critical_section mRenderSurfaceCriticalSection;
@@ -33,5 +75,100 @@ namespace unigles {
 		Platform::Agile<Windows::Media::Capture::MediaCapture> mMediaCapture;
 		Concurrency::critical_section mFrameCriticalSection;
 		TextureBridge* mTextureBridge;
+		// GL and D3D resources with their recreate callbacks; each side is rebuilt on its own.
+		GpuResourceRegistry mGpuResources;
+
+		// Programs, buffers and conversion shaders are prepared off the render thread,
+		// on a context sharing objects with the render context. The renderer outlives
+		// render loop restarts and is rebuilt with the context after a lost device.
+		std::unique_ptr<WarmupLoader> mWarmup;
+		std::unique_ptr<SimpleRenderer> mRenderer;
+		std::unique_ptr<StreamingUploader> mUploader;
+		GpuProfileLog mGlProfileLog;
+		std::unique_ptr<GlGpuProfiler> mGlProfiler;
+		std::unique_ptr<StatsOverlay> mOverlay;
+		// Block compressed textures listed in Assets\Textures\textures.txt, loaded with
+		// the other GL resources.
+		std::unique_ptr<TextureAssetLoader> mTextureAssets;
+		StartupTimer mStartupTimer;
+
+		// Statistics are drawn into the scene by the render loop instead of going through
+		// the XAML dispatcher. The camera thread leaves its report in mStatusText.
+		Concurrency::critical_section mStatusCriticalSection;
+		std::string mStatusText;
+		// Render thread only.
+		std::string mStartupText;
+		std::string mHudText;
+		unsigned mHudFrames;
+		RollingStatistic mFrameTimes;
+		std::vector<double> mFrameSamples;
+		uint64_t mDroppedFrames;	// Converted frames replaced before they were drawn
+		// Stage times and draw counts of the current render loop run, checked against
+		// Assets\PerfBudgets.txt when the loop stops.
+		PerfRecorder mPerfRecorder;
+		// When set, frames are drawn only where the back buffer is out of date and presented
+		// as damage rectangles, if the display can.
+		bool mPartialPresents;
+		DamageTracker mDamage;
+
+		// When set, static camera frames skip both conversion and redraw.
+		bool mSkipUnchangedFrames;
+		// When set, camera frames go through the temporal denoiser before they are shown.
+		bool mDenoiseFrames;
+		// When set, camera frames are corrected for CameraLens() before anything else sees them.
+		bool mCorrectLens;
+		// When set, both the bridge and the CPU path build a luma pyramid of every frame.
+		bool mBuildPyramids;
+		// When set, CPU frames carry the features tracked on their luma plane.
+		bool mTrackFeatures;
+		Concurrency::event mFrameConvertedEvent;
+		int mConvertedCount;
+
+		// When set, camera surfaces are handed to the render loop through mCameraEdge and
+		// wait in a jitter buffer; the render loop converts the one the pacer picks for its
+		// vsync, instead of the camera thread converting whatever arrived last.
+		struct PacedFrame {
+			Windows::Media::Capture::Frames::MediaFrameReference^ reference;	// Keeps the camera buffer from being recycled
+			Microsoft::WRL::ComPtr<IDXGISurface> surface;
+			int64_t timestamp;
+			int64_t arrival;
+		};
+		bool mPaceFrames;
+		PipelineEdge<PacedFrame> mCameraEdge;
+		std::atomic<bool> mCameraBacklog;	// Set while mCameraEdge is above its high water level
+		// Render thread only.
+		FramePacer mFramePacer;
+		std::deque<PacedFrame> mPacedFrames;	// Same frames as the pacer's queue
+		uint64_t mPacedFrameIds;
+
+		// Frames without a Direct3D surface are copied into pooled buffers and published to
+		// their subscribers; the render loop uploads what mCpuPreview takes.
+		FrameHub<Nv12Frame> mCpuFrames;
+		FrameHub<Nv12Frame>::SubscriberId mCpuPreview;
+		// When set, the same frames are written into a shared-memory ring for analytics
+		// running in other processes. Camera thread only.
+		bool mExportFrames;
+		SharedFrameWriter mFrameExport;
+		TrackedResource mFrameExportMemory;
+		TrackedResource mCpuFrameMemory;
+		LumaChangeDetector mCpuChangeDetector;
+		TemporalDenoiser mCpuDenoiser;
+		TrackedResource mCpuDenoiserMemory;
+		// Luma statistics of the frames the subscribers see, computed off the camera thread
+		// on a copy that is refilled whenever the worker is idle.
+		LumaStatisticsWorker mCpuStatistics;
+		std::shared_ptr<std::vector<uint8_t>> mCpuStatisticsPlane;
+		TrackedResource mCpuStatisticsMemory;
+		LensCorrector mCpuLens;
+		TrackedResource mCpuLensMemory;
+		Nv12Frame mCpuDistorted;	// Camera image the correction reads from
+		// The last frame's pyramid stays for the tracker while the next one is built in
+		// the other.
+		GaussianPyramid mCpuPyramids[2];
+		unsigned mCpuPyramidWrite;
+		TrackedResource mCpuPyramidMemory;
+		FeatureTracker mCpuFeatures;
+		uint64_t mCpuFrameSequence;
+		StreamingUploadStats mUploadStats;	// Copy of the render loop's uploader counters, under mFrameCriticalSection
 	};
 }
@@ -0,0 +1,219 @@
+#include "PerfRecorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+using namespace unigles;
+
+// Standard error of a median over the median absolute deviation, for normal noise:
+// 1.4826 turns the deviation into a standard deviation, 1.2533 is the median's
+// efficiency penalty over the mean.
+static const double MedianErrorPerMad = 1.4826 * 1.2533;
+static const double NoiseSigmas = 2.0;
+
+static double Percentile(const std::vector<double>& sorted, double fraction) {
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	double position = fraction * (sorted.size() - 1);
+	size_t below = size_t(position);
+	size_t above = std::min(below + 1, sorted.size() - 1);
+	return sorted[below] + (sorted[above] - sorted[below]) * (position - below);
+}
+
+static void WriteJsonString(std::ostream& out, const std::string& text) {
+	out << '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			out << '\\' << c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			static const char* Hex = "0123456789abcdef";
+			out << "\\u00" << Hex[(c >> 4) & 15] << Hex[c & 15];
+		} else {
+			out << c;
+		}
+	}
+	out << '"';
+}
+
+PerfRecorder::PerfRecorder() :
+	mFrames(0) {
+}
+
+void PerfRecorder::EndFrame() {
+	mFrames++;
+}
+
+void PerfRecorder::Clear() {
+	mStages.clear();
+	mFrames = 0;
+}
+
+PerfRecorder::Stage& PerfRecorder::Find(const std::string& stage) {
+	for (Stage& entry : mStages) {
+		if (entry.name == stage) {
+			return entry;
+		}
+	}
+	mStages.push_back(Stage{ stage, {}, {} });
+	return mStages.back();
+}
+
+void PerfRecorder::AddTime(const std::string& stage, double milliseconds) {
+	Find(stage).times.push_back(milliseconds);
+}
+
+void PerfRecorder::AddCount(const std::string& stage, const std::string& counter, uint64_t count) {
+	Find(stage).counts[counter] += count;
+}
+
+std::vector<PerfStageSummary> PerfRecorder::Summarize() const {
+	std::vector<PerfStageSummary> summaries;
+	for (const Stage& stage : mStages) {
+		PerfStageSummary summary;
+		summary.name = stage.name;
+		summary.samples = stage.times.size();
+		if (!stage.times.empty()) {
+			std::vector<double> sorted(stage.times);
+			std::sort(sorted.begin(), sorted.end());
+			summary.median = Percentile(sorted, 0.5);
+			summary.p95 = Percentile(sorted, 0.95);
+			summary.max = sorted.back();
+			double sum = 0.0;
+			for (double time : sorted) {
+				sum += time;
+			}
+			summary.mean = sum / sorted.size();
+			std::vector<double> deviations;
+			deviations.reserve(sorted.size());
+			for (double time : sorted) {
+				deviations.push_back(std::fabs(time - summary.median));
+			}
+			std::sort(deviations.begin(), deviations.end());
+			summary.mad = Percentile(deviations, 0.5);
+		}
+		for (const auto& count : stage.counts) {
+			summary.countsPerFrame[count.first] = mFrames > 0 ? double(count.second) / mFrames : double(count.second);
+		}
+		summaries.push_back(summary);
+	}
+	return summaries;
+}
+
+PerfScope::PerfScope(PerfRecorder& recorder, const std::string& stage) :
+	mRecorder(recorder),
+	mStage(stage),
+	mStart(std::chrono::steady_clock::now()) {
+}
+
+PerfScope::~PerfScope() {
+	mRecorder.AddTime(mStage, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count());
+}
+
+bool unigles::ParsePerfBudgets(const std::string& text, std::vector<PerfBudget>& budgets, std::string* error) {
+	std::istringstream lines(text);
+	std::string line;
+	unsigned number = 0;
+	while (std::getline(lines, line)) {
+		number++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) {
+			line.erase(comment);
+		}
+		std::istringstream fields(line);
+		PerfBudget budget;
+		if (!(fields >> budget.stage)) {
+			continue;
+		}
+		std::string tolerance;
+		std::string extra;
+		bool valid = bool(fields >> budget.metric >> budget.limit);
+		if (valid && fields >> tolerance) {
+			std::istringstream value(tolerance);
+			valid = bool(value >> budget.tolerance) && value.eof() && !(fields >> extra);
+		}
+		if (!valid) {
+			if (error) {
+				std::ostringstream message;
+				message << "line " << number << ": expected stage, metric, limit and optional tolerance";
+				*error = message.str();
+			}
+			return false;
+		}
+		budgets.push_back(budget);
+	}
+	return true;
+}
+
+std::vector<PerfBudgetResult> unigles::CheckPerfBudgets(const PerfRecorder& recorder, const std::vector<PerfBudget>& budgets) {
+	std::vector<PerfStageSummary> summaries = recorder.Summarize();
+	std::vector<PerfBudgetResult> results;
+	for (const PerfBudget& budget : budgets) {
+		PerfBudgetResult result;
+		result.budget = budget;
+		result.threshold = budget.limit * (1.0 + budget.tolerance);
+		auto stage = std::find_if(summaries.begin(), summaries.end(), [&](const PerfStageSummary& summary) {
+			return summary.name == budget.stage;
+		});
+		if (stage != summaries.end()) {
+			bool time = true;
+			if (budget.metric == "median") {
+				result.measured = stage->median;
+			} else if (budget.metric == "p95") {
+				result.measured = stage->p95;
+			} else if (budget.metric == "mean") {
+				result.measured = stage->mean;
+			} else if (budget.metric == "max") {
+				result.measured = stage->max;
+			} else {
+				time = false;
+				auto count = stage->countsPerFrame.find(budget.metric);
+				if (count != stage->countsPerFrame.end()) {
+					result.measured = count->second;
+					result.found = true;
+				}
+			}
+			if (time && stage->samples > 0) {
+				result.found = true;
+				result.threshold += NoiseSigmas * MedianErrorPerMad * stage->mad / std::sqrt(double(stage->samples));
+			}
+		}
+		result.passed = result.found && result.measured <= result.threshold;
+		results.push_back(result);
+	}
+	return results;
+}
+
+void unigles::WritePerfReport(std::ostream& out, const PerfRecorder& recorder, const std::vector<PerfBudgetResult>& results) {
+	out << "{\n  \"frames\": " << recorder.GetFrameCount() << ",\n  \"stages\": [";
+	std::vector<PerfStageSummary> summaries = recorder.Summarize();
+	for (size_t i = 0; i < summaries.size(); i++) {
+		const PerfStageSummary& stage = summaries[i];
+		out << (i > 0 ? "," : "") << "\n    { \"name\": ";
+		WriteJsonString(out, stage.name);
+		out << ", \"samples\": " << stage.samples << ", \"median\": " << stage.median << ", \"p95\": " << stage.p95
+			<< ", \"mean\": " << stage.mean << ", \"max\": " << stage.max << ", \"mad\": " << stage.mad << ", \"counts\": {";
+		bool first = true;
+		for (const auto& count : stage.countsPerFrame) {
+			out << (first ? " " : ", ");
+			WriteJsonString(out, count.first);
+			out << ": " << count.second;
+			first = false;
+		}
+		out << (first ? "} }" : " } }");
+	}
+	out << (summaries.empty() ? "],\n" : "\n  ],\n") << "  \"budgets\": [";
+	bool passed = true;
+	for (size_t i = 0; i < results.size(); i++) {
+		const PerfBudgetResult& result = results[i];
+		out << (i > 0 ? "," : "") << "\n    { \"stage\": ";
+		WriteJsonString(out, result.budget.stage);
+		out << ", \"metric\": ";
+		WriteJsonString(out, result.budget.metric);
+		out << ", \"limit\": " << result.budget.limit << ", \"threshold\": " << result.threshold << ", \"measured\": " << result.measured
+			<< ", \"found\": " << (result.found ? "true" : "false") << ", \"passed\": " << (result.passed ? "true" : "false") << " }";
+		passed = passed && result.passed;
+	}
+	out << (results.empty() ? "],\n" : "\n  ],\n") << "  \"passed\": " << (passed ? "true" : "false") << "\n}\n";
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	struct PerfStageSummary {
+		std::string name;
+		uint64_t samples = 0;
+		// Milliseconds per frame. The median and its median absolute deviation stand
+		// up to the odd preempted frame that the mean and maximum do not.
+		double median = 0.0;
+		double p95 = 0.0;
+		double mean = 0.0;
+		double max = 0.0;
+		double mad = 0.0;
+		// Counter totals divided by the recorded frames.
+		std::map<std::string, double> countsPerFrame;
+	};
+
+	// Per-stage timings and counters (draws, state changes, allocations, anything the
+	// caller counts) of a run, kept whole rather than rolling so a replay can be
+	// summarized and checked against budgets at the end. Not thread safe.
+	class PerfRecorder {
+	public:
+		PerfRecorder();
+
+		// Counts a frame; counters are reported per frame.
+		void EndFrame();
+		void AddTime(const std::string& stage, double milliseconds);
+		void AddCount(const std::string& stage, const std::string& counter, uint64_t count);
+		void Clear();
+
+		uint64_t GetFrameCount() const { return mFrames; }
+		// Stages in the order they were first recorded.
+		std::vector<PerfStageSummary> Summarize() const;
+
+	private:
+		struct Stage {
+			std::string name;
+			std::vector<double> times;
+			std::map<std::string, uint64_t> counts;
+		};
+
+		Stage& Find(const std::string& stage);
+
+		std::vector<Stage> mStages;
+		uint64_t mFrames;
+	};
+
+	// Times the enclosing block as one sample of a stage.
+	class PerfScope {
+	public:
+		PerfScope(PerfRecorder& recorder, const std::string& stage);
+		~PerfScope();
+
+	private:
+		PerfRecorder& mRecorder;
+		std::string mStage;
+		std::chrono::steady_clock::time_point mStart;
+	};
+
+	// A limit on one metric of a stage: "median", "p95", "mean" or "max" for times in
+	// milliseconds, or the name of a counter for its per-frame average.
+	struct PerfBudget {
+		std::string stage;
+		std::string metric;
+		double limit = 0.0;
+		double tolerance = 0.1;		// Fraction over the limit that still passes
+	};
+
+	struct PerfBudgetResult {
+		PerfBudget budget;
+		double measured = 0.0;
+		double threshold = 0.0;		// Limit with the tolerance and measurement noise added
+		bool found = false;			// Whether the run recorded the stage and metric at all
+		bool passed = false;
+	};
+
+	// One budget per line: stage, metric, limit and an optional tolerance, separated by
+	// whitespace; '#' starts a comment. Returns false with the offending line in error.
+	bool ParsePerfBudgets(const std::string& text, std::vector<PerfBudget>& budgets, std::string* error = nullptr);
+
+	// Time metrics get twice the standard error of their median on top of the tolerance,
+	// so a noisy run does not fail a budget it meets on average. Counters are exact.
+	// Budgets for stages or counters the run never recorded fail.
+	std::vector<PerfBudgetResult> CheckPerfBudgets(const PerfRecorder& recorder, const std::vector<PerfBudget>& budgets);
+
+	// Machine-readable report of the run, with the budget results when given.
+	void WritePerfReport(std::ostream& out, const PerfRecorder& recorder, const std::vector<PerfBudgetResult>& results);
+}
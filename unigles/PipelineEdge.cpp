@@ -0,0 +1,35 @@
+#include "PipelineEdge.h"
+
+using namespace unigles;
+
+const char* unigles::ToString(EdgePolicy policy) {
+	switch (policy) {
+	case EdgePolicy::LatestWins:
+		return "latest wins";
+	case EdgePolicy::BoundedQueue:
+		return "bounded queue";
+	case EdgePolicy::BlockProducer:
+		return "block producer";
+	}
+	return "unknown";
+}
+
+const char* unigles::ToString(DropReason reason) {
+	switch (reason) {
+	case DropReason::ProducerBusy:
+		return "producer busy";
+	case DropReason::ConsumerSlow:
+		return "consumer slow";
+	case DropReason::StaleTimestamp:
+		return "stale timestamp";
+	}
+	return "unknown";
+}
+
+uint64_t EdgeStats::Dropped() const {
+	uint64_t total = 0;
+	for (uint64_t count : drops) {
+		total += count;
+	}
+	return total;
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace unigles {
+	// What an edge does with an item when the consumer has not made room for it.
+	enum class EdgePolicy {
+		LatestWins,		// The oldest queued item is replaced; the producer never waits
+		BoundedQueue,	// The new item is refused; the producer never waits
+		BlockProducer,	// The producer waits for room, up to a timeout
+	};
+
+	enum class DropReason {
+		ProducerBusy,	// Refused or timed out at the producer, the queue being full
+		ConsumerSlow,	// Replaced in the queue before the consumer took it
+		StaleTimestamp,	// Older than the newest item, or waited longer than maxAge
+	};
+	static const unsigned DropReasonCount = 3;
+
+	const char* ToString(EdgePolicy policy);
+	const char* ToString(DropReason reason);
+
+	struct EdgeSettings {
+		EdgePolicy policy = EdgePolicy::LatestWins;
+		unsigned capacity = 1;
+		// Items that spent longer than this in the queue are dropped when popped; zero keeps
+		// them whatever their age. Same unit as the timestamps.
+		int64_t maxAge = 0;
+		// Depth at which the edge reports pressure, zero for the capacity. Pressure is
+		// released once the queue drains to half of it.
+		unsigned highWater = 0;
+		// How long a blocked producer waits before its item is dropped.
+		unsigned blockTimeoutMilliseconds = 100;
+	};
+
+	struct EdgeStats {
+		uint64_t pushed = 0;
+		uint64_t delivered = 0;
+		uint64_t drops[DropReasonCount] = {};
+		unsigned depth = 0;
+		unsigned highWaterMark = 0;		// Deepest the queue has been
+		uint64_t pressureEvents = 0;	// Times the depth reached the high water level
+		double blockedMilliseconds = 0.0;
+
+		uint64_t Dropped() const;
+	};
+
+	// Hand-off between two stages of the frame pipeline running on different threads.
+	// Every item that does not reach the consumer is counted by reason, so losses are
+	// attributed to the edge that caused them, and crossing the high water level is
+	// signalled to whoever can shed load upstream.
+	template <typename T>
+	class PipelineEdge {
+	public:
+		// Called with true when the depth reaches the high water level and with false when
+		// it drains again, on the thread that caused the change and outside the edge's lock.
+		typedef std::function<void(bool)> PressureCallback;
+
+		PipelineEdge(const std::string& stage, const EdgeSettings& settings = EdgeSettings()) :
+			mStage(stage),
+			mSettings(settings),
+			mNewest(0),
+			mHasNewest(false),
+			mUnderPressure(false) {
+			if (mSettings.capacity < 1) {
+				mSettings.capacity = 1;
+			}
+			if (mSettings.highWater == 0 || mSettings.highWater > mSettings.capacity) {
+				mSettings.highWater = mSettings.capacity;
+			}
+		}
+
+		const std::string& GetStage() const { return mStage; }
+		const EdgeSettings& GetSettings() const { return mSettings; }
+		void SetPressureCallback(PressureCallback callback) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			mPressureCallback = callback;
+		}
+
+		// Returns false when this item was dropped; items it displaced are only counted.
+		bool Push(T item, int64_t timestamp) {
+			std::unique_lock<std::mutex> lock(mMutex);
+			mStats.pushed++;
+			if (mHasNewest && timestamp < mNewest) {
+				mStats.drops[unsigned(DropReason::StaleTimestamp)]++;
+				return false;
+			}
+			if (mQueue.size() >= mSettings.capacity) {
+				switch (mSettings.policy) {
+				case EdgePolicy::LatestWins:
+					mQueue.pop_front();
+					mStats.drops[unsigned(DropReason::ConsumerSlow)]++;
+					break;
+				case EdgePolicy::BoundedQueue:
+					mStats.drops[unsigned(DropReason::ProducerBusy)]++;
+					return false;
+				case EdgePolicy::BlockProducer: {
+					auto start = std::chrono::steady_clock::now();
+					bool room = mRoom.wait_for(lock, std::chrono::milliseconds(mSettings.blockTimeoutMilliseconds), [this]() {
+						return mQueue.size() < mSettings.capacity;
+					});
+					mStats.blockedMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+					if (!room) {
+						mStats.drops[unsigned(DropReason::ProducerBusy)]++;
+						return false;
+					}
+					break;
+				}
+				}
+			}
+			mQueue.push_back(Entry{ std::move(item), timestamp });
+			mNewest = timestamp;
+			mHasNewest = true;
+			if (mQueue.size() > mStats.highWaterMark) {
+				mStats.highWaterMark = unsigned(mQueue.size());
+			}
+			UpdatePressure(lock);
+			return true;
+		}
+
+		// Takes the oldest item that is not stale at now; false when none is left.
+		bool TryPop(T& item, int64_t now) {
+			std::unique_lock<std::mutex> lock(mMutex);
+			bool found = false;
+			while (!mQueue.empty() && !found) {
+				Entry& entry = mQueue.front();
+				if (mSettings.maxAge > 0 && now - entry.timestamp > mSettings.maxAge) {
+					mStats.drops[unsigned(DropReason::StaleTimestamp)]++;
+				} else {
+					item = std::move(entry.item);
+					mStats.delivered++;
+					found = true;
+				}
+				mQueue.pop_front();
+			}
+			mRoom.notify_one();
+			UpdatePressure(lock);
+			return found;
+		}
+
+		// Drops every queued item without counting it, as for a pipeline restart.
+		void Clear() {
+			std::unique_lock<std::mutex> lock(mMutex);
+			mQueue.clear();
+			mHasNewest = false;
+			mRoom.notify_all();
+			UpdatePressure(lock);
+		}
+
+		bool IsUnderPressure() const {
+			std::lock_guard<std::mutex> lock(mMutex);
+			return mUnderPressure;
+		}
+
+		EdgeStats GetStats() const {
+			std::lock_guard<std::mutex> lock(mMutex);
+			EdgeStats stats = mStats;
+			stats.depth = unsigned(mQueue.size());
+			return stats;
+		}
+
+	private:
+		struct Entry {
+			T item;
+			int64_t timestamp;
+		};
+
+		// Releases the lock before calling out, so the callback may use the edge.
+		void UpdatePressure(std::unique_lock<std::mutex>& lock) {
+			bool pressure = mUnderPressure;
+			if (!pressure && mQueue.size() >= mSettings.highWater) {
+				pressure = true;
+				mStats.pressureEvents++;
+			} else if (pressure && mQueue.size() <= mSettings.highWater / 2) {
+				pressure = false;
+			}
+			if (pressure == mUnderPressure) {
+				return;
+			}
+			mUnderPressure = pressure;
+			PressureCallback callback = mPressureCallback;
+			lock.unlock();
+			if (callback) {
+				callback(pressure);
+			}
+		}
+
+		std::string mStage;
+		EdgeSettings mSettings;
+		mutable std::mutex mMutex;
+		std::condition_variable mRoom;
+		std::deque<Entry> mQueue;
+		int64_t mNewest;
+		bool mHasNewest;
+		bool mUnderPressure;
+		PressureCallback mPressureCallback;
+		EdgeStats mStats;
+	};
+}
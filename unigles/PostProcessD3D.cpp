@@ -0,0 +1,161 @@
+#include "pch.h"
+#include "PostProcessD3D.h"
+
+using namespace Platform;
+using namespace Microsoft::WRL;
+using namespace unigles;
+
+#pragma region Locals
+static inline void MustSucceed(HRESULT rc, const wchar_t* message) {
+	if (FAILED(rc)) {
+		throw Exception::CreateException(E_FAIL, ref new String(message));
+	}
+}
+#pragma endregion Locals
+
+PostProcessD3D::PostProcessD3D(ComPtr<ID3D11Device> device, const PostProcessPlan& plan, ResourceTracker& resources) :
+	mPlan(plan),
+	mDevice(device),
+	mResources(resources),
+	mPoolWidth(0),
+	mPoolHeight(0) {
+	for (const PostStage& stage : mPlan.stages) {
+		ComPtr<ID3DBlob> psData, errorData;
+		HRESULT rc = D3DCompile(stage.shader.c_str(), stage.shader.size(), stage.name.c_str(), nullptr, nullptr, "PS", "ps_5_0", 0, 0, psData.GetAddressOf(), errorData.GetAddressOf());
+		if (FAILED(rc)) {
+			std::string error = errorData ? static_cast<const char*>(errorData->GetBufferPointer()) : "";
+			std::wstring message = L"Failed to compile post-processing stage: " + std::wstring(error.begin(), error.end());
+			throw Exception::CreateException(E_FAIL, ref new String(message.c_str()));
+		}
+		ComPtr<ID3D11PixelShader> shader;
+		MustSucceed(mDevice->CreatePixelShader(psData->GetBufferPointer(), psData->GetBufferSize(), nullptr, shader.GetAddressOf()), L"Cannot create post-processing PS");
+		mStageShaders.push_back(shader);
+	}
+
+	mLutViews.resize(mPlan.passes.size());
+	for (size_t i = 0; i < mPlan.passes.size(); i++) {
+		const PostPass& pass = mPlan.passes[i];
+		if (pass.type != PostPassType::Lut3D) {
+			continue;
+		}
+		UINT size = pass.lutSize;
+		std::vector<float> texels(size_t(size) * size * size * 4);
+		for (size_t t = 0; t < size_t(size) * size * size; t++) {
+			texels[t * 4 + 0] = (*pass.lut)[t * 3 + 0];
+			texels[t * 4 + 1] = (*pass.lut)[t * 3 + 1];
+			texels[t * 4 + 2] = (*pass.lut)[t * 3 + 2];
+			texels[t * 4 + 3] = 1.0f;
+		}
+		D3D11_TEXTURE3D_DESC lutDesc = {};
+		lutDesc.Width = lutDesc.Height = lutDesc.Depth = size;
+		lutDesc.MipLevels = 1;
+		lutDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+		lutDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		lutDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		D3D11_SUBRESOURCE_DATA lutData = {};
+		lutData.pSysMem = texels.data();
+		lutData.SysMemPitch = size * 4 * sizeof(float);
+		lutData.SysMemSlicePitch = size * size * 4 * sizeof(float);
+		ComPtr<ID3D11Texture3D> lut;
+		MustSucceed(mDevice->CreateTexture3D(&lutDesc, &lutData, lut.GetAddressOf()), L"Failed to create LUT texture");
+		MustSucceed(mDevice->CreateShaderResourceView(lut.Get(), nullptr, mLutViews[i].GetAddressOf()), L"Failed to create LUT view");
+		mLutMemory.push_back(mResources.Track(ResourceHeap::D3D, "Post-processing LUTs", "RGBA32F", ImageBytes(size, size, 16) * size,
+			pass.name));
+	}
+
+	D3D11_BUFFER_DESC constantsDesc = {};
+	constantsDesc.ByteWidth = UINT((mPlan.constants.size() * sizeof(float) + 15) & ~size_t(15));
+	constantsDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	constantsDesc.Usage = D3D11_USAGE_DEFAULT;
+	MustSucceed(mDevice->CreateBuffer(&constantsDesc, nullptr, mConstants.GetAddressOf()), L"Failed to create post-processing constants");
+
+	D3D11_SAMPLER_DESC samplerDesc = {};
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	MustSucceed(mDevice->CreateSamplerState(&samplerDesc, mLinearSampler.GetAddressOf()), L"Failed to create sampler state");
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	MustSucceed(mDevice->CreateSamplerState(&samplerDesc, mLutSampler.GetAddressOf()), L"Failed to create LUT sampler state");
+}
+
+PostProcessD3D::~PostProcessD3D() {}
+
+void PostProcessD3D::EnsureTargets(UINT width, UINT height) {
+	if (mPoolWidth == width && mPoolHeight == height && mPoolTextures.size() == mPlan.poolSize) {
+		return;
+	}
+
+	mPoolWidth = width;
+	mPoolHeight = height;
+	mPoolTextures.resize(mPlan.poolSize);
+	mPoolTargets.resize(mPlan.poolSize);
+	mPoolViews.resize(mPlan.poolSize);
+
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = width;
+	texDesc.Height = height;
+	texDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	for (unsigned i = 0; i < mPlan.poolSize; i++) {
+		MustSucceed(mDevice->CreateTexture2D(&texDesc, nullptr, mPoolTextures[i].ReleaseAndGetAddressOf()), L"Failed to create post-processing target");
+		MustSucceed(mDevice->CreateRenderTargetView(mPoolTextures[i].Get(), nullptr, mPoolTargets[i].ReleaseAndGetAddressOf()), L"Failed to create post-processing target view");
+		MustSucceed(mDevice->CreateShaderResourceView(mPoolTextures[i].Get(), nullptr, mPoolViews[i].ReleaseAndGetAddressOf()), L"Failed to create post-processing resource view");
+	}
+	uint64_t bytes = ImageBytes(width, height, 4) * mPlan.poolSize;
+	if (!mPoolMemory.IsTracked()) {
+		mPoolMemory = mResources.Track(ResourceHeap::D3D, "Post-processing targets", "BGRA8", bytes, "pool");
+	} else {
+		mPoolMemory.Resize(bytes);
+	}
+}
+
+void PostProcessD3D::Execute(ComPtr<ID3D11DeviceContext> context, ID3D11ShaderResourceView* lum, ID3D11ShaderResourceView* chrom,
+	ID3D11RenderTargetView* target, UINT width, UINT height) {
+	EnsureTargets(width, height);
+	mPlan.SetInputSize(width, height);
+	context->UpdateSubresource(mConstants.Get(), 0, nullptr, mPlan.constants.data(), 0, 0);
+	context->PSSetConstantBuffers(0, 1, mConstants.GetAddressOf());
+	ID3D11SamplerState* samplers[] = { mLinearSampler.Get(), mLutSampler.Get() };
+	context->PSSetSamplers(0, 2, samplers);
+
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (FLOAT)width;
+	viewport.Height = (FLOAT)height;
+	viewport.MaxDepth = 1;
+	context->RSSetViewports(1, &viewport);
+
+	for (size_t s = 0; s < mPlan.stages.size(); s++) {
+		const PostStage& stage = mPlan.stages[s];
+		// Unbind the previous input first so it can become this stage's target.
+		ID3D11ShaderResourceView* inputs[2] = { nullptr, nullptr };
+		context->PSSetShaderResources(0, 2, inputs);
+		ID3D11RenderTargetView* output = stage.output == PostStage::External ? target : mPoolTargets[stage.output].Get();
+		context->OMSetRenderTargets(1, &output, nullptr);
+		if (stage.input == PostStage::External) {
+			inputs[0] = lum;
+			inputs[1] = chrom;
+		} else {
+			inputs[0] = mPoolViews[stage.input].Get();
+		}
+		context->PSSetShaderResources(0, 2, inputs);
+		for (unsigned index : stage.fused) {
+			if (mPlan.lutRegister[index] >= 0) {
+				context->PSSetShaderResources(mPlan.lutRegister[index], 1, mLutViews[index].GetAddressOf());
+			}
+		}
+		context->PSSetShader(mStageShaders[s].Get(), nullptr, 0);
+		context->Draw(3, 0);
+	}
+
+	ID3D11ShaderResourceView* inputs[2] = { nullptr, nullptr };
+	context->PSSetShaderResources(0, 2, inputs);
+}
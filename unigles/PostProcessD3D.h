@@ -0,0 +1,41 @@
+#pragma once
+
+#include "PostProcessGraph.h"
+#include "ResourceTracker.h"
+
+// Direct3D 11 backend for a compiled PostProcessPlan. Each stage becomes one
+// full screen draw; intermediates come from a pool sized by the plan's lifetime analysis.
+class PostProcessD3D {
+public:
+	PostProcessD3D(Microsoft::WRL::ComPtr<ID3D11Device> device, const unigles::PostProcessPlan& plan, unigles::ResourceTracker& resources);
+	virtual ~PostProcessD3D();
+
+	// Runs every stage. The caller's full screen triangle (vertex shader, input layout
+	// and vertex buffer) must already be bound. For NV12 plans the first stage reads
+	// the two plane views; for RGB plans it reads lum as an RGB texture.
+	void Execute(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, ID3D11ShaderResourceView* lum, ID3D11ShaderResourceView* chrom,
+		ID3D11RenderTargetView* target, UINT width, UINT height);
+
+	const unigles::PostProcessPlan& GetPlan() const { return mPlan; }
+	// Render targets currently held by the pool.
+	size_t GetPoolSize() const { return mPoolTextures.size(); }
+
+private:
+	void EnsureTargets(UINT width, UINT height);
+
+	unigles::PostProcessPlan mPlan;
+	Microsoft::WRL::ComPtr<ID3D11Device> mDevice;
+	unigles::ResourceTracker& mResources;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11PixelShader>> mStageShaders;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> mLutViews;
+	std::vector<unigles::TrackedResource> mLutMemory;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> mConstants;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> mLinearSampler;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> mLutSampler;
+
+	std::vector<Microsoft::WRL::ComPtr<ID3D11Texture2D>> mPoolTextures;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11RenderTargetView>> mPoolTargets;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> mPoolViews;
+	unigles::TrackedResource mPoolMemory;
+	UINT mPoolWidth, mPoolHeight;
+};
@@ -0,0 +1,341 @@
+#include "PostProcessGraph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+using namespace unigles;
+
+static void WriteFetchHelpers(std::ostringstream& out, PostSource source, bool readsSource) {
+	out << "struct VS_OUTPUT {\n"
+		"\tfloat4 Pos : SV_POSITION;\n"
+		"\tfloat2 TexCoord : TEXCOORD;\n"
+		"};\n";
+	if (readsSource && source == PostSource::Nv12) {
+		// Same conversion as the fixed TextureBridge shader.
+		out << "Texture2D LumTexture : register(t0);\n"
+			"Texture2D ChromTexture : register(t1);\n"
+			"float3 ConvertYuv(float2 uv) {\n"
+			"\tfloat lum = LumTexture.Sample(ObjSamplerState, uv).r;\n"
+			"\tfloat2 chrom = ChromTexture.Sample(ObjSamplerState, uv).rg;\n"
+			"\tfloat b = 1.164 * (lum - 16.0 / 256) + 2.018 * (chrom.x - 128.0 / 256);\n"
+			"\tfloat g = 1.164 * (lum - 16.0 / 256) - 0.813 * (chrom.y - 128.0 / 256) - 0.391 * (chrom.x - 128.0 / 256);\n"
+			"\tfloat r = 1.164 * (lum - 16.0 / 256) + 1.596 * (chrom.y - 128.0 / 256);\n"
+			"\treturn float3(r, g, b);\n"
+			"}\n";
+	} else {
+		out << "Texture2D InputTexture : register(t0);\n"
+			"float3 Fetch(float2 pos, int2 offset) {\n"
+			"\tint2 p = clamp(int2(pos) + offset, int2(0, 0), int2(InputSize.xy) - 1);\n"
+			"\treturn InputTexture.Load(int3(p, 0)).rgb;\n"
+			"}\n";
+	}
+}
+
+static void WritePerPixelFunction(std::ostringstream& out, const PostPass& pass, unsigned index, int lutRegister) {
+	unsigned base = index * 3;
+	switch (pass.type) {
+	case PostPassType::ColorCorrection:
+		out << "float3 Pass" << index << "(float3 c) {\n"
+			"\tfloat4 a = Params[" << base << "];\n"
+			"\tfloat4 b = Params[" << base + 1 << "];\n"
+			"\tc = c * a.rgb + b.rgb;\n"
+			"\tc = (c - 0.5) * a.w + 0.5;\n"
+			"\tfloat l = dot(c, float3(0.2126, 0.7152, 0.0722));\n"
+			"\treturn lerp(float3(l, l, l), c, b.w);\n"
+			"}\n";
+		break;
+	case PostPassType::Lut3D:
+		out << "Texture3D Lut" << index << " : register(t" << lutRegister << ");\n"
+			"float3 Pass" << index << "(float3 c) {\n"
+			"\tfloat4 a = Params[" << base << "];\n"
+			"\treturn Lut" << index << ".SampleLevel(LutSamplerState, saturate(c) * a.x + a.y, 0).rgb;\n"
+			"}\n";
+		break;
+	default:
+		break;
+	}
+}
+
+static void WriteHead(std::ostringstream& out, const PostProcessPlan& plan, const PostStage& stage) {
+	if (stage.head < 0) {
+		if (stage.input == PostStage::External && plan.source == PostSource::Nv12) {
+			out << "\tfloat3 c = ConvertYuv(vsData.TexCoord);\n";
+		} else {
+			out << "\tfloat3 c = Fetch(vsData.Pos.xy, int2(0, 0));\n";
+		}
+		return;
+	}
+
+	unsigned base = unsigned(stage.head) * 3;
+	const PostPass& pass = plan.passes[stage.head];
+	switch (pass.type) {
+	case PostPassType::Sharpen:
+		out << "\tfloat3 center = Fetch(vsData.Pos.xy, int2(0, 0));\n"
+			"\tfloat3 around = Fetch(vsData.Pos.xy, int2(-1, 0)) + Fetch(vsData.Pos.xy, int2(1, 0))"
+			" + Fetch(vsData.Pos.xy, int2(0, -1)) + Fetch(vsData.Pos.xy, int2(0, 1));\n"
+			"\tfloat3 c = center + Params[" << base << "].x * (4.0 * center - around);\n";
+		break;
+	case PostPassType::BlurHorizontal:
+	case PostPassType::BlurVertical: {
+		bool horizontal = pass.type == PostPassType::BlurHorizontal;
+		out << "\tfloat4 w0 = Params[" << base << "];\n"
+			"\tfloat4 w1 = Params[" << base + 1 << "];\n"
+			"\tfloat3 c = w0.x * Fetch(vsData.Pos.xy, int2(0, 0));\n";
+		const char* weights[] = { "w0.x", "w0.y", "w0.z", "w0.w", "w1.x" };
+		for (int k = 1; k <= PostPass::BlurRadius; k++) {
+			int dx = horizontal ? k : 0;
+			int dy = horizontal ? 0 : k;
+			out << "\tc += " << weights[k] << " * (Fetch(vsData.Pos.xy, int2(" << -dx << ", " << -dy << "))"
+				" + Fetch(vsData.Pos.xy, int2(" << dx << ", " << dy << ")));\n";
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+static std::string GenerateStageShader(const PostProcessPlan& plan, const PostStage& stage) {
+	std::ostringstream out;
+	out << "SamplerState ObjSamplerState : register(s0);\n"
+		"SamplerState LutSamplerState : register(s1);\n"
+		"cbuffer PostParams : register(b0) {\n"
+		"\tfloat4 InputSize;\n"
+		"\tfloat4 Params[" << std::max<size_t>(1, plan.passes.size() * 3) << "];\n"
+		"};\n";
+	WriteFetchHelpers(out, plan.source, stage.input == PostStage::External);
+	for (unsigned index : stage.fused) {
+		WritePerPixelFunction(out, plan.passes[index], index, plan.lutRegister[index]);
+	}
+	out << "float4 PS(VS_OUTPUT vsData) : SV_TARGET {\n";
+	WriteHead(out, plan, stage);
+	for (unsigned index : stage.fused) {
+		out << "\tc = Pass" << index << "(c);\n";
+	}
+	out << "\treturn float4(saturate(c), 1.0);\n"
+		"}\n";
+	return out.str();
+}
+
+unsigned PostPass::FetchesPerPixel() const {
+	switch (type) {
+	case PostPassType::Lut3D:
+		return 1;
+	case PostPassType::Sharpen:
+		return 5;
+	case PostPassType::BlurHorizontal:
+	case PostPassType::BlurVertical:
+		return 2 * PostPass::BlurRadius + 1;
+	default:
+		return 0;
+	}
+}
+
+void PostProcessPlan::SetInputSize(unsigned width, unsigned height) {
+	if (constants.size() < PostProcessPlan::ParamsOffset) {
+		constants.resize(PostProcessPlan::ParamsOffset, 0.0f);
+	}
+	constants[0] = float(width);
+	constants[1] = float(height);
+	constants[2] = width ? 1.0f / float(width) : 0.0f;
+	constants[3] = height ? 1.0f / float(height) : 0.0f;
+}
+
+PostPass& PostProcessGraph::AddPass(const std::string& name, PostPassType type) {
+	PostPass pass;
+	pass.name = name;
+	pass.type = type;
+	std::fill(pass.params, pass.params + PostPass::ParamCount, 0.0f);
+	pass.lutSize = 0;
+	mPasses.push_back(pass);
+	return mPasses.back();
+}
+
+PostProcessGraph& PostProcessGraph::AddColorCorrection(const std::string& name, const ColorCorrection& correction) {
+	PostPass& pass = AddPass(name, PostPassType::ColorCorrection);
+	float scale = std::pow(2.0f, correction.exposure);
+	for (int i = 0; i < 3; i++) {
+		pass.params[i] = correction.gain[i] * scale;
+		pass.params[4 + i] = correction.lift[i];
+	}
+	pass.params[3] = correction.contrast;
+	pass.params[7] = correction.saturation;
+	return *this;
+}
+
+PostProcessGraph& PostProcessGraph::AddLut(const std::string& name, unsigned size, std::shared_ptr<const std::vector<float>> table) {
+	if (size < 2 || !table || table->size() < size_t(size) * size * size * 3) {
+		throw std::invalid_argument("LUT table does not match its size");
+	}
+	PostPass& pass = AddPass(name, PostPassType::Lut3D);
+	pass.lutSize = size;
+	pass.lut = table;
+	// Maps 0..1 onto the centres of the first and last texels.
+	pass.params[0] = float(size - 1) / float(size);
+	pass.params[1] = 0.5f / float(size);
+	return *this;
+}
+
+PostProcessGraph& PostProcessGraph::AddSharpen(const std::string& name, float amount) {
+	PostPass& pass = AddPass(name, PostPassType::Sharpen);
+	pass.params[0] = amount;
+	return *this;
+}
+
+PostProcessGraph& PostProcessGraph::AddBlur(const std::string& name, float sigma) {
+	float weights[PostPass::BlurRadius + 1];
+	float total = 0.0f;
+	sigma = std::max(sigma, 0.01f);
+	for (int k = 0; k <= PostPass::BlurRadius; k++) {
+		weights[k] = std::exp(-float(k * k) / (2.0f * sigma * sigma));
+		total += k ? 2.0f * weights[k] : weights[k];
+	}
+	PostPassType types[] = { PostPassType::BlurHorizontal, PostPassType::BlurVertical };
+	const char* suffixes[] = { ".h", ".v" };
+	for (int i = 0; i < 2; i++) {
+		PostPass& pass = AddPass(name + suffixes[i], types[i]);
+		for (int k = 0; k <= PostPass::BlurRadius; k++) {
+			pass.params[k] = weights[k] / total;
+		}
+	}
+	return *this;
+}
+
+PostProcessPlan PostProcessGraph::Compile(PostSource source) const {
+	PostProcessPlan plan;
+	plan.source = source;
+	plan.passes = mPasses;
+	if (mPasses.empty()) {
+		return plan;
+	}
+
+	// Registers t0/t1 hold the stage input, LUTs follow.
+	int nextRegister = 2;
+	plan.lutRegister.assign(mPasses.size(), -1);
+	plan.constants.assign(PostProcessPlan::ParamsOffset + mPasses.size() * PostPass::ParamCount, 0.0f);
+	for (size_t i = 0; i < mPasses.size(); i++) {
+		if (mPasses[i].type == PostPassType::Lut3D) {
+			plan.lutRegister[i] = nextRegister++;
+		}
+		std::copy(mPasses[i].params, mPasses[i].params + PostPass::ParamCount, plan.constants.begin() + PostProcessPlan::ParamsOffset + i * PostPass::ParamCount);
+	}
+
+	// Every neighbourhood pass needs its input materialized, so it opens a new stage;
+	// per-pixel passes ride along with whatever stage is open.
+	plan.stages.push_back(PostStage());
+	for (unsigned i = 0; i < mPasses.size(); i++) {
+		PostStage& current = plan.stages.back();
+		if (mPasses[i].IsPerPixel()) {
+			current.fused.push_back(i);
+		} else if (plan.stages.size() == 1 && current.head < 0 && current.fused.empty() && source == PostSource::Rgb) {
+			current.head = int(i);
+		} else {
+			PostStage next;
+			next.head = int(i);
+			plan.stages.push_back(next);
+		}
+	}
+
+	// Lifetime analysis: the output of stage s is last read by stage s + 1, so its
+	// target returns to the pool once that stage has been assigned its own output.
+	std::vector<int> freeSlots;
+	int previousOutput = PostStage::External;
+	for (size_t s = 0; s < plan.stages.size(); s++) {
+		PostStage& stage = plan.stages[s];
+		stage.input = previousOutput;
+		if (s + 1 < plan.stages.size()) {
+			if (freeSlots.empty()) {
+				stage.output = int(plan.poolSize++);
+			} else {
+				stage.output = freeSlots.back();
+				freeSlots.pop_back();
+			}
+		}
+		if (stage.input != PostStage::External) {
+			freeSlots.push_back(stage.input);
+		}
+		previousOutput = stage.output;
+	}
+
+	unsigned sourceBytes = source == PostSource::Nv12 ? 2 : 4;
+	for (size_t s = 0; s < plan.stages.size(); s++) {
+		PostStage& stage = plan.stages[s];
+		std::ostringstream name;
+		if (stage.head >= 0) {
+			name << mPasses[stage.head].name;
+			stage.fetchesPerPixel = mPasses[stage.head].FetchesPerPixel();
+			plan.costs.push_back(PostPassCost{ mPasses[stage.head].name, stage.fetchesPerPixel, unsigned(s) });
+		} else {
+			name << (stage.input == PostStage::External && source == PostSource::Nv12 ? "convert" : "copy");
+			stage.fetchesPerPixel = stage.input == PostStage::External && source == PostSource::Nv12 ? 2 : 1;
+		}
+		for (unsigned index : stage.fused) {
+			name << "+" << mPasses[index].name;
+			stage.fetchesPerPixel += mPasses[index].FetchesPerPixel();
+			plan.costs.push_back(PostPassCost{ mPasses[index].name, mPasses[index].FetchesPerPixel(), unsigned(s) });
+		}
+		stage.name = name.str();
+		stage.shader = GenerateStageShader(plan, stage);
+	}
+
+	plan.fusedBytesPerPixel = sourceBytes + 4 + 8 * unsigned(plan.stages.size() - 1);
+	plan.unfusedBytesPerPixel = source == PostSource::Nv12 ?
+		sourceBytes + 4 + 8 * unsigned(mPasses.size()) :
+		8 * unsigned(mPasses.size());
+	return plan;
+}
+
+bool unigles::ParsePostProcessGraph(const std::string& text, PostProcessGraph& graph, std::string* error) {
+	std::istringstream lines(text);
+	std::string line;
+	unsigned number = 0;
+	while (std::getline(lines, line)) {
+		number++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) {
+			line.erase(comment);
+		}
+		std::istringstream fields(line);
+		std::string type;
+		if (!(fields >> type)) {
+			continue;
+		}
+		std::string name;
+		std::string extra;
+		bool valid = bool(fields >> name);
+		if (valid && type == "color") {
+			ColorCorrection correction;
+			valid = bool(fields >> correction.exposure >> correction.contrast >> correction.saturation);
+			// The gain and lift triplets are optional, but only as a whole.
+			for (float* triplet : { correction.gain, correction.lift }) {
+				if (valid && fields >> extra) {
+					std::istringstream value(extra);
+					valid = bool(value >> triplet[0]) && value.eof() && bool(fields >> triplet[1] >> triplet[2]);
+				}
+			}
+			if (valid && !(fields >> extra)) {
+				graph.AddColorCorrection(name, correction);
+				continue;
+			}
+		} else if (valid && (type == "sharpen" || type == "blur")) {
+			float value = 0.0f;
+			if (fields >> value && !(fields >> extra)) {
+				if (type == "sharpen") {
+					graph.AddSharpen(name, value);
+				} else {
+					graph.AddBlur(name, value);
+				}
+				continue;
+			}
+		}
+		if (error) {
+			std::ostringstream message;
+			message << "line " << number << ": expected color, sharpen or blur, a name and the pass's values";
+			*error = message.str();
+		}
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	enum class PostPassType {
+		ColorCorrection,
+		Lut3D,
+		Sharpen,
+		BlurHorizontal,
+		BlurVertical,
+	};
+
+	// Where the first stage of a compiled graph reads from.
+	enum class PostSource {
+		Rgb,	// An RGB texture or image
+		Nv12,	// Luma and chroma planes; the YUV conversion becomes part of the first stage
+	};
+
+	struct ColorCorrection {
+		float exposure = 0.0f;		// In stops
+		float contrast = 1.0f;		// Around mid grey
+		float saturation = 1.0f;
+		float gain[3] = { 1.0f, 1.0f, 1.0f };
+		float lift[3] = { 0.0f, 0.0f, 0.0f };
+	};
+
+	struct PostPass {
+		// Number of floats every pass owns in the constant block (three float4 registers).
+		static const unsigned ParamCount = 12;
+		// Blur passes read the centre plus this many texels on each side.
+		static const int BlurRadius = 4;
+
+		std::string name;
+		PostPassType type;
+		float params[ParamCount];
+		// Lut3D only: lutSize^3 RGB triplets, red varying fastest.
+		unsigned lutSize;
+		std::shared_ptr<const std::vector<float>> lut;
+
+		// Per-pixel passes only look at the pixel they write and can be fused after any other pass.
+		bool IsPerPixel() const { return type == PostPassType::ColorCorrection || type == PostPassType::Lut3D; }
+		// Texel fetches one output pixel costs, for the cost report.
+		unsigned FetchesPerPixel() const;
+	};
+
+	// One draw of a compiled graph: an optional neighborhood pass that reads the
+	// input texture, followed by any number of fused per-pixel passes.
+	struct PostStage {
+		static const int External = -1;
+
+		int head = -1;					// Index into PostProcessPlan::passes, -1 for a plain read
+		std::vector<unsigned> fused;	// Per-pixel passes applied after the head
+		int input = External;			// Pool slot the stage reads, External for the graph source
+		int output = External;			// Pool slot the stage writes, External for the graph target
+		std::string name;
+		std::string shader;				// Generated HLSL pixel shader, entry point "PS"
+		unsigned fetchesPerPixel = 0;
+	};
+
+	struct PostPassCost {
+		std::string name;
+		unsigned fetchesPerPixel;
+		unsigned stage;
+	};
+
+	struct PostProcessPlan {
+		// Floats ahead of the first pass parameter in the constant block (InputSize).
+		static const unsigned ParamsOffset = 4;
+
+		PostSource source = PostSource::Rgb;
+		std::vector<PostPass> passes;
+		std::vector<PostStage> stages;
+		// Render targets the stages need at the same time, after lifetime analysis.
+		unsigned poolSize = 0;
+		// Constant block shared by every stage: float4 InputSize followed by ParamCount floats per pass.
+		std::vector<float> constants;
+		// Texture register of each pass's LUT, -1 for passes without one.
+		std::vector<int> lutRegister;
+		std::vector<PostPassCost> costs;
+		// Estimated memory traffic per output pixel with fusion, and with one draw per pass.
+		unsigned fusedBytesPerPixel = 0;
+		unsigned unfusedBytesPerPixel = 0;
+
+		bool Empty() const { return stages.empty(); }
+		// Stores the input dimensions the Fetch() helper clamps against.
+		void SetInputSize(unsigned width, unsigned height);
+	};
+
+	// Declarative list of image operations applied to the camera image.
+	// Compile() fuses per-pixel passes into the neighbouring draw, generates one HLSL
+	// pixel shader per remaining draw and assigns intermediates to a pool of targets.
+	class PostProcessGraph {
+	public:
+		PostProcessGraph& AddColorCorrection(const std::string& name, const ColorCorrection& correction);
+		PostProcessGraph& AddLut(const std::string& name, unsigned size, std::shared_ptr<const std::vector<float>> table);
+		// Unsharp mask over the four direct neighbours.
+		PostProcessGraph& AddSharpen(const std::string& name, float amount);
+		// Separable 9-tap Gaussian; it becomes a horizontal and a vertical pass.
+		PostProcessGraph& AddBlur(const std::string& name, float sigma);
+
+		const std::vector<PostPass>& GetPasses() const { return mPasses; }
+		bool Empty() const { return mPasses.empty(); }
+
+		PostProcessPlan Compile(PostSource source) const;
+
+	private:
+		PostPass& AddPass(const std::string& name, PostPassType type);
+
+		std::vector<PostPass> mPasses;
+	};
+
+	// One pass per line, in order, as a type, a name and the type's values separated by
+	// whitespace; '#' starts a comment:
+	//   color <name> <exposure> <contrast> <saturation> [<gain r g b> [<lift r g b>]]
+	//   sharpen <name> <amount>
+	//   blur <name> <sigma>
+	// LUTs need their tables and can only be added in code. Appends to graph; returns
+	// false with the offending line in error.
+	bool ParsePostProcessGraph(const std::string& text, PostProcessGraph& graph, std::string* error = nullptr);
+}
@@ -0,0 +1,177 @@
+#include "PostProcessInterpreter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+using namespace unigles;
+
+static inline float Saturate(float v) {
+	return std::min(1.0f, std::max(0.0f, v));
+}
+
+static inline float Quantize(float v) {
+	return std::floor(Saturate(v) * 255.0f + 0.5f) / 255.0f;
+}
+
+static void Fetch(const PostImage& image, int x, int y, float* c) {
+	x = std::min(int(image.width) - 1, std::max(0, x));
+	y = std::min(int(image.height) - 1, std::max(0, y));
+	const float* p = image.At(unsigned(x), unsigned(y));
+	c[0] = p[0];
+	c[1] = p[1];
+	c[2] = p[2];
+}
+
+static float SampleChroma(const uint8_t* chroma, size_t stride, unsigned width, unsigned height, float u, float v, int channel) {
+	// Bilinear, like the GPU sampler on the half resolution chroma plane.
+	float x = u * width - 0.5f;
+	float y = v * height - 0.5f;
+	int x0 = int(std::floor(x));
+	int y0 = int(std::floor(y));
+	float fx = x - x0;
+	float fy = y - y0;
+	auto at = [&](int xi, int yi) {
+		xi = std::min(int(width) - 1, std::max(0, xi));
+		yi = std::min(int(height) - 1, std::max(0, yi));
+		return float(chroma[yi * stride + xi * 2 + channel]) / 255.0f;
+	};
+	float top = at(x0, y0) * (1 - fx) + at(x0 + 1, y0) * fx;
+	float bottom = at(x0, y0 + 1) * (1 - fx) + at(x0 + 1, y0 + 1) * fx;
+	return top * (1 - fy) + bottom * fy;
+}
+
+PostProcessInterpreter::PostProcessInterpreter(const PostProcessPlan& plan) :
+	mPlan(plan),
+	mPool(plan.poolSize) {}
+
+void PostProcessInterpreter::Execute(const PostImage& input, PostImage& output) {
+	if (mPlan.source != PostSource::Rgb) {
+		throw std::invalid_argument("Plan expects NV12 input");
+	}
+	Run(&input, nullptr, input.width, input.height, output);
+}
+
+void PostProcessInterpreter::Execute(const uint8_t* luma, size_t lumaStride, const uint8_t* chroma, size_t chromaStride,
+	unsigned width, unsigned height, PostImage& output) {
+	if (mPlan.source != PostSource::Nv12) {
+		throw std::invalid_argument("Plan expects RGB input");
+	}
+	Nv12Source source = { luma, lumaStride, chroma, chromaStride };
+	Run(nullptr, &source, width, height, output);
+}
+
+void PostProcessInterpreter::Run(const PostImage* rgbSource, const Nv12Source* nv12Source, unsigned width, unsigned height, PostImage& output) {
+	mPlan.SetInputSize(width, height);
+	mTimings.clear();
+	for (auto& target : mPool) {
+		target.Resize(width, height);
+	}
+	output.Resize(width, height);
+	for (const PostStage& stage : mPlan.stages) {
+		auto start = std::chrono::steady_clock::now();
+		const PostImage* input = stage.input == PostStage::External ? rgbSource : &mPool[stage.input];
+		PostImage& target = stage.output == PostStage::External ? output : mPool[stage.output];
+		RunStage(stage, input, stage.input == PostStage::External ? nv12Source : nullptr, target);
+		auto end = std::chrono::steady_clock::now();
+		mTimings.push_back(PostStageTiming{ stage.name, std::chrono::duration<double, std::milli>(end - start).count() });
+	}
+}
+
+void PostProcessInterpreter::ApplyPerPixel(unsigned index, float* c) const {
+	const PostPass& pass = mPlan.passes[index];
+	const float* p = &mPlan.constants[PostProcessPlan::ParamsOffset + index * PostPass::ParamCount];
+	if (pass.type == PostPassType::ColorCorrection) {
+		for (int i = 0; i < 3; i++) {
+			c[i] = c[i] * p[i] + p[4 + i];
+			c[i] = (c[i] - 0.5f) * p[3] + 0.5f;
+		}
+		float l = 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+		for (int i = 0; i < 3; i++) {
+			c[i] = l + (c[i] - l) * p[7];
+		}
+	} else if (pass.type == PostPassType::Lut3D) {
+		// Trilinear lookup at the same coordinates the shader samples.
+		int n = int(pass.lutSize);
+		float t[3];
+		int i0[3];
+		for (int i = 0; i < 3; i++) {
+			float coord = Saturate(c[i]) * p[0] + p[1];
+			float texel = std::min(float(n - 1), std::max(0.0f, coord * n - 0.5f));
+			i0[i] = std::min(n - 2, int(texel));
+			t[i] = texel - i0[i];
+		}
+		const std::vector<float>& lut = *pass.lut;
+		float result[3] = { 0, 0, 0 };
+		for (int corner = 0; corner < 8; corner++) {
+			int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+			float w = (dx ? t[0] : 1 - t[0]) * (dy ? t[1] : 1 - t[1]) * (dz ? t[2] : 1 - t[2]);
+			size_t entry = ((size_t(i0[2] + dz) * n + (i0[1] + dy)) * n + (i0[0] + dx)) * 3;
+			for (int i = 0; i < 3; i++) {
+				result[i] += w * lut[entry + i];
+			}
+		}
+		c[0] = result[0];
+		c[1] = result[1];
+		c[2] = result[2];
+	}
+}
+
+void PostProcessInterpreter::RunStage(const PostStage& stage, const PostImage* input, const Nv12Source* nv12Source, PostImage& output) {
+	const PostPass* head = stage.head >= 0 ? &mPlan.passes[stage.head] : nullptr;
+	const float* p = head ? &mPlan.constants[PostProcessPlan::ParamsOffset + stage.head * PostPass::ParamCount] : nullptr;
+	unsigned width = output.width;
+	unsigned height = output.height;
+	for (unsigned y = 0; y < height; y++) {
+		for (unsigned x = 0; x < width; x++) {
+			float c[3];
+			int xi = int(x), yi = int(y);
+			if (nv12Source) {
+				float u = (x + 0.5f) / width;
+				float v = 1.0f - (y + 0.5f) / height;
+				float lum = nv12Source->luma[(height - 1 - y) * nv12Source->lumaStride + x] / 255.0f;
+				float cb = SampleChroma(nv12Source->chroma, nv12Source->chromaStride, (width + 1) / 2, (height + 1) / 2, u, v, 0);
+				float cr = SampleChroma(nv12Source->chroma, nv12Source->chromaStride, (width + 1) / 2, (height + 1) / 2, u, v, 1);
+				c[2] = 1.164f * (lum - 16.0f / 256) + 2.018f * (cb - 128.0f / 256);
+				c[1] = 1.164f * (lum - 16.0f / 256) - 0.813f * (cr - 128.0f / 256) - 0.391f * (cb - 128.0f / 256);
+				c[0] = 1.164f * (lum - 16.0f / 256) + 1.596f * (cr - 128.0f / 256);
+			} else if (!head) {
+				Fetch(*input, xi, yi, c);
+			} else if (head->type == PostPassType::Sharpen) {
+				float center[3], n[3], s[3], e[3], w[3];
+				Fetch(*input, xi, yi, center);
+				Fetch(*input, xi - 1, yi, w);
+				Fetch(*input, xi + 1, yi, e);
+				Fetch(*input, xi, yi - 1, n);
+				Fetch(*input, xi, yi + 1, s);
+				for (int i = 0; i < 3; i++) {
+					c[i] = center[i] + p[0] * (4.0f * center[i] - (w[i] + e[i] + n[i] + s[i]));
+				}
+			} else {
+				bool horizontal = head->type == PostPassType::BlurHorizontal;
+				Fetch(*input, xi, yi, c);
+				for (int i = 0; i < 3; i++) {
+					c[i] *= p[0];
+				}
+				for (int k = 1; k <= PostPass::BlurRadius; k++) {
+					float a[3], b[3];
+					int dx = horizontal ? k : 0;
+					int dy = horizontal ? 0 : k;
+					Fetch(*input, xi - dx, yi - dy, a);
+					Fetch(*input, xi + dx, yi + dy, b);
+					for (int i = 0; i < 3; i++) {
+						c[i] += p[k] * (a[i] + b[i]);
+					}
+				}
+			}
+			for (unsigned index : stage.fused) {
+				ApplyPerPixel(index, c);
+			}
+			float* out = output.At(x, y);
+			out[0] = Quantize(c[0]);
+			out[1] = Quantize(c[1]);
+			out[2] = Quantize(c[2]);
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "PostProcessGraph.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	struct PostImage {
+		unsigned width = 0;
+		unsigned height = 0;
+		// Three floats per pixel, rows top to bottom.
+		std::vector<float> rgb;
+
+		void Resize(unsigned w, unsigned h) { width = w; height = h; rgb.resize(size_t(w) * h * 3); }
+		float* At(unsigned x, unsigned y) { return &rgb[(size_t(y) * width + x) * 3]; }
+		const float* At(unsigned x, unsigned y) const { return &rgb[(size_t(y) * width + x) * 3]; }
+	};
+
+	struct PostStageTiming {
+		std::string name;
+		double milliseconds;
+	};
+
+	// Executes a compiled plan on the CPU with the same stage split, pool slots and
+	// arithmetic as the generated shaders, so graph compilation and fusion can be
+	// checked without a GPU. Intermediates are rounded to 8 bits like the BGRA targets.
+	class PostProcessInterpreter {
+	public:
+		explicit PostProcessInterpreter(const PostProcessPlan& plan);
+
+		// For plans compiled with PostSource::Rgb.
+		void Execute(const PostImage& input, PostImage& output);
+		// For plans compiled with PostSource::Nv12. Like the conversion draw, row 0 of
+		// the output comes from the bottom row of the planes.
+		void Execute(const uint8_t* luma, size_t lumaStride, const uint8_t* chroma, size_t chromaStride,
+			unsigned width, unsigned height, PostImage& output);
+
+		const std::vector<PostStageTiming>& GetTimings() const { return mTimings; }
+		const PostProcessPlan& GetPlan() const { return mPlan; }
+
+	private:
+		struct Nv12Source {
+			const uint8_t* luma;
+			size_t lumaStride;
+			const uint8_t* chroma;
+			size_t chromaStride;
+		};
+
+		void Run(const PostImage* rgbSource, const Nv12Source* nv12Source, unsigned width, unsigned height, PostImage& output);
+		void RunStage(const PostStage& stage, const PostImage* input, const Nv12Source* nv12Source, PostImage& output);
+		void ApplyPerPixel(unsigned index, float* c) const;
+
+		PostProcessPlan mPlan;
+		std::vector<PostImage> mPool;
+		std::vector<PostStageTiming> mTimings;
+	};
+}
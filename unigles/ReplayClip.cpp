@@ -0,0 +1,189 @@
+#include "ReplayClip.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+using namespace unigles;
+
+Nv12Clip::Nv12Clip() :
+	mWidth(0),
+	mHeight(0),
+	mFrameCount(0),
+	mFrameBytes(0),
+	mFramesPerSecond(30.0) {
+}
+
+bool Nv12Clip::Open(const std::string& path, unsigned width, unsigned height, double framesPerSecond) {
+	Close();
+	if (width == 0 || height == 0 || framesPerSecond <= 0.0 || !mFile.Open(path)) {
+		return false;
+	}
+	size_t frameBytes = size_t(width) * height + size_t((width + 1) / 2) * 2 * ((height + 1) / 2);
+	if (mFile.GetSize() % frameBytes != 0) {
+		mFile.Close();
+		return false;
+	}
+	mWidth = width;
+	mHeight = height;
+	mFrameBytes = frameBytes;
+	mFrameCount = unsigned(mFile.GetSize() / frameBytes);
+	mFramesPerSecond = framesPerSecond;
+	return true;
+}
+
+void Nv12Clip::Close() {
+	mFile.Close();
+	mWidth = 0;
+	mHeight = 0;
+	mFrameCount = 0;
+	mFrameBytes = 0;
+}
+
+bool Nv12Clip::ReadFrame(unsigned index, Nv12Frame& frame) const {
+	if (index >= mFrameCount) {
+		return false;
+	}
+	const uint8_t* luma = mFile.GetData() + size_t(index) * mFrameBytes;
+	const uint8_t* chroma = luma + size_t(mWidth) * mHeight;
+	frame.Assign(luma, mWidth, chroma, size_t((mWidth + 1) / 2) * 2, mWidth, mHeight);
+	frame.sequence = uint64_t(index) + 1;
+	frame.timestamp = int64_t(std::llround(index * 10000000.0 / mFramesPerSecond));
+	return true;
+}
+
+// Netpbm headers are whitespace separated tokens, with comments from '#' to the end of
+// the line; a single whitespace character separates the last token from the pixels.
+static bool ReadToken(const uint8_t* data, size_t size, size_t& offset, std::string& token) {
+	token.clear();
+	while (offset < size) {
+		char c = char(data[offset]);
+		if (c == '#') {
+			while (offset < size && data[offset] != '\n') {
+				offset++;
+			}
+		} else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			if (!token.empty()) {
+				return true;
+			}
+			offset++;
+		} else {
+			token += c;
+			offset++;
+		}
+	}
+	return !token.empty();
+}
+
+static bool ParseUnsigned(const std::string& token, unsigned& value) {
+	if (token.empty() || token.size() > 9 || token.find_first_not_of("0123456789") != std::string::npos) {
+		return false;
+	}
+	value = unsigned(std::strtoul(token.c_str(), nullptr, 10));
+	return true;
+}
+
+bool GoldenImage::Read(const std::string& path) {
+	MappedFile file;
+	if (!file.Open(path)) {
+		return false;
+	}
+	const uint8_t* data = file.GetData();
+	size_t size = file.GetSize();
+	size_t offset = 0;
+	std::string token;
+	if (!ReadToken(data, size, offset, token)) {
+		return false;
+	}
+	unsigned w = 0;
+	unsigned h = 0;
+	unsigned c = 0;
+	unsigned maxValue = 0;
+	if (token == "P5" || token == "P6") {
+		c = token == "P5" ? 1 : 3;
+		if (!ReadToken(data, size, offset, token) || !ParseUnsigned(token, w) || !ReadToken(data, size, offset, token) ||
+			!ParseUnsigned(token, h) || !ReadToken(data, size, offset, token) || !ParseUnsigned(token, maxValue)) {
+			return false;
+		}
+	} else if (token == "P7") {
+		std::string key;
+		while (ReadToken(data, size, offset, key) && key != "ENDHDR") {
+			if (!ReadToken(data, size, offset, token)) {
+				return false;
+			}
+			if (key == "WIDTH") {
+				ParseUnsigned(token, w);
+			} else if (key == "HEIGHT") {
+				ParseUnsigned(token, h);
+			} else if (key == "DEPTH") {
+				ParseUnsigned(token, c);
+			} else if (key == "MAXVAL") {
+				ParseUnsigned(token, maxValue);
+			}
+		}
+		if (key != "ENDHDR" || (c != 1 && c != 3 && c != 4)) {
+			return false;
+		}
+	} else {
+		return false;
+	}
+	offset++;
+	size_t bytes = size_t(w) * h * c;
+	if (w == 0 || h == 0 || maxValue != 255 || offset > size || size - offset < bytes) {
+		return false;
+	}
+	width = w;
+	height = h;
+	channels = c;
+	pixels.assign(data + offset, data + offset + bytes);
+	return true;
+}
+
+bool GoldenImage::Write(const std::string& path) const {
+	if (pixels.size() != size_t(width) * height * channels) {
+		return false;
+	}
+	std::ostringstream header;
+	if (channels == 1 || channels == 3) {
+		header << (channels == 1 ? "P5" : "P6") << "\n" << width << " " << height << "\n255\n";
+	} else if (channels == 4) {
+		header << "P7\nWIDTH " << width << "\nHEIGHT " << height << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+	} else {
+		return false;
+	}
+	std::ofstream file(path.c_str(), std::ios::binary);
+	std::string text = header.str();
+	file.write(text.data(), text.size());
+	file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+	return bool(file);
+}
+
+bool ImageDifference::Matches(double maxDifferingFraction) const {
+	return sameShape && differing <= uint64_t(maxDifferingFraction * values);
+}
+
+ImageDifference unigles::CompareImages(const GoldenImage& image, const GoldenImage& golden, unsigned tolerance) {
+	ImageDifference difference;
+	difference.sameShape = image.width == golden.width && image.height == golden.height && image.channels == golden.channels &&
+		image.pixels.size() == golden.pixels.size();
+	if (!difference.sameShape) {
+		return difference;
+	}
+	double squares = 0.0;
+	for (size_t i = 0; i < image.pixels.size(); i++) {
+		unsigned delta = unsigned(std::abs(int(image.pixels[i]) - int(golden.pixels[i])));
+		if (delta > difference.maxDifference) {
+			difference.maxDifference = delta;
+		}
+		if (delta > tolerance) {
+			difference.differing++;
+		}
+		squares += double(delta) * delta;
+	}
+	difference.values = image.pixels.size();
+	double mse = difference.values > 0 ? squares / difference.values : 0.0;
+	difference.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+	return difference;
+}
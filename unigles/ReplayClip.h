@@ -0,0 +1,65 @@
+#pragma once
+
+#include "KtxFile.h"
+#include "Nv12FrameBuffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	// A recorded camera stream for replays: NV12 frames of one size stored back to back
+	// in a raw file, as written by ffmpeg -pix_fmt nv12 -f rawvideo. The file is mapped,
+	// so a frame costs one copy into the Nv12Frame.
+	class Nv12Clip {
+	public:
+		Nv12Clip();
+
+		// Fails when the file size is not a whole number of frames.
+		bool Open(const std::string& path, unsigned width, unsigned height, double framesPerSecond = 30.0);
+		void Close();
+
+		unsigned GetFrameCount() const { return mFrameCount; }
+		unsigned GetWidth() const { return mWidth; }
+		unsigned GetHeight() const { return mHeight; }
+		// Fills the frame as the camera reader would: sequence from 1, timestamps in 100 ns
+		// ticks at the clip's frame rate, the whole frame dirty.
+		bool ReadFrame(unsigned index, Nv12Frame& frame) const;
+
+	private:
+		MappedFile mFile;
+		unsigned mWidth;
+		unsigned mHeight;
+		unsigned mFrameCount;
+		size_t mFrameBytes;
+		double mFramesPerSecond;
+	};
+
+	// 8-bit image with 1, 3 or 4 interleaved channels, rows top to bottom.
+	struct GoldenImage {
+		unsigned width = 0;
+		unsigned height = 0;
+		unsigned channels = 0;
+		std::vector<uint8_t> pixels;
+
+		// Netpbm files: P5 for one channel, P6 for three, P7 RGB_ALPHA for four.
+		bool Read(const std::string& path);
+		bool Write(const std::string& path) const;
+	};
+
+	struct ImageDifference {
+		bool sameShape = false;
+		unsigned maxDifference = 0;
+		uint64_t differing = 0;		// Values further than the tolerance from the golden image
+		uint64_t values = 0;
+		double psnr = 0.0;			// Infinite for identical images
+
+		// Whether at most maxDifferingFraction of the values are out of tolerance.
+		bool Matches(double maxDifferingFraction = 0.0) const;
+	};
+
+	// Per-value comparison of a rendered or converted image with its golden image.
+	// Tolerance absorbs rounding that legitimately differs between drivers and SIMD paths.
+	ImageDifference CompareImages(const GoldenImage& image, const GoldenImage& golden, unsigned tolerance);
+}
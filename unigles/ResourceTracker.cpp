@@ -0,0 +1,243 @@
+#include "ResourceTracker.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace unigles;
+
+static std::string FormatBytes(uint64_t bytes) {
+	std::ostringstream text;
+	if (bytes >= 1024 * 1024) {
+		text.precision(1);
+		text << std::fixed << bytes / (1024.0 * 1024.0) << " MB";
+	} else if (bytes >= 1024) {
+		text.precision(1);
+		text << std::fixed << bytes / 1024.0 << " KB";
+	} else {
+		text << bytes << " bytes";
+	}
+	return text.str();
+}
+
+const char* unigles::ResourceHeapName(ResourceHeap heap) {
+	switch (heap) {
+	case ResourceHeap::Gl:
+		return "GL";
+	case ResourceHeap::D3D:
+		return "D3D";
+	default:
+		return "Host";
+	}
+}
+
+uint64_t unigles::ImageBytes(unsigned width, unsigned height, unsigned bytesPerPixel, unsigned levels) {
+	uint64_t bytes = 0;
+	for (unsigned level = 0; level < levels; level++) {
+		bytes += uint64_t(width) * height * bytesPerPixel;
+		if (width == 1 && height == 1) {
+			break;
+		}
+		width = (std::max)(width / 2, 1u);
+		height = (std::max)(height / 2, 1u);
+	}
+	return bytes;
+}
+
+TrackedResource::TrackedResource() :
+	mTracker(nullptr),
+	mSubsystem(0),
+	mBytes(0),
+	mId(0) {
+}
+
+TrackedResource::TrackedResource(TrackedResource&& other) :
+	mTracker(other.mTracker),
+	mSubsystem(other.mSubsystem),
+	mBytes(other.mBytes),
+	mId(other.mId) {
+	other.mTracker = nullptr;
+}
+
+TrackedResource& TrackedResource::operator=(TrackedResource&& other) {
+	if (this != &other) {
+		Reset();
+		mTracker = other.mTracker;
+		mSubsystem = other.mSubsystem;
+		mBytes = other.mBytes;
+		mId = other.mId;
+		other.mTracker = nullptr;
+	}
+	return *this;
+}
+
+TrackedResource::~TrackedResource() {
+	Reset();
+}
+
+void TrackedResource::Resize(uint64_t bytes) {
+	if (mTracker) {
+		mTracker->Resize(*this, bytes);
+	}
+}
+
+void TrackedResource::Reset() {
+	if (mTracker) {
+		mTracker->Release(*this);
+		mTracker = nullptr;
+		mBytes = 0;
+	}
+}
+
+std::string ResourceLeaks::Describe() const {
+	std::ostringstream text;
+	text << ResourceHeapName(heap) << ": " << resources << " resources, " << FormatBytes(bytes) << " not released";
+	for (const ResourceUsage& usage : subsystems) {
+		text << std::endl << "  " << usage.subsystem << ": " << usage.live << ", " << FormatBytes(usage.liveBytes);
+	}
+	for (const ResourceRecord& record : records) {
+		text << std::endl << "  #" << record.id << " " << record.subsystem;
+		if (!record.name.empty()) {
+			text << " " << record.name;
+		}
+		text << " " << record.format << " " << FormatBytes(record.bytes) << ", " << int64_t(record.ageMilliseconds) << " ms old";
+	}
+	return text.str();
+}
+
+ResourceTracker::ResourceTracker(TrackingLevel level) :
+	mLevel(level),
+	mLiveBytes(),
+	mPeakBytes(),
+	mCheckedIds(),
+	mNextId(1),
+	mLeaks(0) {
+}
+
+unsigned ResourceTracker::FindSubsystem(ResourceHeap heap, const std::string& subsystem) {
+	for (size_t i = 0; i < mSubsystems.size(); i++) {
+		if (mSubsystems[i].heap == heap && mSubsystems[i].subsystem == subsystem) {
+			return unsigned(i);
+		}
+	}
+	ResourceUsage usage;
+	usage.heap = heap;
+	usage.subsystem = subsystem;
+	mSubsystems.push_back(usage);
+	return unsigned(mSubsystems.size() - 1);
+}
+
+void ResourceTracker::Add(unsigned subsystem, int64_t bytes) {
+	ResourceUsage& usage = mSubsystems[subsystem];
+	unsigned heap = unsigned(usage.heap);
+	usage.liveBytes += bytes;
+	usage.peakBytes = (std::max)(usage.peakBytes, usage.liveBytes);
+	mLiveBytes[heap] += bytes;
+	mPeakBytes[heap] = (std::max)(mPeakBytes[heap], mLiveBytes[heap]);
+}
+
+TrackedResource ResourceTracker::Track(ResourceHeap heap, const std::string& subsystem, const std::string& format, uint64_t bytes,
+	const std::string& name) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	TrackedResource resource;
+	resource.mTracker = this;
+	resource.mSubsystem = FindSubsystem(heap, subsystem);
+	resource.mBytes = bytes;
+	resource.mId = mNextId++;
+	ResourceUsage& usage = mSubsystems[resource.mSubsystem];
+	usage.live++;
+	usage.allocations++;
+	Add(resource.mSubsystem, int64_t(bytes));
+	if (mLevel == TrackingLevel::Detailed) {
+		mRecords[resource.mId] = Record{ resource.mSubsystem, name, format, bytes, std::chrono::steady_clock::now() };
+	}
+	return resource;
+}
+
+void ResourceTracker::Resize(TrackedResource& resource, uint64_t bytes) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	Add(resource.mSubsystem, int64_t(bytes) - int64_t(resource.mBytes));
+	resource.mBytes = bytes;
+	auto record = mRecords.find(resource.mId);
+	if (record != mRecords.end()) {
+		record->second.bytes = bytes;
+	}
+}
+
+void ResourceTracker::Release(TrackedResource& resource) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	ResourceUsage& usage = mSubsystems[resource.mSubsystem];
+	usage.live--;
+	usage.releases++;
+	if (resource.mId < mCheckedIds[unsigned(usage.heap)]) {
+		usage.leaked--;
+	}
+	Add(resource.mSubsystem, -int64_t(resource.mBytes));
+	mRecords.erase(resource.mId);
+}
+
+uint64_t ResourceTracker::GetLiveBytes(ResourceHeap heap) const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mLiveBytes[unsigned(heap)];
+}
+
+uint64_t ResourceTracker::GetPeakBytes(ResourceHeap heap) const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPeakBytes[unsigned(heap)];
+}
+
+std::vector<ResourceUsage> ResourceTracker::GetUsage() const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mSubsystems;
+}
+
+ResourceRecord ResourceTracker::MakeRecord(uint64_t id, const Record& record, std::chrono::steady_clock::time_point now) const {
+	ResourceRecord result;
+	result.id = id;
+	result.heap = mSubsystems[record.subsystem].heap;
+	result.subsystem = mSubsystems[record.subsystem].subsystem;
+	result.name = record.name;
+	result.format = record.format;
+	result.bytes = record.bytes;
+	result.ageMilliseconds = std::chrono::duration<double, std::milli>(now - record.created).count();
+	return result;
+}
+
+std::vector<ResourceRecord> ResourceTracker::GetLiveRecords() const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto now = std::chrono::steady_clock::now();
+	std::vector<ResourceRecord> records;
+	// Ids grow with time, so the map is already oldest first.
+	for (const auto& record : mRecords) {
+		records.push_back(MakeRecord(record.first, record.second, now));
+	}
+	return records;
+}
+
+ResourceLeaks ResourceTracker::CheckReleased(ResourceHeap heap) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	ResourceLeaks leaks;
+	leaks.heap = heap;
+	for (ResourceUsage& usage : mSubsystems) {
+		if (usage.heap == heap && usage.live > 0) {
+			leaks.resources += usage.live;
+			leaks.bytes += usage.liveBytes;
+			leaks.subsystems.push_back(usage);
+			// Those a previous check saw were counted then.
+			mLeaks += usage.live - usage.leaked;
+			usage.leaked = usage.live;
+		}
+	}
+	mCheckedIds[unsigned(heap)] = mNextId;
+	auto now = std::chrono::steady_clock::now();
+	for (const auto& record : mRecords) {
+		if (mSubsystems[record.second.subsystem].heap == heap) {
+			leaks.records.push_back(MakeRecord(record.first, record.second, now));
+		}
+	}
+	return leaks;
+}
+
+uint64_t ResourceTracker::GetLeakCount() const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mLeaks;
+}
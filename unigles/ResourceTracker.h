@@ -0,0 +1,148 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	class ResourceTracker;
+
+	// Where an allocation lives. Gl and D3D follow GpuDomain, so the heap of a lost
+	// domain can be checked once the domain's resources were released.
+	enum class ResourceHeap {
+		Gl,
+		D3D,
+		Host,
+	};
+
+	const char* ResourceHeapName(ResourceHeap heap);
+
+	enum class TrackingLevel {
+		Counters,	// Counts and bytes per subsystem only; cheap enough to leave on in release builds
+		Detailed,	// Also a record of every live allocation with its name, format and age
+	};
+
+	// Bytes of a 2D image with its mip chain, each level halved down to 1x1 like GL and D3D do.
+	uint64_t ImageBytes(unsigned width, unsigned height, unsigned bytesPerPixel, unsigned levels = 1);
+
+	// Accounting for one allocation, held next to the resource it describes and reset
+	// wherever the resource is released or replaced. Move only; an empty one tracks
+	// nothing. Must not outlive its tracker.
+	class TrackedResource {
+	public:
+		TrackedResource();
+		TrackedResource(TrackedResource&& other);
+		TrackedResource& operator=(TrackedResource&& other);
+		~TrackedResource();
+
+		// For buffers that grow or shrink in place.
+		void Resize(uint64_t bytes);
+		void Reset();
+		bool IsTracked() const { return mTracker != nullptr; }
+		uint64_t GetBytes() const { return mBytes; }
+
+	private:
+		friend class ResourceTracker;
+
+		TrackedResource(const TrackedResource&) = delete;
+		TrackedResource& operator=(const TrackedResource&) = delete;
+
+		ResourceTracker* mTracker;
+		unsigned mSubsystem;
+		uint64_t mBytes;
+		uint64_t mId;
+	};
+
+	struct ResourceUsage {
+		ResourceHeap heap = ResourceHeap::Host;
+		std::string subsystem;
+		uint64_t live = 0;
+		uint64_t liveBytes = 0;
+		uint64_t peakBytes = 0;
+		uint64_t allocations = 0;
+		uint64_t releases = 0;
+		uint64_t leaked = 0;		// Live resources an earlier check already counted as leaks
+	};
+
+	struct ResourceRecord {
+		uint64_t id = 0;
+		ResourceHeap heap = ResourceHeap::Host;
+		std::string subsystem;
+		std::string name;
+		std::string format;
+		uint64_t bytes = 0;
+		double ageMilliseconds = 0.0;
+	};
+
+	struct ResourceLeaks {
+		ResourceHeap heap = ResourceHeap::Host;
+		uint64_t resources = 0;
+		uint64_t bytes = 0;
+		std::vector<ResourceUsage> subsystems;	// Only those with live resources
+		std::vector<ResourceRecord> records;	// Empty unless tracking is detailed
+
+		bool Empty() const { return resources == 0; }
+		// One line per subsystem, then one per record.
+		std::string Describe() const;
+	};
+
+	// Live and peak bytes of every resource the pipeline owns, tagged by heap, subsystem
+	// and format. Owners hold a TrackedResource per allocation, so the accounting follows
+	// the resources' own lifetimes. Thread safe.
+	class ResourceTracker {
+	public:
+		explicit ResourceTracker(TrackingLevel level = TrackingLevel::Counters);
+
+		TrackingLevel GetLevel() const { return mLevel; }
+
+		// Format is free text like "BGRA8" or "R8"; the name only matters to detailed tracking.
+		TrackedResource Track(ResourceHeap heap, const std::string& subsystem, const std::string& format, uint64_t bytes,
+			const std::string& name = std::string());
+
+		uint64_t GetLiveBytes(ResourceHeap heap) const;
+		uint64_t GetPeakBytes(ResourceHeap heap) const;
+		// Subsystems in the order they first allocated.
+		std::vector<ResourceUsage> GetUsage() const;
+		// Oldest first; empty unless tracking is detailed.
+		std::vector<ResourceRecord> GetLiveRecords() const;
+
+		// What is still live in the heap, for when its owners should have released all of it:
+		// after a lost domain's resources were released, or at shutdown. Counted as leaks.
+		ResourceLeaks CheckReleased(ResourceHeap heap);
+		// Every leaked resource counts once, however many checks find it still live.
+		uint64_t GetLeakCount() const;
+
+	private:
+		friend class TrackedResource;
+
+		static const unsigned HeapCount = 3;
+
+		struct Record {
+			unsigned subsystem;
+			std::string name;
+			std::string format;
+			uint64_t bytes;
+			std::chrono::steady_clock::time_point created;
+		};
+
+		unsigned FindSubsystem(ResourceHeap heap, const std::string& subsystem);
+		void Add(unsigned subsystem, int64_t bytes);
+		ResourceRecord MakeRecord(uint64_t id, const Record& record, std::chrono::steady_clock::time_point now) const;
+		void Resize(TrackedResource& resource, uint64_t bytes);
+		void Release(TrackedResource& resource);
+
+		mutable std::mutex mMutex;
+		TrackingLevel mLevel;
+		std::vector<ResourceUsage> mSubsystems;
+		std::map<uint64_t, Record> mRecords;
+		uint64_t mLiveBytes[HeapCount];
+		uint64_t mPeakBytes[HeapCount];
+		// Resources of the heap below this id were live at its last check, and so counted.
+		uint64_t mCheckedIds[HeapCount];
+		uint64_t mNextId;
+		uint64_t mLeaks;
+	};
+}
@@ -0,0 +1,434 @@
+#include "SceneBvh.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace unigles;
+
+Aabb Aabb::FromCenterExtents(float x, float y, float z, float ex, float ey, float ez) {
+	Aabb box = { { x - ex, y - ey, z - ez }, { x + ex, y + ey, z + ez } };
+	return box;
+}
+
+Aabb Aabb::Transformed(const float* matrix) const {
+	// Each output axis gathers the smaller and larger contribution of every input axis.
+	Aabb box;
+	for (int i = 0; i < 3; i++) {
+		box.min[i] = box.max[i] = matrix[12 + i];
+		for (int j = 0; j < 3; j++) {
+			float a = matrix[j * 4 + i] * min[j];
+			float b = matrix[j * 4 + i] * max[j];
+			box.min[i] += std::min(a, b);
+			box.max[i] += std::max(a, b);
+		}
+	}
+	return box;
+}
+
+Aabb Aabb::Expanded(float margin) const {
+	Aabb box = { { min[0] - margin, min[1] - margin, min[2] - margin }, { max[0] + margin, max[1] + margin, max[2] + margin } };
+	return box;
+}
+
+Aabb Aabb::Union(const Aabb& other) const {
+	Aabb box;
+	for (int i = 0; i < 3; i++) {
+		box.min[i] = std::min(min[i], other.min[i]);
+		box.max[i] = std::max(max[i], other.max[i]);
+	}
+	return box;
+}
+
+bool Aabb::Contains(const Aabb& other) const {
+	return min[0] <= other.min[0] && min[1] <= other.min[1] && min[2] <= other.min[2] &&
+		max[0] >= other.max[0] && max[1] >= other.max[1] && max[2] >= other.max[2];
+}
+
+bool Aabb::Overlaps(const Aabb& other) const {
+	return min[0] <= other.max[0] && min[1] <= other.max[1] && min[2] <= other.max[2] &&
+		max[0] >= other.min[0] && max[1] >= other.min[1] && max[2] >= other.min[2];
+}
+
+float Aabb::SurfaceArea() const {
+	float x = max[0] - min[0];
+	float y = max[1] - min[1];
+	float z = max[2] - min[2];
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+Frustum Frustum::FromViewProjection(const float* matrix) {
+	// Gribb-Hartmann: each plane is the last row of the matrix plus or minus another row.
+	static const int Rows[6] = { 0, 0, 1, 1, 2, 2 };
+	static const float Signs[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };
+	Frustum frustum;
+	for (int plane = 0; plane < 8; plane++) {
+		if (plane >= 6) {
+			frustum.mX[plane] = frustum.mY[plane] = frustum.mZ[plane] = 0.0f;
+			frustum.mW[plane] = 1.0f;
+			continue;
+		}
+		int row = Rows[plane];
+		float sign = Signs[plane];
+		frustum.mX[plane] = matrix[3] + sign * matrix[row];
+		frustum.mY[plane] = matrix[7] + sign * matrix[4 + row];
+		frustum.mZ[plane] = matrix[11] + sign * matrix[8 + row];
+		frustum.mW[plane] = matrix[15] + sign * matrix[12 + row];
+	}
+	return frustum;
+}
+
+Frustum::Result Frustum::Test(const Aabb& box) const {
+	// A box is outside a plane when its center is further behind it than the box reaches
+	// along the normal, and inside when it is further in front.
+	float cx = (box.min[0] + box.max[0]) * 0.5f;
+	float cy = (box.min[1] + box.max[1]) * 0.5f;
+	float cz = (box.min[2] + box.max[2]) * 0.5f;
+	float ex = (box.max[0] - box.min[0]) * 0.5f;
+	float ey = (box.max[1] - box.min[1]) * 0.5f;
+	float ez = (box.max[2] - box.min[2]) * 0.5f;
+	bool outside = false;
+	bool intersecting = false;
+#if defined(UNIGLES_SIMD_SSE2)
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy), vcz = _mm_set1_ps(cz);
+	__m128 vex = _mm_set1_ps(ex), vey = _mm_set1_ps(ey), vez = _mm_set1_ps(ez);
+	int outsideMask = 0;
+	int intersectMask = 0;
+	for (int i = 0; i < 8; i += 4) {
+		__m128 nx = _mm_loadu_ps(mX + i);
+		__m128 ny = _mm_loadu_ps(mY + i);
+		__m128 nz = _mm_loadu_ps(mZ + i);
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, vcx), _mm_mul_ps(ny, vcy)), _mm_add_ps(_mm_mul_ps(nz, vcz), _mm_loadu_ps(mW + i)));
+		__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, nx), vex), _mm_mul_ps(_mm_andnot_ps(sign, ny), vey)),
+			_mm_mul_ps(_mm_andnot_ps(sign, nz), vez));
+		outsideMask |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		intersectMask |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero));
+	}
+	outside = outsideMask != 0;
+	intersecting = intersectMask != 0;
+#elif defined(UNIGLES_SIMD_NEON)
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+	uint32x4_t outsideMask = vdupq_n_u32(0);
+	uint32x4_t intersectMask = vdupq_n_u32(0);
+	for (int i = 0; i < 8; i += 4) {
+		float32x4_t nx = vld1q_f32(mX + i);
+		float32x4_t ny = vld1q_f32(mY + i);
+		float32x4_t nz = vld1q_f32(mZ + i);
+		float32x4_t distance = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vld1q_f32(mW + i), nx, cx), ny, cy), nz, cz);
+		float32x4_t radius = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(vabsq_f32(nx), ex), vabsq_f32(ny), ey), vabsq_f32(nz), ez);
+		outsideMask = vorrq_u32(outsideMask, vcltq_f32(vaddq_f32(distance, radius), zero));
+		intersectMask = vorrq_u32(intersectMask, vcltq_f32(vsubq_f32(distance, radius), zero));
+	}
+	uint32x2_t o = vorr_u32(vget_low_u32(outsideMask), vget_high_u32(outsideMask));
+	uint32x2_t s = vorr_u32(vget_low_u32(intersectMask), vget_high_u32(intersectMask));
+	outside = (vget_lane_u32(o, 0) | vget_lane_u32(o, 1)) != 0;
+	intersecting = (vget_lane_u32(s, 0) | vget_lane_u32(s, 1)) != 0;
+#else
+	for (int i = 0; i < 6; i++) {
+		float distance = mX[i] * cx + mY[i] * cy + mZ[i] * cz + mW[i];
+		float radius = std::abs(mX[i]) * ex + std::abs(mY[i]) * ey + std::abs(mZ[i]) * ez;
+		outside = outside || distance + radius < 0.0f;
+		intersecting = intersecting || distance - radius < 0.0f;
+	}
+#endif
+	return outside ? Outside : intersecting ? Intersecting : Inside;
+}
+
+SceneBvh::SceneBvh(float margin) :
+	mMargin(margin),
+	mRoot(NullProxy),
+	mFreeList(NullProxy),
+	mLeafCount(0),
+	mRefits(0),
+	mReinserts(0) {}
+
+SceneBvh::Proxy SceneBvh::AllocateNode() {
+	Proxy node;
+	if (mFreeList != NullProxy) {
+		node = mFreeList;
+		mFreeList = mNodes[node].parent;
+	} else {
+		node = Proxy(mNodes.size());
+		mNodes.push_back(Node());
+	}
+	Node& n = mNodes[node];
+	n.parent = NullProxy;
+	n.child1 = NullProxy;
+	n.child2 = NullProxy;
+	n.height = 0;
+	n.userData = 0;
+	return node;
+}
+
+void SceneBvh::FreeNode(Proxy node) {
+	mNodes[node].parent = mFreeList;
+	mNodes[node].height = -1;
+	mFreeList = node;
+}
+
+SceneBvh::Proxy SceneBvh::Insert(const Aabb& bounds, uint32_t userData) {
+	Proxy leaf = AllocateNode();
+	mNodes[leaf].box = bounds.Expanded(mMargin);
+	mNodes[leaf].userData = userData;
+	InsertLeaf(leaf);
+	mLeafCount++;
+	return leaf;
+}
+
+void SceneBvh::Remove(Proxy proxy) {
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	mLeafCount--;
+}
+
+bool SceneBvh::Move(Proxy proxy, const Aabb& bounds) {
+	if (mNodes[proxy].box.Contains(bounds)) {
+		return false;
+	}
+	Aabb fat = bounds.Expanded(mMargin);
+	Proxy parent = mNodes[proxy].parent;
+	if (parent == NullProxy) {
+		mNodes[proxy].box = fat;
+		return true;
+	}
+	Proxy sibling = mNodes[parent].child1 == proxy ? mNodes[parent].child2 : mNodes[parent].child1;
+	if (fat.Overlaps(mNodes[sibling].box)) {
+		// Still among its neighbours: the structure stays, only the boxes above grow or shrink.
+		mNodes[proxy].box = fat;
+		Refit(parent);
+		mRefits++;
+	} else {
+		RemoveLeaf(proxy);
+		mNodes[proxy].box = fat;
+		InsertLeaf(proxy);
+		mReinserts++;
+	}
+	return true;
+}
+
+void SceneBvh::Refit(Proxy node) {
+	while (node != NullProxy) {
+		Node& n = mNodes[node];
+		Aabb box = mNodes[n.child1].box.Union(mNodes[n.child2].box);
+		if (std::equal(box.min, box.min + 3, n.box.min) && std::equal(box.max, box.max + 3, n.box.max)) {
+			break;
+		}
+		n.box = box;
+		node = n.parent;
+	}
+}
+
+void SceneBvh::InsertLeaf(Proxy leaf) {
+	if (mRoot == NullProxy) {
+		mRoot = leaf;
+		mNodes[leaf].parent = NullProxy;
+		return;
+	}
+
+	// Walk down towards the child whose box grows least, stopping where pairing with
+	// the current node is cheaper than pushing the leaf further down.
+	Aabb leafBox = mNodes[leaf].box;
+	Proxy index = mRoot;
+	while (!mNodes[index].IsLeaf()) {
+		const Node& node = mNodes[index];
+		float area = node.box.SurfaceArea();
+		float combinedArea = node.box.Union(leafBox).SurfaceArea();
+		float cost = 2.0f * combinedArea;
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		const Node& child1 = mNodes[node.child1];
+		float cost1 = child1.box.Union(leafBox).SurfaceArea() + inheritanceCost;
+		if (!child1.IsLeaf()) {
+			cost1 -= child1.box.SurfaceArea();
+		}
+		const Node& child2 = mNodes[node.child2];
+		float cost2 = child2.box.Union(leafBox).SurfaceArea() + inheritanceCost;
+		if (!child2.IsLeaf()) {
+			cost2 -= child2.box.SurfaceArea();
+		}
+
+		if (cost < cost1 && cost < cost2) {
+			break;
+		}
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+
+	Proxy sibling = index;
+	Proxy oldParent = mNodes[sibling].parent;
+	Proxy newParent = AllocateNode();
+	mNodes[newParent].parent = oldParent;
+	mNodes[newParent].box = leafBox.Union(mNodes[sibling].box);
+	mNodes[newParent].height = mNodes[sibling].height + 1;
+	mNodes[newParent].child1 = sibling;
+	mNodes[newParent].child2 = leaf;
+	mNodes[sibling].parent = newParent;
+	mNodes[leaf].parent = newParent;
+	if (oldParent == NullProxy) {
+		mRoot = newParent;
+	} else if (mNodes[oldParent].child1 == sibling) {
+		mNodes[oldParent].child1 = newParent;
+	} else {
+		mNodes[oldParent].child2 = newParent;
+	}
+
+	for (index = mNodes[leaf].parent; index != NullProxy; index = mNodes[index].parent) {
+		index = Balance(index);
+		Node& node = mNodes[index];
+		node.height = 1 + std::max(mNodes[node.child1].height, mNodes[node.child2].height);
+		node.box = mNodes[node.child1].box.Union(mNodes[node.child2].box);
+	}
+}
+
+void SceneBvh::RemoveLeaf(Proxy leaf) {
+	if (leaf == mRoot) {
+		mRoot = NullProxy;
+		return;
+	}
+
+	Proxy parent = mNodes[leaf].parent;
+	Proxy grandParent = mNodes[parent].parent;
+	Proxy sibling = mNodes[parent].child1 == leaf ? mNodes[parent].child2 : mNodes[parent].child1;
+	FreeNode(parent);
+	if (grandParent == NullProxy) {
+		mRoot = sibling;
+		mNodes[sibling].parent = NullProxy;
+		return;
+	}
+
+	if (mNodes[grandParent].child1 == parent) {
+		mNodes[grandParent].child1 = sibling;
+	} else {
+		mNodes[grandParent].child2 = sibling;
+	}
+	mNodes[sibling].parent = grandParent;
+	for (Proxy index = grandParent; index != NullProxy; index = mNodes[index].parent) {
+		index = Balance(index);
+		Node& node = mNodes[index];
+		node.height = 1 + std::max(mNodes[node.child1].height, mNodes[node.child2].height);
+		node.box = mNodes[node.child1].box.Union(mNodes[node.child2].box);
+	}
+}
+
+SceneBvh::Proxy SceneBvh::Balance(Proxy iA) {
+	// Rotates the taller child up when the heights of A's children differ by more than one.
+	Node& A = mNodes[iA];
+	if (A.IsLeaf() || A.height < 2) {
+		return iA;
+	}
+	Proxy iB = A.child1;
+	Proxy iC = A.child2;
+	Node& B = mNodes[iB];
+	Node& C = mNodes[iC];
+	int balance = C.height - B.height;
+
+	if (balance > 1) {
+		Proxy iF = C.child1;
+		Proxy iG = C.child2;
+		Node& F = mNodes[iF];
+		Node& G = mNodes[iG];
+		C.child1 = iA;
+		C.parent = A.parent;
+		A.parent = iC;
+		if (C.parent == NullProxy) {
+			mRoot = iC;
+		} else if (mNodes[C.parent].child1 == iA) {
+			mNodes[C.parent].child1 = iC;
+		} else {
+			mNodes[C.parent].child2 = iC;
+		}
+		if (F.height > G.height) {
+			C.child2 = iF;
+			A.child2 = iG;
+			G.parent = iA;
+			A.box = B.box.Union(G.box);
+			C.box = A.box.Union(F.box);
+			A.height = 1 + std::max(B.height, G.height);
+			C.height = 1 + std::max(A.height, F.height);
+		} else {
+			C.child2 = iG;
+			A.child2 = iF;
+			F.parent = iA;
+			A.box = B.box.Union(F.box);
+			C.box = A.box.Union(G.box);
+			A.height = 1 + std::max(B.height, F.height);
+			C.height = 1 + std::max(A.height, G.height);
+		}
+		return iC;
+	}
+
+	if (balance < -1) {
+		Proxy iD = B.child1;
+		Proxy iE = B.child2;
+		Node& D = mNodes[iD];
+		Node& E = mNodes[iE];
+		B.child1 = iA;
+		B.parent = A.parent;
+		A.parent = iB;
+		if (B.parent == NullProxy) {
+			mRoot = iB;
+		} else if (mNodes[B.parent].child1 == iA) {
+			mNodes[B.parent].child1 = iB;
+		} else {
+			mNodes[B.parent].child2 = iB;
+		}
+		if (D.height > E.height) {
+			B.child2 = iD;
+			A.child1 = iE;
+			E.parent = iA;
+			A.box = C.box.Union(E.box);
+			B.box = A.box.Union(D.box);
+			A.height = 1 + std::max(C.height, E.height);
+			B.height = 1 + std::max(A.height, D.height);
+		} else {
+			B.child2 = iE;
+			A.child1 = iD;
+			D.parent = iA;
+			A.box = C.box.Union(D.box);
+			B.box = A.box.Union(E.box);
+			A.height = 1 + std::max(C.height, D.height);
+			B.height = 1 + std::max(A.height, E.height);
+		}
+		return iB;
+	}
+
+	return iA;
+}
+
+void SceneBvh::Cull(const Frustum& frustum, std::vector<uint32_t>& visible) {
+	auto start = std::chrono::steady_clock::now();
+	visible.clear();
+	mCullStats = CullStats();
+	mCullStats.objects = mLeafCount;
+
+	mStack.clear();
+	if (mRoot != NullProxy) {
+		mStack.push_back(StackEntry{ mRoot, false });
+	}
+	while (!mStack.empty()) {
+		StackEntry entry = mStack.back();
+		mStack.pop_back();
+		const Node& node = mNodes[entry.node];
+		bool inside = entry.inside;
+		if (!inside) {
+			mCullStats.nodesTested++;
+			Frustum::Result result = frustum.Test(node.box);
+			if (result == Frustum::Outside) {
+				continue;
+			}
+			inside = result == Frustum::Inside;
+		}
+		if (node.IsLeaf()) {
+			visible.push_back(node.userData);
+		} else {
+			mStack.push_back(StackEntry{ node.child2, inside });
+			mStack.push_back(StackEntry{ node.child1, inside });
+		}
+	}
+
+	mCullStats.visible = uint32_t(visible.size());
+	mCullStats.culled = mCullStats.objects - mCullStats.visible;
+	mCullStats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace unigles {
+	struct Aabb {
+		float min[3];
+		float max[3];
+
+		static Aabb FromCenterExtents(float x, float y, float z, float ex, float ey, float ez);
+		// Bounds of this box after a column major 4x4 transform, as uploaded to GL.
+		Aabb Transformed(const float* matrix) const;
+		Aabb Expanded(float margin) const;
+		Aabb Union(const Aabb& other) const;
+		bool Contains(const Aabb& other) const;
+		bool Overlaps(const Aabb& other) const;
+		float SurfaceArea() const;
+	};
+
+	// Six clip planes of a view-projection matrix, stored plane-per-lane so one box is
+	// tested against four planes at a time.
+	class Frustum {
+	public:
+		enum Result {
+			Outside,
+			Intersecting,
+			Inside,
+		};
+
+		// Column major, GL clip space (-w <= z <= w).
+		static Frustum FromViewProjection(const float* matrix);
+
+		Result Test(const Aabb& box) const;
+
+	private:
+		// Six planes padded to eight with planes every point is in front of.
+		float mX[8];
+		float mY[8];
+		float mZ[8];
+		float mW[8];
+	};
+
+	struct CullStats {
+		uint32_t objects = 0;
+		uint32_t visible = 0;
+		uint32_t culled = 0;
+		uint32_t nodesTested = 0;
+		double milliseconds = 0.0;
+	};
+
+	// Dynamic AABB tree over the objects of a scene. Leaves hold boxes enlarged by a
+	// margin so small movements cost nothing; a leaf that leaves its box but stays next
+	// to its sibling is refitted in place, anything further is removed and reinserted.
+	// Insertion picks the sibling by surface area cost and rotations keep the tree
+	// balanced, so objects added in spatial order do not degrade it into a list.
+	class SceneBvh {
+	public:
+		typedef int32_t Proxy;
+		static const Proxy NullProxy = -1;
+
+		explicit SceneBvh(float margin = 0.1f);
+
+		Proxy Insert(const Aabb& bounds, uint32_t userData);
+		void Remove(Proxy proxy);
+		// Returns false when the enlarged box still holds the new bounds.
+		bool Move(Proxy proxy, const Aabb& bounds);
+
+		uint32_t GetUserData(Proxy proxy) const { return mNodes[proxy].userData; }
+		const Aabb& GetFatBounds(Proxy proxy) const { return mNodes[proxy].box; }
+		uint32_t GetCount() const { return mLeafCount; }
+		int GetHeight() const { return mRoot == NullProxy ? 0 : mNodes[mRoot].height; }
+		uint64_t GetRefitCount() const { return mRefits; }
+		uint64_t GetReinsertCount() const { return mReinserts; }
+
+		// Replaces visible with the user data of every object whose box touches the frustum.
+		void Cull(const Frustum& frustum, std::vector<uint32_t>& visible);
+		const CullStats& GetCullStats() const { return mCullStats; }
+
+	private:
+		struct Node {
+			Aabb box;
+			Proxy parent;	// Next free node while on the free list
+			Proxy child1;
+			Proxy child2;
+			int height;		// 0 for leaves, -1 while free
+			uint32_t userData;
+
+			bool IsLeaf() const { return child1 == NullProxy; }
+		};
+
+		struct StackEntry {
+			Proxy node;
+			bool inside;	// Every plane already passed, no more tests below
+		};
+
+		Proxy AllocateNode();
+		void FreeNode(Proxy node);
+		void InsertLeaf(Proxy leaf);
+		void RemoveLeaf(Proxy leaf);
+		void Refit(Proxy node);
+		Proxy Balance(Proxy node);
+
+		float mMargin;
+		std::vector<Node> mNodes;
+		Proxy mRoot;
+		Proxy mFreeList;
+		uint32_t mLeafCount;
+		uint64_t mRefits;
+		uint64_t mReinserts;
+		std::vector<StackEntry> mStack;
+		CullStats mCullStats;
+	};
+}
@@ -0,0 +1,152 @@
+#include "ShaderPermutations.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+using namespace unigles;
+
+PermutationKey ShaderPermutations::AddFeature(const std::string& define, PermutationKey needs, PermutationKey excludes) {
+	if (mFeatures.size() >= MaxFeatures) {
+		throw std::length_error("too many shader features");
+	}
+	PermutationKey bit = PermutationKey(1) << mFeatures.size();
+	mFeatures.push_back(Feature{ define, needs, excludes });
+	return bit;
+}
+
+bool ShaderPermutations::IsValid(PermutationKey key) const {
+	if (key >> mFeatures.size() != 0) {
+		return false;
+	}
+	for (size_t i = 0; i < mFeatures.size(); i++) {
+		const Feature& feature = mFeatures[i];
+		if ((key & (PermutationKey(1) << i)) != 0 && ((key & feature.needs) != feature.needs || (key & feature.excludes) != 0)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+std::vector<PermutationKey> ShaderPermutations::GetValidKeys() const {
+	std::vector<PermutationKey> keys;
+	for (PermutationKey key = 0; key < (PermutationKey(1) << mFeatures.size()); key++) {
+		if (IsValid(key)) {
+			keys.push_back(key);
+		}
+	}
+	return keys;
+}
+
+std::vector<std::pair<std::string, std::string>> ShaderPermutations::GetDefines(PermutationKey key) const {
+	std::vector<std::pair<std::string, std::string>> defines;
+	for (size_t i = 0; i < mFeatures.size(); i++) {
+		if ((key & (PermutationKey(1) << i)) != 0) {
+			defines.push_back(std::make_pair(mFeatures[i].define, std::string("1")));
+		}
+	}
+	return defines;
+}
+
+std::string ShaderPermutations::Describe(PermutationKey key) const {
+	std::string name;
+	for (const auto& define : GetDefines(key)) {
+		if (!name.empty()) {
+			name += '+';
+		}
+		name += define.first;
+	}
+	return name.empty() ? "base" : name;
+}
+
+// Position of the first character that is not blank or inside a comment.
+static size_t SkipBlanksAndComments(const std::string& source) {
+	size_t position = 0;
+	for (;;) {
+		position = source.find_first_not_of(" \t\r\n", position);
+		if (position == std::string::npos) {
+			return position;
+		}
+		if (source.compare(position, 2, "//") == 0) {
+			position = source.find('\n', position);
+		} else if (source.compare(position, 2, "/*") == 0) {
+			position = source.find("*/", position + 2);
+			if (position != std::string::npos) {
+				position += 2;
+			}
+		} else {
+			return position;
+		}
+	}
+}
+
+std::string ShaderPermutations::Generate(PermutationKey key, const std::string& source) const {
+	std::string preamble;
+	for (const auto& define : GetDefines(key)) {
+		preamble += "#define " + define.first + " " + define.second + "\n";
+	}
+	// GLSL wants #version before anything else, comments and blank lines aside.
+	size_t start = SkipBlanksAndComments(source);
+	if (start != std::string::npos && source.compare(start, 8, "#version") == 0) {
+		size_t end = source.find('\n', start);
+		if (end == std::string::npos) {
+			return source + "\n" + preamble;
+		}
+		return source.substr(0, end + 1) + preamble + source.substr(end + 1);
+	}
+	return preamble + source;
+}
+
+ShaderVariantCache::ShaderVariantCache(const ShaderPermutations& permutations, CompileFunction compile, ReleaseFunction release) :
+	mPermutations(permutations),
+	mCompile(compile),
+	mRelease(release) {
+}
+
+ShaderVariantCache::~ShaderVariantCache() {
+	Clear();
+}
+
+void ShaderVariantCache::Clear() {
+	for (const auto& variant : mVariants) {
+		if (variant.second != 0 && mRelease) {
+			mRelease(variant.second);
+		}
+	}
+	mVariants.clear();
+}
+
+uint32_t ShaderVariantCache::Compile(PermutationKey key) {
+	auto start = std::chrono::steady_clock::now();
+	uint32_t handle = mCompile(key, mPermutations);
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	mStats.compiled++;
+	if (handle == 0) {
+		mStats.failed++;
+	}
+	mStats.compileMilliseconds += milliseconds;
+	mStats.maxCompileMilliseconds = std::max(mStats.maxCompileMilliseconds, milliseconds);
+	mVariants[key] = handle;
+	return handle;
+}
+
+uint32_t ShaderVariantCache::Get(PermutationKey key) {
+	mStats.lookups++;
+	auto found = mVariants.find(key);
+	if (found != mVariants.end()) {
+		return found->second;
+	}
+	if (!mPermutations.IsValid(key)) {
+		return 0;
+	}
+	mStats.misses++;
+	return Compile(key);
+}
+
+void ShaderVariantCache::Precompile(const std::vector<PermutationKey>& keys) {
+	for (PermutationKey key : keys) {
+		if (mPermutations.IsValid(key) && mVariants.find(key) == mVariants.end()) {
+			Compile(key);
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace unigles {
+	// One bit per feature; zero is the variant with every feature off.
+	typedef uint32_t PermutationKey;
+
+	// Feature flags of an uber shader, each turned into a #define at the top of its
+	// source, so every variant is compiled with only the code it needs instead of
+	// branching at run time. The same source text serves GLSL and HLSL.
+	class ShaderPermutations {
+	public:
+		static const unsigned MaxFeatures = 16;
+
+		// Returns the feature's bit. A key with the feature set must also contain every
+		// bit of needs and none of excludes.
+		PermutationKey AddFeature(const std::string& define, PermutationKey needs = 0, PermutationKey excludes = 0);
+
+		bool IsValid(PermutationKey key) const;
+		// Every valid key, ascending.
+		std::vector<PermutationKey> GetValidKeys() const;
+		unsigned GetFeatureCount() const { return unsigned(mFeatures.size()); }
+
+		// Name and value of each define of the key, e.g. for D3D_SHADER_MACRO.
+		std::vector<std::pair<std::string, std::string>> GetDefines(PermutationKey key) const;
+		// Defines joined with '+', or "base" for key 0.
+		std::string Describe(PermutationKey key) const;
+		// The source with the key's defines inserted after a leading #version line, or at
+		// the start when there is none. Comments and blank lines may precede #version.
+		std::string Generate(PermutationKey key, const std::string& source) const;
+
+	private:
+		struct Feature {
+			std::string define;
+			PermutationKey needs;
+			PermutationKey excludes;
+		};
+
+		std::vector<Feature> mFeatures;
+	};
+
+	struct ShaderVariantStats {
+		unsigned compiled = 0;			// Variants built so far, failures included
+		unsigned failed = 0;
+		uint64_t lookups = 0;
+		uint64_t misses = 0;			// Lookups that had to compile
+		double compileMilliseconds = 0.0;
+		double maxCompileMilliseconds = 0.0;
+	};
+
+	// Compiled variants of one ShaderPermutations, looked up by key and built on first
+	// use or ahead of time with Precompile(). Handles are whatever the compile function
+	// returns, a GL program or an index into the caller's shader objects; zero means
+	// the compilation failed, and is cached like a success so a broken variant is not
+	// rebuilt every frame.
+	class ShaderVariantCache {
+	public:
+		typedef std::function<uint32_t(PermutationKey key, const ShaderPermutations& permutations)> CompileFunction;
+		typedef std::function<void(uint32_t handle)> ReleaseFunction;
+
+		ShaderVariantCache(const ShaderPermutations& permutations, CompileFunction compile, ReleaseFunction release);
+		~ShaderVariantCache();
+		ShaderVariantCache(const ShaderVariantCache&) = delete;
+		ShaderVariantCache& operator=(const ShaderVariantCache&) = delete;
+
+		// Zero for invalid keys and failed variants.
+		uint32_t Get(PermutationKey key);
+		void Precompile(const std::vector<PermutationKey>& keys);
+		void Clear();
+
+		unsigned GetVariantCount() const { return unsigned(mVariants.size()); }
+		const ShaderPermutations& GetPermutations() const { return mPermutations; }
+		const ShaderVariantStats& GetStats() const { return mStats; }
+
+	private:
+		uint32_t Compile(PermutationKey key);
+
+		ShaderPermutations mPermutations;
+		CompileFunction mCompile;
+		ReleaseFunction mRelease;
+		std::unordered_map<PermutationKey, uint32_t> mVariants;
+		ShaderVariantStats mStats;
+	};
+}
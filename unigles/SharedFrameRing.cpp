@@ -0,0 +1,529 @@
+#include "SharedFrameRing.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <random>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace unigles;
+
+// Layout of the region: RingHeader, maxReaders ReaderRecords, then slotCount slots of a
+// SlotHeader and slotBytes of data each, every part on its own cache lines. Everything
+// shared is either written before the magic is published or is a lock-free atomic,
+// which works across processes because it does not depend on the address it lives at.
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared ring counters must be lock-free");
+
+static const uint32_t RingMagic = 0x474E5246;	// "FRNG"
+static const uint32_t RingVersion = 1;
+static const size_t CacheLine = 64;
+
+namespace {
+	struct RingHeader {
+		std::atomic<uint32_t> magic;	// Stored last by the writer, so readers never see a half built region
+		uint32_t version;
+		uint32_t slotCount;
+		uint32_t maxReaders;
+		uint64_t slotBytes;
+		uint64_t slotStride;
+		uint64_t readersOffset;
+		uint64_t slotsOffset;
+		uint64_t regionBytes;
+		alignas(CacheLine) std::atomic<uint64_t> published;	// Sequence of the newest frame, 0 before the first
+		std::atomic<int64_t> writerHeartbeat;
+	};
+
+	struct alignas(CacheLine) ReaderRecord {
+		std::atomic<uint64_t> owner;	// Token of the reader holding it, 0 when free
+		std::atomic<uint64_t> cursor;
+		std::atomic<int64_t> heartbeat;
+	};
+
+	struct alignas(CacheLine) SlotHeader {
+		// 2 * sequence once the frame is complete, odd while it is being written.
+		std::atomic<uint64_t> version;
+		SharedFrameInfo info;
+	};
+}
+
+static size_t AlignUp(size_t value, size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static int64_t HeartbeatNow() {
+	// Steady clocks count from boot on both platforms, so processes agree on them.
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double IdleMilliseconds(int64_t heartbeat) {
+	return (HeartbeatNow() - heartbeat) / 1.0e6;
+}
+
+static ReaderRecord* Readers(RingHeader* header) {
+	return reinterpret_cast<ReaderRecord*>(reinterpret_cast<uint8_t*>(header) + header->readersOffset);
+}
+
+static SlotHeader* Slot(RingHeader* header, uint64_t sequence) {
+	uint64_t index = (sequence - 1) % header->slotCount;
+	return reinterpret_cast<SlotHeader*>(reinterpret_cast<uint8_t*>(header) + header->slotsOffset + index * header->slotStride);
+}
+
+static uint8_t* SlotData(SlotHeader* slot) {
+	return reinterpret_cast<uint8_t*>(slot) + AlignUp(sizeof(SlotHeader), CacheLine);
+}
+
+SharedMemory::SharedMemory() :
+	mData(nullptr),
+	mSize(0),
+	mMapping(nullptr),
+	mCreated(false) {
+}
+
+SharedMemory::~SharedMemory() {
+	Close();
+}
+
+#if defined(_WIN32)
+
+static std::wstring WidePath(const std::string& name) {
+	int length = MultiByteToWideChar(CP_UTF8, 0, name.c_str(), -1, nullptr, 0);
+	if (length <= 0) {
+		return std::wstring();
+	}
+	std::wstring wide(length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, name.c_str(), -1, &wide[0], length);
+	return wide;
+}
+
+bool SharedMemory::Create(const std::string& name, size_t size) {
+	Close();
+	std::wstring wideName = WidePath(name);
+	if (wideName.empty() || size == 0) {
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingFromApp(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, ULONG64(size), wideName.c_str());
+	if (mapping == nullptr) {
+		return false;
+	}
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		// Still mapped by readers of an earlier producer, possibly with another layout.
+		CloseHandle(mapping);
+		return false;
+	}
+	void* view = MapViewOfFileFromApp(mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, size);
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		return false;
+	}
+	mMapping = mapping;
+	mData = static_cast<uint8_t*>(view);
+	mSize = size;
+	mName = name;
+	mCreated = true;
+	return true;
+}
+
+bool SharedMemory::Open(const std::string& name) {
+	Close();
+	std::wstring wideName = WidePath(name);
+	if (wideName.empty()) {
+		return false;
+	}
+	HANDLE mapping = OpenFileMappingFromApp(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, wideName.c_str());
+	if (mapping == nullptr) {
+		return false;
+	}
+	void* view = MapViewOfFileFromApp(mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0);
+	MEMORY_BASIC_INFORMATION region;
+	if (view == nullptr || VirtualQuery(view, &region, sizeof(region)) == 0) {
+		if (view != nullptr) {
+			UnmapViewOfFile(view);
+		}
+		CloseHandle(mapping);
+		return false;
+	}
+	mMapping = mapping;
+	mData = static_cast<uint8_t*>(view);
+	// Whole pages; the ring header has the exact size.
+	mSize = region.RegionSize;
+	mName = name;
+	return true;
+}
+
+void SharedMemory::Close() {
+	// The mapping goes away with its last handle, so there is nothing to unlink.
+	if (mData != nullptr) {
+		UnmapViewOfFile(mData);
+	}
+	if (mMapping != nullptr) {
+		CloseHandle(mMapping);
+	}
+	mData = nullptr;
+	mSize = 0;
+	mMapping = nullptr;
+	mName.clear();
+	mCreated = false;
+}
+
+#else
+
+bool SharedMemory::Create(const std::string& name, size_t size) {
+	Close();
+	if (name.empty() || size == 0) {
+		return false;
+	}
+	// A region of that name that outlived its producer would never be freed otherwise.
+	shm_unlink(name.c_str());
+	int file = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (file < 0) {
+		return false;
+	}
+	if (ftruncate(file, off_t(size)) != 0) {
+		close(file);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	close(file);
+	if (view == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		return false;
+	}
+	mData = static_cast<uint8_t*>(view);
+	mSize = size;
+	mName = name;
+	mCreated = true;
+	return true;
+}
+
+bool SharedMemory::Open(const std::string& name) {
+	Close();
+	int file = shm_open(name.c_str(), O_RDWR, 0);
+	if (file < 0) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size <= 0) {
+		close(file);
+		return false;
+	}
+	void* view = mmap(nullptr, size_t(status.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	close(file);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+	mData = static_cast<uint8_t*>(view);
+	mSize = size_t(status.st_size);
+	mName = name;
+	return true;
+}
+
+void SharedMemory::Close() {
+	if (mData != nullptr) {
+		munmap(mData, mSize);
+		if (mCreated) {
+			shm_unlink(mName.c_str());
+		}
+	}
+	mData = nullptr;
+	mSize = 0;
+	mName.clear();
+	mCreated = false;
+}
+
+#endif
+
+SharedFrameWriter::SharedFrameWriter() :
+	mHeader(nullptr),
+	mSlotBytes(0),
+	mNext(1),
+	mWriting(false) {
+}
+
+SharedFrameWriter::~SharedFrameWriter() {
+	Close();
+}
+
+bool SharedFrameWriter::Create(const std::string& name, unsigned slotCount, size_t slotBytes, unsigned maxReaders) {
+	Close();
+	if (slotCount < 2 || slotBytes == 0 || maxReaders == 0) {
+		return false;
+	}
+	size_t readersOffset = AlignUp(sizeof(RingHeader), CacheLine);
+	size_t slotsOffset = readersOffset + size_t(maxReaders) * sizeof(ReaderRecord);
+	size_t slotStride = AlignUp(sizeof(SlotHeader), CacheLine) + AlignUp(slotBytes, CacheLine);
+	size_t regionBytes = slotsOffset + size_t(slotCount) * slotStride;
+	if (!mMemory.Create(name, regionBytes)) {
+		return false;
+	}
+
+	// The region starts zeroed: no frames, free reader records, slot versions of 0.
+	RingHeader* header = new (mMemory.GetData()) RingHeader();
+	header->version = RingVersion;
+	header->slotCount = slotCount;
+	header->maxReaders = maxReaders;
+	header->slotBytes = slotBytes;
+	header->slotStride = slotStride;
+	header->readersOffset = readersOffset;
+	header->slotsOffset = slotsOffset;
+	header->regionBytes = regionBytes;
+	header->published.store(0, std::memory_order_relaxed);
+	header->writerHeartbeat.store(HeartbeatNow(), std::memory_order_relaxed);
+	for (unsigned i = 0; i < maxReaders; i++) {
+		new (mMemory.GetData() + readersOffset + i * sizeof(ReaderRecord)) ReaderRecord();
+	}
+	for (unsigned i = 0; i < slotCount; i++) {
+		new (mMemory.GetData() + slotsOffset + i * slotStride) SlotHeader();
+	}
+	header->magic.store(RingMagic, std::memory_order_release);
+
+	mHeader = header;
+	mSlotBytes = slotBytes;
+	mNext = 1;
+	mWriting = false;
+	mStats = SharedWriterStats();
+	return true;
+}
+
+void SharedFrameWriter::Close() {
+	mMemory.Close();
+	mHeader = nullptr;
+	mSlotBytes = 0;
+}
+
+uint8_t* SharedFrameWriter::BeginWrite() {
+	if (!mHeader) {
+		return nullptr;
+	}
+	RingHeader* header = static_cast<RingHeader*>(mHeader);
+	SlotHeader* slot = Slot(header, mNext);
+	// Odd first: a reader that checks the version after reading knows it was overwritten.
+	slot->version.store(2 * mNext - 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	mWriting = true;
+	return SlotData(slot);
+}
+
+uint64_t SharedFrameWriter::Publish(const SharedFrameInfo& info) {
+	if (!mHeader || !mWriting) {
+		return 0;
+	}
+	RingHeader* header = static_cast<RingHeader*>(mHeader);
+	uint64_t sequence = mNext++;
+	SlotHeader* slot = Slot(header, sequence);
+	slot->info = info;
+	slot->version.store(2 * sequence, std::memory_order_release);
+	header->published.store(sequence, std::memory_order_release);
+	header->writerHeartbeat.store(HeartbeatNow(), std::memory_order_relaxed);
+	mWriting = false;
+
+	mStats.published++;
+	// The next frame overwrites the oldest slot; a reader whose cursor is that far back
+	// is about to lose a frame.
+	unsigned readers = 0;
+	bool slow = false;
+	ReaderRecord* records = Readers(header);
+	for (unsigned i = 0; i < header->maxReaders; i++) {
+		if (records[i].owner.load(std::memory_order_acquire) != 0) {
+			readers++;
+			slow |= sequence - records[i].cursor.load(std::memory_order_relaxed) >= header->slotCount - 1;
+		}
+	}
+	mStats.readers = readers;
+	mStats.slowFrames += slow ? 1 : 0;
+	return sequence;
+}
+
+unsigned SharedFrameWriter::ReclaimStaleReaders(double timeoutMilliseconds) {
+	if (!mHeader) {
+		return 0;
+	}
+	RingHeader* header = static_cast<RingHeader*>(mHeader);
+	ReaderRecord* records = Readers(header);
+	unsigned reclaimed = 0;
+	for (unsigned i = 0; i < header->maxReaders; i++) {
+		uint64_t owner = records[i].owner.load(std::memory_order_acquire);
+		if (owner != 0 && IdleMilliseconds(records[i].heartbeat.load(std::memory_order_relaxed)) > timeoutMilliseconds &&
+			records[i].owner.compare_exchange_strong(owner, 0, std::memory_order_acq_rel)) {
+			reclaimed++;
+		}
+	}
+	mStats.reclaimed += reclaimed;
+	return reclaimed;
+}
+
+std::vector<SharedReaderState> SharedFrameWriter::GetReaders() const {
+	std::vector<SharedReaderState> states;
+	if (!mHeader) {
+		return states;
+	}
+	RingHeader* header = static_cast<RingHeader*>(mHeader);
+	ReaderRecord* records = Readers(header);
+	uint64_t published = header->published.load(std::memory_order_relaxed);
+	for (unsigned i = 0; i < header->maxReaders; i++) {
+		if (records[i].owner.load(std::memory_order_acquire) == 0) {
+			continue;
+		}
+		SharedReaderState state;
+		state.index = i;
+		state.cursor = records[i].cursor.load(std::memory_order_relaxed);
+		state.lag = published > state.cursor ? published - state.cursor : 0;
+		state.slow = state.lag >= header->slotCount - 1;
+		state.idleMilliseconds = IdleMilliseconds(records[i].heartbeat.load(std::memory_order_relaxed));
+		states.push_back(state);
+	}
+	return states;
+}
+
+SharedFrameReader::SharedFrameReader() :
+	mHeader(nullptr),
+	mIndex(0),
+	mToken(0),
+	mCursor(0) {
+	std::random_device random;
+	while (mToken == 0) {
+		mToken = uint64_t(random()) << 32 | random();
+	}
+}
+
+SharedFrameReader::~SharedFrameReader() {
+	Close();
+}
+
+bool SharedFrameReader::Open(const std::string& name) {
+	Close();
+	if (!mMemory.Open(name) || mMemory.GetSize() < sizeof(RingHeader)) {
+		mMemory.Close();
+		return false;
+	}
+	RingHeader* header = reinterpret_cast<RingHeader*>(mMemory.GetData());
+	// Never trust the layout of a region some other process wrote.
+	if (header->magic.load(std::memory_order_acquire) != RingMagic || header->version != RingVersion || header->slotCount < 2 ||
+		header->maxReaders == 0 || header->regionBytes > mMemory.GetSize() ||
+		header->slotStride < AlignUp(sizeof(SlotHeader), CacheLine) + header->slotBytes ||
+		header->readersOffset + uint64_t(header->maxReaders) * sizeof(ReaderRecord) > header->slotsOffset ||
+		header->slotsOffset + uint64_t(header->slotCount) * header->slotStride > header->regionBytes) {
+		mMemory.Close();
+		return false;
+	}
+	mHeader = header;
+	mStats = SharedReaderStats();
+	if (!Register()) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool SharedFrameReader::Register() {
+	RingHeader* header = static_cast<RingHeader*>(mHeader);
+	ReaderRecord* records = Readers(header);
+	for (unsigned i = 0; i < header->maxReaders; i++) {
+		uint64_t free = 0;
+		if (records[i].owner.compare_exchange_strong(free, mToken, std::memory_order_acq_rel)) {
+			mIndex = i;
+			mCursor = header->published.load(std::memory_order_acquire);
+			records[i].heartbeat.store(HeartbeatNow(), std::memory_order_relaxed);
+			records[i].cursor.store(mCursor, std::memory_order_release);
+			return true;
+		}
+	}
+	return false;
+}
+
+void SharedFrameReader::Close() {
+	if (mHeader) {
+		uint64_t token = mToken;
+		Readers(static_cast<RingHeader*>(mHeader))[mIndex].owner.compare_exchange_strong(token, 0, std::memory_order_acq_rel);
+	}
+	mMemory.Close();
+	mHeader = nullptr;
+	mCursor = 0;
+}
+
+bool SharedFrameReader::Acquire(SharedFrameView& view) {
+	if (!mHeader) {
+		return false;
+	}
+	RingHeader* header = static_cast<RingHeader*>(mHeader);
+	ReaderRecord& record = Readers(header)[mIndex];
+	if (record.owner.load(std::memory_order_acquire) != mToken) {
+		// Reclaimed while this process was not calling in; start over from the newest frame.
+		mStats.evicted++;
+		if (!Register()) {
+			return false;
+		}
+	}
+	record.heartbeat.store(HeartbeatNow(), std::memory_order_relaxed);
+
+	// A few tries: each failure means the writer lapped this reader in the meantime.
+	for (int attempt = 0; attempt < 4; attempt++) {
+		uint64_t published = header->published.load(std::memory_order_acquire);
+		if (published <= mCursor) {
+			return false;
+		}
+		uint64_t sequence = mCursor + 1;
+		// The slot after the newest frame may already be half overwritten; leave it out.
+		uint64_t oldest = published >= header->slotCount ? published - header->slotCount + 2 : 1;
+		if (sequence < oldest) {
+			mStats.skipped += oldest - sequence;
+			sequence = oldest;
+		}
+		SlotHeader* slot = Slot(header, sequence);
+		if (slot->version.load(std::memory_order_acquire) != 2 * sequence) {
+			mStats.skipped++;
+			mCursor = sequence;
+			continue;
+		}
+		SharedFrameInfo info = slot->info;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot->version.load(std::memory_order_relaxed) != 2 * sequence) {
+			mStats.skipped++;
+			mCursor = sequence;
+			continue;
+		}
+		mCursor = sequence;
+		record.cursor.store(sequence, std::memory_order_release);
+		if (info.bytes > header->slotBytes) {
+			// Intact but nonsense; nothing to read in place.
+			mStats.torn++;
+			return false;
+		}
+		view.sequence = sequence;
+		view.info = info;
+		view.data = SlotData(slot);
+		mStats.frames++;
+		return true;
+	}
+	record.cursor.store(mCursor, std::memory_order_release);
+	return false;
+}
+
+bool SharedFrameReader::Release(const SharedFrameView& view) {
+	if (!mHeader || view.sequence == 0) {
+		return false;
+	}
+	// Orders the reads of the frame before the version check.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	bool intact = Slot(static_cast<RingHeader*>(mHeader), view.sequence)->version.load(std::memory_order_relaxed) == 2 * view.sequence;
+	if (!intact) {
+		mStats.torn++;
+	}
+	return intact;
+}
+
+double SharedFrameReader::GetWriterIdleMilliseconds() const {
+	if (!mHeader) {
+		return 0.0;
+	}
+	return IdleMilliseconds(static_cast<RingHeader*>(mHeader)->writerHeartbeat.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	// A named region of memory that other processes can map: POSIX shared memory, or a
+	// pagefile backed file mapping on Windows. Mapped read-write on both sides.
+	class SharedMemory {
+	public:
+		SharedMemory();
+		~SharedMemory();
+		SharedMemory(const SharedMemory&) = delete;
+		SharedMemory& operator=(const SharedMemory&) = delete;
+
+		// Zero filled. On POSIX a region left behind by a process that died is replaced;
+		// on Windows the name is only free once every process mapping it let go, and
+		// this fails until then. Names are "/name" on POSIX and a kernel object name,
+		// resolved in the app container's namespace, on Windows.
+		bool Create(const std::string& name, size_t size);
+		bool Open(const std::string& name);
+		// Creators also remove the name, so nothing can open the region any more.
+		void Close();
+
+		bool IsOpen() const { return mData != nullptr; }
+		uint8_t* GetData() const { return mData; }
+		size_t GetSize() const { return mSize; }
+
+	private:
+		uint8_t* mData;
+		size_t mSize;
+		void* mMapping;		// HANDLE on Windows, unused elsewhere
+		std::string mName;	// Unlinked by the creator on POSIX
+		bool mCreated;
+	};
+
+	inline uint32_t MakeFourCC(char a, char b, char c, char d) {
+		return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+	}
+
+	// Metadata stored next to each frame. Plain data, so readers written in any
+	// language can lay it out the same way.
+	struct SharedFrameInfo {
+		static const unsigned MaxPlanes = 4;
+
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t format = 0;		// FourCC, like MakeFourCC('N', 'V', '1', '2')
+		uint32_t planeCount = 0;
+		uint32_t planeOffsets[MaxPlanes] = {};	// Bytes from the start of the frame's data
+		uint32_t planeStrides[MaxPlanes] = {};
+		uint64_t bytes = 0;			// Of data, at most the ring's slot size
+		int64_t timestamp = 0;		// 100 ns units, as delivered by the capture source
+		uint64_t frameNumber = 0;	// The producer's own numbering, which may have gaps
+	};
+
+	struct SharedFrameView {
+		uint64_t sequence = 0;		// From 1, one per published frame
+		SharedFrameInfo info;
+		const uint8_t* data = nullptr;	// In the shared region; valid until Release
+	};
+
+	struct SharedReaderState {
+		unsigned index = 0;
+		uint64_t cursor = 0;		// Sequence of the frame it took last
+		uint64_t lag = 0;			// Frames published since
+		bool slow = false;			// Far enough behind that the next frames overwrite what it has not read
+		double idleMilliseconds = 0.0;	// Since it last called in
+	};
+
+	struct SharedWriterStats {
+		uint64_t published = 0;
+		unsigned readers = 0;
+		uint64_t slowFrames = 0;	// Frames published while some reader was slow
+		uint64_t reclaimed = 0;		// Readers dropped for not calling in
+	};
+
+	struct SharedReaderStats {
+		uint64_t frames = 0;		// Acquired
+		uint64_t skipped = 0;		// Overwritten before this reader got to them
+		uint64_t torn = 0;			// Overwritten while this reader was reading them
+		uint64_t evicted = 0;		// Times the writer reclaimed this reader as stale
+	};
+
+	// Producer side of a single-producer, multi-consumer ring of fixed frame slots in
+	// shared memory. A frame is written once, straight into its slot, and read in place
+	// by the other processes. The producer never waits: a reader that falls a whole ring
+	// behind loses frames, and a slot being read while it is overwritten is caught by the
+	// slot's sequence check. Every reader has a cursor in the region, so the producer
+	// can see who is slow and reclaim readers whose process died.
+	class SharedFrameWriter {
+	public:
+		SharedFrameWriter();
+		~SharedFrameWriter();
+		SharedFrameWriter(const SharedFrameWriter&) = delete;
+		SharedFrameWriter& operator=(const SharedFrameWriter&) = delete;
+
+		// At least two slots; slotBytes is the most data one frame can have.
+		bool Create(const std::string& name, unsigned slotCount, size_t slotBytes, unsigned maxReaders = 8);
+		void Close();
+
+		bool IsOpen() const { return mHeader != nullptr; }
+		size_t GetSlotBytes() const { return mSlotBytes; }
+		// Of the whole region, metadata and slots.
+		size_t GetRegionBytes() const { return mMemory.GetSize(); }
+
+		// The slot the next frame goes into, 64 byte aligned. Readers skip it from here
+		// until Publish.
+		uint8_t* BeginWrite();
+		// Publishes the frame begun last and returns its sequence.
+		uint64_t Publish(const SharedFrameInfo& info);
+
+		// Drops readers that have not called in for this long, as after their process died.
+		unsigned ReclaimStaleReaders(double timeoutMilliseconds);
+		std::vector<SharedReaderState> GetReaders() const;
+		const SharedWriterStats& GetStats() const { return mStats; }
+
+	private:
+		SharedMemory mMemory;
+		void* mHeader;		// RingHeader in the region
+		size_t mSlotBytes;
+		uint64_t mNext;
+		bool mWriting;
+		SharedWriterStats mStats;
+	};
+
+	class SharedFrameReader {
+	public:
+		SharedFrameReader();
+		~SharedFrameReader();
+		SharedFrameReader(const SharedFrameReader&) = delete;
+		SharedFrameReader& operator=(const SharedFrameReader&) = delete;
+
+		// Takes a reader record, starting after the newest frame. Fails when the region
+		// does not exist yet, is still being set up, or has no free reader record.
+		bool Open(const std::string& name);
+		void Close();
+
+		bool IsOpen() const { return mHeader != nullptr; }
+
+		// The frame after the last one taken, in place. A reader more than a ring behind
+		// jumps to the oldest frame still there and counts the rest as skipped. False
+		// when there is nothing new.
+		bool Acquire(SharedFrameView& view);
+		// True when the frame was left intact while it was read. Otherwise the writer
+		// overwrote it, and anything computed from it must be thrown away.
+		bool Release(const SharedFrameView& view);
+
+		// Time since the producer last published. A producer that restarted creates a
+		// new region, so a reader that sees this grow should reopen.
+		double GetWriterIdleMilliseconds() const;
+		const SharedReaderStats& GetStats() const { return mStats; }
+
+	private:
+		bool Register();
+
+		SharedMemory mMemory;
+		void* mHeader;		// RingHeader in the region
+		unsigned mIndex;
+		uint64_t mToken;
+		uint64_t mCursor;
+		SharedReaderStats mStats;
+	};
+}
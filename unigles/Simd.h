@@ -0,0 +1,12 @@
+#pragma once
+
+// Selects the vector instruction set used by the portable image kernels.
+// Every kernel keeps a scalar path, so unknown targets still build.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define UNIGLES_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define UNIGLES_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
@@ -6,6 +6,9 @@
 #include "SimpleRenderer.h"
 #include "MathHelper.h"
 
+#include <algorithm>
+#include <iterator>
+
 // These are used by the shader compilation methods.
 #include <vector>
 #include <iostream>
@@ -17,6 +20,71 @@ using namespace unigles;
 
 #define STRING(s) #s
 
+// User data of the objects in the scene tree.
+static const uint32_t CubeObject = 0;
+
+// The full mesh bulges every face out by this much at its center, over a grid of
+// CubeSubdivisions squared quads; its coarser level is the plain cube, whose error that is.
+static const float CubeBulge = 0.08f;
+static const unsigned CubeSubdivisions = 8;
+
+// Source of every variant of the cube's shaders. Preprocessor lines cannot go through
+// the STRING macro, hence the raw strings.
+static const char* CubeVertexShader = R"(
+uniform mat4 uModelMatrix;
+uniform mat4 uViewMatrix;
+uniform mat4 uProjMatrix;
+attribute vec4 aPosition;
+#if defined(CAMERA_TEXTURE)
+varying vec2 vTexCoord;
+#else
+attribute vec4 aColor;
+varying vec4 vColor;
+#endif
+void main() {
+	gl_Position = uProjMatrix * uViewMatrix * uModelMatrix * aPosition;
+#if defined(CAMERA_TEXTURE)
+	vTexCoord = (vec2(1.0, 1.0) + aPosition.xy) * 0.5;
+#else
+	vColor = aColor;
+#endif
+}
+)";
+
+// CPU-side frames arrive as NV12 planes and are converted here, with the coefficients
+// of the Direct3D conversion pass. Their rows are stored top down, while the converted
+// camera texture is bottom up, hence the flip.
+static const char* CubeFragmentShader = R"(
+precision mediump float;
+#if defined(NV12_PLANES)
+uniform sampler2D uLumaTexture;
+uniform sampler2D uChromaTexture;
+#elif defined(CAMERA_TEXTURE)
+uniform sampler2D uCameraTexture;
+#endif
+#if defined(CAMERA_TEXTURE)
+varying vec2 vTexCoord;
+#else
+varying vec4 vColor;
+#endif
+void main() {
+#if defined(NV12_PLANES)
+	vec2 uv = vec2(vTexCoord.x, 1.0 - vTexCoord.y);
+	float lum = texture2D(uLumaTexture, uv).r - 16.0 / 256.0;
+	vec2 chrom = texture2D(uChromaTexture, uv).ra - vec2(128.0 / 256.0);
+	gl_FragColor = vec4(
+		1.164 * lum + 1.596 * chrom.y,
+		1.164 * lum - 0.813 * chrom.y - 0.391 * chrom.x,
+		1.164 * lum + 2.018 * chrom.x,
+		1.0);
+#elif defined(CAMERA_TEXTURE)
+	gl_FragColor = texture2D(uCameraTexture, vTexCoord);
+#else
+	gl_FragColor = vColor;
+#endif
+}
+)";
+
 GLuint CompileShader(GLenum type, const std::string &source) {
 	GLuint shader = glCreateShader(type);
 
@@ -87,57 +155,80 @@ GLuint CompileProgram(const std::string &vsSource, const std::string &fsSource)
 	return program;
 }
 
-SimpleRenderer::SimpleRenderer() :
-	mWindowWidth(0),
-	mWindowHeight(0),
-	mDrawCount(0) {
-	// Vertex Shader source
-	const std::string vs = STRING
-	(
-		uniform mat4 uModelMatrix;
-	uniform mat4 uViewMatrix;
-	uniform mat4 uProjMatrix;
-	attribute vec4 aPosition;
-	attribute vec4 aColor;
-	varying vec4 vColor;
-	varying vec2 vTexCoord;
-	void main() {
-		gl_Position = uProjMatrix * uViewMatrix * uModelMatrix * aPosition;
-		vColor = aColor;
-		if (aPosition.z > 0.99) {
-			vTexCoord = (vec2(1.0, 1.0) + aPosition.xy) * 0.5;
-		} else {
-			vTexCoord = vec2(-100.0, -100.0);
+// In model space, around the bulge of the full mesh.
+static Aabb CubeBounds() {
+	const float extent = 1.0f + CubeBulge;
+	return Aabb::FromCenterExtents(0.0f, 0.0f, 0.0f, extent, extent, extent);
+}
+
+// Appends the faces of the bulged cube in the order of the plain one, -x to +z, each wound
+// counter-clockwise seen from outside. Colors are those of the plain cube at the same
+// spot, so both levels shade alike.
+static void AppendBulgedCube(std::vector<GLfloat>& positions, std::vector<GLfloat>& colors, std::vector<short>& indices) {
+	const unsigned side = CubeSubdivisions + 1;
+	for (unsigned face = 0; face < 6; face++) {
+		unsigned axis = face / 2;
+		float sign = (face % 2) ? 1.0f : -1.0f;
+		// Tangents whose cross product is the outward normal.
+		unsigned a = (face % 2) ? (axis + 1) % 3 : (axis + 2) % 3;
+		unsigned b = (face % 2) ? (axis + 2) % 3 : (axis + 1) % 3;
+		short first = short(positions.size() / 3);
+		for (unsigned j = 0; j < side; j++) {
+			for (unsigned i = 0; i < side; i++) {
+				float u = 2.0f * i / CubeSubdivisions - 1.0f;
+				float v = 2.0f * j / CubeSubdivisions - 1.0f;
+				float flat[3];
+				flat[axis] = sign;
+				flat[a] = u;
+				flat[b] = v;
+				for (unsigned c = 0; c < 3; c++) {
+					float bulge = c == axis ? sign * CubeBulge * (1.0f - u * u) * (1.0f - v * v) : 0.0f;
+					positions.push_back(flat[c] + bulge);
+					colors.push_back((flat[c] + 1.0f) * 0.5f);
+				}
+			}
 		}
-	}
-	);
-
-	// Fragment Shader source
-	const std::string fs = STRING
-	(
-		precision mediump float;
-	uniform sampler2D uCameraTexture;
-	varying vec4 vColor;
-	varying vec2 vTexCoord;
-	void main() {
-		if (vTexCoord.x < 0.0) {
-			gl_FragColor = vColor;
-		} else {
-			gl_FragColor = texture2D(uCameraTexture, vTexCoord);
+		for (unsigned j = 0; j < CubeSubdivisions; j++) {
+			for (unsigned i = 0; i < CubeSubdivisions; i++) {
+				short corner = short(first + j * side + i);
+				indices.push_back(corner);
+				indices.push_back(short(corner + 1));
+				indices.push_back(short(corner + side));
+				indices.push_back(short(corner + side));
+				indices.push_back(short(corner + 1));
+				indices.push_back(short(corner + side + 1));
+			}
 		}
 	}
-	);
-
-	// Set up the shader and its uniform/attribute locations.
-	mProgram = CompileProgram(vs, fs);
-	mPositionAttribLocation = glGetAttribLocation(mProgram, "aPosition");
-	mColorAttribLocation = glGetAttribLocation(mProgram, "aColor");
-	mModelUniformLocation = glGetUniformLocation(mProgram, "uModelMatrix");
-	mViewUniformLocation = glGetUniformLocation(mProgram, "uViewMatrix");
-	mProjUniformLocation = glGetUniformLocation(mProgram, "uProjMatrix");
-	mTextureLocation = glGetUniformLocation(mProgram, "uCameraTexture");
-
-	glGenTextures(1, &mTexture);
+}
+
+SimpleRenderer::SimpleRenderer(ResourceTracker& resources) :
+	mWindowWidth(0),
+	mWindowHeight(0),
+	mCameraTextureFeature(0),
+	mNv12PlanesFeature(0),
+	mLumaTexture(0),
+	mChromaTexture(0),
+	mDrawCount(0),
+	mCubeProxy(SceneBvh::NullProxy),
+	mCubeLevel(0),
+	mCameraWidth(0),
+	mCameraHeight(0),
+	mCameraLevels(1),
+	mCameraLevel(0) {
+	ShaderPermutations permutations;
+	mCameraTextureFeature = permutations.AddFeature("CAMERA_TEXTURE");
+	mNv12PlanesFeature = permutations.AddFeature("NV12_PLANES", mCameraTextureFeature);
+	mVariants.reset(new ShaderVariantCache(permutations, [this](PermutationKey key, const ShaderPermutations& features) {
+		return CompileVariant(key, features);
+	}, [](uint32_t program) {
+		glDeleteProgram(program);
+	}));
+	// Three variants; building them all now keeps the compiler off the first frames.
+	mVariants->Precompile(permutations.GetValidKeys());
+
+	// The camera pbuffer is bound to the default texture, which has no mips and is rarely
+	// a power of two, so it samples without mipmaps and clamps.
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -156,10 +247,6 @@ SimpleRenderer::SimpleRenderer() :
 		 1.0f,  1.0f,  1.0f,
 	};
 
-	glGenBuffers(1, &mVertexPositionBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, mVertexPositionBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertexPositions), vertexPositions, GL_STATIC_DRAW);
-
 	GLfloat vertexColors[] =
 	{
 		0.0f, 0.0f, 0.0f,
@@ -172,10 +259,6 @@ SimpleRenderer::SimpleRenderer() :
 		1.0f, 1.0f, 1.0f,
 	};
 
-	glGenBuffers(1, &mVertexColorBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, mVertexColorBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertexColors), vertexColors, GL_STATIC_DRAW);
-
 	short indices[] =
 	{
 		0, 1, 2, // -x
@@ -197,16 +280,36 @@ SimpleRenderer::SimpleRenderer() :
 		1, 5, 7,
 	};
 
+	// Both levels share the buffers: the bulged cube follows the plain one.
+	std::vector<GLfloat> positions(std::begin(vertexPositions), std::end(vertexPositions));
+	std::vector<GLfloat> colors(std::begin(vertexColors), std::end(vertexColors));
+	std::vector<short> allIndices(std::begin(indices), std::end(indices));
+	AppendBulgedCube(positions, colors, allIndices);
+	GLsizei plainCount = GLsizei(sizeof(indices) / sizeof(indices[0]));
+	mCubeLods.push_back(MeshLod{ 0.0f, uint32_t(allIndices.size() - plainCount) / 3 });
+	mCubeMeshes.push_back(CubeMesh{ plainCount, GLsizei(allIndices.size()) - plainCount });
+	mCubeLods.push_back(MeshLod{ CubeBulge, uint32_t(plainCount) / 3 });
+	mCubeMeshes.push_back(CubeMesh{ 0, plainCount });
+
+	glGenBuffers(1, &mVertexPositionBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mVertexPositionBuffer);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(GLfloat), positions.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &mVertexColorBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mVertexColorBuffer);
+	glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(GLfloat), colors.data(), GL_STATIC_DRAW);
+
 	glGenBuffers(1, &mIndexBuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, allIndices.size() * sizeof(short), allIndices.data(), GL_STATIC_DRAW);
+	mGeometryMemory = resources.Track(ResourceHeap::Gl, "Renderer", "buffers",
+		(positions.size() + colors.size()) * sizeof(GLfloat) + allIndices.size() * sizeof(short), "cube geometry");
+
+	mCubeProxy = mScene.Insert(CubeBounds(), CubeObject);
 }
 
 SimpleRenderer::~SimpleRenderer() {
-	if (mProgram != 0) {
-		glDeleteProgram(mProgram);
-		mProgram = 0;
-	}
+	mVariants.reset();
 
 	if (mVertexPositionBuffer != 0) {
 		glDeleteBuffers(1, &mVertexPositionBuffer);
@@ -222,6 +325,21 @@ SimpleRenderer::~SimpleRenderer() {
 		glDeleteBuffers(1, &mIndexBuffer);
 		mIndexBuffer = 0;
 	}
+	mGeometryMemory.Reset();
+}
+
+GLuint SimpleRenderer::CompileVariant(PermutationKey key, const ShaderPermutations& permutations) {
+	GLuint program = CompileProgram(permutations.Generate(key, CubeVertexShader), permutations.Generate(key, CubeFragmentShader));
+	VariantLocations& locations = mVariantLocations[key];
+	locations.position = glGetAttribLocation(program, "aPosition");
+	locations.color = glGetAttribLocation(program, "aColor");
+	locations.model = glGetUniformLocation(program, "uModelMatrix");
+	locations.view = glGetUniformLocation(program, "uViewMatrix");
+	locations.projection = glGetUniformLocation(program, "uProjMatrix");
+	locations.cameraTexture = glGetUniformLocation(program, "uCameraTexture");
+	locations.lumaTexture = glGetUniformLocation(program, "uLumaTexture");
+	locations.chromaTexture = glGetUniformLocation(program, "uChromaTexture");
+	return program;
 }
 
 void SimpleRenderer::Draw() {
@@ -232,33 +350,121 @@ void SimpleRenderer::Draw() {
 
 	glEnable(GL_DEPTH_TEST);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	mCounts = RenderCounts();
 
-	if (mProgram == 0) return;
+	bool planes = mLumaTexture != 0 && mChromaTexture != 0;
 
-	glUseProgram(mProgram);
+	MathHelper::Matrix4 modelMatrix = MathHelper::SimpleModelMatrix((float)mDrawCount / 50.0f);
+	MathHelper::Matrix4 viewMatrix = MathHelper::SimpleViewMatrix();
+	MathHelper::Matrix4 projectionMatrix = MathHelper::SimpleProjectionMatrix(float(mWindowWidth) / float(mWindowHeight));
 
-	glBindBuffer(GL_ARRAY_BUFFER, mVertexPositionBuffer);
-	glEnableVertexAttribArray(mPositionAttribLocation);
-	glVertexAttribPointer(mPositionAttribLocation, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	// The cube spins in place, so its world bounds follow the model matrix.
+	mScene.Move(mCubeProxy, CubeBounds().Transformed(&(modelMatrix.m[0][0])));
+	MathHelper::Matrix4 viewProjection = MathHelper::MultiplyMatrices(projectionMatrix, viewMatrix);
+	mScene.Cull(Frustum::FromViewProjection(&(viewProjection.m[0][0])), mVisible);
+	float pixelsPerUnit = LodSelector::PixelsPerUnit(&(projectionMatrix.m[0][0]), mWindowHeight);
+	mLod.BeginFrame(pixelsPerUnit);
+	if (std::find(mVisible.begin(), mVisible.end(), CubeObject) == mVisible.end()) {
+		mDrawCount += 1;
+		return;
+	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, mVertexColorBuffer);
-	glEnableVertexAttribArray(mColorAttribLocation);
-	glVertexAttribPointer(mColorAttribLocation, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	// View depth of the cube's center, and of the camera face one unit in front of it.
+	MathHelper::Matrix4 modelView = MathHelper::MultiplyMatrices(viewMatrix, modelMatrix);
+	float cubeDistance = -modelView.m[3][2];
+	float faceDistance = -(modelView.m[2][2] + modelView.m[3][2]);
+	mCubeLevel = mLod.SelectMesh(mCubeLods, cubeDistance, mCubeLevel);
+	if (!planes) {
+		// The face is two units across; seen head-on that is its largest footprint.
+		float footprint = 2.0f * pixelsPerUnit / (std::max)(faceDistance, 1.0e-3f);
+		mCameraLevel = mLod.SelectTexture(mCameraWidth, mCameraHeight, mCameraLevels, footprint, mCameraLevel);
+	}
+
+	// Each face draws with the variant that has just what it needs: five with vertex
+	// colors, the camera face with the camera texture or the planes. The +z face that
+	// shows the camera is the last sixth of either level's indices.
+	const CubeMesh& mesh = mCubeMeshes[mCubeLevel];
+	GLsizei faceCount = mesh.indexCount / 6;
+	GLsizei cameraFirst = mesh.firstIndex + 5 * faceCount;
+	DrawFaces(0, mesh.firstIndex, 5 * faceCount, &(modelMatrix.m[0][0]), &(viewMatrix.m[0][0]), &(projectionMatrix.m[0][0]));
+	PermutationKey cameraKey = planes ? mCameraTextureFeature | mNv12PlanesFeature : mCameraTextureFeature;
+	DrawFaces(cameraKey, cameraFirst, faceCount, &(modelMatrix.m[0][0]), &(viewMatrix.m[0][0]), &(projectionMatrix.m[0][0]));
+
+	mDrawCount += 1;
+}
 
+DamageRect SimpleRenderer::GetNextDrawBounds() const {
+	if (mWindowWidth <= 0 || mWindowHeight <= 0) {
+		return DamageRect();
+	}
 	MathHelper::Matrix4 modelMatrix = MathHelper::SimpleModelMatrix((float)mDrawCount / 50.0f);
-	glUniformMatrix4fv(mModelUniformLocation, 1, GL_FALSE, &(modelMatrix.m[0][0]));
+	MathHelper::Matrix4 viewProjection = MathHelper::MultiplyMatrices(MathHelper::SimpleProjectionMatrix(float(mWindowWidth) / float(mWindowHeight)),
+		MathHelper::SimpleViewMatrix());
+	Aabb cubeBounds = CubeBounds().Transformed(&(modelMatrix.m[0][0]));
+	return ProjectBounds(cubeBounds, &(viewProjection.m[0][0]), mWindowWidth, mWindowHeight);
+}
 
-	MathHelper::Matrix4 viewMatrix = MathHelper::SimpleViewMatrix();
-	glUniformMatrix4fv(mViewUniformLocation, 1, GL_FALSE, &(viewMatrix.m[0][0]));
+void SimpleRenderer::DrawFaces(PermutationKey key, GLsizei firstIndex, GLsizei count, const float* model, const float* view, const float* projection) {
+	GLuint program = mVariants->Get(key);
+	if (program == 0) return;
+	const VariantLocations& locations = mVariantLocations[key];
+	bool planes = (key & mNv12PlanesFeature) != 0;
 
-	MathHelper::Matrix4 projectionMatrix = MathHelper::SimpleProjectionMatrix(float(mWindowWidth) / float(mWindowHeight));
-	glUniformMatrix4fv(mProjUniformLocation, 1, GL_FALSE, &(projectionMatrix.m[0][0]));
+	glUseProgram(program);
+	mCounts.programChanges++;
+
+	glBindBuffer(GL_ARRAY_BUFFER, mVertexPositionBuffer);
+	glEnableVertexAttribArray(locations.position);
+	glVertexAttribPointer(locations.position, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	if (locations.color >= 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, mVertexColorBuffer);
+		glEnableVertexAttribArray(locations.color);
+		glVertexAttribPointer(locations.color, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	}
+
+	glUniformMatrix4fv(locations.model, 1, GL_FALSE, model);
+	glUniformMatrix4fv(locations.view, 1, GL_FALSE, view);
+	glUniformMatrix4fv(locations.projection, 1, GL_FALSE, projection);
+
+	if (planes) {
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, mChromaTexture);
+		glUniform1i(locations.chromaTexture, 1);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, mLumaTexture);
+		glUniform1i(locations.lumaTexture, 0);
+		mCounts.textureBinds += 2;
+	} else if (locations.cameraTexture >= 0) {
+		glUniform1i(locations.cameraTexture, 0);
+	}
 
-	// Draw 36 indices: six faces, two triangles per face, 3 indices per triangle
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
-	glDrawElements(GL_TRIANGLES, (6 * 2) * 3, GL_UNSIGNED_SHORT, 0);
+	glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, reinterpret_cast<const void*>(firstIndex * sizeof(short)));
+	mCounts.drawCalls++;
 
-	mDrawCount += 1;
+	if (locations.color >= 0) {
+		glDisableVertexAttribArray(locations.color);
+	}
+	if (planes) {
+		// The camera pbuffer is bound to the default texture; leave it current for the next draw.
+		glBindTexture(GL_TEXTURE_2D, 0);
+		mCounts.textureBinds++;
+	}
+}
+
+void SimpleRenderer::SetCameraPlanes(GLuint lumaTexture, GLuint chromaTexture) {
+	mLumaTexture = lumaTexture;
+	mChromaTexture = chromaTexture;
+}
+
+void SimpleRenderer::SetCameraTextureLevels(unsigned fullWidth, unsigned fullHeight, unsigned levels) {
+	mCameraWidth = fullWidth;
+	mCameraHeight = fullHeight;
+	mCameraLevels = levels < 1 ? 1 : levels;
+	if (mCameraLevel >= mCameraLevels) {
+		mCameraLevel = mCameraLevels - 1;
+	}
 }
 
 void SimpleRenderer::UpdateWindowSize(GLsizei width, GLsizei height) {
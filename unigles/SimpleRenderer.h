@@ -1,35 +1,104 @@
 #pragma once
 
 #include "pch.h"
+#include "DamageTracker.h"
+#include "LodSelector.h"
+#include "ResourceTracker.h"
+#include "SceneBvh.h"
+#include "ShaderPermutations.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace unigles
 {
+    // GL work issued by one Draw, for budgets on state changes as well as time.
+    struct RenderCounts {
+        unsigned drawCalls = 0;
+        unsigned programChanges = 0;
+        unsigned textureBinds = 0;
+    };
+
     class SimpleRenderer
     {
     public:
-        SimpleRenderer();
+        // Buffers and textures are counted by the tracker, which must outlive the renderer.
+        explicit SimpleRenderer(ResourceTracker& resources);
         ~SimpleRenderer();
         void Draw();
         void UpdateWindowSize(GLsizei width, GLsizei height);
+        // Samples the camera face from NV12 planes instead of the bound camera texture.
+        // Passing 0 goes back to the camera texture.
+        void SetCameraPlanes(GLuint lumaTexture, GLuint chromaTexture);
+        // Objects tested against the view frustum by the last Draw.
+        const CullStats& GetCullStats() const { return mScene.GetCullStats(); }
+        // Size of the camera texture at level 0 and how many halved variants exist.
+        void SetCameraTextureLevels(unsigned fullWidth, unsigned fullHeight, unsigned levels);
+        // Variant the camera face should sample at its current size on screen.
+        unsigned GetCameraTextureLevel() const { return mCameraLevel; }
+        const LodStats& GetLodStats() const { return mLod.GetStats(); }
+        // Shader variants built so far and what building them cost.
+        unsigned GetShaderVariantCount() const { return mVariants->GetVariantCount(); }
+        const ShaderVariantStats& GetShaderVariantStats() const { return mVariants->GetStats(); }
+        const RenderCounts& GetRenderCounts() const { return mCounts; }
+        // Window pixels the next Draw can touch, from the cube's bounds at its next angle.
+        DamageRect GetNextDrawBounds() const;
 
     private:
-        GLuint mProgram;
+        struct VariantLocations {
+            GLint position;
+            GLint color;        // -1 in the camera variants, which have no vertex colors
+            GLint model;
+            GLint view;
+            GLint projection;
+            GLint cameraTexture;
+            GLint lumaTexture;
+            GLint chromaTexture;
+        };
+
+        // Index range of one mesh level of the cube.
+        struct CubeMesh {
+            GLsizei firstIndex;
+            GLsizei indexCount;
+        };
+
+        GLuint CompileVariant(PermutationKey key, const ShaderPermutations& permutations);
+        void DrawFaces(PermutationKey key, GLsizei firstIndex, GLsizei count, const float* model, const float* view, const float* projection);
+
         GLsizei mWindowWidth;
         GLsizei mWindowHeight;
 
-        GLint mPositionAttribLocation;
-        GLint mColorAttribLocation;
+        // The cube's uber shader: vertex colored faces by default, the camera face with
+        // CAMERA_TEXTURE, sampling NV12 planes when NV12_PLANES is added.
+        PermutationKey mCameraTextureFeature;
+        PermutationKey mNv12PlanesFeature;
+        std::unique_ptr<ShaderVariantCache> mVariants;
+        std::unordered_map<PermutationKey, VariantLocations> mVariantLocations;
 
-        GLint mModelUniformLocation;
-        GLint mViewUniformLocation;
-        GLint mProjUniformLocation;
-		GLint mTextureLocation;
+        GLuint mLumaTexture;
+        GLuint mChromaTexture;
 
-        GLuint mTexture;
         GLuint mVertexPositionBuffer;
         GLuint mVertexColorBuffer;
         GLuint mIndexBuffer;
+        TrackedResource mGeometryMemory;
 
         int mDrawCount;
+        RenderCounts mCounts;
+
+        // Bounds of everything drawn, culled against the frustum before each draw.
+        SceneBvh mScene;
+        SceneBvh::Proxy mCubeProxy;
+        std::vector<uint32_t> mVisible;
+
+        LodSelector mLod;
+        std::vector<MeshLod> mCubeLods;
+        std::vector<CubeMesh> mCubeMeshes;  // Parallel to mCubeLods
+        unsigned mCubeLevel;
+        unsigned mCameraWidth;
+        unsigned mCameraHeight;
+        unsigned mCameraLevels;
+        unsigned mCameraLevel;
     };
 }
\ No newline at end of file
@@ -0,0 +1,381 @@
+#include "StatsOverlay.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+using namespace unigles;
+
+namespace {
+	// Printable ASCII from ' ' to '_', five columns per glyph, bit 0 the top row.
+	const uint8_t Font[64][5] = {
+		{ 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x5F, 0x00, 0x00 }, { 0x00, 0x07, 0x00, 0x07, 0x00 }, { 0x14, 0x7F, 0x14, 0x7F, 0x14 },
+		{ 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, { 0x23, 0x13, 0x08, 0x64, 0x62 }, { 0x36, 0x49, 0x56, 0x20, 0x50 }, { 0x00, 0x05, 0x03, 0x00, 0x00 },
+		{ 0x00, 0x1C, 0x22, 0x41, 0x00 }, { 0x00, 0x41, 0x22, 0x1C, 0x00 }, { 0x14, 0x08, 0x3E, 0x08, 0x14 }, { 0x08, 0x08, 0x3E, 0x08, 0x08 },
+		{ 0x00, 0x50, 0x30, 0x00, 0x00 }, { 0x08, 0x08, 0x08, 0x08, 0x08 }, { 0x00, 0x60, 0x60, 0x00, 0x00 }, { 0x20, 0x10, 0x08, 0x04, 0x02 },
+		{ 0x3E, 0x51, 0x49, 0x45, 0x3E }, { 0x00, 0x42, 0x7F, 0x40, 0x00 }, { 0x42, 0x61, 0x51, 0x49, 0x46 }, { 0x21, 0x41, 0x45, 0x4B, 0x31 },
+		{ 0x18, 0x14, 0x12, 0x7F, 0x10 }, { 0x27, 0x45, 0x45, 0x45, 0x39 }, { 0x3C, 0x4A, 0x49, 0x49, 0x30 }, { 0x01, 0x71, 0x09, 0x05, 0x03 },
+		{ 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x06, 0x49, 0x49, 0x29, 0x1E }, { 0x00, 0x36, 0x36, 0x00, 0x00 }, { 0x00, 0x56, 0x36, 0x00, 0x00 },
+		{ 0x08, 0x14, 0x22, 0x41, 0x00 }, { 0x14, 0x14, 0x14, 0x14, 0x14 }, { 0x00, 0x41, 0x22, 0x14, 0x08 }, { 0x02, 0x01, 0x51, 0x09, 0x06 },
+		{ 0x32, 0x49, 0x79, 0x41, 0x3E }, { 0x7E, 0x11, 0x11, 0x11, 0x7E }, { 0x7F, 0x49, 0x49, 0x49, 0x36 }, { 0x3E, 0x41, 0x41, 0x41, 0x22 },
+		{ 0x7F, 0x41, 0x41, 0x22, 0x1C }, { 0x7F, 0x49, 0x49, 0x49, 0x41 }, { 0x7F, 0x09, 0x09, 0x09, 0x01 }, { 0x3E, 0x41, 0x49, 0x49, 0x7A },
+		{ 0x7F, 0x08, 0x08, 0x08, 0x7F }, { 0x00, 0x41, 0x7F, 0x41, 0x00 }, { 0x20, 0x40, 0x41, 0x3F, 0x01 }, { 0x7F, 0x08, 0x14, 0x22, 0x41 },
+		{ 0x7F, 0x40, 0x40, 0x40, 0x40 }, { 0x7F, 0x02, 0x0C, 0x02, 0x7F }, { 0x7F, 0x04, 0x08, 0x10, 0x7F }, { 0x3E, 0x41, 0x41, 0x41, 0x3E },
+		{ 0x7F, 0x09, 0x09, 0x09, 0x06 }, { 0x3E, 0x41, 0x51, 0x21, 0x5E }, { 0x7F, 0x09, 0x19, 0x29, 0x46 }, { 0x46, 0x49, 0x49, 0x49, 0x31 },
+		{ 0x01, 0x01, 0x7F, 0x01, 0x01 }, { 0x3F, 0x40, 0x40, 0x40, 0x3F }, { 0x1F, 0x20, 0x40, 0x20, 0x1F }, { 0x3F, 0x40, 0x38, 0x40, 0x3F },
+		{ 0x63, 0x14, 0x08, 0x14, 0x63 }, { 0x07, 0x08, 0x70, 0x08, 0x07 }, { 0x61, 0x51, 0x49, 0x45, 0x43 }, { 0x00, 0x7F, 0x41, 0x41, 0x00 },
+		{ 0x02, 0x04, 0x08, 0x10, 0x20 }, { 0x00, 0x41, 0x41, 0x7F, 0x00 }, { 0x04, 0x02, 0x01, 0x02, 0x04 }, { 0x40, 0x40, 0x40, 0x40, 0x40 },
+	};
+
+	// 16 by 4 cells of 8x8 texels hold the glyphs; the cell below the first glyph row
+	// is solid and gives rectangles and graph bars a texel to sample.
+	const unsigned Cell = 8;
+	const unsigned AtlasColumns = 16;
+	const unsigned AtlasWidth = 128;
+	const unsigned AtlasHeight = 64;
+	const unsigned SolidRow = 4;
+
+	enum AttribLocation : GLuint {
+		PositionLocation = 0,
+		TexCoordLocation = 1,
+		ColorLocation = 2,
+	};
+
+	unsigned GlyphIndex(char c) {
+		if (c >= 'a' && c <= 'z') {
+			c = char(c - 'a' + 'A');
+		}
+		if (c < ' ' || c > '_') {
+			c = '?';
+		}
+		return unsigned(c - ' ');
+	}
+
+	GLuint CompileShader(GLenum type, const char* source) {
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, nullptr);
+		glCompileShader(shader);
+		GLint compiled = 0;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+		if (!compiled) {
+			GLint length = 0;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+			std::string log(length > 0 ? length : 1, '\0');
+			glGetShaderInfoLog(shader, GLsizei(log.size()), nullptr, &log[0]);
+			glDeleteShader(shader);
+			throw std::runtime_error("Overlay shader compilation failed: " + log);
+		}
+		return shader;
+	}
+}
+
+StatsOverlay::StatsOverlay(ResourceTracker* resources) :
+	mProgram(0),
+	mScaleLocation(-1),
+	mAtlasLocation(-1),
+	mAtlas(0),
+	mVertexBuffer(0),
+	mIndexBuffer(0),
+	mVertexBufferSize(0),
+	mResources(resources),
+	mScale(2) {
+	const char* vs =
+		"uniform vec2 uScale;\n"
+		"attribute vec2 aPosition;\n"
+		"attribute vec2 aTexCoord;\n"
+		"attribute vec4 aColor;\n"
+		"varying vec2 vTexCoord;\n"
+		"varying vec4 vColor;\n"
+		"void main() {\n"
+		"	gl_Position = vec4(aPosition * uScale + vec2(-1.0, 1.0), 0.0, 1.0);\n"
+		"	vTexCoord = aTexCoord;\n"
+		"	vColor = aColor;\n"
+		"}\n";
+	const char* fs =
+		"precision mediump float;\n"
+		"uniform sampler2D uAtlas;\n"
+		"varying vec2 vTexCoord;\n"
+		"varying vec4 vColor;\n"
+		"void main() {\n"
+		"	gl_FragColor = vec4(vColor.rgb, vColor.a * texture2D(uAtlas, vTexCoord).a);\n"
+		"}\n";
+
+	GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vs);
+	GLuint fragmentShader = 0;
+	try {
+		fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fs);
+	} catch (...) {
+		glDeleteShader(vertexShader);
+		throw;
+	}
+	mProgram = glCreateProgram();
+	glAttachShader(mProgram, vertexShader);
+	glAttachShader(mProgram, fragmentShader);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	glBindAttribLocation(mProgram, PositionLocation, "aPosition");
+	glBindAttribLocation(mProgram, TexCoordLocation, "aTexCoord");
+	glBindAttribLocation(mProgram, ColorLocation, "aColor");
+	glLinkProgram(mProgram);
+	GLint linked = 0;
+	glGetProgramiv(mProgram, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		Release();
+		throw std::runtime_error("Overlay program link failed");
+	}
+	mScaleLocation = glGetUniformLocation(mProgram, "uScale");
+	mAtlasLocation = glGetUniformLocation(mProgram, "uAtlas");
+
+	std::vector<uint8_t> texels(AtlasWidth * AtlasHeight, 0);
+	for (unsigned glyph = 0; glyph < 64; glyph++) {
+		unsigned left = (glyph % AtlasColumns) * Cell;
+		unsigned top = (glyph / AtlasColumns) * Cell;
+		for (unsigned column = 0; column < GlyphWidth; column++) {
+			for (unsigned row = 0; row < GlyphHeight; row++) {
+				if (Font[glyph][column] & (1 << row)) {
+					texels[(top + row) * AtlasWidth + left + column] = 0xFF;
+				}
+			}
+		}
+	}
+	for (unsigned row = 0; row < Cell; row++) {
+		std::fill_n(texels.begin() + (SolidRow * Cell + row) * AtlasWidth, Cell, uint8_t(0xFF));
+	}
+
+	GLint previousTexture = 0;
+	GLint previousAlignment = 4;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+	glGenTextures(1, &mAtlas);
+	glBindTexture(GL_TEXTURE_2D, mAtlas);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, AtlasWidth, AtlasHeight, 0, GL_ALPHA, GL_UNSIGNED_BYTE, texels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+	glBindTexture(GL_TEXTURE_2D, previousTexture);
+	if (mResources) {
+		mAtlasMemory = mResources->Track(ResourceHeap::Gl, "Stats overlay", "A8", ImageBytes(AtlasWidth, AtlasHeight, 1), "glyph atlas");
+	}
+
+	// Every quad is two triangles over its four vertices, so the indices never change.
+	std::vector<GLushort> indices(MaxQuads * 6);
+	for (unsigned quad = 0; quad < MaxQuads; quad++) {
+		GLushort first = GLushort(quad * 4);
+		GLushort* index = &indices[quad * 6];
+		index[0] = first;
+		index[1] = GLushort(first + 1);
+		index[2] = GLushort(first + 2);
+		index[3] = GLushort(first + 2);
+		index[4] = GLushort(first + 1);
+		index[5] = GLushort(first + 3);
+	}
+	GLint previousElements = 0;
+	glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &previousElements);
+	glGenBuffers(1, &mIndexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, previousElements);
+	if (mResources) {
+		mIndexMemory = mResources->Track(ResourceHeap::Gl, "Stats overlay", "buffers", indices.size() * sizeof(GLushort), "index buffer");
+	}
+
+	glGenBuffers(1, &mVertexBuffer);
+	mVertices.reserve(1024);
+}
+
+StatsOverlay::~StatsOverlay() {
+	Release();
+}
+
+void StatsOverlay::Release() {
+	if (mProgram != 0) {
+		glDeleteProgram(mProgram);
+		mProgram = 0;
+	}
+	if (mAtlas != 0) {
+		glDeleteTextures(1, &mAtlas);
+		mAtlas = 0;
+	}
+	if (mVertexBuffer != 0) {
+		glDeleteBuffers(1, &mVertexBuffer);
+		mVertexBuffer = 0;
+	}
+	if (mIndexBuffer != 0) {
+		glDeleteBuffers(1, &mIndexBuffer);
+		mIndexBuffer = 0;
+	}
+	mVertexBufferSize = 0;
+	mAtlasMemory.Reset();
+	mIndexMemory.Reset();
+	mVertexMemory.Reset();
+}
+
+void StatsOverlay::SetScale(unsigned scale) {
+	mScale = scale < 1 ? 1 : scale;
+}
+
+void StatsOverlay::MeasureText(const std::string& text, unsigned& width, unsigned& height) const {
+	unsigned columns = 0;
+	unsigned lines = text.empty() ? 0 : 1;
+	unsigned lineColumns = 0;
+	for (char c : text) {
+		if (c == '\n') {
+			lines++;
+			lineColumns = 0;
+		} else {
+			columns = (std::max)(columns, ++lineColumns);
+		}
+	}
+	width = columns * (GlyphWidth + 1) * mScale;
+	height = lines * GetLineHeight();
+}
+
+void StatsOverlay::Begin() {
+	mVertices.clear();
+}
+
+void StatsOverlay::AddQuad(float x, float y, float width, float height, float u0, float v0, float u1, float v1, uint32_t color) {
+	if (mVertices.size() >= MaxQuads * 4) {
+		return;
+	}
+	uint8_t r = uint8_t(color >> 24);
+	uint8_t g = uint8_t(color >> 16);
+	uint8_t b = uint8_t(color >> 8);
+	uint8_t a = uint8_t(color);
+	mVertices.push_back(Vertex{ x, y, u0, v0, { r, g, b, a } });
+	mVertices.push_back(Vertex{ x + width, y, u1, v0, { r, g, b, a } });
+	mVertices.push_back(Vertex{ x, y + height, u0, v1, { r, g, b, a } });
+	mVertices.push_back(Vertex{ x + width, y + height, u1, v1, { r, g, b, a } });
+}
+
+void StatsOverlay::AddRect(float x, float y, float width, float height, uint32_t color) {
+	const float u = (Cell / 2) / float(AtlasWidth);
+	const float v = (SolidRow * Cell + Cell / 2) / float(AtlasHeight);
+	AddQuad(x, y, width, height, u, v, u, v, color);
+}
+
+void StatsOverlay::AddText(float x, float y, const std::string& text, uint32_t color) {
+	const float glyphWidth = float(GlyphWidth * mScale);
+	const float glyphHeight = float(GlyphHeight * mScale);
+	const float advance = float((GlyphWidth + 1) * mScale);
+	float penX = x;
+	float penY = y;
+	for (char c : text) {
+		if (c == '\n') {
+			penX = x;
+			penY += GetLineHeight();
+			continue;
+		}
+		unsigned glyph = GlyphIndex(c);
+		if (glyph != 0) {
+			float u0 = float((glyph % AtlasColumns) * Cell) / AtlasWidth;
+			float v0 = float((glyph / AtlasColumns) * Cell) / AtlasHeight;
+			AddQuad(penX, penY, glyphWidth, glyphHeight, u0, v0, u0 + float(GlyphWidth) / AtlasWidth, v0 + float(GlyphHeight) / AtlasHeight, color);
+		}
+		penX += advance;
+	}
+}
+
+void StatsOverlay::AddGraph(float x, float y, float width, float height, const std::vector<double>& values, double maxValue, uint32_t color) {
+	if (values.empty() || maxValue <= 0.0) {
+		return;
+	}
+	float barWidth = width / values.size();
+	for (size_t i = 0; i < values.size(); i++) {
+		float barHeight = float((std::min)(values[i] / maxValue, 1.0)) * height;
+		if (barHeight > 0.0f) {
+			AddRect(x + i * barWidth, y + height - barHeight, (std::max)(barWidth - 1.0f, 1.0f), barHeight, color);
+		}
+	}
+}
+
+bool StatsOverlay::GetBounds(float& left, float& top, float& right, float& bottom) const {
+	if (mVertices.empty()) {
+		return false;
+	}
+	left = right = mVertices[0].x;
+	top = bottom = mVertices[0].y;
+	for (const Vertex& vertex : mVertices) {
+		left = (std::min)(left, vertex.x);
+		right = (std::max)(right, vertex.x);
+		top = (std::min)(top, vertex.y);
+		bottom = (std::max)(bottom, vertex.y);
+	}
+	return true;
+}
+
+void StatsOverlay::Draw(GLsizei width, GLsizei height) {
+	if (mVertices.empty() || mProgram == 0 || width <= 0 || height <= 0) {
+		return;
+	}
+
+	GLint previousProgram = 0;
+	GLint previousArrayBuffer = 0;
+	GLint previousElementBuffer = 0;
+	GLint previousActiveTexture = GL_TEXTURE0;
+	GLint previousTexture = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previousArrayBuffer);
+	glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &previousElementBuffer);
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &previousActiveTexture);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	GLsizeiptr size = GLsizeiptr(mVertices.size() * sizeof(Vertex));
+	if (size > mVertexBufferSize) {
+		// Grow in steps so the buffer is not reallocated every time a line gets longer.
+		mVertexBufferSize = (std::max)(size, mVertexBufferSize * 2);
+		glBufferData(GL_ARRAY_BUFFER, mVertexBufferSize, nullptr, GL_DYNAMIC_DRAW);
+		if (mVertexMemory.IsTracked()) {
+			mVertexMemory.Resize(uint64_t(mVertexBufferSize));
+		} else if (mResources) {
+			mVertexMemory = mResources->Track(ResourceHeap::Gl, "Stats overlay", "buffers", uint64_t(mVertexBufferSize), "vertex buffer");
+		}
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, mVertices.data());
+
+	glUseProgram(mProgram);
+	glUniform2f(mScaleLocation, 2.0f / width, -2.0f / height);
+	glUniform1i(mAtlasLocation, 0);
+	glBindTexture(GL_TEXTURE_2D, mAtlas);
+
+	glEnableVertexAttribArray(PositionLocation);
+	glEnableVertexAttribArray(TexCoordLocation);
+	glEnableVertexAttribArray(ColorLocation);
+	glVertexAttribPointer(PositionLocation, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<const void*>(offsetof(Vertex, x)));
+	glVertexAttribPointer(TexCoordLocation, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<const void*>(offsetof(Vertex, u)));
+	glVertexAttribPointer(ColorLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), reinterpret_cast<const void*>(offsetof(Vertex, color)));
+
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+	glDrawElements(GL_TRIANGLES, GLsizei(GetQuadCount() * 6), GL_UNSIGNED_SHORT, 0);
+
+	glDisableVertexAttribArray(PositionLocation);
+	glDisableVertexAttribArray(TexCoordLocation);
+	glDisableVertexAttribArray(ColorLocation);
+	if (!blend) {
+		glDisable(GL_BLEND);
+	}
+	if (depthTest) {
+		glEnable(GL_DEPTH_TEST);
+	}
+	if (cullFace) {
+		glEnable(GL_CULL_FACE);
+	}
+	glBindTexture(GL_TEXTURE_2D, previousTexture);
+	glActiveTexture(previousActiveTexture);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, previousElementBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, previousArrayBuffer);
+	glUseProgram(previousProgram);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "ResourceTracker.h"
+
+#include <GLES2/gl2.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	// In-scene text and graphs for runtime statistics. Glyphs come from a 5x7 bitmap
+	// font baked into an alpha atlas once; every rectangle, glyph and graph bar of a
+	// frame is batched into one dynamic vertex buffer and drawn with a single call.
+	// Coordinates are pixels from the top left corner. Letters are drawn upper case.
+	// GLES2 only, so it also runs on desktop Mesa.
+	class StatsOverlay {
+	public:
+		// Quads past this are dropped; the index buffer is 16 bit.
+		static const unsigned MaxQuads = 8192;
+		static const unsigned GlyphWidth = 5;
+		static const unsigned GlyphHeight = 7;
+
+		// Needs a current context; the atlas, buffers and program belong to it. They are
+		// counted in resources when it is given.
+		explicit StatsOverlay(ResourceTracker* resources = nullptr);
+		~StatsOverlay();
+
+		// Screen pixels per font pixel.
+		void SetScale(unsigned scale);
+		unsigned GetScale() const { return mScale; }
+		unsigned GetLineHeight() const { return (GlyphHeight + 2) * mScale; }
+		// Extent of a block of text, lines split at '\n'.
+		void MeasureText(const std::string& text, unsigned& width, unsigned& height) const;
+
+		// Starts a new batch, dropping everything added since the last one.
+		void Begin();
+		// Colors are 0xRRGGBBAA.
+		void AddRect(float x, float y, float width, float height, uint32_t color);
+		void AddText(float x, float y, const std::string& text, uint32_t color);
+		// One bar per sample, oldest on the left, scaled so maxValue fills the height.
+		void AddGraph(float x, float y, float width, float height, const std::vector<double>& values, double maxValue, uint32_t color);
+		// Uploads and draws the batch over whatever is in the framebuffer. Blending, depth
+		// test, program, buffer and texture bindings are restored afterwards.
+		void Draw(GLsizei width, GLsizei height);
+
+		unsigned GetQuadCount() const { return unsigned(mVertices.size() / 4); }
+		// Pixels the batch covers, for damage tracking; false when it is empty.
+		bool GetBounds(float& left, float& top, float& right, float& bottom) const;
+
+	private:
+		struct Vertex {
+			float x, y;
+			float u, v;
+			uint8_t color[4];
+		};
+
+		StatsOverlay(const StatsOverlay&) = delete;
+		StatsOverlay& operator=(const StatsOverlay&) = delete;
+
+		void AddQuad(float x, float y, float width, float height, float u0, float v0, float u1, float v1, uint32_t color);
+		void Release();
+
+		GLuint mProgram;
+		GLint mScaleLocation;
+		GLint mAtlasLocation;
+		GLuint mAtlas;
+		GLuint mVertexBuffer;
+		GLuint mIndexBuffer;
+		GLsizeiptr mVertexBufferSize;
+		ResourceTracker* mResources;
+		TrackedResource mAtlasMemory;
+		TrackedResource mIndexMemory;
+		TrackedResource mVertexMemory;
+		unsigned mScale;
+		std::vector<Vertex> mVertices;
+	};
+}
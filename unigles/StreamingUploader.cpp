@@ -0,0 +1,177 @@
+#include "StreamingUploader.h"
+
+#include <chrono>
+
+using namespace unigles;
+
+const double StreamingUploader::StallMilliseconds = 4.0;
+
+static void CreatePlane(GLuint texture, GLenum format, unsigned width, unsigned height) {
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+}
+
+StreamingUploader::StreamingUploader(unsigned sets) :
+	mSets(sets < 2 ? 2 : sets),
+	mCurrent(-1),
+	mWidth(0),
+	mHeight(0),
+	mBandRows(0),
+	mLastSequence(0),
+	mResources(nullptr) {}
+
+StreamingUploader::~StreamingUploader() {
+	Release();
+}
+
+GLuint StreamingUploader::GetLumaTexture() const {
+	return mCurrent >= 0 ? mSets[mCurrent].luma : 0;
+}
+
+GLuint StreamingUploader::GetChromaTexture() const {
+	return mCurrent >= 0 ? mSets[mCurrent].chroma : 0;
+}
+
+void StreamingUploader::Release() {
+	for (TextureSet& set : mSets) {
+		if (set.luma != 0) {
+			glDeleteTextures(1, &set.luma);
+			set.luma = 0;
+		}
+		if (set.chroma != 0) {
+			glDeleteTextures(1, &set.chroma);
+			set.chroma = 0;
+		}
+		set.pendingBands.clear();
+	}
+	mTextureMemory.Reset();
+	mCurrent = -1;
+	mWidth = 0;
+	mHeight = 0;
+	mBandRows = 0;
+	mLastSequence = 0;
+}
+
+void StreamingUploader::Allocate(unsigned width, unsigned height) {
+	Release();
+	GLint previous = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+	for (TextureSet& set : mSets) {
+		glGenTextures(1, &set.luma);
+		glGenTextures(1, &set.chroma);
+		CreatePlane(set.luma, GL_LUMINANCE, width, height);
+		CreatePlane(set.chroma, GL_LUMINANCE_ALPHA, (width + 1) / 2, (height + 1) / 2);
+	}
+	glBindTexture(GL_TEXTURE_2D, GLuint(previous));
+	mWidth = width;
+	mHeight = height;
+	if (mResources) {
+		uint64_t bytes = mSets.size() * (ImageBytes(width, height, 1) + ImageBytes((width + 1) / 2, (height + 1) / 2, 2));
+		mTextureMemory = mResources->Track(ResourceHeap::Gl, "Streaming textures", "L8+LA8", bytes);
+	}
+}
+
+void StreamingUploader::Upload(const Nv12Frame& frame) {
+	if (frame.width == 0 || frame.height == 0) {
+		return;
+	}
+	if (frame.width != mWidth || frame.height != mHeight) {
+		Allocate(frame.width, frame.height);
+	}
+
+	// Freshly allocated sets, or a change of band size, mean every set needs everything.
+	unsigned bandRows = frame.bandRows != 0 ? frame.bandRows : mHeight;
+	unsigned bandCount = (mHeight + bandRows - 1) / bandRows;
+	if (bandRows != mBandRows) {
+		mBandRows = bandRows;
+		for (TextureSet& set : mSets) {
+			set.pendingBands.assign(bandCount, 1);
+		}
+	}
+	// Dirty bands are relative to the previous frame; after a dropped one they say nothing.
+	bool gap = mLastSequence != 0 && frame.sequence != mLastSequence + 1;
+	mLastSequence = frame.sequence;
+	for (unsigned band = 0; band < bandCount; band++) {
+		if (gap || frame.IsBandDirty(band)) {
+			for (TextureSet& set : mSets) {
+				set.pendingBands[band] = 1;
+			}
+		}
+	}
+
+	unsigned next = unsigned(mCurrent + 1) % unsigned(mSets.size());
+	TextureSet& set = mSets[next];
+
+	GLint previousTexture = 0;
+	GLint previousAlignment = 4;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	auto start = std::chrono::steady_clock::now();
+	size_t bytes = UploadBands(set, frame, bandRows, set.pendingBands);
+	auto end = std::chrono::steady_clock::now();
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+	glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+	for (uint8_t& pending : set.pendingBands) {
+		if (!pending) {
+			mStats.bandsSkipped++;
+		}
+		pending = 0;
+	}
+	mCurrent = int(next);
+
+	double milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+	mStats.frames++;
+	mStats.bytes += bytes;
+	mStats.uploadSeconds += milliseconds / 1000.0;
+	mStats.lastMilliseconds = milliseconds;
+	if (milliseconds > StallMilliseconds) {
+		mStats.stalls++;
+	}
+}
+
+size_t StreamingUploader::UploadBands(const TextureSet& set, const Nv12Frame& frame, unsigned bandRows, const std::vector<uint8_t>& bands) {
+	size_t bytes = 0;
+	unsigned chromaWidth = frame.ChromaWidth();
+	unsigned chromaHeight = frame.ChromaHeight();
+	unsigned bandCount = unsigned(bands.size());
+	unsigned band = 0;
+	while (band < bandCount) {
+		if (!bands[band]) {
+			band++;
+			continue;
+		}
+		// Merge neighbouring dirty bands into one sub-image update.
+		unsigned last = band;
+		while (last + 1 < bandCount && bands[last + 1]) {
+			last++;
+		}
+		unsigned y0 = band * bandRows;
+		unsigned y1 = (last + 1) * bandRows;
+		if (y1 > frame.height) {
+			y1 = frame.height;
+		}
+		unsigned c0 = y0 / 2;
+		unsigned c1 = (y1 + 1) / 2;
+		if (c1 > chromaHeight) {
+			c1 = chromaHeight;
+		}
+
+		glBindTexture(GL_TEXTURE_2D, set.luma);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y0, frame.width, y1 - y0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+			&frame.luma[size_t(y0) * frame.width]);
+		glBindTexture(GL_TEXTURE_2D, set.chroma);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, c0, chromaWidth, c1 - c0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
+			&frame.chroma[size_t(c0) * chromaWidth * 2]);
+		bytes += size_t(frame.width) * (y1 - y0) + size_t(chromaWidth) * 2 * (c1 - c0);
+		band = last + 1;
+	}
+	return bytes;
+}
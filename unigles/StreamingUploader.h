@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Nv12FrameBuffer.h"
+#include "ResourceTracker.h"
+
+#include <GLES2/gl2.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace unigles {
+	struct StreamingUploadStats {
+		uint64_t frames = 0;			// Frames uploaded
+		uint64_t bytes = 0;				// Texel bytes handed to glTexSubImage2D
+		uint64_t bandsSkipped = 0;		// Row bands left alone because they had not changed
+		uint64_t stalls = 0;			// Uploads that took longer than StallMilliseconds
+		double uploadSeconds = 0.0;		// Time spent inside the upload calls
+		double lastMilliseconds = 0.0;
+
+		double MegabytesPerSecond() const { return uploadSeconds > 0.0 ? bytes / uploadSeconds / 1.0e6 : 0.0; }
+	};
+
+	// Uploads CPU-side NV12 frames into a round-robin set of GL texture pairs: a
+	// GL_LUMINANCE plane and a half size GL_LUMINANCE_ALPHA plane for interleaved UV.
+	// A frame is never written into the set the previous draw sampled, so the driver
+	// does not have to wait for, or copy around, textures still in flight. Only row
+	// bands that changed since a set was last written are uploaded. GLES2 only, so it
+	// also runs on desktop Mesa.
+	class StreamingUploader {
+	public:
+		// Uploads slower than this are counted as stalls.
+		static const double StallMilliseconds;
+
+		explicit StreamingUploader(unsigned sets = 3);
+		~StreamingUploader();
+
+		// Counts the texture sets from the next allocation on; the tracker must outlive the uploader.
+		void SetResourceTracker(ResourceTracker* resources) { mResources = resources; }
+
+		// Uploads a frame into the next texture set. Needs a current GL context.
+		void Upload(const Nv12Frame& frame);
+		// Texture pair holding the most recent upload; 0 before the first one.
+		GLuint GetLumaTexture() const;
+		GLuint GetChromaTexture() const;
+		bool HasFrame() const { return mCurrent >= 0; }
+		unsigned GetWidth() const { return mWidth; }
+		unsigned GetHeight() const { return mHeight; }
+
+		const StreamingUploadStats& GetStats() const { return mStats; }
+
+	private:
+		struct TextureSet {
+			GLuint luma = 0;
+			GLuint chroma = 0;
+			// Bands changed by frames that went into other sets since this one was written.
+			std::vector<uint8_t> pendingBands;
+		};
+
+		void Allocate(unsigned width, unsigned height);
+		void Release();
+		size_t UploadBands(const TextureSet& set, const Nv12Frame& frame, unsigned bandRows, const std::vector<uint8_t>& bands);
+
+		std::vector<TextureSet> mSets;
+		int mCurrent;
+		unsigned mWidth;
+		unsigned mHeight;
+		unsigned mBandRows;
+		uint64_t mLastSequence;
+		StreamingUploadStats mStats;
+		ResourceTracker* mResources;
+		TrackedResource mTextureMemory;
+	};
+}
@@ -0,0 +1,98 @@
+#include "TaskPool.h"
+
+#include <algorithm>
+
+using namespace unigles;
+
+TaskPool::TaskPool(unsigned threads) :
+	mTask(nullptr),
+	mCount(0),
+	mNext(0),
+	mRemaining(0),
+	mActiveWorkers(0),
+	mGeneration(0),
+	mStopping(false) {
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (unsigned i = 1; i < threads; i++) {
+		mWorkers.emplace_back(&TaskPool::WorkerLoop, this);
+	}
+}
+
+TaskPool::~TaskPool() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWake.notify_all();
+	for (auto& worker : mWorkers) {
+		worker.join();
+	}
+}
+
+TaskPool& TaskPool::Default() {
+	static TaskPool pool;
+	return pool;
+}
+
+void TaskPool::Drain(const std::function<void(unsigned)>& task, unsigned count) {
+	unsigned index;
+	while ((index = mNext.fetch_add(1)) < count) {
+		task(index);
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (--mRemaining == 0) {
+			mDone.notify_all();
+		}
+	}
+}
+
+void TaskPool::Run(unsigned count, const std::function<void(unsigned)>& task) {
+	if (count == 0) {
+		return;
+	}
+	if (mWorkers.empty() || count == 1) {
+		for (unsigned i = 0; i < count; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	std::lock_guard<std::mutex> runLock(mRunMutex);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		mCount = count;
+		mNext = 0;
+		mRemaining = count;
+		mGeneration++;
+	}
+	mWake.notify_all();
+	Drain(task, count);
+
+	// Workers hold a pointer to the caller's task, so wait until they let go of it too.
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDone.wait(lock, [this]() { return mRemaining == 0 && mActiveWorkers == 0; });
+	mTask = nullptr;
+}
+
+void TaskPool::WorkerLoop() {
+	unsigned long long seen = 0;
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		mWake.wait(lock, [&]() { return mStopping || (mGeneration != seen && mTask != nullptr); });
+		if (mStopping) {
+			return;
+		}
+		seen = mGeneration;
+		const std::function<void(unsigned)>* task = mTask;
+		unsigned count = mCount;
+		mActiveWorkers++;
+		lock.unlock();
+		Drain(*task, count);
+		lock.lock();
+		if (--mActiveWorkers == 0 && mRemaining == 0) {
+			mDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace unigles {
+	// A fixed set of worker threads that split indexed work with the calling thread.
+	// The image kernels use it to spread row bands and tiles across cores without
+	// paying for thread creation on every frame.
+	class TaskPool {
+	public:
+		// Zero picks one thread per hardware core, the caller included.
+		explicit TaskPool(unsigned threads = 0);
+		~TaskPool();
+
+		// Total number of threads that execute tasks, the caller included.
+		unsigned GetThreadCount() const { return unsigned(mWorkers.size()) + 1; }
+
+		// Calls task(i) for every i in [0, count) and returns once all calls are done.
+		void Run(unsigned count, const std::function<void(unsigned)>& task);
+
+		// Process wide pool shared by the kernels that are not handed one explicitly.
+		static TaskPool& Default();
+
+	private:
+		void WorkerLoop();
+		void Drain(const std::function<void(unsigned)>& task, unsigned count);
+
+		std::vector<std::thread> mWorkers;
+		std::mutex mRunMutex;
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		std::condition_variable mDone;
+		const std::function<void(unsigned)>* mTask;
+		unsigned mCount;
+		std::atomic<unsigned> mNext;
+		unsigned mRemaining;
+		unsigned mActiveWorkers;
+		unsigned long long mGeneration;
+		bool mStopping;
+	};
+}
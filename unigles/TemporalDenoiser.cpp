@@ -0,0 +1,197 @@
+#include "TemporalDenoiser.h"
+#include "Nv12FrameBuffer.h"
+#include "Simd.h"
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+using namespace unigles;
+
+// Bytes handed to one task; the planes are packed, so bands need not follow rows.
+static const size_t BandBytes = 64 * 1024;
+
+DenoiseWeights DenoiseWeights::From(float strength, unsigned threshold) {
+	DenoiseWeights weights;
+	weights.strength = int16_t(std::lround(std::min(1.0f, std::max(0.0f, strength)) * 128.0f));
+	weights.threshold = int16_t(std::min(255u, std::max(1u, threshold)));
+	// threshold * slope stays near strength * 16, so the 16-bit products never overflow.
+	weights.slope = int16_t((weights.strength * 16 + weights.threshold / 2) / weights.threshold);
+	return weights;
+}
+
+static inline uint8_t DenoisePixel(uint8_t image, uint8_t history, const DenoiseWeights& weights) {
+	int difference = std::min(std::abs(int(image) - int(history)), int(weights.threshold));
+	int weight = std::max(0, weights.strength - ((difference * weights.slope) >> 4));
+	// The blend lies between the two inputs, so it needs no clamping.
+	return uint8_t(image + (((history - image) * weight + 64) >> 7));
+}
+
+void unigles::DenoiseRowScalar(uint8_t* image, uint8_t* history, size_t count, const DenoiseWeights& weights) {
+	for (size_t i = 0; i < count; i++) {
+		history[i] = image[i] = DenoisePixel(image[i], history[i], weights);
+	}
+}
+
+#if defined(UNIGLES_SIMD_SSE2)
+static inline __m128i DenoiseHalf(__m128i image, __m128i history, __m128i strength, __m128i threshold, __m128i slope) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i delta = _mm_sub_epi16(history, image);
+	__m128i difference = _mm_min_epi16(_mm_max_epi16(delta, _mm_sub_epi16(zero, delta)), threshold);
+	__m128i weight = _mm_max_epi16(zero, _mm_sub_epi16(strength, _mm_srli_epi16(_mm_mullo_epi16(difference, slope), 4)));
+	__m128i blend = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(delta, weight), _mm_set1_epi16(64)), 7);
+	return _mm_add_epi16(image, blend);
+}
+#elif defined(UNIGLES_SIMD_NEON)
+static inline uint8x8_t DenoiseHalf(uint8x8_t image, uint8x8_t history, int16x8_t strength, int16x8_t threshold, int16_t slope) {
+	int16x8_t current = vreinterpretq_s16_u16(vmovl_u8(image));
+	int16x8_t delta = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(history)), current);
+	int16x8_t difference = vminq_s16(vabsq_s16(delta), threshold);
+	int16x8_t weight = vmaxq_s16(vdupq_n_s16(0), vsubq_s16(strength, vshrq_n_s16(vmulq_n_s16(difference, slope), 4)));
+	int16x8_t blend = vshrq_n_s16(vaddq_s16(vmulq_s16(delta, weight), vdupq_n_s16(64)), 7);
+	return vqmovun_s16(vaddq_s16(current, blend));
+}
+#endif
+
+void unigles::DenoiseRow(uint8_t* image, uint8_t* history, size_t count, const DenoiseWeights& weights) {
+	size_t i = 0;
+#if defined(UNIGLES_SIMD_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i strength = _mm_set1_epi16(weights.strength);
+	const __m128i threshold = _mm_set1_epi16(weights.threshold);
+	const __m128i slope = _mm_set1_epi16(weights.slope);
+	for (; i + 16 <= count; i += 16) {
+		__m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(image + i));
+		__m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(history + i));
+		__m128i low = DenoiseHalf(_mm_unpacklo_epi8(current, zero), _mm_unpacklo_epi8(previous, zero), strength, threshold, slope);
+		__m128i high = DenoiseHalf(_mm_unpackhi_epi8(current, zero), _mm_unpackhi_epi8(previous, zero), strength, threshold, slope);
+		__m128i result = _mm_packus_epi16(low, high);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(image + i), result);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(history + i), result);
+	}
+#elif defined(UNIGLES_SIMD_NEON)
+	const int16x8_t strength = vdupq_n_s16(weights.strength);
+	const int16x8_t threshold = vdupq_n_s16(weights.threshold);
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t current = vld1q_u8(image + i);
+		uint8x16_t previous = vld1q_u8(history + i);
+		uint8x8_t low = DenoiseHalf(vget_low_u8(current), vget_low_u8(previous), strength, threshold, weights.slope);
+		uint8x8_t high = DenoiseHalf(vget_high_u8(current), vget_high_u8(previous), strength, threshold, weights.slope);
+		uint8x16_t result = vcombine_u8(low, high);
+		vst1q_u8(image + i, result);
+		vst1q_u8(history + i, result);
+	}
+#endif
+	for (; i < count; i++) {
+		history[i] = image[i] = DenoisePixel(image[i], history[i], weights);
+	}
+}
+
+typedef void (*DenoiseKernel)(uint8_t*, uint8_t*, size_t, const DenoiseWeights&);
+
+// Filters bytes [begin, end) of a plane with rows of rowBytes, rowsPerBand of them to each
+// of the frame's bands. Rows of clean bands take the history instead: it holds the band as
+// it was filtered when it last changed, which is what the consumers kept of it.
+static void DenoiseRange(const Nv12Frame& frame, uint8_t* image, uint8_t* history, size_t begin, size_t end,
+	size_t rowBytes, unsigned rowsPerBand, const DenoiseWeights& weights, DenoiseKernel kernel) {
+	if (frame.bandRows == 0 || frame.dirtyBands.empty()) {
+		kernel(image + begin, history + begin, end - begin, weights);
+		return;
+	}
+	while (begin < end) {
+		size_t row = begin / rowBytes;
+		size_t rowEnd = std::min(end, (row + 1) * rowBytes);
+		if (frame.IsBandDirty(unsigned(row / rowsPerBand))) {
+			kernel(image + begin, history + begin, rowEnd - begin, weights);
+		} else {
+			memcpy(image + begin, history + begin, rowEnd - begin);
+		}
+		begin = rowEnd;
+	}
+}
+
+double unigles::ComputePsnr(const uint8_t* image, size_t imageStride, const uint8_t* reference, size_t referenceStride,
+	unsigned width, unsigned height) {
+	uint64_t squares = 0;
+	for (unsigned y = 0; y < height; y++) {
+		const uint8_t* a = image + y * imageStride;
+		const uint8_t* b = reference + y * referenceStride;
+		for (unsigned x = 0; x < width; x++) {
+			int difference = int(a[x]) - int(b[x]);
+			squares += uint64_t(difference * difference);
+		}
+	}
+	if (squares == 0 || width == 0 || height == 0) {
+		return std::numeric_limits<double>::infinity();
+	}
+	double mse = double(squares) / (double(width) * double(height));
+	return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+TemporalDenoiser::TemporalDenoiser(const DenoiseSettings& settings) :
+	mSettings(settings),
+	mWidth(0),
+	mHeight(0),
+	mFrames(0),
+	mLastMilliseconds(0.0) {}
+
+void TemporalDenoiser::Reset() {
+	mLuma.clear();
+	mChroma.clear();
+	mWidth = 0;
+	mHeight = 0;
+}
+
+bool TemporalDenoiser::PrepareHistory(const Nv12Frame& frame) {
+	mFrames++;
+	if (mWidth == frame.width && mHeight == frame.height && !mLuma.empty()) {
+		return true;
+	}
+	mWidth = frame.width;
+	mHeight = frame.height;
+	mLuma = frame.luma;
+	mChroma = frame.chroma;
+	return false;
+}
+
+void TemporalDenoiser::Process(Nv12Frame& frame, TaskPool* pool) {
+	auto start = std::chrono::steady_clock::now();
+	if (PrepareHistory(frame) && mSettings.strength > 0.0f) {
+		if (!pool) {
+			pool = &TaskPool::Default();
+		}
+		DenoiseWeights lumaWeights = DenoiseWeights::From(mSettings.strength, mSettings.lumaThreshold);
+		DenoiseWeights chromaWeights = DenoiseWeights::From(mSettings.strength, mSettings.chromaThreshold);
+		size_t lumaBands = (frame.luma.size() + BandBytes - 1) / BandBytes;
+		size_t chromaBands = (frame.chroma.size() + BandBytes - 1) / BandBytes;
+		pool->Run(unsigned(lumaBands + chromaBands), [&](unsigned band) {
+			bool isLuma = band < lumaBands;
+			std::vector<uint8_t>& image = isLuma ? frame.luma : frame.chroma;
+			std::vector<uint8_t>& history = isLuma ? mLuma : mChroma;
+			size_t begin = (isLuma ? band : band - lumaBands) * BandBytes;
+			size_t end = std::min(begin + BandBytes, image.size());
+			if (isLuma) {
+				DenoiseRange(frame, image.data(), history.data(), begin, end, frame.width, frame.bandRows, lumaWeights, DenoiseRow);
+			} else {
+				DenoiseRange(frame, image.data(), history.data(), begin, end, frame.ChromaWidth() * 2,
+					(std::max)(1u, frame.bandRows / 2), chromaWeights, DenoiseRow);
+			}
+		});
+	}
+	mLastMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TemporalDenoiser::ProcessScalar(Nv12Frame& frame) {
+	auto start = std::chrono::steady_clock::now();
+	if (PrepareHistory(frame) && mSettings.strength > 0.0f) {
+		DenoiseRange(frame, frame.luma.data(), mLuma.data(), 0, frame.luma.size(), frame.width, frame.bandRows,
+			DenoiseWeights::From(mSettings.strength, mSettings.lumaThreshold), DenoiseRowScalar);
+		DenoiseRange(frame, frame.chroma.data(), mChroma.data(), 0, frame.chroma.size(), frame.ChromaWidth() * 2,
+			(std::max)(1u, frame.bandRows / 2), DenoiseWeights::From(mSettings.strength, mSettings.chromaThreshold), DenoiseRowScalar);
+	}
+	mLastMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
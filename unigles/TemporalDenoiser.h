@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace unigles {
+	class TaskPool;
+	struct Nv12Frame;
+
+	struct DenoiseSettings {
+		// Share of the history a pixel keeps where nothing moved; zero turns the filter off.
+		float strength = 0.8f;
+		// Difference to the history, in 8-bit levels, at which a pixel counts as moving and
+		// shows the camera value alone. Below it the history weight falls off linearly.
+		unsigned lumaThreshold = 32;
+		unsigned chromaThreshold = 16;
+	};
+
+	// Fixed point form of one plane's settings, as used by the row kernels.
+	struct DenoiseWeights {
+		int16_t strength;	// History weight of a static pixel, 1/128 units
+		int16_t threshold;	// Differences are clamped here
+		int16_t slope;		// Weight lost per level of difference, 1/2048 units
+
+		static DenoiseWeights From(float strength, unsigned threshold);
+	};
+
+	// Blends count bytes of image with history and writes the result to both, so the
+	// history becomes the recursively filtered image. Bit exact with the scalar version.
+	void DenoiseRow(uint8_t* image, uint8_t* history, size_t count, const DenoiseWeights& weights);
+	void DenoiseRowScalar(uint8_t* image, uint8_t* history, size_t count, const DenoiseWeights& weights);
+
+	// Peak signal to noise ratio of an 8-bit plane against a reference, in dB;
+	// infinity for identical planes.
+	double ComputePsnr(const uint8_t* image, size_t imageStride, const uint8_t* reference, size_t referenceStride,
+		unsigned width, unsigned height);
+
+	// Motion adaptive temporal filter for NV12 frames on the CPU. Each pixel is pulled
+	// towards the filtered previous frame by a weight that shrinks with its difference
+	// to it, so static noise averages out while moving edges do not smear. Luma and
+	// chroma bytes are weighted independently. TextureBridge runs the same filter fused
+	// into its conversion draw.
+	class TemporalDenoiser {
+	public:
+		explicit TemporalDenoiser(const DenoiseSettings& settings = DenoiseSettings());
+
+		void SetSettings(const DenoiseSettings& settings) { mSettings = settings; }
+		const DenoiseSettings& GetSettings() const { return mSettings; }
+
+		// Filters the frame in place, in row bands over the pool (TaskPool::Default() when
+		// null). The first frame, and the first after Reset() or a size change, only fills
+		// the history. Bands the frame marks clean are not filtered but take the history,
+		// so a consumer that only updates dirty bands holds the filtered frame all the same.
+		void Process(Nv12Frame& frame, TaskPool* pool = nullptr);
+		// Single threaded reference the vectorized version is checked against.
+		void ProcessScalar(Nv12Frame& frame);
+		void Reset();
+
+		uint64_t GetFrameCount() const { return mFrames; }
+		double GetLastMilliseconds() const { return mLastMilliseconds; }
+		// Of the history planes.
+		size_t GetBytes() const { return mLuma.capacity() + mChroma.capacity(); }
+
+	private:
+		bool PrepareHistory(const Nv12Frame& frame);
+
+		DenoiseSettings mSettings;
+		std::vector<uint8_t> mLuma;
+		std::vector<uint8_t> mChroma;
+		unsigned mWidth, mHeight;
+		uint64_t mFrames;
+		double mLastMilliseconds;
+	};
+}
@@ -0,0 +1,151 @@
+#include "TextureAssetLoader.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace unigles;
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+TextureAssetLoader::TextureAssetLoader() :
+	mForceDecode(false),
+	mResources(nullptr) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+	if (count > 0) {
+		std::vector<GLint> formats(count);
+		glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+		mNativeFormats.assign(formats.begin(), formats.end());
+	}
+}
+
+TextureAssetLoader::~TextureAssetLoader() {
+	Release();
+}
+
+void TextureAssetLoader::Release() {
+	for (TextureAsset& asset : mAssets) {
+		glDeleteTextures(1, &asset.texture);
+	}
+	mAssets.clear();
+	mAssetMemory.clear();
+	mStats.gpuBytes = 0;
+}
+
+void TextureAssetLoader::SetResourceTracker(ResourceTracker* resources) {
+	mResources = resources;
+	mDecodeBufferMemory = mResources ? mResources->Track(ResourceHeap::Host, "Texture assets", "RGBA8", mDecodeBuffer.capacity(), "decode buffer") : TrackedResource();
+}
+
+bool TextureAssetLoader::IsNativelySupported(CompressedFormat format) const {
+	GLenum glFormat = GetFormatInfo(format).glFormat;
+	return glFormat != 0 && std::find(mNativeFormats.begin(), mNativeFormats.end(), glFormat) != mNativeFormats.end();
+}
+
+GLuint TextureAssetLoader::Fail(const std::string& name, const std::string& error) {
+	mStats.failed++;
+	mLastError = name + ": " + error;
+	return 0;
+}
+
+GLuint TextureAssetLoader::Load(const std::string& path) {
+	auto start = std::chrono::steady_clock::now();
+	MappedFile file;
+	if (!file.Open(path)) {
+		return Fail(path, "cannot be mapped");
+	}
+	mStats.mapMilliseconds += MillisecondsSince(start);
+	// The mapping only has to live until the levels are in GL.
+	return Load(path, file.GetData(), file.GetSize());
+}
+
+GLuint TextureAssetLoader::Load(const std::string& name, const uint8_t* data, size_t size) {
+	auto start = std::chrono::steady_clock::now();
+	KtxTexture ktx;
+	bool parsed = ktx.Parse(data, size);
+	mStats.parseMilliseconds += MillisecondsSince(start);
+	if (!parsed) {
+		return Fail(name, ktx.GetError());
+	}
+
+	TextureAsset asset;
+	asset.name = name;
+	asset.format = ktx.GetFormat();
+	asset.width = ktx.GetWidth();
+	asset.height = ktx.GetHeight();
+	asset.levels = unsigned(ktx.GetLevels().size());
+	asset.decoded = mForceDecode || !IsNativelySupported(asset.format);
+	if (asset.decoded && !GetFormatInfo(asset.format).decodable) {
+		return Fail(name, std::string(GetFormatInfo(asset.format).name) + " is neither supported by the GPU nor decodable");
+	}
+	GLuint texture = Upload(asset, ktx);
+	if (texture == 0) {
+		return Fail(name, "upload failed");
+	}
+	asset.milliseconds = MillisecondsSince(start);
+
+	mStats.loaded++;
+	if (asset.decoded) {
+		mStats.decoded++;
+	}
+	mStats.fileBytes += ktx.GetDataSize();
+	mStats.gpuBytes += asset.gpuBytes;
+	mAssets.push_back(asset);
+	mAssetMemory.push_back(mResources ? mResources->Track(ResourceHeap::Gl, "Texture assets", asset.decoded ? "RGBA8" : GetFormatInfo(asset.format).name,
+		asset.gpuBytes, name) : TrackedResource());
+	return texture;
+}
+
+GLuint TextureAssetLoader::Upload(TextureAsset& asset, const KtxTexture& ktx) {
+	GLint previousTexture = 0;
+	GLint previousAlignment = 4;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+	while (glGetError() != GL_NO_ERROR) {
+	}
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	// GLES2 has no GL_TEXTURE_MAX_LEVEL, so a partial chain is sampled without mipmaps.
+	bool fullChain = (std::max(asset.width, asset.height) >> (asset.levels - 1)) == 1;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, fullChain && asset.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	GLenum glFormat = GetFormatInfo(asset.format).glFormat;
+	asset.gpuBytes = 0;
+	GLint level = 0;
+	for (const KtxLevel& data : ktx.GetLevels()) {
+		if (asset.decoded) {
+			auto start = std::chrono::steady_clock::now();
+			mDecodeBuffer.resize(size_t(data.width) * data.height * 4);
+			mDecodeBufferMemory.Resize(mDecodeBuffer.capacity());
+			DecodeBlocks(asset.format, data.data, data.size, data.width, data.height, mDecodeBuffer.data());
+			mStats.decodeMilliseconds += MillisecondsSince(start);
+			start = std::chrono::steady_clock::now();
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, data.width, data.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, mDecodeBuffer.data());
+			mStats.uploadMilliseconds += MillisecondsSince(start);
+			asset.gpuBytes += mDecodeBuffer.size();
+		} else {
+			auto start = std::chrono::steady_clock::now();
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, glFormat, data.width, data.height, 0, GLsizei(data.size), data.data);
+			mStats.uploadMilliseconds += MillisecondsSince(start);
+			asset.gpuBytes += data.size;
+		}
+		level++;
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+	glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+	if (glGetError() != GL_NO_ERROR) {
+		glDeleteTextures(1, &texture);
+		return 0;
+	}
+	asset.texture = texture;
+	return texture;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "KtxFile.h"
+#include "ResourceTracker.h"
+
+#include <GLES2/gl2.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace unigles {
+	struct TextureAsset {
+		std::string name;
+		GLuint texture = 0;
+		CompressedFormat format = CompressedFormat::Unknown;
+		unsigned width = 0;
+		unsigned height = 0;
+		unsigned levels = 0;
+		bool decoded = false;		// Uploaded as RGBA8 because the GPU lacks the format
+		size_t gpuBytes = 0;		// Texel storage of every level as uploaded
+		double milliseconds = 0.0;	// Mapping, parsing, decoding and uploading
+	};
+
+	struct TextureAssetStats {
+		uint64_t loaded = 0;
+		uint64_t decoded = 0;		// Loaded through the CPU decoder
+		uint64_t failed = 0;		// Missing, malformed or undecodable files
+		uint64_t fileBytes = 0;		// Level data read from the files
+		uint64_t gpuBytes = 0;		// Texel storage of the live textures
+		double mapMilliseconds = 0.0;
+		double parseMilliseconds = 0.0;
+		double decodeMilliseconds = 0.0;
+		double uploadMilliseconds = 0.0;
+
+		double TotalMilliseconds() const { return mapMilliseconds + parseMilliseconds + decodeMilliseconds + uploadMilliseconds; }
+	};
+
+	// Loads block compressed textures with their mip chains from KTX and KTX2 files.
+	// Levels go from the mapped file straight to glCompressedTexImage2D when the GPU
+	// lists the format; otherwise they are decoded to RGBA8 on the CPU, at four to eight
+	// times the memory, and the asset is marked as decoded. sRGB formats decoded this
+	// way keep their encoded values, as GLES2 has no sRGB textures to put them in.
+	// Owns the textures it creates. Needs a current GL context.
+	class TextureAssetLoader {
+	public:
+		TextureAssetLoader();
+		~TextureAssetLoader();
+
+		// Counts textures loaded from now on and the decode buffer; the tracker must outlive the loader.
+		void SetResourceTracker(ResourceTracker* resources);
+
+		bool IsNativelySupported(CompressedFormat format) const;
+		// Decodes every format the CPU decoder knows, to compare or to test the fallback.
+		void SetForceDecode(bool force) { mForceDecode = force; }
+
+		// Returns the texture, or 0 when the asset could not be loaded.
+		GLuint Load(const std::string& path);
+		GLuint Load(const std::string& name, const uint8_t* data, size_t size);
+		void Release();
+
+		const std::vector<TextureAsset>& GetAssets() const { return mAssets; }
+		const TextureAssetStats& GetStats() const { return mStats; }
+		// Why the last failed load failed.
+		const std::string& GetLastError() const { return mLastError; }
+
+	private:
+		GLuint Upload(TextureAsset& asset, const KtxTexture& ktx);
+		GLuint Fail(const std::string& name, const std::string& error);
+
+		std::vector<GLenum> mNativeFormats;
+		bool mForceDecode;
+		std::vector<TextureAsset> mAssets;
+		TextureAssetStats mStats;
+		std::string mLastError;
+		std::vector<uint8_t> mDecodeBuffer;
+		ResourceTracker* mResources;
+		std::vector<TrackedResource> mAssetMemory;
+		TrackedResource mDecodeBufferMemory;
+	};
+}
@@ -1,5 +1,9 @@
 #include "pch.h"
 #include "TextureBridge.h"
+#include "ShaderPermutations.h"
+
+#include <algorithm>
+#include <string>
 
 using namespace Platform;
 
@@ -25,20 +29,193 @@ static inline void MustSucceed(HRESULT rc, const Microsoft::WRL::ComPtr<ID3DBlob
 }
 #pragma endregion Locals
 
-TextureBridge::TextureBridge() : mSharedTextureHandle(0), mTextureWidth(0), mTextureHeight(0) {}
+static unigles::ChangeDetectorSettings ThumbnailDetectorSettings() {
+	unigles::ChangeDetectorSettings settings;
+	// 16 thumbnail pixels are 64 camera pixels; every thumbnail row is compared.
+	settings.tileSize = 16;
+	settings.rowStep = 1;
+	return settings;
+}
 
-TextureBridge::~TextureBridge() {}
+TextureBridge::TextureBridge(unigles::GpuResourceRegistry& registry, unigles::ResourceTracker& resources) :
+	mRegistry(registry),
+	mResources(resources),
+	mThumbnailWidth(0),
+	mThumbnailHeight(0),
+	mThumbnailWrite(0),
+	mThumbnailPending(0),
+	mThumbnailChanged(true),
+	mChangeDetectionEnabled(false),
+	mChangeDetector(ThumbnailDetectorSettings()),
+	mStatisticsWrite(0),
+	mStatisticsPending(0),
+	mStatisticsTilesX(0),
+	mStatisticsTilesY(0),
+	mStatisticsEnabled(false),
+	mHasStatistics(false),
+	mPostProcessDirty(false),
+	mRequestedLevel(0),
+	mTextureLevel(0),
+	mDenoiseWrite(0),
+	mDenoiseHasHistory(false),
+	mDenoiseEnabled(false),
+	mRemapVersion(0),
+	mRemapWidth(0),
+	mRemapHeight(0),
+	mPyramidLevels(0),
+	mSharedTextureHandle(0),
+	mTextureWidth(0),
+	mTextureHeight(0),
+	mFrameVersion(0) {
+	RegisterResources();
+}
 
-void TextureBridge::SetupD3D(Microsoft::WRL::ComPtr<IDXGISurface> anchor) {
-	if (mDevice != nullptr) {
-		return;
+TextureBridge::~TextureBridge() {
+	for (auto handle : mResourceHandles) {
+		mRegistry.Unregister(handle);
 	}
-	ComPtr<IDXGIDeviceSubObject> deviceSub;
-	MustSucceed(anchor.As(&deviceSub), L"Cannot cast surface");
-	ComPtr<IDXGIDevice> device;
-	MustSucceed(deviceSub->GetDevice(__uuidof(IDXGIDevice), &device), L"Failed to get DXG device");
-	MustSucceed(device.As(&mDevice), L"Failed to cast DXG to D3D device");
-	mDevice->GetImmediateContext(mDeviceContext.GetAddressOf());
+}
+
+void TextureBridge::RegisterResources() {
+	using unigles::GpuDomain;
+	// Released in reverse order, so the device goes last. Only the pipeline is created
+	// eagerly; everything sized by the camera frame is rebuilt lazily by its Ensure*().
+	mResourceHandles.push_back(mRegistry.Register(GpuDomain::D3D, "Camera device", nullptr, [this]() {
+		mDeviceContext.Reset();
+		mDevice.Reset();
+	}));
+	mResourceHandles.push_back(mRegistry.Register(GpuDomain::D3D, "Conversion pipeline", [this]() {
+		CreatePipeline();
+	}, [this]() {
+		mVertexShader.Reset();
+		mPixelShader.Reset();
+		mLumaPixelShader.Reset();
+		mDownscalePixelShader.Reset();
+		mDenoisePixelShader.Reset();
+		mDenoiseConstants.Reset();
+		mRemapPixelShader.Reset();
+		mRemapDenoisePixelShader.Reset();
+		mRemapConstants.Reset();
+		mClampSamplerState.Reset();
+		mPyramidPixelShader.Reset();
+		mRemapLumaPixelShader.Reset();
+		mStatisticsShader.Reset();
+		mStatisticsConstants.Reset();
+		mProfiler.reset();
+		mInputLayout.Reset();
+		mVertexBuffer.Reset();
+		mSamplerState.Reset();
+	}));
+	mResourceHandles.push_back(mRegistry.Register(GpuDomain::D3D, "Shared texture", nullptr, [this]() {
+		// A new handle makes the GL side bind a new pbuffer.
+		for (TextureVariant& variant : mVariants) {
+			variant = TextureVariant();
+		}
+		mTextureLevel = 0;
+		mSharedResourceView.Reset();
+		mSharedTexture.Reset();
+		mSharedTextureMemory.Reset();
+		mSharedTextureHandle = 0;
+		mTextureWidth = 0;
+		mTextureHeight = 0;
+	}));
+	mResourceHandles.push_back(mRegistry.Register(GpuDomain::D3D, "Change detection thumbnail", nullptr, [this]() {
+		mThumbnailTargetView.Reset();
+		mThumbnailTexture.Reset();
+		for (auto& staging : mThumbnailStaging) {
+			staging.Reset();
+		}
+		mThumbnailMemory.Reset();
+		mThumbnailPending = 0;
+		mThumbnailWrite = 0;
+		mThumbnailChanged = true;
+		mChangeDetector.Reset();
+	}));
+	mResourceHandles.push_back(mRegistry.Register(GpuDomain::D3D, "Denoise history", nullptr, [this]() {
+		for (TextureVariant& history : mDenoiseHistory) {
+			history = TextureVariant();
+		}
+		mDenoiseHasHistory = false;
+	}));
+	mResourceHandles.push_back(mRegistry.Register(GpuDomain::D3D, "Lens remap table", nullptr, [this]() {
+		mRemapResourceView.Reset();
+		mRemapTexture.Reset();
+		mRemapMemory.Reset();
+	}));
+	mResourceHandles.push_back(mRegistry.Register(GpuDomain::D3D, "Luma pyramid", nullptr, [this]() {
+		mPyramid.clear();
+		mPyramidScratch = TextureVariant();
+		mCorrectedLuma = TextureVariant();
+		mPyramidMemory.Reset();
+	}));
+	mResourceHandles.push_back(mRegistry.Register(GpuDomain::D3D, "Statistics readback", nullptr, [this]() {
+		mStatisticsView.Reset();
+		mStatisticsBuffer.Reset();
+		for (auto& staging : mStatisticsStaging) {
+			staging.Reset();
+		}
+		mStatisticsMemory.Reset();
+		mStatisticsPending = 0;
+		mStatisticsWrite = 0;
+	}));
+	mResourceHandles.push_back(mRegistry.Register(GpuDomain::D3D, "Post-processing", nullptr, [this]() {
+		mPostProcess.reset();
+		mPostProcessDirty = !mPostProcessGraph.Empty();
+	}));
+	mRegistry.SetLossProbe(GpuDomain::D3D, [this]() {
+		return mDevice != nullptr && FAILED(mDevice->GetDeviceRemovedReason());
+	});
+}
+
+void TextureBridge::EnableChangeDetection(bool enable) {
+	if (enable && !mChangeDetectionEnabled) {
+		// Thumbnails still in flight were taken before detection stopped.
+		mChangeDetector.Reset();
+		mThumbnailPending = 0;
+		mThumbnailChanged = true;
+	}
+	mChangeDetectionEnabled = enable;
+}
+
+void TextureBridge::EnableDenoising(bool enable) {
+	if (enable && !mDenoiseEnabled) {
+		// The history stopped following the camera while disabled.
+		mDenoiseHasHistory = false;
+	}
+	mDenoiseEnabled = enable;
+}
+
+void TextureBridge::SetLensModel(const unigles::LensModel& lens) {
+	mLensTables.SetLens(lens);
+	// The history holds the frame as the previous lens model saw it.
+	mDenoiseHasHistory = false;
+}
+
+void TextureBridge::EnableStatistics(bool enable) {
+	mStatisticsEnabled = enable;
+}
+
+void TextureBridge::SetPostProcessing(const unigles::PostProcessGraph& graph) {
+	mPostProcessGraph = graph;
+	mPostProcessDirty = true;
+}
+
+bool TextureBridge::GetLatestStatistics(unigles::LumaStatistics& result) const {
+	if (mHasStatistics) {
+		result = mLatestStatistics;
+	}
+	return mHasStatistics;
+}
+
+void TextureBridge::PrecompileShaders() {
+	// Compilation does not depend on the device, so it can run before the first frame
+	// tells us which one the camera uses. Concurrent callers wait for the first one.
+	std::call_once(mShadersCompiled, [this]() {
+		CompileShaders();
+	});
+}
+
+void TextureBridge::CompileShaders() {
 	const char vertexShader[] = STRING(
 		struct VS_OUTPUT {
 		float4 Pos : SV_POSITION;
@@ -51,10 +228,17 @@ void TextureBridge::SetupD3D(Microsoft::WRL::ComPtr<IDXGISurface> anchor) {
 		return result;
 	}
 	);
+	// LENS_REMAP selects the variant that takes the source coordinates from the lens
+	// table. RemapScale maps texture coordinates onto the table, whose texel centers are
+	// its nodes; pixels the lens maps outside the frame come out black.
 	const char pixelShader[] = STRING(
 		Texture2D LumTexture : register(t0);
 	Texture2D ChromTexture : register(t1);
+	Texture2D RemapTexture : register(t3);
 	SamplerState ObjSamplerState;
+	cbuffer Remap : register(b1) {
+		float4 RemapScale;
+	};
 
 	struct VS_OUTPUT {
 		float4 Pos : SV_POSITION;
@@ -63,19 +247,258 @@ void TextureBridge::SetupD3D(Microsoft::WRL::ComPtr<IDXGISurface> anchor) {
 
 	float4 PS(VS_OUTPUT vsData) : SV_TARGET
 	{
-		float lum = LumTexture.Sample(ObjSamplerState, vsData.TexCoord);
-	float2 chrom = ChromTexture.Sample(ObjSamplerState, vsData.TexCoord);
+		float2 uv = vsData.TexCoord;
+	if (LENS_REMAP) {
+		uv = RemapTexture.SampleLevel(ObjSamplerState, uv * RemapScale.xy + RemapScale.zw, 0).rg * 2 - 0.5;
+	}
+	bool inside = all(uv == saturate(uv));
+	float lum = inside ? LumTexture.Sample(ObjSamplerState, uv).r : 16.0 / 256;
+	float2 chrom = inside ? ChromTexture.Sample(ObjSamplerState, uv).rg : float2(128.0 / 256, 128.0 / 256);
 	float b = 1.164 * (lum - 16.0 / 256) + 2.018 * (chrom.x - 128.0 / 256);
 	float g = 1.164 * (lum - 16.0 / 256) - 0.813 * (chrom.y - 128.0 / 256) - 0.391 * (chrom.x - 128.0 / 256);
 	float r = 1.164 * (lum - 16.0 / 256) + 1.596 * (chrom.y - 128.0 / 256);
 	return float4(r, g, b, 1.0f);
 	}
 	);
-	ComPtr<ID3DBlob> vsData, psData, errorData;
-	MustSucceed(D3DCompile(vertexShader, sizeof(vertexShader), nullptr, nullptr, nullptr, "VS", "vs_5_0", 0, 0, vsData.GetAddressOf(), errorData.GetAddressOf()), errorData);
-	MustSucceed(D3DCompile(pixelShader, sizeof(pixelShader), nullptr, nullptr, nullptr, "PS", "ps_5_0", 0, 0, psData.GetAddressOf(), errorData.GetAddressOf()), errorData);
-	MustSucceed(mDevice->CreateVertexShader(vsData->GetBufferPointer(), vsData->GetBufferSize(), nullptr, mVertexShader.GetAddressOf()), L"Cannot create VS");
-	MustSucceed(mDevice->CreatePixelShader(psData->GetBufferPointer(), psData->GetBufferSize(), nullptr, mPixelShader.GetAddressOf()), L"Cannot create PS");
+	// The conversion with the temporal filter in front of it. Weights holds the strength,
+	// the luma and chroma slopes per 8-bit level and whether the history is valid.
+	const char denoisePixelShader[] = STRING(
+		Texture2D LumTexture : register(t0);
+	Texture2D ChromTexture : register(t1);
+	Texture2D HistoryTexture : register(t2);
+	Texture2D RemapTexture : register(t3);
+	SamplerState ObjSamplerState;
+	cbuffer Params : register(b0) {
+		float4 Weights;
+	};
+	cbuffer Remap : register(b1) {
+		float4 RemapScale;
+	};
+
+	struct VS_OUTPUT {
+		float4 Pos : SV_POSITION;
+		float2 TexCoord : TEXCOORD;
+	};
+
+	struct PS_OUTPUT {
+		float4 Color : SV_TARGET0;
+		float4 History : SV_TARGET1;
+	};
+
+	PS_OUTPUT PS(VS_OUTPUT vsData)
+	{
+		float2 uv = vsData.TexCoord;
+	if (LENS_REMAP) {
+		uv = RemapTexture.SampleLevel(ObjSamplerState, uv * RemapScale.xy + RemapScale.zw, 0).rg * 2 - 0.5;
+	}
+	bool inside = all(uv == saturate(uv));
+	float3 yuv = inside ? float3(LumTexture.Sample(ObjSamplerState, uv).r, ChromTexture.Sample(ObjSamplerState, uv).rg) : float3(16.0 / 256, 128.0 / 256, 128.0 / 256);
+	float3 history = HistoryTexture.Load(int3(vsData.Pos.xy, 0)).rgb;
+	float3 weight = Weights.x * Weights.w * saturate(1 - abs(yuv - history) * 255 * Weights.yzz);
+	yuv = lerp(yuv, history, weight);
+	PS_OUTPUT result;
+	result.History = float4(yuv, 1);
+	float b = 1.164 * (yuv.x - 16.0 / 256) + 2.018 * (yuv.y - 128.0 / 256);
+	float g = 1.164 * (yuv.x - 16.0 / 256) - 0.813 * (yuv.z - 128.0 / 256) - 0.391 * (yuv.y - 128.0 / 256);
+	float r = 1.164 * (yuv.x - 16.0 / 256) + 1.596 * (yuv.z - 128.0 / 256);
+	result.Color = float4(r, g, b, 1.0f);
+	return result;
+	}
+	);
+	// The lens variant gives the pyramid the luma the conversion saw.
+	const char lumaPixelShader[] = STRING(
+		Texture2D LumTexture : register(t0);
+	Texture2D RemapTexture : register(t3);
+	SamplerState ObjSamplerState;
+	cbuffer Remap : register(b1) {
+		float4 RemapScale;
+	};
+
+	struct VS_OUTPUT {
+		float4 Pos : SV_POSITION;
+		float2 TexCoord : TEXCOORD;
+	};
+
+	float PS(VS_OUTPUT vsData) : SV_TARGET
+	{
+		float2 uv = vsData.TexCoord;
+	if (LENS_REMAP) {
+		uv = RemapTexture.SampleLevel(ObjSamplerState, uv * RemapScale.xy + RemapScale.zw, 0).rg * 2 - 0.5;
+	}
+	return all(uv == saturate(uv)) ? LumTexture.Sample(ObjSamplerState, uv).r : 16.0 / 256;
+	}
+	);
+	// Rendered at half the size of its source, so every bilinear sample lands between
+	// four texels and averages them.
+	const char downscalePixelShader[] = STRING(
+		Texture2D SourceTexture : register(t0);
+	SamplerState ObjSamplerState;
+
+	struct VS_OUTPUT {
+		float4 Pos : SV_POSITION;
+		float2 TexCoord : TEXCOORD;
+	};
+
+	float4 PS(VS_OUTPUT vsData) : SV_TARGET
+	{
+		return SourceTexture.Sample(ObjSamplerState, vsData.TexCoord);
+	}
+	);
+	// One pass of the 5-tap binomial filter along Direction, reading every other texel of
+	// the source on that axis, so a horizontal and a vertical pass halve an image. Load
+	// with the coordinates clamped replicates the edges like the CPU pyramid.
+	const char pyramidPixelShader[] = STRING(
+		Texture2D<float> SourceTexture : register(t0);
+	cbuffer PyramidParams : register(b0) {
+		int2 Direction;
+		int2 SourceMax;
+	};
+
+	struct VS_OUTPUT {
+		float4 Pos : SV_POSITION;
+		float2 TexCoord : TEXCOORD;
+	};
+
+	float Tap(int2 p)
+	{
+		return SourceTexture.Load(int3(clamp(p, int2(0, 0), SourceMax), 0));
+	}
+
+	float PS(VS_OUTPUT vsData) : SV_TARGET
+	{
+		int2 p = int2(vsData.Pos.xy);
+		int2 center = p + p * Direction;
+		float sum = Tap(center - 2 * Direction) + Tap(center + 2 * Direction);
+		sum += 4 * (Tap(center - Direction) + Tap(center + Direction));
+		sum += 6 * Tap(center);
+		return sum / 16;
+	}
+	);
+	// One 16x16 group per 64x64 tile; every thread folds a 4x4 block into the
+	// group histogram and the tile sum/min/max before they are merged into the result.
+	const char statisticsShader[] = STRING(
+		Texture2D<float> LumTexture : register(t0);
+	RWByteAddressBuffer Result : register(u0);
+	cbuffer Params : register(b0) {
+		uint Width;
+		uint Height;
+		uint TilesX;
+		uint Padding;
+	};
+	groupshared uint Histogram[256];
+	groupshared uint TileSum;
+	groupshared uint TileMin;
+	groupshared uint TileMax;
+
+	[numthreads(16, 16, 1)]
+	void CS(uint3 group : SV_GroupID, uint3 local : SV_GroupThreadID, uint index : SV_GroupIndex)
+	{
+		Histogram[index] = 0;
+		if (index == 0) {
+			TileSum = 0;
+			TileMin = 255;
+			TileMax = 0;
+		}
+		GroupMemoryBarrierWithGroupSync();
+		uint sum = 0;
+		uint lo = 255;
+		uint hi = 0;
+		uint2 origin = group.xy * 64 + local.xy * 4;
+		for (uint y = 0; y < 4; y++) {
+			for (uint x = 0; x < 4; x++) {
+				uint2 p = origin + uint2(x, y);
+				if (p.x < Width && p.y < Height) {
+					uint v = (uint)round(LumTexture.Load(int3(p, 0)) * 255.0);
+					InterlockedAdd(Histogram[v], 1);
+					sum += v;
+					lo = min(lo, v);
+					hi = max(hi, v);
+				}
+			}
+		}
+		InterlockedAdd(TileSum, sum);
+		InterlockedMin(TileMin, lo);
+		InterlockedMax(TileMax, hi);
+		GroupMemoryBarrierWithGroupSync();
+		if (Histogram[index] != 0) {
+			Result.InterlockedAdd(index * 4, Histogram[index]);
+		}
+		if (index == 0) {
+			uint tile = 256 + (group.y * TilesX + group.x) * 3;
+			Result.Store3(tile * 4, uint3(TileSum, TileMin, TileMax));
+		}
+	}
+	);
+	// The lens variants come from the permutation system like the GL ones. A variant
+	// without the feature sees LENS_REMAP as 0, which the compiler folds out of the if;
+	// the single line sources cannot hold an #ifdef of their own.
+	unigles::ShaderPermutations permutations;
+	unigles::PermutationKey lensRemap = permutations.AddFeature("LENS_REMAP");
+	ComPtr<ID3DBlob> errorData;
+	auto compileVariant = [&](const char* source, unigles::PermutationKey key, ID3DBlob** blob) {
+		std::string variant = permutations.Generate(key, std::string("#ifndef LENS_REMAP\n#define LENS_REMAP 0\n#endif\n") + source);
+		MustSucceed(D3DCompile(variant.c_str(), variant.size(), permutations.Describe(key).c_str(), nullptr, nullptr, "PS", "ps_5_0", 0, 0, blob, errorData.ReleaseAndGetAddressOf()), errorData);
+	};
+	MustSucceed(D3DCompile(vertexShader, sizeof(vertexShader), nullptr, nullptr, nullptr, "VS", "vs_5_0", 0, 0, mVertexShaderBlob.GetAddressOf(), errorData.GetAddressOf()), errorData);
+	compileVariant(pixelShader, 0, mPixelShaderBlob.GetAddressOf());
+	compileVariant(pixelShader, lensRemap, mRemapPixelShaderBlob.GetAddressOf());
+	compileVariant(denoisePixelShader, 0, mDenoisePixelShaderBlob.GetAddressOf());
+	compileVariant(denoisePixelShader, lensRemap, mRemapDenoisePixelShaderBlob.GetAddressOf());
+	compileVariant(lumaPixelShader, 0, mLumaPixelShaderBlob.GetAddressOf());
+	compileVariant(lumaPixelShader, lensRemap, mRemapLumaPixelShaderBlob.GetAddressOf());
+	MustSucceed(D3DCompile(downscalePixelShader, sizeof(downscalePixelShader), nullptr, nullptr, nullptr, "PS", "ps_5_0", 0, 0, mDownscalePixelShaderBlob.GetAddressOf(), errorData.GetAddressOf()), errorData);
+	MustSucceed(D3DCompile(pyramidPixelShader, sizeof(pyramidPixelShader), nullptr, nullptr, nullptr, "PS", "ps_5_0", 0, 0, mPyramidPixelShaderBlob.GetAddressOf(), errorData.GetAddressOf()), errorData);
+	MustSucceed(D3DCompile(statisticsShader, sizeof(statisticsShader), nullptr, nullptr, nullptr, "CS", "cs_5_0", 0, 0, mStatisticsShaderBlob.GetAddressOf(), errorData.GetAddressOf()), errorData);
+}
+
+bool TextureBridge::SetupD3D(Microsoft::WRL::ComPtr<IDXGISurface> anchor) {
+	ComPtr<IDXGIDeviceSubObject> deviceSub;
+	MustSucceed(anchor.As(&deviceSub), L"Cannot cast surface");
+	ComPtr<IDXGIDevice> dxgiDevice;
+	MustSucceed(deviceSub->GetDevice(__uuidof(IDXGIDevice), &dxgiDevice), L"Failed to get DXG device");
+	ComPtr<ID3D11Device> device;
+	MustSucceed(dxgiDevice.As(&device), L"Failed to cast DXG to D3D device");
+	if (mDevice != nullptr && (mDevice != device || mRegistry.CheckLost(unigles::GpuDomain::D3D))) {
+		// Removed, or the camera moved to another device: whatever was made on ours is dead.
+		mRegistry.ReportLost(unigles::GpuDomain::D3D);
+	}
+	if (mDevice == device && !mRegistry.IsLost(unigles::GpuDomain::D3D)) {
+		return true;
+	}
+	mDevice = device;
+	mDevice->GetImmediateContext(mDeviceContext.ReleaseAndGetAddressOf());
+	if (FAILED(mDevice->GetDeviceRemovedReason())) {
+		// The camera still delivers surfaces of the removed device; wait for the new one.
+		return false;
+	}
+	PrecompileShaders();
+	return mRegistry.Recreate(unigles::GpuDomain::D3D);
+}
+
+void TextureBridge::CreatePipeline() {
+	MustSucceed(mDevice->CreateVertexShader(mVertexShaderBlob->GetBufferPointer(), mVertexShaderBlob->GetBufferSize(), nullptr, mVertexShader.ReleaseAndGetAddressOf()), L"Cannot create VS");
+	MustSucceed(mDevice->CreatePixelShader(mPixelShaderBlob->GetBufferPointer(), mPixelShaderBlob->GetBufferSize(), nullptr, mPixelShader.ReleaseAndGetAddressOf()), L"Cannot create PS");
+	MustSucceed(mDevice->CreatePixelShader(mLumaPixelShaderBlob->GetBufferPointer(), mLumaPixelShaderBlob->GetBufferSize(), nullptr, mLumaPixelShader.ReleaseAndGetAddressOf()), L"Cannot create luma PS");
+	MustSucceed(mDevice->CreatePixelShader(mDownscalePixelShaderBlob->GetBufferPointer(), mDownscalePixelShaderBlob->GetBufferSize(), nullptr, mDownscalePixelShader.ReleaseAndGetAddressOf()), L"Cannot create downscale PS");
+	MustSucceed(mDevice->CreatePixelShader(mDenoisePixelShaderBlob->GetBufferPointer(), mDenoisePixelShaderBlob->GetBufferSize(), nullptr, mDenoisePixelShader.ReleaseAndGetAddressOf()), L"Cannot create denoise PS");
+	D3D11_BUFFER_DESC denoiseDesc = {};
+	denoiseDesc.ByteWidth = 4 * sizeof(float);
+	denoiseDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	denoiseDesc.Usage = D3D11_USAGE_DEFAULT;
+	MustSucceed(mDevice->CreateBuffer(&denoiseDesc, nullptr, mDenoiseConstants.ReleaseAndGetAddressOf()), L"Failed to create denoise constants");
+	MustSucceed(mDevice->CreatePixelShader(mRemapPixelShaderBlob->GetBufferPointer(), mRemapPixelShaderBlob->GetBufferSize(), nullptr, mRemapPixelShader.ReleaseAndGetAddressOf()), L"Cannot create remap PS");
+	MustSucceed(mDevice->CreatePixelShader(mRemapDenoisePixelShaderBlob->GetBufferPointer(), mRemapDenoisePixelShaderBlob->GetBufferSize(), nullptr, mRemapDenoisePixelShader.ReleaseAndGetAddressOf()), L"Cannot create remap denoise PS");
+	MustSucceed(mDevice->CreateBuffer(&denoiseDesc, nullptr, mRemapConstants.ReleaseAndGetAddressOf()), L"Failed to create remap constants");
+	MustSucceed(mDevice->CreatePixelShader(mPyramidPixelShaderBlob->GetBufferPointer(), mPyramidPixelShaderBlob->GetBufferSize(), nullptr, mPyramidPixelShader.ReleaseAndGetAddressOf()), L"Cannot create pyramid PS");
+	MustSucceed(mDevice->CreatePixelShader(mRemapLumaPixelShaderBlob->GetBufferPointer(), mRemapLumaPixelShaderBlob->GetBufferSize(), nullptr, mRemapLumaPixelShader.ReleaseAndGetAddressOf()), L"Cannot create remap luma PS");
+	if (mDevice->GetFeatureLevel() >= D3D_FEATURE_LEVEL_11_0) {
+		MustSucceed(mDevice->CreateComputeShader(mStatisticsShaderBlob->GetBufferPointer(), mStatisticsShaderBlob->GetBufferSize(), nullptr, mStatisticsShader.ReleaseAndGetAddressOf()), L"Cannot create statistics CS");
+		D3D11_BUFFER_DESC constantsDesc = {};
+		constantsDesc.ByteWidth = 4 * sizeof(UINT);
+		constantsDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		constantsDesc.Usage = D3D11_USAGE_DEFAULT;
+		MustSucceed(mDevice->CreateBuffer(&constantsDesc, nullptr, mStatisticsConstants.ReleaseAndGetAddressOf()), L"Failed to create statistics constants");
+	}
 	XMFLOAT3 vertices[] = {
 		XMFLOAT3(1, 1, 0.5), XMFLOAT3(1, -3, 0.5), XMFLOAT3(-3, 1, 0.5)
 	};
@@ -85,7 +508,7 @@ void TextureBridge::SetupD3D(Microsoft::WRL::ComPtr<IDXGISurface> anchor) {
 	vertexBufDesc.Usage = D3D11_USAGE_DEFAULT;
 	D3D11_SUBRESOURCE_DATA vertexBufData = {};
 	vertexBufData.pSysMem = vertices;
-	MustSucceed(mDevice->CreateBuffer(&vertexBufDesc, &vertexBufData, mVertexBuffer.GetAddressOf()), L"Failed to create vertex buffer");
+	MustSucceed(mDevice->CreateBuffer(&vertexBufDesc, &vertexBufData, mVertexBuffer.ReleaseAndGetAddressOf()), L"Failed to create vertex buffer");
 	D3D11_SAMPLER_DESC samplerDesc = {};
 	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
@@ -94,23 +517,39 @@ void TextureBridge::SetupD3D(Microsoft::WRL::ComPtr<IDXGISurface> anchor) {
 	samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
 	samplerDesc.MinLOD = 0;
 	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	MustSucceed(mDevice->CreateSamplerState(&samplerDesc, mSamplerState.GetAddressOf()), L"Failed to create sampler state");
+	MustSucceed(mDevice->CreateSamplerState(&samplerDesc, mSamplerState.ReleaseAndGetAddressOf()), L"Failed to create sampler state");
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	MustSucceed(mDevice->CreateSamplerState(&samplerDesc, mClampSamplerState.ReleaseAndGetAddressOf()), L"Failed to create clamp sampler state");
 	D3D11_INPUT_ELEMENT_DESC layout[] =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 	};
-	mDevice->CreateInputLayout(layout, ARRAYSIZE(layout), vsData->GetBufferPointer(), vsData->GetBufferSize(), mInputLayout.GetAddressOf());
+	mDevice->CreateInputLayout(layout, ARRAYSIZE(layout), mVertexShaderBlob->GetBufferPointer(), mVertexShaderBlob->GetBufferSize(), mInputLayout.ReleaseAndGetAddressOf());
+	mProfiler.reset(new D3DGpuProfiler(mDevice, mProfileLog));
 }
 
 void TextureBridge::EnsureTexture(Microsoft::WRL::ComPtr<IDXGISurface> source) {
 	DXGI_SURFACE_DESC desc = {};
 	source->GetDesc(&desc);
-	if (mTextureWidth == desc.Width && mTextureHeight == desc.Height) {
+	if (mSharedTexture != nullptr && mTextureWidth == desc.Width && mTextureHeight == desc.Height) {
 		return;
 	}
 
 	mTextureWidth = desc.Width;
 	mTextureHeight = desc.Height;
+	// The variants are sized from the camera frame; the next request recreates them.
+	for (TextureVariant& variant : mVariants) {
+		variant = TextureVariant();
+	}
+	mTextureLevel = 0;
+	for (TextureVariant& history : mDenoiseHistory) {
+		history = TextureVariant();
+	}
+	mDenoiseHasHistory = false;
+	mPyramid.clear();
+	mCorrectedLuma = TextureVariant();
 
 	D3D11_TEXTURE2D_DESC texDesc = {};
 	texDesc.Width = mTextureWidth;
@@ -125,13 +564,514 @@ void TextureBridge::EnsureTexture(Microsoft::WRL::ComPtr<IDXGISurface> source) {
 	texDesc.CPUAccessFlags = 0;
 	texDesc.MiscFlags = D3D11_RESOURCE_MISC_SHARED;
 	MustSucceed(mDevice->CreateTexture2D(&texDesc, nullptr, mSharedTexture.ReleaseAndGetAddressOf()), L"Failed to create the texture");
+	mSharedTextureMemory = mResources.Track(unigles::ResourceHeap::D3D, "Shared texture", "BGRA8", unigles::ImageBytes(mTextureWidth, mTextureHeight, 4));
 	ComPtr<IDXGIResource> outputResource;
 	MustSucceed(mSharedTexture.As(&outputResource), L"Cannot view texture as resource");
 	// TODO: Check if the handle has to be closed.
 	MustSucceed(outputResource->GetSharedHandle(&mSharedTextureHandle), L"Shared texture has no handle");
+	MustSucceed(mDevice->CreateShaderResourceView(mSharedTexture.Get(), nullptr, mSharedResourceView.ReleaseAndGetAddressOf()), L"Failed to create shared texture resource");
+}
+
+void TextureBridge::EnsureVariants(UINT levels) {
+	for (UINT level = 1; level < levels; level++) {
+		TextureVariant& variant = mVariants[level - 1];
+		if (variant.texture != nullptr) {
+			continue;
+		}
+		variant.width = (std::max)(mTextureWidth >> level, 1u);
+		variant.height = (std::max)(mTextureHeight >> level, 1u);
+
+		D3D11_TEXTURE2D_DESC texDesc = {};
+		texDesc.Width = variant.width;
+		texDesc.Height = variant.height;
+		texDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+		texDesc.MipLevels = 1;
+		texDesc.ArraySize = 1;
+		texDesc.SampleDesc.Count = 1;
+		texDesc.Usage = D3D11_USAGE_DEFAULT;
+		texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+		texDesc.MiscFlags = D3D11_RESOURCE_MISC_SHARED;
+		MustSucceed(mDevice->CreateTexture2D(&texDesc, nullptr, variant.texture.ReleaseAndGetAddressOf()), L"Failed to create the downscaled texture");
+		variant.memory = mResources.Track(unigles::ResourceHeap::D3D, "Downscaled textures", "BGRA8", unigles::ImageBytes(variant.width, variant.height, 4),
+			"level " + std::to_string(level));
+		MustSucceed(mDevice->CreateRenderTargetView(variant.texture.Get(), nullptr, variant.targetView.ReleaseAndGetAddressOf()), L"Failed to create downscaled target view");
+		MustSucceed(mDevice->CreateShaderResourceView(variant.texture.Get(), nullptr, variant.resourceView.ReleaseAndGetAddressOf()), L"Failed to create downscaled resource");
+		ComPtr<IDXGIResource> outputResource;
+		MustSucceed(variant.texture.As(&outputResource), L"Cannot view texture as resource");
+		MustSucceed(outputResource->GetSharedHandle(&variant.handle), L"Downscaled texture has no handle");
+	}
+}
+
+void TextureBridge::DownscaleVariants(UINT levels) {
+	// Each level is halved from the one above it, so the cost stays a third of a frame
+	// whatever the depth.
+	mDeviceContext->PSSetShader(mDownscalePixelShader.Get(), nullptr, 0);
+	mDeviceContext->PSSetSamplers(0, 1, mSamplerState.GetAddressOf());
+	for (UINT level = 1; level < levels; level++) {
+		TextureVariant& variant = mVariants[level - 1];
+		ID3D11ShaderResourceView* source = level == 1 ? mSharedResourceView.Get() : mVariants[level - 2].resourceView.Get();
+		mDeviceContext->OMSetRenderTargets(1, variant.targetView.GetAddressOf(), nullptr);
+		mDeviceContext->PSSetShaderResources(0, 1, &source);
+		D3D11_VIEWPORT viewport = {};
+		viewport.Width = (FLOAT)variant.width;
+		viewport.Height = (FLOAT)variant.height;
+		viewport.MaxDepth = 1;
+		mDeviceContext->RSSetViewports(1, &viewport);
+		mDeviceContext->Draw(3, 0);
+		// The target becomes the next level's source.
+		ID3D11ShaderResourceView* none = nullptr;
+		mDeviceContext->PSSetShaderResources(0, 1, &none);
+	}
+	ID3D11RenderTargetView* noTarget = nullptr;
+	mDeviceContext->OMSetRenderTargets(1, &noTarget, nullptr);
+}
+
+void TextureBridge::EnsureDenoiseHistory() {
+	for (TextureVariant& history : mDenoiseHistory) {
+		if (history.texture != nullptr) {
+			continue;
+		}
+		history.width = mTextureWidth;
+		history.height = mTextureHeight;
+		mDenoiseHasHistory = false;
+
+		D3D11_TEXTURE2D_DESC texDesc = {};
+		texDesc.Width = history.width;
+		texDesc.Height = history.height;
+		texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		texDesc.MipLevels = 1;
+		texDesc.ArraySize = 1;
+		texDesc.SampleDesc.Count = 1;
+		texDesc.Usage = D3D11_USAGE_DEFAULT;
+		texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+		MustSucceed(mDevice->CreateTexture2D(&texDesc, nullptr, history.texture.ReleaseAndGetAddressOf()), L"Failed to create the denoise history");
+		history.memory = mResources.Track(unigles::ResourceHeap::D3D, "Denoise history", "RGBA8", unigles::ImageBytes(history.width, history.height, 4));
+		MustSucceed(mDevice->CreateRenderTargetView(history.texture.Get(), nullptr, history.targetView.ReleaseAndGetAddressOf()), L"Failed to create denoise history target view");
+		MustSucceed(mDevice->CreateShaderResourceView(history.texture.Get(), nullptr, history.resourceView.ReleaseAndGetAddressOf()), L"Failed to create denoise history resource");
+	}
+}
+
+void TextureBridge::ConvertDenoised(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lumResourceView,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> chromResourceView, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtView, bool remap) {
+	EnsureDenoiseHistory();
+	// Stored in 8 bits like the CPU filter's history, so both settle on the same values.
+	float weights[4] = {
+		(std::min)(1.0f, (std::max)(0.0f, mDenoiseSettings.strength)),
+		1.0f / (std::max)(1u, mDenoiseSettings.lumaThreshold),
+		1.0f / (std::max)(1u, mDenoiseSettings.chromaThreshold),
+		mDenoiseHasHistory ? 1.0f : 0.0f
+	};
+	mDeviceContext->UpdateSubresource(mDenoiseConstants.Get(), 0, nullptr, weights, 0, 0);
+
+	TextureVariant& previous = mDenoiseHistory[1 - mDenoiseWrite];
+	TextureVariant& next = mDenoiseHistory[mDenoiseWrite];
+	ID3D11ShaderResourceView* resources[3] = { lumResourceView.Get(), chromResourceView.Get(), previous.resourceView.Get() };
+	ID3D11RenderTargetView* targets[2] = { rtView.Get(), next.targetView.Get() };
+	mDeviceContext->PSSetShader(remap ? mRemapDenoisePixelShader.Get() : mDenoisePixelShader.Get(), nullptr, 0);
+	mDeviceContext->PSSetShaderResources(0, 3, resources);
+	mDeviceContext->PSSetConstantBuffers(0, 1, mDenoiseConstants.GetAddressOf());
+	mDeviceContext->OMSetRenderTargets(2, targets, nullptr);
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (FLOAT)mTextureWidth;
+	viewport.Height = (FLOAT)mTextureHeight;
+	viewport.MaxDepth = 1;
+	mDeviceContext->RSSetViewports(1, &viewport);
+	mDeviceContext->Draw(3, 0);
+
+	// The history just written is read by the next frame, which writes the other one.
+	ID3D11ShaderResourceView* noResource = nullptr;
+	ID3D11RenderTargetView* noTargets[2] = {};
+	mDeviceContext->PSSetShaderResources(2, 1, &noResource);
+	mDeviceContext->OMSetRenderTargets(2, noTargets, nullptr);
+	mDenoiseWrite = 1 - mDenoiseWrite;
+	mDenoiseHasHistory = true;
+}
+
+void TextureBridge::EnsureRemap() {
+	if (mRemapTexture != nullptr && mRemapVersion == mLensTables.GetVersion() &&
+		mRemapWidth == mTextureWidth && mRemapHeight == mTextureHeight) {
+		return;
+	}
+
+	mRemapVersion = mLensTables.GetVersion();
+	mRemapWidth = mTextureWidth;
+	mRemapHeight = mTextureHeight;
+	const unigles::RemapTable& table = mLensTables.Get(mTextureWidth, mTextureHeight);
+	std::vector<uint16_t> texels = table.PackUnorm16();
+
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = table.gridWidth;
+	texDesc.Height = table.gridHeight;
+	texDesc.Format = DXGI_FORMAT_R16G16_UNORM;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	D3D11_SUBRESOURCE_DATA texData = {};
+	texData.pSysMem = texels.data();
+	texData.SysMemPitch = table.gridWidth * 2 * sizeof(uint16_t);
+	MustSucceed(mDevice->CreateTexture2D(&texDesc, &texData, mRemapTexture.ReleaseAndGetAddressOf()), L"Failed to create the lens remap table");
+	MustSucceed(mDevice->CreateShaderResourceView(mRemapTexture.Get(), nullptr, mRemapResourceView.ReleaseAndGetAddressOf()), L"Failed to create lens remap resource");
+	mRemapMemory = mResources.Track(unigles::ResourceHeap::D3D, "Lens remap table", "RG16", unigles::ImageBytes(table.gridWidth, table.gridHeight, 4));
+
+	// Node i sits on pixel i * step, whose texture coordinate is (i * step + 0.5) / width.
+	float constants[4] = {
+		float(mTextureWidth) / (table.step * table.gridWidth),
+		float(mTextureHeight) / (table.step * table.gridHeight),
+		(0.5f - 0.5f / table.step) / table.gridWidth,
+		(0.5f - 0.5f / table.step) / table.gridHeight
+	};
+	mDeviceContext->UpdateSubresource(mRemapConstants.Get(), 0, nullptr, constants, 0, 0);
+}
+
+bool TextureBridge::BindRemap() {
+	if (!IsLensCorrectionEnabled()) {
+		return false;
+	}
+	EnsureRemap();
+	mDeviceContext->PSSetShaderResources(3, 1, mRemapResourceView.GetAddressOf());
+	mDeviceContext->PSSetConstantBuffers(1, 1, mRemapConstants.GetAddressOf());
+	// Samples pulled in from the edges must not wrap round to the other side.
+	mDeviceContext->PSSetSamplers(0, 1, mClampSamplerState.GetAddressOf());
+	return true;
+}
+
+void TextureBridge::EnsurePyramid() {
+	UINT levels = mPyramidLevels;
+	for (UINT w = mTextureWidth, h = mTextureHeight, count = 1; count < levels; count++) {
+		if (w == 1 && h == 1) {
+			levels = count;
+			break;
+		}
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+	if (levels < 2 || (mPyramid.size() == levels - 1 && mPyramidScratch.texture != nullptr)) {
+		return;
+	}
+
+	mPyramid.clear();
+	mPyramid.resize(levels - 1);
+	uint64_t bytes = 0;
+	UINT sourceWidth = mTextureWidth;
+	UINT sourceHeight = mTextureHeight;
+	for (PyramidLevel& level : mPyramid) {
+		level.width = (sourceWidth + 1) / 2;
+		level.height = (sourceHeight + 1) / 2;
+
+		D3D11_TEXTURE2D_DESC texDesc = {};
+		texDesc.Width = level.width;
+		texDesc.Height = level.height;
+		texDesc.Format = DXGI_FORMAT_R8_UNORM;
+		texDesc.MipLevels = 1;
+		texDesc.ArraySize = 1;
+		texDesc.SampleDesc.Count = 1;
+		texDesc.Usage = D3D11_USAGE_DEFAULT;
+		texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+		MustSucceed(mDevice->CreateTexture2D(&texDesc, nullptr, level.texture.ReleaseAndGetAddressOf()), L"Failed to create a pyramid level");
+		MustSucceed(mDevice->CreateRenderTargetView(level.texture.Get(), nullptr, level.targetView.ReleaseAndGetAddressOf()), L"Failed to create pyramid level target view");
+		MustSucceed(mDevice->CreateShaderResourceView(level.texture.Get(), nullptr, level.resourceView.ReleaseAndGetAddressOf()), L"Failed to create pyramid level resource");
+		bytes += unigles::ImageBytes(level.width, level.height, 1);
+
+		// The horizontal pass reads the level above; the vertical one reads its own output
+		// in the scratch texture, as wide as this level and as high as the one above.
+		int horizontal[4] = { 1, 0, int(sourceWidth) - 1, int(sourceHeight) - 1 };
+		int vertical[4] = { 0, 1, int(level.width) - 1, int(sourceHeight) - 1 };
+		D3D11_BUFFER_DESC constantsDesc = {};
+		constantsDesc.ByteWidth = sizeof(horizontal);
+		constantsDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		constantsDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		D3D11_SUBRESOURCE_DATA constantsData = {};
+		constantsData.pSysMem = horizontal;
+		MustSucceed(mDevice->CreateBuffer(&constantsDesc, &constantsData, level.horizontalConstants.ReleaseAndGetAddressOf()), L"Failed to create pyramid constants");
+		constantsData.pSysMem = vertical;
+		MustSucceed(mDevice->CreateBuffer(&constantsDesc, &constantsData, level.verticalConstants.ReleaseAndGetAddressOf()), L"Failed to create pyramid constants");
+
+		sourceWidth = level.width;
+		sourceHeight = level.height;
+	}
+
+	// Level 1 needs the largest scratch area; the deeper levels draw into its corner.
+	TextureVariant& scratch = mPyramidScratch;
+	scratch = TextureVariant();
+	scratch.width = mPyramid[0].width;
+	scratch.height = mTextureHeight;
+	// Feature level 9 devices may not render to 16-bit single channel textures; 8 bits
+	// round once more, which puts the levels at most one step off the CPU pyramid.
+	UINT support = 0;
+	DXGI_FORMAT format = SUCCEEDED(mDevice->CheckFormatSupport(DXGI_FORMAT_R16_UNORM, &support)) &&
+		(support & D3D11_FORMAT_SUPPORT_RENDER_TARGET) ? DXGI_FORMAT_R16_UNORM : DXGI_FORMAT_R8_UNORM;
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = scratch.width;
+	texDesc.Height = scratch.height;
+	texDesc.Format = format;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	MustSucceed(mDevice->CreateTexture2D(&texDesc, nullptr, scratch.texture.ReleaseAndGetAddressOf()), L"Failed to create the pyramid scratch texture");
+	MustSucceed(mDevice->CreateRenderTargetView(scratch.texture.Get(), nullptr, scratch.targetView.ReleaseAndGetAddressOf()), L"Failed to create pyramid scratch target view");
+	MustSucceed(mDevice->CreateShaderResourceView(scratch.texture.Get(), nullptr, scratch.resourceView.ReleaseAndGetAddressOf()), L"Failed to create pyramid scratch resource");
+	bool wide = format == DXGI_FORMAT_R16_UNORM;
+	scratch.memory = mResources.Track(unigles::ResourceHeap::D3D, "Luma pyramid", wide ? "R16" : "R8",
+		unigles::ImageBytes(scratch.width, scratch.height, wide ? 2 : 1), "scratch");
+	mPyramidMemory = mResources.Track(unigles::ResourceHeap::D3D, "Luma pyramid", "R8", bytes, "levels");
+}
+
+ComPtr<ID3D11ShaderResourceView> TextureBridge::CorrectLuma(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lumResourceView) {
+	TextureVariant& corrected = mCorrectedLuma;
+	if (corrected.texture == nullptr) {
+		corrected.width = mTextureWidth;
+		corrected.height = mTextureHeight;
+		D3D11_TEXTURE2D_DESC texDesc = {};
+		texDesc.Width = corrected.width;
+		texDesc.Height = corrected.height;
+		texDesc.Format = DXGI_FORMAT_R8_UNORM;
+		texDesc.MipLevels = 1;
+		texDesc.ArraySize = 1;
+		texDesc.SampleDesc.Count = 1;
+		texDesc.Usage = D3D11_USAGE_DEFAULT;
+		texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+		MustSucceed(mDevice->CreateTexture2D(&texDesc, nullptr, corrected.texture.ReleaseAndGetAddressOf()), L"Failed to create the corrected luma");
+		MustSucceed(mDevice->CreateRenderTargetView(corrected.texture.Get(), nullptr, corrected.targetView.ReleaseAndGetAddressOf()), L"Failed to create corrected luma target view");
+		MustSucceed(mDevice->CreateShaderResourceView(corrected.texture.Get(), nullptr, corrected.resourceView.ReleaseAndGetAddressOf()), L"Failed to create corrected luma resource");
+		corrected.memory = mResources.Track(unigles::ResourceHeap::D3D, "Luma pyramid", "R8",
+			unigles::ImageBytes(corrected.width, corrected.height, 1), "corrected luma");
+	}
+
+	mProfiler->BeginPass("Pyramid level 0");
+	BindRemap();
+	mDeviceContext->PSSetShader(mRemapLumaPixelShader.Get(), nullptr, 0);
+	mDeviceContext->PSSetShaderResources(0, 1, lumResourceView.GetAddressOf());
+	mDeviceContext->OMSetRenderTargets(1, corrected.targetView.GetAddressOf(), nullptr);
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (FLOAT)corrected.width;
+	viewport.Height = (FLOAT)corrected.height;
+	viewport.MaxDepth = 1;
+	mDeviceContext->RSSetViewports(1, &viewport);
+	mDeviceContext->Draw(3, 0);
+	ID3D11RenderTargetView* noTarget = nullptr;
+	mDeviceContext->OMSetRenderTargets(1, &noTarget, nullptr);
+	mProfiler->EndPass();
+	return corrected.resourceView;
+}
+
+void TextureBridge::BuildPyramid(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lumResourceView) {
+	EnsurePyramid();
+	mDeviceContext->PSSetShader(mPyramidPixelShader.Get(), nullptr, 0);
+	ID3D11ShaderResourceView* none = nullptr;
+	ID3D11RenderTargetView* noTarget = nullptr;
+	for (UINT index = 0; index < mPyramid.size(); index++) {
+		PyramidLevel& level = mPyramid[index];
+		ID3D11ShaderResourceView* source = index == 0 ? lumResourceView.Get() : mPyramid[index - 1].resourceView.Get();
+		UINT sourceHeight = index == 0 ? mTextureHeight : mPyramid[index - 1].height;
+		mProfiler->BeginPass("Pyramid level " + std::to_string(index + 1));
+
+		mDeviceContext->OMSetRenderTargets(1, mPyramidScratch.targetView.GetAddressOf(), nullptr);
+		mDeviceContext->PSSetShaderResources(0, 1, &source);
+		mDeviceContext->PSSetConstantBuffers(0, 1, level.horizontalConstants.GetAddressOf());
+		D3D11_VIEWPORT viewport = {};
+		viewport.Width = (FLOAT)level.width;
+		viewport.Height = (FLOAT)sourceHeight;
+		viewport.MaxDepth = 1;
+		mDeviceContext->RSSetViewports(1, &viewport);
+		mDeviceContext->Draw(3, 0);
+		mDeviceContext->PSSetShaderResources(0, 1, &none);
+
+		mDeviceContext->OMSetRenderTargets(1, level.targetView.GetAddressOf(), nullptr);
+		mDeviceContext->PSSetShaderResources(0, 1, mPyramidScratch.resourceView.GetAddressOf());
+		mDeviceContext->PSSetConstantBuffers(0, 1, level.verticalConstants.GetAddressOf());
+		viewport.Height = (FLOAT)level.height;
+		mDeviceContext->RSSetViewports(1, &viewport);
+		mDeviceContext->Draw(3, 0);
+		// The scratch is written again by the next level, which reads this one.
+		mDeviceContext->PSSetShaderResources(0, 1, &none);
+		mDeviceContext->OMSetRenderTargets(1, &noTarget, nullptr);
+
+		mProfiler->EndPass();
+	}
 }
 
-void TextureBridge::ReadImpl(Microsoft::WRL::ComPtr<ID3D11Texture2D> source) {
+void TextureBridge::EnsureThumbnail() {
+	UINT width = (mTextureWidth + ChangeDetectionScale - 1) / ChangeDetectionScale;
+	UINT height = (mTextureHeight + ChangeDetectionScale - 1) / ChangeDetectionScale;
+	if (mThumbnailTexture != nullptr && mThumbnailWidth == width && mThumbnailHeight == height) {
+		return;
+	}
+
+	mThumbnailWidth = width;
+	mThumbnailHeight = height;
+	mThumbnailPending = 0;
+	mThumbnailWrite = 0;
+	mThumbnailChanged = true;
+
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = mThumbnailWidth;
+	texDesc.Height = mThumbnailHeight;
+	texDesc.Format = DXGI_FORMAT_R8_UNORM;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET;
+	MustSucceed(mDevice->CreateTexture2D(&texDesc, nullptr, mThumbnailTexture.ReleaseAndGetAddressOf()), L"Failed to create the thumbnail texture");
+	MustSucceed(mDevice->CreateRenderTargetView(mThumbnailTexture.Get(), nullptr, mThumbnailTargetView.ReleaseAndGetAddressOf()), L"Failed to create thumbnail target view");
+
+	texDesc.Usage = D3D11_USAGE_STAGING;
+	texDesc.BindFlags = 0;
+	texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (UINT i = 0; i < ThumbnailReadbackDepth; i++) {
+		MustSucceed(mDevice->CreateTexture2D(&texDesc, nullptr, mThumbnailStaging[i].ReleaseAndGetAddressOf()), L"Failed to create a thumbnail staging texture");
+	}
+	// The target and its staging copies.
+	mThumbnailMemory = mResources.Track(unigles::ResourceHeap::D3D, "Change detection thumbnail", "R8",
+		(1 + ThumbnailReadbackDepth) * unigles::ImageBytes(mThumbnailWidth, mThumbnailHeight, 1));
+}
+
+bool TextureBridge::DetectChange(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lumResourceView) {
+	EnsureThumbnail();
+	CollectThumbnails();
+	if (mThumbnailPending == ThumbnailReadbackDepth) {
+		// The GPU is more than the readback depth behind; keep the last decision rather than wait.
+		return mThumbnailChanged;
+	}
+
+	mDeviceContext->PSSetShader(mLumaPixelShader.Get(), nullptr, 0);
+	mDeviceContext->PSSetShaderResources(0, 1, lumResourceView.GetAddressOf());
+	mDeviceContext->OMSetRenderTargets(1, mThumbnailTargetView.GetAddressOf(), nullptr);
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (FLOAT)mThumbnailWidth;
+	viewport.Height = (FLOAT)mThumbnailHeight;
+	viewport.MaxDepth = 1;
+	mDeviceContext->RSSetViewports(1, &viewport);
+	mDeviceContext->Draw(3, 0);
+	mDeviceContext->CopyResource(mThumbnailStaging[mThumbnailWrite].Get(), mThumbnailTexture.Get());
+	mThumbnailWrite = (mThumbnailWrite + 1) % ThumbnailReadbackDepth;
+	mThumbnailPending++;
+	// Mapping this frame's thumbnail would wait for the GPU to finish it. The motion it
+	// shows is caught a frame later instead, and the detector's quiet frames keep the
+	// frames converted for a while after the scene settles.
+	return mThumbnailChanged;
+}
+
+void TextureBridge::CollectThumbnails() {
+	while (mThumbnailPending > 0) {
+		UINT oldest = (mThumbnailWrite + ThumbnailReadbackDepth - mThumbnailPending) % ThumbnailReadbackDepth;
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		HRESULT rc = mDeviceContext->Map(mThumbnailStaging[oldest].Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+		if (rc == DXGI_ERROR_WAS_STILL_DRAWING) {
+			return;
+		}
+		MustSucceed(rc, L"Failed to map the thumbnail");
+		mThumbnailChanged = mChangeDetector.Process(static_cast<const uint8_t*>(mapped.pData), mThumbnailWidth, mThumbnailHeight, mapped.RowPitch);
+		mDeviceContext->Unmap(mThumbnailStaging[oldest].Get(), 0);
+		mThumbnailPending--;
+	}
+}
+
+void TextureBridge::EnsureStatistics() {
+	UINT tilesX = (mTextureWidth + StatisticsTileSize - 1) / StatisticsTileSize;
+	UINT tilesY = (mTextureHeight + StatisticsTileSize - 1) / StatisticsTileSize;
+	if (mStatisticsBuffer != nullptr && mStatisticsTilesX == tilesX && mStatisticsTilesY == tilesY) {
+		return;
+	}
+
+	mStatisticsTilesX = tilesX;
+	mStatisticsTilesY = tilesY;
+	mStatisticsPending = 0;
+	mStatisticsWrite = 0;
+
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.ByteWidth = (256 + tilesX * tilesY * 3) * sizeof(UINT);
+	bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+	MustSucceed(mDevice->CreateBuffer(&bufferDesc, nullptr, mStatisticsBuffer.ReleaseAndGetAddressOf()), L"Failed to create statistics buffer");
+	D3D11_UNORDERED_ACCESS_VIEW_DESC viewDesc = {};
+	viewDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	viewDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	viewDesc.Buffer.NumElements = bufferDesc.ByteWidth / sizeof(UINT);
+	viewDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+	MustSucceed(mDevice->CreateUnorderedAccessView(mStatisticsBuffer.Get(), &viewDesc, mStatisticsView.ReleaseAndGetAddressOf()), L"Failed to create statistics view");
+
+	bufferDesc.BindFlags = 0;
+	bufferDesc.Usage = D3D11_USAGE_STAGING;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	bufferDesc.MiscFlags = 0;
+	for (UINT i = 0; i < StatisticsReadbackDepth; i++) {
+		MustSucceed(mDevice->CreateBuffer(&bufferDesc, nullptr, mStatisticsStaging[i].ReleaseAndGetAddressOf()), L"Failed to create statistics staging buffer");
+	}
+	mStatisticsMemory = mResources.Track(unigles::ResourceHeap::D3D, "Statistics readback", "R32 raw", uint64_t(bufferDesc.ByteWidth) * (1 + StatisticsReadbackDepth));
+
+	UINT constants[4] = { mTextureWidth, mTextureHeight, tilesX, 0 };
+	mDeviceContext->UpdateSubresource(mStatisticsConstants.Get(), 0, nullptr, constants, 0, 0);
+}
+
+void TextureBridge::DispatchStatistics(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lumResourceView) {
+	EnsureStatistics();
+	CollectStatistics();
+	if (mStatisticsPending == StatisticsReadbackDepth) {
+		// The GPU is more than the readback depth behind; skip rather than wait.
+		return;
+	}
+
+	const UINT zero[4] = {};
+	mDeviceContext->ClearUnorderedAccessViewUint(mStatisticsView.Get(), zero);
+	mDeviceContext->CSSetShader(mStatisticsShader.Get(), nullptr, 0);
+	mDeviceContext->CSSetShaderResources(0, 1, lumResourceView.GetAddressOf());
+	mDeviceContext->CSSetUnorderedAccessViews(0, 1, mStatisticsView.GetAddressOf(), nullptr);
+	mDeviceContext->CSSetConstantBuffers(0, 1, mStatisticsConstants.GetAddressOf());
+	mDeviceContext->Dispatch(mStatisticsTilesX, mStatisticsTilesY, 1);
+	ID3D11ShaderResourceView* nullResource = nullptr;
+	ID3D11UnorderedAccessView* nullView = nullptr;
+	mDeviceContext->CSSetShaderResources(0, 1, &nullResource);
+	mDeviceContext->CSSetUnorderedAccessViews(0, 1, &nullView, nullptr);
+
+	mDeviceContext->CopyResource(mStatisticsStaging[mStatisticsWrite].Get(), mStatisticsBuffer.Get());
+	mStatisticsFrame[mStatisticsWrite] = mFrameVersion;
+	mStatisticsWrite = (mStatisticsWrite + 1) % StatisticsReadbackDepth;
+	mStatisticsPending++;
+}
+
+void TextureBridge::CollectStatistics() {
+	while (mStatisticsPending > 0) {
+		UINT oldest = (mStatisticsWrite + StatisticsReadbackDepth - mStatisticsPending) % StatisticsReadbackDepth;
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		HRESULT rc = mDeviceContext->Map(mStatisticsStaging[oldest].Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+		if (rc == DXGI_ERROR_WAS_STILL_DRAWING) {
+			return;
+		}
+		MustSucceed(rc, L"Failed to map statistics");
+
+		const UINT* data = static_cast<const UINT*>(mapped.pData);
+		unigles::LumaStatistics& result = mLatestStatistics;
+		result.frame = mStatisticsFrame[oldest];
+		memcpy(result.histogram, data, sizeof(result.histogram));
+		const UINT tileSize = StatisticsTileSize;
+		result.tileSize = tileSize;
+		result.tilesX = mStatisticsTilesX;
+		result.tilesY = mStatisticsTilesY;
+		result.tiles.resize(mStatisticsTilesX * mStatisticsTilesY);
+		for (UINT ty = 0; ty < mStatisticsTilesY; ty++) {
+			for (UINT tx = 0; tx < mStatisticsTilesX; tx++) {
+				const UINT* tileData = data + 256 + (ty * mStatisticsTilesX + tx) * 3;
+				unigles::LumaTileStatistics& tile = result.tiles[ty * mStatisticsTilesX + tx];
+				tile.sum = tileData[0];
+				tile.min = (uint8_t)tileData[1];
+				tile.max = (uint8_t)tileData[2];
+				tile.count = (std::min)(tileSize, mTextureWidth - tx * tileSize) * (std::min)(tileSize, mTextureHeight - ty * tileSize);
+			}
+		}
+		mDeviceContext->Unmap(mStatisticsStaging[oldest].Get(), 0);
+		result.Finalize();
+		mHasStatistics = true;
+		mStatisticsPending--;
+	}
+}
+
+bool TextureBridge::ReadImpl(Microsoft::WRL::ComPtr<ID3D11Texture2D> source) {
 	UINT stride = sizeof(XMFLOAT3);
 	UINT offset = 0;
 	D3D11_SHADER_RESOURCE_VIEW_DESC rvDesc = {};
@@ -143,32 +1083,101 @@ void TextureBridge::ReadImpl(Microsoft::WRL::ComPtr<ID3D11Texture2D> source) {
 	rvDesc.Format = DXGI_FORMAT_R8G8_UNORM;
 	MustSucceed(mDevice->CreateShaderResourceView(source.Get(), &rvDesc, chromResourceView.GetAddressOf()), L"Failed to create chroma resource");
 	mDeviceContext->VSSetShader(mVertexShader.Get(), nullptr, 0);
-	mDeviceContext->PSSetShader(mPixelShader.Get(), nullptr, 0);
-	mDeviceContext->PSSetShaderResources(0, 1, lumResourceView.GetAddressOf());
-	mDeviceContext->PSSetShaderResources(1, 1, chromResourceView.GetAddressOf());
 	mDeviceContext->PSSetSamplers(0, 1, mSamplerState.GetAddressOf());
 	mDeviceContext->IASetVertexBuffers(0, 1, mVertexBuffer.GetAddressOf(), &stride, &offset);
 	mDeviceContext->IASetInputLayout(mInputLayout.Get());
 	mDeviceContext->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	mProfiler->BeginFrame(mDeviceContext);
+	if (mChangeDetectionEnabled) {
+		mProfiler->BeginPass("Change detection");
+		bool changed = DetectChange(lumResourceView);
+		mProfiler->EndPass();
+		if (!changed) {
+			mProfiler->EndFrame();
+			return false;
+		}
+	}
 	D3D11_RENDER_TARGET_VIEW_DESC rtDesc = {};
 	rtDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
 	rtDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
 	ComPtr<ID3D11RenderTargetView> rtView;
 	MustSucceed(mDevice->CreateRenderTargetView(mSharedTexture.Get(), &rtDesc, rtView.GetAddressOf()), L"Failed to create render target view");
-	mDeviceContext->OMSetRenderTargets(1, rtView.GetAddressOf(), nullptr);
-	D3D11_VIEWPORT viewport = {};
-	viewport.Width = mTextureWidth;
-	viewport.Height = mTextureHeight;
-	mDeviceContext->RSSetViewports(1, &viewport);
-	FLOAT bgColor[4] = { 1, 0, 1, 1 };
-	mDeviceContext->ClearRenderTargetView(rtView.Get(), bgColor);
-	mDeviceContext->Draw(3, 0);
+	if (mPostProcessDirty) {
+		unigles::PostProcessPlan plan = mPostProcessGraph.Compile(unigles::PostSource::Nv12);
+		mPostProcess.reset(plan.Empty() ? nullptr : new PostProcessD3D(mDevice, plan, mResources));
+		mPostProcessDirty = false;
+	}
+	mProfiler->BeginPass(mPostProcess ? "Post-processing" : "Conversion");
+	if (mPostProcess) {
+		// The graph's first stage performs the YUV conversion with any per-pixel passes fused in.
+		mPostProcess->Execute(mDeviceContext, lumResourceView.Get(), chromResourceView.Get(), rtView.Get(), mTextureWidth, mTextureHeight);
+		mDenoiseHasHistory = false;
+	} else if (mDenoiseEnabled) {
+		ConvertDenoised(lumResourceView, chromResourceView, rtView, BindRemap());
+	} else {
+		bool remap = BindRemap();
+		mDeviceContext->PSSetShader(remap ? mRemapPixelShader.Get() : mPixelShader.Get(), nullptr, 0);
+		mDeviceContext->PSSetShaderResources(0, 1, lumResourceView.GetAddressOf());
+		mDeviceContext->PSSetShaderResources(1, 1, chromResourceView.GetAddressOf());
+		mDeviceContext->OMSetRenderTargets(1, rtView.GetAddressOf(), nullptr);
+		D3D11_VIEWPORT viewport = {};
+		viewport.Width = mTextureWidth;
+		viewport.Height = mTextureHeight;
+		mDeviceContext->RSSetViewports(1, &viewport);
+		FLOAT bgColor[4] = { 1, 0, 1, 1 };
+		mDeviceContext->ClearRenderTargetView(rtView.Get(), bgColor);
+		mDeviceContext->Draw(3, 0);
+	}
+	mProfiler->EndPass();
+	if (mRequestedLevel > 0) {
+		mProfiler->BeginPass("Downscale");
+		EnsureVariants(mRequestedLevel + 1);
+		DownscaleVariants(mRequestedLevel + 1);
+		mProfiler->EndPass();
+	}
+	mTextureLevel = mRequestedLevel;
+	if (mPyramidLevels > 1) {
+		// From the luma the frame was converted from, as the CPU pyramid is built from the
+		// corrected and denoised frame. The history just written holds it in red.
+		if (mPostProcess) {
+			BuildPyramid(lumResourceView);
+		} else if (mDenoiseEnabled) {
+			BuildPyramid(mDenoiseHistory[1 - mDenoiseWrite].resourceView);
+		} else if (IsLensCorrectionEnabled()) {
+			BuildPyramid(CorrectLuma(lumResourceView));
+		} else {
+			BuildPyramid(lumResourceView);
+		}
+	} else if (!mPyramid.empty()) {
+		mPyramid.clear();
+		mPyramidScratch = TextureVariant();
+		mCorrectedLuma = TextureVariant();
+		mPyramidMemory.Reset();
+	}
+	mFrameVersion++;
+	if (IsStatisticsEnabled()) {
+		mProfiler->BeginPass("Statistics");
+		DispatchStatistics(lumResourceView);
+		mProfiler->EndPass();
+	}
+	mProfiler->EndFrame();
+	return true;
 }
 
-void TextureBridge::ReadData(Microsoft::WRL::ComPtr<IDXGISurface> source) {
+bool TextureBridge::ReadData(Microsoft::WRL::ComPtr<IDXGISurface> source) {
 	ComPtr<ID3D11Texture2D> surfaceTexture;
 	MustSucceed(source.As(&surfaceTexture), L"Source is not a texture");
-	SetupD3D(source);
-	EnsureTexture(source);
-	ReadImpl(surfaceTexture);
+	if (!SetupD3D(source)) {
+		return false;
+	}
+	try {
+		EnsureTexture(source);
+		return ReadImpl(surfaceTexture);
+	} catch (Exception^) {
+		// Calls on a removed device fail; drop the frame and rebuild with the next one.
+		if (mRegistry.CheckLost(unigles::GpuDomain::D3D)) {
+			return false;
+		}
+		throw;
+	}
 }
@@ -1,16 +1,110 @@
 #pragma once
+
+#include "D3DGpuProfiler.h"
+#include "GpuProfileLog.h"
+#include "GpuResourceRegistry.h"
+#include "LensRemap.h"
+#include "LumaChangeDetector.h"
+#include "LumaStatistics.h"
+#include "PostProcessD3D.h"
+#include "PostProcessGraph.h"
+#include "ResourceTracker.h"
+#include "TemporalDenoiser.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 class TextureBridge {
 public:
-	TextureBridge();
+	// Every D3D resource is registered with the registry, so a removed device or a
+	// camera that moved to another device only costs rebuilding them on the next frame.
+	// The textures and buffers sized by the camera frame are counted by the tracker.
+	TextureBridge(unigles::GpuResourceRegistry& registry, unigles::ResourceTracker& resources);
 	virtual ~TextureBridge();
 
-	void ReadData(Microsoft::WRL::ComPtr<IDXGISurface> source);
-	HANDLE GetTextureHandle() const { return mSharedTextureHandle; }
-	UINT GetTextureWidth() const { return mTextureWidth; }
-	UINT GetTextureHeight() const { return mTextureHeight; }
+	// Compiles the conversion shaders ahead of the first frame; safe to call from any thread.
+	void PrecompileShaders();
+	// Returns false when change detection decided the frame was not worth converting,
+	// or when the device is lost and the frame could not be converted.
+	bool ReadData(Microsoft::WRL::ComPtr<IDXGISurface> source);
+	// Shared texture of the current level; level 0 is the camera resolution.
+	HANDLE GetTextureHandle() const { return mTextureLevel == 0 ? mSharedTextureHandle : mVariants[mTextureLevel - 1].handle; }
+	UINT GetTextureWidth() const { return mTextureLevel == 0 ? mTextureWidth : mVariants[mTextureLevel - 1].width; }
+	UINT GetTextureHeight() const { return mTextureLevel == 0 ? mTextureHeight : mVariants[mTextureLevel - 1].height; }
+	UINT GetSourceWidth() const { return mTextureWidth; }
+	UINT GetSourceHeight() const { return mTextureHeight; }
+
+	// Every level halves the previous one. Levels above 0 are downscaled from the
+	// converted frame, only up to the requested one; the current level follows the
+	// request once a frame has been converted at it.
+	static const UINT TextureLevels = 3;
+	void SetTextureLevel(UINT level) { mRequestedLevel = (std::min)(level, TextureLevels - 1); }
+	UINT GetTextureLevel() const { return mTextureLevel; }
+	// Incremented every time the shared texture receives a new image.
+	UINT64 GetFrameVersion() const { return mFrameVersion; }
+
+	void EnableChangeDetection(bool enable);
+	bool IsChangeDetectionEnabled() const { return mChangeDetectionEnabled; }
+	const unigles::LumaChangeDetector& GetChangeDetector() const { return mChangeDetector; }
+	// Edge of one dirty mask tile, in camera pixels.
+	UINT GetDirtyTileSize() const { return mChangeDetector.GetSettings().tileSize * ChangeDetectionScale; }
+
+	// Luma statistics are reduced on the GPU right after the conversion draw and read
+	// back a few frames later, so asking for them never stalls the pipeline.
+	void EnableStatistics(bool enable);
+	bool IsStatisticsEnabled() const { return mStatisticsEnabled && mStatisticsShader != nullptr; }
+	// Newest statistics that made it back from the GPU; false until the first one lands.
+	bool GetLatestStatistics(unigles::LumaStatistics& result) const;
+
+	// Rolling CPU and GPU times of the change detection, conversion and statistics passes.
+	const unigles::GpuProfileLog& GetProfileLog() const { return mProfileLog; }
+
+	// Replaces the fixed YUV conversion with the graph, compiled on the next frame.
+	// An empty graph brings the fixed conversion back.
+	void SetPostProcessing(const unigles::PostProcessGraph& graph);
+	// Compiled plan with stage split and per-pass costs; null while the fixed conversion is used.
+	const unigles::PostProcessPlan* GetPostProcessPlan() const { return mPostProcess ? &mPostProcess->GetPlan() : nullptr; }
+
+	// Motion adaptive temporal denoising, performed by the fixed conversion draw itself:
+	// it reads the filtered previous frame and writes the new one as a second target,
+	// so it adds no pass. Frames converted by a post-processing graph are not filtered.
+	void EnableDenoising(bool enable);
+	bool IsDenoisingEnabled() const { return mDenoiseEnabled; }
+	void SetDenoiseSettings(const unigles::DenoiseSettings& settings) { mDenoiseSettings = settings; }
+	const unigles::DenoiseSettings& GetDenoiseSettings() const { return mDenoiseSettings; }
+
+	// Lens correction, also performed by the fixed conversion draw: every pixel looks up
+	// where to sample the camera frame in a small table of the lens, built once per
+	// resolution. An identity model turns it off. Frames converted by a post-processing
+	// graph are not corrected.
+	void SetLensModel(const unigles::LensModel& lens);
+	const unigles::LensModel& GetLensModel() const { return mLensTables.GetLens(); }
+	bool IsLensCorrectionEnabled() const { return !mLensTables.GetLens().IsIdentity(); }
+
+	// Gaussian luma pyramid for trackers and other multi-scale consumers, built on the GPU
+	// after the conversion so no full frame has to be read back for it. Each level is the
+	// one above filtered with the 5-tap binomial kernel and decimated 2x, as a horizontal
+	// and a vertical pass, both timed as "Pyramid level n". Level 0 is the luma the frame
+	// was converted from, denoised and lens corrected like the CPU pyramid's, and is not
+	// exposed; drawing it through the lens alone is timed as "Pyramid level 0". Levels
+	// from 1 live in R8 textures reused every frame.
+	static const UINT MaxPyramidLevels = 8;
+	// Fewer than two levels turns it off.
+	void EnablePyramid(UINT levels) { mPyramidLevels = (std::min)(levels, MaxPyramidLevels); }
+	UINT GetPyramidLevelCount() const { return mPyramid.empty() ? 0 : UINT(mPyramid.size()) + 1; }
+	ID3D11ShaderResourceView* GetPyramidLevel(UINT level) const { return mPyramid[level - 1].resourceView.Get(); }
+	UINT GetPyramidLevelWidth(UINT level) const { return mPyramid[level - 1].width; }
+	UINT GetPyramidLevelHeight(UINT level) const { return mPyramid[level - 1].height; }
 
 private:
+	unigles::GpuResourceRegistry& mRegistry;
+	std::vector<unigles::GpuResourceRegistry::Handle> mResourceHandles;
+	unigles::ResourceTracker& mResources;
+
 	Microsoft::WRL::ComPtr<ID3D11Texture2D> mSharedTexture;
+	unigles::TrackedResource mSharedTextureMemory;
 	Microsoft::WRL::ComPtr<ID3D11Device> mDevice;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> mDeviceContext;
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> mVertexShader;
@@ -19,10 +113,141 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> mVertexBuffer;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> mSamplerState;
 
+	std::once_flag mShadersCompiled;
+	Microsoft::WRL::ComPtr<ID3DBlob> mVertexShaderBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> mPixelShaderBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> mLumaPixelShaderBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> mStatisticsShaderBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> mDownscalePixelShaderBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> mDenoisePixelShaderBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> mRemapPixelShaderBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> mRemapDenoisePixelShaderBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> mPyramidPixelShaderBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> mRemapLumaPixelShaderBlob;
+
+	struct TextureVariant {
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> targetView;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> resourceView;
+		HANDLE handle = 0;
+		UINT width = 0;
+		UINT height = 0;
+		unigles::TrackedResource memory;
+	};
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> mDownscalePixelShader;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> mSharedResourceView;
+	TextureVariant mVariants[TextureLevels - 1];
+	UINT mRequestedLevel;
+	UINT mTextureLevel;
+
+	// The history holds the filtered YUV of the last frame at full resolution. One
+	// texture is read while the other is written, and they swap every frame.
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> mDenoisePixelShader;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> mDenoiseConstants;
+	TextureVariant mDenoiseHistory[2];
+	UINT mDenoiseWrite;
+	bool mDenoiseHasHistory;
+	bool mDenoiseEnabled;
+	unigles::DenoiseSettings mDenoiseSettings;
+
+	// Both conversion shaders have a variant that reads the source coordinates from the
+	// table, a grid of nodes filtered by the sampler in between. The table texture
+	// follows the lens and the camera resolution.
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> mRemapPixelShader;
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> mRemapDenoisePixelShader;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> mRemapConstants;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> mClampSamplerState;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> mRemapTexture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> mRemapResourceView;
+	unigles::TrackedResource mRemapMemory;
+	unigles::RemapTableCache mLensTables;
+	UINT64 mRemapVersion;
+	UINT mRemapWidth, mRemapHeight;
+
+	// Every level's horizontal pass writes the scratch texture, sized for level 1 and at
+	// 16 bits where the device renders them, so the vertical pass sees the sums nearly
+	// unrounded. The constants of both passes are made with the level. Level 0 is the
+	// camera's luma, the denoise history's, or when only the lens is corrected, the
+	// camera's luma drawn through the table into its own texture.
+	struct PyramidLevel {
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> targetView;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> resourceView;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> horizontalConstants;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> verticalConstants;
+		UINT width = 0;
+		UINT height = 0;
+	};
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> mPyramidPixelShader;
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> mRemapLumaPixelShader;
+	std::vector<PyramidLevel> mPyramid;		// Levels from 1
+	TextureVariant mPyramidScratch;
+	TextureVariant mCorrectedLuma;
+	unigles::TrackedResource mPyramidMemory;
+	UINT mPyramidLevels;
+
+	// Change detection runs on a luma thumbnail, ChangeDetectionScale times smaller on each axis.
+	// Thumbnails are read back like the statistics, so a frame is converted or skipped by
+	// the newest comparison that made it back, at least one frame older than the frame.
+	static const UINT ChangeDetectionScale = 4;
+	static const UINT ThumbnailReadbackDepth = 3;
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> mLumaPixelShader;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> mThumbnailTexture;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> mThumbnailStaging[ThumbnailReadbackDepth];
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> mThumbnailTargetView;
+	unigles::TrackedResource mThumbnailMemory;
+	UINT mThumbnailWidth, mThumbnailHeight;
+	UINT mThumbnailWrite, mThumbnailPending;
+	bool mThumbnailChanged;
+	bool mChangeDetectionEnabled;
+	unigles::LumaChangeDetector mChangeDetector;
+
+	static const UINT StatisticsTileSize = 64;
+	static const UINT StatisticsReadbackDepth = 3;
+	Microsoft::WRL::ComPtr<ID3D11ComputeShader> mStatisticsShader;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> mStatisticsBuffer;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> mStatisticsConstants;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> mStatisticsView;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> mStatisticsStaging[StatisticsReadbackDepth];
+	unigles::TrackedResource mStatisticsMemory;
+	UINT64 mStatisticsFrame[StatisticsReadbackDepth];
+	UINT mStatisticsWrite, mStatisticsPending;
+	UINT mStatisticsTilesX, mStatisticsTilesY;
+	bool mStatisticsEnabled;
+	bool mHasStatistics;
+	unigles::LumaStatistics mLatestStatistics;
+
+	unigles::GpuProfileLog mProfileLog;
+	std::unique_ptr<D3DGpuProfiler> mProfiler;
+
+	unigles::PostProcessGraph mPostProcessGraph;
+	bool mPostProcessDirty;
+	std::unique_ptr<PostProcessD3D> mPostProcess;
+
 	HANDLE mSharedTextureHandle;
 	UINT mTextureWidth, mTextureHeight;
+	UINT64 mFrameVersion;
 
-	void SetupD3D(Microsoft::WRL::ComPtr<IDXGISurface> anchor);
+	void CompileShaders();
+	void RegisterResources();
+	void CreatePipeline();
+	bool SetupD3D(Microsoft::WRL::ComPtr<IDXGISurface> anchor);
 	void EnsureTexture(Microsoft::WRL::ComPtr<IDXGISurface> source);
-	void ReadImpl(Microsoft::WRL::ComPtr<ID3D11Texture2D> source);
+	void EnsureVariants(UINT levels);
+	void DownscaleVariants(UINT levels);
+	void EnsureDenoiseHistory();
+	void ConvertDenoised(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lumResourceView,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> chromResourceView, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtView, bool remap);
+	void EnsureRemap();
+	bool BindRemap();
+	void EnsurePyramid();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CorrectLuma(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lumResourceView);
+	void BuildPyramid(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lumResourceView);
+	void EnsureThumbnail();
+	bool DetectChange(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lumResourceView);
+	void CollectThumbnails();
+	void EnsureStatistics();
+	void DispatchStatistics(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lumResourceView);
+	void CollectStatistics();
+	bool ReadImpl(Microsoft::WRL::ComPtr<ID3D11Texture2D> source);
 };
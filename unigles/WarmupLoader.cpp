@@ -0,0 +1,149 @@
+#include "WarmupLoader.h"
+
+#include <GLES2/gl2.h>
+
+#include <cstring>
+
+using namespace unigles;
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+WarmupLoader::WarmupLoader(EGLDisplay display, EGLConfig config, EGLContext shareContext) :
+	mDisplay(display),
+	mConfig(config),
+	mShareContext(shareContext),
+	mContext(EGL_NO_CONTEXT),
+	mSurface(EGL_NO_SURFACE),
+	mSucceeded(false),
+	mTotalMilliseconds(0.0),
+	mReady(false) {}
+
+WarmupLoader::~WarmupLoader() {
+	if (mThread.joinable()) {
+		mThread.join();
+	}
+}
+
+void WarmupLoader::AddGlTask(const std::string& name, std::function<void()> task) {
+	mTasks.push_back(Task{ name, std::move(task), true });
+}
+
+void WarmupLoader::AddTask(const std::string& name, std::function<void()> task) {
+	mTasks.push_back(Task{ name, std::move(task), false });
+}
+
+void WarmupLoader::Start() {
+	if (!mThread.joinable()) {
+		mThread = std::thread(&WarmupLoader::Run, this);
+	}
+}
+
+bool WarmupLoader::Wait(unsigned timeoutMilliseconds) {
+	std::unique_lock<std::mutex> lock(mMutex);
+	return mReadyCondition.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [this] { return mReady; });
+}
+
+bool WarmupLoader::IsReady() const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mReady;
+}
+
+bool WarmupLoader::MakeContextCurrent() {
+	const EGLint contextAttributes[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+	mContext = eglCreateContext(mDisplay, mConfig, mShareContext, contextAttributes);
+	if (mContext == EGL_NO_CONTEXT) {
+		return false;
+	}
+	// Nothing is drawn here, so skip the surface when the display allows it.
+	const char* extensions = eglQueryString(mDisplay, EGL_EXTENSIONS);
+	if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+		const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		mSurface = eglCreatePbufferSurface(mDisplay, mConfig, surfaceAttributes);
+		if (mSurface == EGL_NO_SURFACE) {
+			return false;
+		}
+	}
+	return eglMakeCurrent(mDisplay, mSurface, mSurface, mContext) == EGL_TRUE;
+}
+
+void WarmupLoader::ReleaseContext() {
+	eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (mSurface != EGL_NO_SURFACE) {
+		eglDestroySurface(mDisplay, mSurface);
+		mSurface = EGL_NO_SURFACE;
+	}
+	// Objects created here belong to the share group and outlive this context.
+	if (mContext != EGL_NO_CONTEXT) {
+		eglDestroyContext(mDisplay, mContext);
+		mContext = EGL_NO_CONTEXT;
+	}
+}
+
+void WarmupLoader::Run() {
+	auto start = std::chrono::steady_clock::now();
+	bool succeeded = true;
+	bool needsContext = false;
+	for (const Task& task : mTasks) {
+		needsContext |= task.needsContext;
+	}
+	bool hasContext = needsContext && MakeContextCurrent();
+
+	std::vector<WarmupTaskTiming> timings;
+	for (const Task& task : mTasks) {
+		auto taskStart = std::chrono::steady_clock::now();
+		bool taskSucceeded = !task.needsContext || hasContext;
+		if (taskSucceeded) {
+			try {
+				task.run();
+			} catch (...) {
+				taskSucceeded = false;
+			}
+		}
+		succeeded &= taskSucceeded;
+		timings.push_back(WarmupTaskTiming{ task.name, MillisecondsSince(taskStart), taskSucceeded });
+	}
+	if (hasContext) {
+		// The render context may only use the objects once the commands creating them completed.
+		glFinish();
+	}
+	if (needsContext) {
+		ReleaseContext();
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mTimings.swap(timings);
+	mSucceeded = succeeded;
+	mTotalMilliseconds = MillisecondsSince(start);
+	mReady = true;
+	mReadyCondition.notify_all();
+}
+
+StartupTimer::StartupTimer() :
+	mStart(std::chrono::steady_clock::now()),
+	mReadyMilliseconds(0.0),
+	mFirstFrameMilliseconds(0.0),
+	mFirstFrame(false) {}
+
+void StartupTimer::Start() {
+	mStart = std::chrono::steady_clock::now();
+	mReadyMilliseconds = 0.0;
+	mFirstFrameMilliseconds = 0.0;
+	mFirstFrame = false;
+}
+
+void StartupTimer::MarkReady() {
+	mReadyMilliseconds = Elapsed();
+}
+
+void StartupTimer::MarkFirstFrame() {
+	if (!mFirstFrame) {
+		mFirstFrameMilliseconds = Elapsed();
+		mFirstFrame = true;
+	}
+}
+
+double StartupTimer::Elapsed() const {
+	return MillisecondsSince(mStart);
+}
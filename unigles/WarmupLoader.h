@@ -0,0 +1,93 @@
+#pragma once
+
+#include <EGL/egl.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace unigles {
+	struct WarmupTaskTiming {
+		std::string name;
+		double milliseconds;
+		bool succeeded;
+	};
+
+	// Prepares programs, buffers and other pipeline state on a background thread before
+	// the first frame needs them. GL tasks run on a context shared with the render
+	// context, so whatever they create is usable by the render thread once the loader
+	// is ready; other tasks (shader compilation for D3D, file loading) run on the same
+	// thread without a context. A failing task is recorded and the others still run,
+	// so callers can fall back to creating what is missing on demand.
+	class WarmupLoader {
+	public:
+		WarmupLoader(EGLDisplay display, EGLConfig config, EGLContext shareContext);
+		~WarmupLoader();
+
+		// Tasks must be added before Start().
+		void AddGlTask(const std::string& name, std::function<void()> task);
+		void AddTask(const std::string& name, std::function<void()> task);
+		void Start();
+
+		// Readiness signal: true once every task has run, whether it succeeded or not.
+		bool Wait(unsigned timeoutMilliseconds);
+		bool IsReady() const;
+		// Valid once ready.
+		bool Succeeded() const { return mSucceeded; }
+		const std::vector<WarmupTaskTiming>& GetTimings() const { return mTimings; }
+		double GetTotalMilliseconds() const { return mTotalMilliseconds; }
+
+	private:
+		struct Task {
+			std::string name;
+			std::function<void()> run;
+			bool needsContext;
+		};
+
+		void Run();
+		bool MakeContextCurrent();
+		void ReleaseContext();
+
+		EGLDisplay mDisplay;
+		EGLConfig mConfig;
+		EGLContext mShareContext;
+		EGLContext mContext;
+		EGLSurface mSurface;
+
+		std::vector<Task> mTasks;
+		std::vector<WarmupTaskTiming> mTimings;
+		bool mSucceeded;
+		double mTotalMilliseconds;
+
+		mutable std::mutex mMutex;
+		std::condition_variable mReadyCondition;
+		bool mReady;
+		std::thread mThread;
+	};
+
+	// Wall clock milestones from launch (or device recovery) to the first presented frame.
+	class StartupTimer {
+	public:
+		StartupTimer();
+
+		void Start();
+		void MarkReady();
+		void MarkFirstFrame();
+
+		bool HasFirstFrame() const { return mFirstFrame; }
+		double GetReadyMilliseconds() const { return mReadyMilliseconds; }
+		double GetFirstFrameMilliseconds() const { return mFirstFrameMilliseconds; }
+
+	private:
+		double Elapsed() const;
+
+		std::chrono::steady_clock::time_point mStart;
+		double mReadyMilliseconds;
+		double mFirstFrameMilliseconds;
+		bool mFirstFrame;
+	};
+}
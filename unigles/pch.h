@@ -10,6 +10,7 @@
 #include <D3Dcompiler.h>
 #include <DirectXMath.h>
 #include <Windows.Graphics.DirectX.Direct3D11.interop.h>
+#include <MemoryBuffer.h>
 
 // Enable function definitions in the GL headers below
 #define GL_GLEXT_PROTOTYPES